@@ -0,0 +1,69 @@
+// An example native module, with functions that compute checksums of the
+// data in an object that has the buffer protocol (eg bytes or bytearray).
+//
+//     >>> import checksum
+//     >>> checksum.crc32(b'123456789')
+//     3421780262
+//     >>> checksum.adler32(b'abc')
+//     38600999
+
+#include "py/natmod.h"
+
+// the table for computing the CRC a byte at a time, filled in by mpy_init
+STATIC uint32_t crc32_table[256];
+
+STATIC uint32_t arg_get_init(size_t n_args, const mp_obj_t *args, uint32_t init) {
+    if (n_args > 1) {
+        return mp_obj_get_int(args[1]);
+    }
+    return init;
+}
+
+// crc32(data[, crc]) is the same as zlib's crc32
+STATIC mp_obj_t checksum_crc32(size_t n_args, const mp_obj_t *args) {
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[0], &bufinfo, MP_BUFFER_READ);
+    uint32_t crc = ~arg_get_init(n_args, args, 0);
+    const byte *p = bufinfo.buf;
+    for (size_t i = 0; i < bufinfo.len; ++i) {
+        crc = crc32_table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    }
+    return mp_obj_new_int_from_uint(~crc);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(checksum_crc32_obj, 1, 2, checksum_crc32);
+
+// adler32(data[, value]) is the same as zlib's adler32
+STATIC mp_obj_t checksum_adler32(size_t n_args, const mp_obj_t *args) {
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[0], &bufinfo, MP_BUFFER_READ);
+    uint32_t value = arg_get_init(n_args, args, 1);
+    uint32_t a = value & 0xffff;
+    uint32_t b = value >> 16;
+    const byte *p = bufinfo.buf;
+    for (size_t len = bufinfo.len; len > 0;) {
+        // the sums can't overflow in this many bytes before they're reduced
+        size_t n = len < 5552 ? len : 5552;
+        len -= n;
+        while (n-- > 0) {
+            a += *p++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return mp_obj_new_int_from_uint((b << 16) | a);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(checksum_adler32_obj, 1, 2, checksum_adler32);
+
+mp_obj_t mpy_init(void) {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int j = 0; j < 8; ++j) {
+            c = (c >> 1) ^ (0xedb88320 & -(c & 1));
+        }
+        crc32_table[i] = c;
+    }
+    mp_store_name(MP_QSTR_crc32, MP_OBJ_FROM_PTR(&checksum_crc32_obj));
+    mp_store_name(MP_QSTR_adler32, MP_OBJ_FROM_PTR(&checksum_adler32_obj));
+    return mp_const_none;
+}
@@ -115,6 +115,7 @@ STATIC int usage(char **argv) {
 "-msmall-int-bits=number : set the maximum bits used to encode a small-int\n"
 "-mno-unicode : don't support unicode in compiled strings\n"
 "-mcache-lookup-bc : cache map lookups in the bytecode\n"
+"-march=<arch> : set architecture for native emitter; x64, armv7m\n"
 "\n"
 "Implementation specific options:\n", argv[0]
 );
@@ -199,6 +200,7 @@ MP_NOINLINE int main_(int argc, char **argv) {
     mp_dynamic_compiler.small_int_bits = 31;
     mp_dynamic_compiler.opt_cache_map_lookup_in_bytecode = 0;
     mp_dynamic_compiler.py_builtins_str_unicode = 1;
+    mp_dynamic_compiler.native_arch = MP_NATIVE_ARCH_NONE;
 
     const char *input_file = NULL;
     const char *output_file = NULL;
@@ -246,6 +248,16 @@ MP_NOINLINE int main_(int argc, char **argv) {
                 mp_dynamic_compiler.py_builtins_str_unicode = 0;
             } else if (strcmp(argv[a], "-municode") == 0) {
                 mp_dynamic_compiler.py_builtins_str_unicode = 1;
+            } else if (strncmp(argv[a], "-march=", sizeof("-march=") - 1) == 0) {
+                const char *arch = argv[a] + sizeof("-march=") - 1;
+                if (strcmp(arch, "x64") == 0) {
+                    mp_dynamic_compiler.native_arch = MP_NATIVE_ARCH_X64;
+                } else if (strcmp(arch, "armv7m") == 0) {
+                    mp_dynamic_compiler.native_arch = MP_NATIVE_ARCH_ARMV7M;
+                } else {
+                    mp_printf(&mp_stderr_print, "unknown architecture: %s\n", arch);
+                    exit(1);
+                }
             } else {
                 return usage(argv);
             }
@@ -263,6 +275,12 @@ MP_NOINLINE int main_(int argc, char **argv) {
         exit(1);
     }
 
+    if ((emit_opt == MP_EMIT_OPT_NATIVE_PYTHON || emit_opt == MP_EMIT_OPT_VIPER)
+        && mp_dynamic_compiler.native_arch == MP_NATIVE_ARCH_NONE) {
+        mp_printf(&mp_stderr_print, "arch not specified\n");
+        exit(1);
+    }
+
     int ret = compile_and_save(input_file, output_file, source_file);
 
     #if MICROPY_PY_MICROPYTHON_MEM_INFO
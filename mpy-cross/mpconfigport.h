@@ -30,9 +30,9 @@
 #define MICROPY_PERSISTENT_CODE_LOAD (0)
 #define MICROPY_PERSISTENT_CODE_SAVE (1)
 
-#define MICROPY_EMIT_X64            (0)
+#define MICROPY_EMIT_X64            (1)
 #define MICROPY_EMIT_X86            (0)
-#define MICROPY_EMIT_THUMB          (0)
+#define MICROPY_EMIT_THUMB          (1)
 #define MICROPY_EMIT_INLINE_THUMB   (0)
 #define MICROPY_EMIT_INLINE_THUMB_ARMV7M (0)
 #define MICROPY_EMIT_INLINE_THUMB_FLOAT (0)
@@ -0,0 +1,269 @@
+/*
+ * This file is part of the Micro Python project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Damien P. George
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "py/allocprof.h"
+#include "py/bc.h"
+#include "py/gc.h"
+#include "py/objtuple.h"
+#include "py/runtime.h"
+
+#if MICROPY_PY_MICROPYTHON_ALLOC_PROFILE
+
+// The profiler counts allocations made while running bytecode against the
+// location of the opcode doing the allocation, and allocations of objects
+// against their type.  All counts go in a table allocated on the heap when
+// profiling starts, so that recording doesn't need to allocate.
+
+#define ALLOC_PROFILE_TYPES (32)
+
+typedef struct _alloc_profile_count_t {
+    size_t count;
+    size_t bytes;
+} alloc_profile_count_t;
+
+typedef struct _alloc_profile_site_t {
+    const byte *code_info; // NULL if the entry is unused
+    size_t offset;
+    alloc_profile_count_t c;
+} alloc_profile_site_t;
+
+typedef struct _alloc_profile_type_t {
+    const mp_obj_type_t *type; // NULL for allocations that aren't objects of a known type
+    alloc_profile_count_t c;
+} alloc_profile_type_t;
+
+typedef struct _mp_alloc_profile_t {
+    // the last allocation recorded, whose type is found at the next one
+    void *pending;
+    size_t pending_bytes;
+    // allocations made outside bytecode, or that didn't fit in sites
+    alloc_profile_count_t other;
+    alloc_profile_type_t types[ALLOC_PROFILE_TYPES];
+    alloc_profile_site_t sites[MICROPY_ALLOC_PROFILE_SITES];
+} mp_alloc_profile_t;
+
+// The type of an object is only read from the object if it's on the heap
+// (it's a class), or if it's one of these.  Any other value in the first word
+// of an allocation can't be followed safely.
+STATIC const mp_obj_type_t *const alloc_profile_known_types[] = {
+    &mp_type_type,
+    &mp_type_object,
+    &mp_type_int,
+    #if MICROPY_PY_BUILTINS_FLOAT
+    &mp_type_float,
+    #endif
+    #if MICROPY_PY_BUILTINS_COMPLEX
+    &mp_type_complex,
+    #endif
+    &mp_type_str,
+    &mp_type_bytes,
+    #if MICROPY_PY_BUILTINS_BYTEARRAY
+    &mp_type_bytearray,
+    #endif
+    &mp_type_tuple,
+    &mp_type_list,
+    &mp_type_dict,
+    #if MICROPY_PY_BUILTINS_SET
+    &mp_type_set,
+    #endif
+    #if MICROPY_PY_BUILTINS_SLICE
+    &mp_type_slice,
+    #endif
+    &mp_type_range,
+    &mp_type_fun_bc,
+    &mp_type_gen_instance,
+    &mp_type_polymorph_iter,
+};
+
+STATIC const mp_obj_type_t *alloc_profile_get_type(void *ptr) {
+    if (gc_nbytes(ptr) < sizeof(mp_obj_base_t)) {
+        // freed already, or too small to be an object
+        return NULL;
+    }
+    const mp_obj_type_t *type = ((mp_obj_base_t*)ptr)->type;
+    if (gc_nbytes(type) >= sizeof(mp_obj_type_t) && type->base.type == &mp_type_type) {
+        return type;
+    }
+    for (size_t i = 0; i < MP_ARRAY_SIZE(alloc_profile_known_types); i++) {
+        if (type == alloc_profile_known_types[i]) {
+            return type;
+        }
+    }
+    return NULL;
+}
+
+STATIC void alloc_profile_count(alloc_profile_count_t *c, size_t n_bytes) {
+    c->count += 1;
+    c->bytes += n_bytes;
+}
+
+STATIC void alloc_profile_record_pending(mp_alloc_profile_t *prof) {
+    if (prof->pending == NULL) {
+        return;
+    }
+    const mp_obj_type_t *type = alloc_profile_get_type(prof->pending);
+    // entries are used in order, and the last one is kept for types that don't fit
+    size_t i = 0;
+    while (i < ALLOC_PROFILE_TYPES - 1 && prof->types[i].c.count != 0 && prof->types[i].type != type) {
+        i += 1;
+    }
+    if (prof->types[i].c.count == 0) {
+        prof->types[i].type = type;
+    } else if (prof->types[i].type != type) {
+        prof->types[i].type = NULL;
+    }
+    alloc_profile_count(&prof->types[i].c, prof->pending_bytes);
+    prof->pending = NULL;
+}
+
+void mp_alloc_profile_record(void *ptr, size_t n_bytes) {
+    mp_alloc_profile_t *prof = MP_STATE_VM(alloc_profile);
+
+    // the previous allocation has been initialised by now, so get its type
+    alloc_profile_record_pending(prof);
+    prof->pending = ptr;
+    prof->pending_bytes = n_bytes;
+
+    mp_code_state_t *code_state = MP_STATE_THREAD(current_code_state);
+    if (code_state == NULL) {
+        alloc_profile_count(&prof->other, n_bytes);
+        return;
+    }
+
+    // look up the site in the hash table, using linear probing
+    const byte *code_info = code_state->code_info;
+    size_t offset = code_state->ip - code_info;
+    size_t hash = ((uintptr_t)code_info >> 3) ^ (offset * 31);
+    for (size_t n = 0; n < MICROPY_ALLOC_PROFILE_SITES; n++) {
+        alloc_profile_site_t *site = &prof->sites[(hash + n) % MICROPY_ALLOC_PROFILE_SITES];
+        if (site->code_info == NULL) {
+            site->code_info = code_info;
+            site->offset = offset;
+        } else if (site->code_info != code_info || site->offset != offset) {
+            continue;
+        }
+        alloc_profile_count(&site->c, n_bytes);
+        return;
+    }
+    alloc_profile_count(&prof->other, n_bytes);
+}
+
+void mp_alloc_profile_start(void) {
+    MP_STATE_VM(alloc_profile_active) = false;
+    if (MP_STATE_VM(alloc_profile) == NULL) {
+        MP_STATE_VM(alloc_profile) = m_new_obj(mp_alloc_profile_t);
+    }
+    memset(MP_STATE_VM(alloc_profile), 0, sizeof(mp_alloc_profile_t));
+    MP_STATE_VM(alloc_profile_active) = true;
+}
+
+void mp_alloc_profile_stop(void) {
+    if (MP_STATE_VM(alloc_profile_active)) {
+        MP_STATE_VM(alloc_profile_active) = false;
+        alloc_profile_record_pending(MP_STATE_VM(alloc_profile));
+    }
+}
+
+// sort a list of tuples by their last item, which is the number of bytes, largest first
+STATIC void alloc_profile_sort(mp_obj_t list_in) {
+    size_t len;
+    mp_obj_t *items;
+    mp_obj_list_get(list_in, &len, &items);
+    for (size_t i = 1; i < len; i++) {
+        mp_obj_t item = items[i];
+        size_t item_len;
+        mp_obj_t *item_items;
+        mp_obj_tuple_get(item, &item_len, &item_items);
+        mp_uint_t bytes = mp_obj_get_int_truncated(item_items[item_len - 1]);
+        size_t j = i;
+        for (; j > 0; j--) {
+            size_t prev_len;
+            mp_obj_t *prev_items;
+            mp_obj_tuple_get(items[j - 1], &prev_len, &prev_items);
+            if ((mp_uint_t)mp_obj_get_int_truncated(prev_items[prev_len - 1]) >= bytes) {
+                break;
+            }
+            items[j] = items[j - 1];
+        }
+        items[j] = item;
+    }
+}
+
+mp_obj_t mp_alloc_profile_snapshot(void) {
+    mp_alloc_profile_t *prof = MP_STATE_VM(alloc_profile);
+    mp_obj_t sites = mp_obj_new_list(0, NULL);
+    mp_obj_t types = mp_obj_new_list(0, NULL);
+    if (prof == NULL) {
+        return mp_obj_new_tuple(2, (mp_obj_t[]){sites, types});
+    }
+
+    // don't profile the snapshot itself
+    bool active = MP_STATE_VM(alloc_profile_active);
+    mp_alloc_profile_stop();
+
+    // each site is (file, line, block, count, bytes)
+    for (size_t i = 0; i < MICROPY_ALLOC_PROFILE_SITES; i++) {
+        alloc_profile_site_t *site = &prof->sites[i];
+        if (site->code_info == NULL) {
+            continue;
+        }
+        qstr block_name, source_file;
+        size_t line = mp_bytecode_get_source_info(site->code_info, site->code_info + site->offset, &block_name, &source_file);
+        mp_obj_t items[5] = {
+            MP_OBJ_NEW_QSTR(source_file),
+            MP_OBJ_NEW_SMALL_INT(line),
+            MP_OBJ_NEW_QSTR(block_name),
+            mp_obj_new_int_from_uint(site->c.count),
+            mp_obj_new_int_from_uint(site->c.bytes),
+        };
+        mp_obj_list_append(sites, mp_obj_new_tuple(5, items));
+    }
+    if (prof->other.count != 0) {
+        mp_obj_t items[5] = {mp_const_none, MP_OBJ_NEW_SMALL_INT(0), mp_const_none,
+            mp_obj_new_int_from_uint(prof->other.count), mp_obj_new_int_from_uint(prof->other.bytes)};
+        mp_obj_list_append(sites, mp_obj_new_tuple(5, items));
+    }
+    alloc_profile_sort(sites);
+
+    // each type is (type, count, bytes), with None as the type of other allocations
+    for (size_t i = 0; i < ALLOC_PROFILE_TYPES && prof->types[i].c.count != 0; i++) {
+        alloc_profile_type_t *t = &prof->types[i];
+        mp_obj_t items[3] = {
+            t->type == NULL ? mp_const_none : MP_OBJ_FROM_PTR(t->type),
+            mp_obj_new_int_from_uint(t->c.count),
+            mp_obj_new_int_from_uint(t->c.bytes),
+        };
+        mp_obj_list_append(types, mp_obj_new_tuple(3, items));
+    }
+    alloc_profile_sort(types);
+
+    MP_STATE_VM(alloc_profile_active) = active;
+    return mp_obj_new_tuple(2, (mp_obj_t[]){sites, types});
+}
+
+#endif // MICROPY_PY_MICROPYTHON_ALLOC_PROFILE
@@ -0,0 +1,52 @@
+/*
+ * This file is part of the Micro Python project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Damien P. George
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __MICROPY_INCLUDED_PY_ALLOCPROF_H__
+#define __MICROPY_INCLUDED_PY_ALLOCPROF_H__
+
+#include "py/mpstate.h"
+
+#if MICROPY_PY_MICROPYTHON_ALLOC_PROFILE
+
+// record an allocation if the profiler is running
+#define MP_ALLOC_PROFILE_RECORD(ptr, n_bytes) \
+    do { \
+        if (MP_STATE_VM(alloc_profile_active)) { \
+            mp_alloc_profile_record(ptr, n_bytes); \
+        } \
+    } while (0)
+
+void mp_alloc_profile_record(void *ptr, size_t n_bytes);
+void mp_alloc_profile_start(void);
+void mp_alloc_profile_stop(void);
+mp_obj_t mp_alloc_profile_snapshot(void);
+
+#else
+
+#define MP_ALLOC_PROFILE_RECORD(ptr, n_bytes)
+
+#endif
+
+#endif // __MICROPY_INCLUDED_PY_ALLOCPROF_H__
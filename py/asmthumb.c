@@ -269,19 +269,22 @@ void asm_thumb_mov_reg_i32_optimised(asm_thumb_t *as, uint reg_dest, int i32) {
     }
 }
 
-// i32 is stored as a full word in the code, and aligned to machine-word boundary
-// TODO this is very inefficient, improve it!
+#define OP_LDR_FROM_PC_OFFSET(rlo_dest, word_offset) (0x4800 | ((rlo_dest) << 8) | ((word_offset) & 0x00ff))
+
+// i32 is stored as a full word in the code, aligned to machine-word boundary,
+// and loaded from there, so it's the last word of these instructions
 void asm_thumb_mov_reg_i32_aligned(asm_thumb_t *as, uint reg_dest, int i32) {
-    // align on machine-word + 2
-    if ((as->base.code_offset & 3) == 0) {
+    assert(reg_dest < ASM_THUMB_REG_R8);
+    // align on machine-word
+    if ((as->base.code_offset & 3) != 0) {
         asm_thumb_op16(as, ASM_THUMB_OP_NOP);
     }
+    // load the i32 value that follows the branch (the PC reads 4 ahead)
+    asm_thumb_op16(as, OP_LDR_FROM_PC_OFFSET(reg_dest, 0));
     // jump over the i32 value (instruction prefetch adds 2 to PC)
     asm_thumb_op16(as, OP_B_N(2));
     // store i32 on machine-word aligned boundary
     mp_asm_base_data(&as->base, 4, i32);
-    // do the actual load of the i32 value
-    asm_thumb_mov_reg_i32_optimised(as, reg_dest, i32);
 }
 
 #define OP_STR_TO_SP_OFFSET(rlo_dest, word_offset) (0x9000 | ((rlo_dest) << 8) | ((word_offset) & 0x00ff))
@@ -370,8 +373,10 @@ void asm_thumb_bl_ind(asm_thumb_t *as, void *fun_ptr, uint fun_id, uint reg_temp
         asm_thumb_op16(as, ASM_THUMB_FORMAT_9_10_ENCODE(ASM_THUMB_FORMAT_9_LDR | ASM_THUMB_FORMAT_9_WORD_TRANSFER, reg_temp, ASM_THUMB_REG_R7, fun_id));
         asm_thumb_op16(as, OP_BLX(reg_temp));
     } else {
-        // load ptr to function into register using immediate; 6 bytes
-        asm_thumb_mov_reg_i32(as, reg_temp, (mp_uint_t)fun_ptr);
+        // load ptr to function from table, indexed by fun_id, using ldr.w; 6 bytes
+        // (the address of the function isn't used so that the code only
+        // depends on r7, which matters for code saved to a .mpy file)
+        asm_thumb_op32(as, 0xf8d0 | ASM_THUMB_REG_R7, (reg_temp << 12) | (fun_id << 2));
         asm_thumb_op16(as, OP_BLX(reg_temp));
     }
 }
@@ -73,6 +73,7 @@
 #define OPCODE_CMP_R64_WITH_RM64 (0x39) /* /r */
 //#define OPCODE_CMP_RM32_WITH_R32 (0x3b)
 #define OPCODE_TEST_R8_WITH_RM8  (0x84) /* /r */
+#define OPCODE_TEST_R64_WITH_RM64 (0x85) /* /r */
 #define OPCODE_JMP_REL8          (0xeb)
 #define OPCODE_JMP_REL32         (0xe9)
 #define OPCODE_JCC_REL8          (0x70) /* | jcc type */
@@ -83,6 +84,23 @@
 #define OPCODE_CALL_REL32        (0xe8)
 #define OPCODE_CALL_RM32         (0xff) /* /2 */
 #define OPCODE_LEAVE             (0xc9)
+#define OPCODE_NEG_RM64          (0xf7) /* /3 */
+
+// SSE2 opcodes, which follow a mandatory prefix and 0x0f
+#define SSE_PREFIX_SD            (0xf2)
+#define SSE_PREFIX_SS            (0xf3)
+#define SSE_OPCODE_MOV_TO_XMM    (0x10) /* movsd/movss xmm, m */
+#define SSE_OPCODE_MOV_FROM_XMM  (0x11) /* movsd/movss m, xmm */
+#define SSE_OPCODE_CVTSI2SD      (0x2a)
+#define SSE_OPCODE_CVTTSD2SI     (0x2c)
+#define SSE_OPCODE_ADD           (0x58)
+#define SSE_OPCODE_MUL           (0x59)
+#define SSE_OPCODE_CVT           (0x5a) /* cvtsd2ss/cvtss2sd */
+#define SSE_OPCODE_SUB           (0x5c)
+#define SSE_OPCODE_DIV           (0x5e)
+#define SSE_OPCODE_MOVQ_TO_XMM   (0x6e) /* with 0x66 prefix */
+#define SSE_OPCODE_MOVQ_FROM_XMM (0x7e) /* with 0x66 prefix */
+#define SSE_OPCODE_CMP           (0xc2)
 
 #define MODRM_R64(x)    (((x) & 0x7) << 3)
 #define MODRM_RM_DISP0  (0x00)
@@ -344,8 +362,9 @@ STATIC void asm_x64_mov_i32_to_r64(asm_x64_t *as, int src_i32, int dest_r64) {
 void asm_x64_mov_i64_to_r64(asm_x64_t *as, int64_t src_i64, int dest_r64) {
     // cpu defaults to i32 to r64
     // to mov i64 to r64 need to use REX prefix
-    assert(dest_r64 < 8);
-    asm_x64_write_byte_2(as, REX_PREFIX | REX_W, OPCODE_MOV_I64_TO_R64 | dest_r64);
+    asm_x64_write_byte_2(as,
+        REX_PREFIX | REX_W | (dest_r64 < 8 ? 0 : REX_B),
+        OPCODE_MOV_I64_TO_R64 | (dest_r64 & 7));
     asm_x64_write_word64(as, src_i64);
 }
 
@@ -470,11 +489,110 @@ void asm_x64_test_r8_with_r8(asm_x64_t *as, int src_r64_a, int src_r64_b) {
     asm_x64_write_byte_2(as, OPCODE_TEST_R8_WITH_RM8, MODRM_R64(src_r64_a) | MODRM_RM_REG | MODRM_RM_R64(src_r64_b));
 }
 
+void asm_x64_test_r64_with_r64(asm_x64_t *as, int src_r64_a, int src_r64_b) {
+    asm_x64_generic_r64_r64(as, src_r64_b, src_r64_a, OPCODE_TEST_R64_WITH_RM64);
+}
+
 void asm_x64_setcc_r8(asm_x64_t *as, int jcc_type, int dest_r8) {
     assert(dest_r8 < 8);
     asm_x64_write_byte_3(as, OPCODE_SETCC_RM8_A, OPCODE_SETCC_RM8_B | jcc_type, MODRM_R64(0) | MODRM_RM_REG | MODRM_RM_R64(dest_r8));
 }
 
+void asm_x64_neg_r64(asm_x64_t *as, int dest_r64) {
+    asm_x64_generic_r64_r64(as, dest_r64, 3, OPCODE_NEG_RM64);
+}
+
+// An SSE instruction is its prefix, then the REX prefix if needed, then 0x0f
+// and the opcode.  The register numbers of xmm registers go where those of
+// general registers do.
+STATIC void asm_x64_write_sse_op(asm_x64_t *as, int prefix, int rex, int op) {
+    asm_x64_write_byte_1(as, prefix);
+    if (rex != 0) {
+        asm_x64_write_byte_1(as, REX_PREFIX | rex);
+    }
+    asm_x64_write_byte_2(as, 0x0f, op);
+}
+
+STATIC void asm_x64_sse_r_r(asm_x64_t *as, int prefix, int rex_w, int op, int reg, int rm) {
+    asm_x64_write_sse_op(as, prefix, rex_w | REX_R_FROM_R64(reg) | REX_B_FROM_R64(rm), op);
+    asm_x64_write_byte_1(as, MODRM_R64(reg) | MODRM_RM_REG | MODRM_RM_R64(rm));
+}
+
+// the memory operand is [base_r64 + index_r64 * 2**scale]
+STATIC void asm_x64_sse_r_mem_index(asm_x64_t *as, int prefix, int op, int reg, int base_r64, int index_r64, int scale) {
+    assert(index_r64 != ASM_X64_REG_RSP);
+    asm_x64_write_sse_op(as, prefix, REX_R_FROM_R64(reg) | REX_X_FROM_R64(index_r64) | REX_B_FROM_R64(base_r64), op);
+    byte sib = scale << 6 | (index_r64 & 7) << 3 | (base_r64 & 7);
+    if ((base_r64 & 7) == ASM_X64_REG_RBP) {
+        // RBP and R13 as a base need a displacement
+        asm_x64_write_byte_3(as, MODRM_R64(reg) | MODRM_RM_DISP8 | 4, sib, 0);
+    } else {
+        asm_x64_write_byte_2(as, MODRM_R64(reg) | MODRM_RM_DISP0 | 4, sib);
+    }
+}
+
+void asm_x64_movq_r64_to_xmm(asm_x64_t *as, int dest_xmm, int src_r64) {
+    asm_x64_sse_r_r(as, OP_SIZE_PREFIX, REX_W, SSE_OPCODE_MOVQ_TO_XMM, dest_xmm, src_r64);
+}
+
+void asm_x64_movq_xmm_to_r64(asm_x64_t *as, int dest_r64, int src_xmm) {
+    asm_x64_sse_r_r(as, OP_SIZE_PREFIX, REX_W, SSE_OPCODE_MOVQ_FROM_XMM, src_xmm, dest_r64);
+}
+
+void asm_x64_movsd_mem_to_xmm(asm_x64_t *as, int base_r64, int index_r64, int dest_xmm) {
+    asm_x64_sse_r_mem_index(as, SSE_PREFIX_SD, SSE_OPCODE_MOV_TO_XMM, dest_xmm, base_r64, index_r64, 3);
+}
+
+void asm_x64_movsd_xmm_to_mem(asm_x64_t *as, int src_xmm, int base_r64, int index_r64) {
+    asm_x64_sse_r_mem_index(as, SSE_PREFIX_SD, SSE_OPCODE_MOV_FROM_XMM, src_xmm, base_r64, index_r64, 3);
+}
+
+void asm_x64_movss_mem_to_xmm(asm_x64_t *as, int base_r64, int index_r64, int dest_xmm) {
+    asm_x64_sse_r_mem_index(as, SSE_PREFIX_SS, SSE_OPCODE_MOV_TO_XMM, dest_xmm, base_r64, index_r64, 2);
+}
+
+void asm_x64_movss_xmm_to_mem(asm_x64_t *as, int src_xmm, int base_r64, int index_r64) {
+    asm_x64_sse_r_mem_index(as, SSE_PREFIX_SS, SSE_OPCODE_MOV_FROM_XMM, src_xmm, base_r64, index_r64, 2);
+}
+
+void asm_x64_addsd_xmm_xmm(asm_x64_t *as, int dest_xmm, int src_xmm) {
+    asm_x64_sse_r_r(as, SSE_PREFIX_SD, 0, SSE_OPCODE_ADD, dest_xmm, src_xmm);
+}
+
+void asm_x64_subsd_xmm_xmm(asm_x64_t *as, int dest_xmm, int src_xmm) {
+    asm_x64_sse_r_r(as, SSE_PREFIX_SD, 0, SSE_OPCODE_SUB, dest_xmm, src_xmm);
+}
+
+void asm_x64_mulsd_xmm_xmm(asm_x64_t *as, int dest_xmm, int src_xmm) {
+    asm_x64_sse_r_r(as, SSE_PREFIX_SD, 0, SSE_OPCODE_MUL, dest_xmm, src_xmm);
+}
+
+void asm_x64_divsd_xmm_xmm(asm_x64_t *as, int dest_xmm, int src_xmm) {
+    asm_x64_sse_r_r(as, SSE_PREFIX_SD, 0, SSE_OPCODE_DIV, dest_xmm, src_xmm);
+}
+
+// sets dest_xmm to all ones if the comparison is true, else to zero
+void asm_x64_cmpsd_xmm_xmm(asm_x64_t *as, int cmp_type, int dest_xmm, int src_xmm) {
+    asm_x64_sse_r_r(as, SSE_PREFIX_SD, 0, SSE_OPCODE_CMP, dest_xmm, src_xmm);
+    asm_x64_write_byte_1(as, cmp_type);
+}
+
+void asm_x64_cvtsi2sd_r64_to_xmm(asm_x64_t *as, int dest_xmm, int src_r64) {
+    asm_x64_sse_r_r(as, SSE_PREFIX_SD, REX_W, SSE_OPCODE_CVTSI2SD, dest_xmm, src_r64);
+}
+
+void asm_x64_cvttsd2si_xmm_to_r64(asm_x64_t *as, int dest_r64, int src_xmm) {
+    asm_x64_sse_r_r(as, SSE_PREFIX_SD, REX_W, SSE_OPCODE_CVTTSD2SI, dest_r64, src_xmm);
+}
+
+void asm_x64_cvtss2sd_xmm_xmm(asm_x64_t *as, int dest_xmm, int src_xmm) {
+    asm_x64_sse_r_r(as, SSE_PREFIX_SS, 0, SSE_OPCODE_CVT, dest_xmm, src_xmm);
+}
+
+void asm_x64_cvtsd2ss_xmm_xmm(asm_x64_t *as, int dest_xmm, int src_xmm) {
+    asm_x64_sse_r_r(as, SSE_PREFIX_SD, 0, SSE_OPCODE_CVT, dest_xmm, src_xmm);
+}
+
 STATIC mp_uint_t get_label_dest(asm_x64_t *as, mp_uint_t label) {
     assert(label < as->base.max_num_labels);
     return as->base.label_offsets[label];
@@ -535,10 +653,14 @@ void asm_x64_entry(asm_x64_t *as, int num_locals) {
     asm_x64_push_r64(as, ASM_X64_REG_RBX);
     asm_x64_push_r64(as, ASM_X64_REG_R12);
     asm_x64_push_r64(as, ASM_X64_REG_R13);
+    asm_x64_push_r64(as, ASM_X64_REG_R14);
+    asm_x64_push_r64(as, ASM_X64_REG_R15);
     as->num_locals = num_locals;
 }
 
 void asm_x64_exit(asm_x64_t *as) {
+    asm_x64_pop_r64(as, ASM_X64_REG_R15);
+    asm_x64_pop_r64(as, ASM_X64_REG_R14);
     asm_x64_pop_r64(as, ASM_X64_REG_R13);
     asm_x64_pop_r64(as, ASM_X64_REG_R12);
     asm_x64_pop_r64(as, ASM_X64_REG_RBX);
@@ -611,6 +733,11 @@ void asm_x64_call_i1(asm_x64_t *as, void* func, int i1) {
 }
 */
 
+void asm_x64_call_r64(asm_x64_t *as, int src_r64) {
+    assert(src_r64 < 8);
+    asm_x64_write_byte_2(as, OPCODE_CALL_RM32, MODRM_R64(2) | MODRM_RM_REG | MODRM_RM_R64(src_r64));
+}
+
 void asm_x64_call_ind(asm_x64_t *as, void *ptr, int temp_r64) {
     assert(temp_r64 < 8);
 #ifdef __LP64__
@@ -619,7 +746,7 @@ void asm_x64_call_ind(asm_x64_t *as, void *ptr, int temp_r64) {
     // If we get here, sizeof(int) == sizeof(void*).
     asm_x64_mov_i64_to_r64_optimised(as, (int64_t)(unsigned int)ptr, temp_r64);
 #endif
-    asm_x64_write_byte_2(as, OPCODE_CALL_RM32, MODRM_R64(2) | MODRM_RM_REG | MODRM_RM_R64(temp_r64));
+    asm_x64_call_r64(as, temp_r64);
     // this reduces code size by 2 bytes per call, but doesn't seem to speed it up at all
     // doesn't work anymore because calls are 64 bits away
     /*
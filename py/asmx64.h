@@ -59,7 +59,12 @@
 #define ASM_X64_REG_R14 (14)
 #define ASM_X64_REG_R15 (15)
 
+// SSE2 registers, all caller-save
+#define ASM_X64_REG_XMM0 (0)
+#define ASM_X64_REG_XMM1 (1)
+
 // condition codes, used for jcc and setcc (despite their j-name!)
+#define ASM_X64_CC_JO  (0x0) // overflow, signed
 #define ASM_X64_CC_JB  (0x2) // below, unsigned
 #define ASM_X64_CC_JZ  (0x4)
 #define ASM_X64_CC_JE  (0x4)
@@ -70,6 +75,12 @@
 #define ASM_X64_CC_JLE (0xe) // less or equal, signed
 #define ASM_X64_CC_JG  (0xf) // greater, signed
 
+// comparisons for cmpsd, which are false if either operand is a NaN, except NEQ
+#define ASM_X64_CMP_EQ  (0x0)
+#define ASM_X64_CMP_LT  (0x1)
+#define ASM_X64_CMP_LE  (0x2)
+#define ASM_X64_CMP_NEQ (0x4)
+
 typedef struct _asm_x64_t {
     mp_asm_base_t base;
     int num_locals;
@@ -104,7 +115,24 @@ void asm_x64_sub_r64_r64(asm_x64_t* as, int dest_r64, int src_r64);
 void asm_x64_mul_r64_r64(asm_x64_t* as, int dest_r64, int src_r64);
 void asm_x64_cmp_r64_with_r64(asm_x64_t* as, int src_r64_a, int src_r64_b);
 void asm_x64_test_r8_with_r8(asm_x64_t* as, int src_r64_a, int src_r64_b);
+void asm_x64_test_r64_with_r64(asm_x64_t* as, int src_r64_a, int src_r64_b);
 void asm_x64_setcc_r8(asm_x64_t* as, int jcc_type, int dest_r8);
+void asm_x64_neg_r64(asm_x64_t *as, int dest_r64);
+void asm_x64_movq_r64_to_xmm(asm_x64_t *as, int dest_xmm, int src_r64);
+void asm_x64_movq_xmm_to_r64(asm_x64_t *as, int dest_r64, int src_xmm);
+void asm_x64_movsd_mem_to_xmm(asm_x64_t *as, int base_r64, int index_r64, int dest_xmm);
+void asm_x64_movsd_xmm_to_mem(asm_x64_t *as, int src_xmm, int base_r64, int index_r64);
+void asm_x64_movss_mem_to_xmm(asm_x64_t *as, int base_r64, int index_r64, int dest_xmm);
+void asm_x64_movss_xmm_to_mem(asm_x64_t *as, int src_xmm, int base_r64, int index_r64);
+void asm_x64_addsd_xmm_xmm(asm_x64_t *as, int dest_xmm, int src_xmm);
+void asm_x64_subsd_xmm_xmm(asm_x64_t *as, int dest_xmm, int src_xmm);
+void asm_x64_mulsd_xmm_xmm(asm_x64_t *as, int dest_xmm, int src_xmm);
+void asm_x64_divsd_xmm_xmm(asm_x64_t *as, int dest_xmm, int src_xmm);
+void asm_x64_cmpsd_xmm_xmm(asm_x64_t *as, int cmp_type, int dest_xmm, int src_xmm);
+void asm_x64_cvtsi2sd_r64_to_xmm(asm_x64_t *as, int dest_xmm, int src_r64);
+void asm_x64_cvttsd2si_xmm_to_r64(asm_x64_t *as, int dest_r64, int src_xmm);
+void asm_x64_cvtss2sd_xmm_xmm(asm_x64_t *as, int dest_xmm, int src_xmm);
+void asm_x64_cvtsd2ss_xmm_xmm(asm_x64_t *as, int dest_xmm, int src_xmm);
 void asm_x64_jmp_label(asm_x64_t* as, mp_uint_t label);
 void asm_x64_jcc_label(asm_x64_t* as, int jcc_type, mp_uint_t label);
 void asm_x64_entry(asm_x64_t* as, int num_locals);
@@ -112,6 +140,7 @@ void asm_x64_exit(asm_x64_t* as);
 void asm_x64_mov_local_to_r64(asm_x64_t* as, int src_local_num, int dest_r64);
 void asm_x64_mov_r64_to_local(asm_x64_t* as, int src_r64, int dest_local_num);
 void asm_x64_mov_local_addr_to_r64(asm_x64_t* as, int local_num, int dest_r64);
+void asm_x64_call_r64(asm_x64_t* as, int src_r64);
 void asm_x64_call_ind(asm_x64_t* as, void* ptr, int temp_r32);
 
 #if GENERIC_ASM_API
@@ -137,7 +166,9 @@ void asm_x64_call_ind(asm_x64_t* as, void* ptr, int temp_r32);
 #define REG_LOCAL_1 ASM_X64_REG_RBX
 #define REG_LOCAL_2 ASM_X64_REG_R12
 #define REG_LOCAL_3 ASM_X64_REG_R13
-#define REG_LOCAL_NUM (3)
+#define REG_LOCAL_4 ASM_X64_REG_R14
+#define REG_LOCAL_5 ASM_X64_REG_R15
+#define REG_LOCAL_NUM (5)
 
 #define ASM_T               asm_x64_t
 #define ASM_END_PASS        asm_x64_end_pass
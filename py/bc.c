@@ -54,6 +54,44 @@ mp_uint_t mp_decode_uint(const byte **ptr) {
     return unum;
 }
 
+size_t mp_bytecode_get_source_info(const byte *code_info, const byte *bc_ip, qstr *block_name, qstr *source_file) {
+    const byte *ip = code_info;
+    mp_uint_t code_info_size = mp_decode_uint(&ip);
+    #if MICROPY_PERSISTENT_CODE
+    *block_name = ip[0] | (ip[1] << 8);
+    *source_file = ip[2] | (ip[3] << 8);
+    ip += 4;
+    #else
+    *block_name = mp_decode_uint(&ip);
+    *source_file = mp_decode_uint(&ip);
+    #endif
+    size_t bc = bc_ip - code_info - code_info_size;
+    size_t source_line = 1;
+    size_t c;
+    while ((c = *ip)) {
+        mp_uint_t b, l;
+        if ((c & 0x80) == 0) {
+            // 0b0LLBBBBB encoding
+            b = c & 0x1f;
+            l = c >> 5;
+            ip += 1;
+        } else {
+            // 0b1LLLBBBB 0bLLLLLLLL encoding (l's LSB in second byte)
+            b = c & 0xf;
+            l = ((c << 4) & 0x700) | ip[1];
+            ip += 2;
+        }
+        if (bc >= b) {
+            bc -= b;
+            source_line += l;
+        } else {
+            // found source line corresponding to bytecode offset
+            break;
+        }
+    }
+    return source_line;
+}
+
 STATIC NORETURN void fun_pos_args_mismatch(mp_obj_fun_bc_t *f, size_t expected, size_t given) {
 #if MICROPY_ERROR_REPORTING == MICROPY_ERROR_REPORTING_TERSE
     // generic message, used also for other argument issues
@@ -100,6 +138,8 @@ void mp_setup_code_state(mp_code_state_t *code_state, mp_obj_fun_bc_t *self, siz
     // store pointer to constant table
     code_state->const_table = self->const_table;
 
+    code_state->fun_bc = self;
+
     #if MICROPY_STACKLESS
     code_state->prev = NULL;
     #endif
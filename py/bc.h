@@ -77,10 +77,13 @@ typedef struct _mp_code_state_t {
     // bit 0 is saved currently_in_except_block value
     mp_exc_stack_t *exc_sp;
     mp_obj_dict_t *old_globals;
+    // the function being run; it's always here so that native code in .mpy
+    // files can assume the same layout whether or not it's used
+    struct _mp_obj_fun_bc_t *fun_bc;
+    size_t n_state;
     #if MICROPY_STACKLESS
     struct _mp_code_state_t *prev;
     #endif
-    size_t n_state;
     // Variable-length
     mp_obj_t state[0];
     // Variable-length, never accessed by name, only as (void*)(state + n_state)
@@ -89,7 +92,17 @@ typedef struct _mp_code_state_t {
 
 mp_uint_t mp_decode_uint(const byte **ptr);
 
+// Get the block name, source file and source line of the bytecode at ip, in
+// the function with the given code info; returns the line
+size_t mp_bytecode_get_source_info(const byte *code_info, const byte *ip, qstr *block_name, qstr *source_file);
+
 mp_vm_return_kind_t mp_execute_bytecode(mp_code_state_t *code_state, volatile mp_obj_t inject_exc);
+#if MICROPY_OPT_TIERED_NATIVE && MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+mp_obj_t mp_native_load_global_cached(qstr qst, byte *hint);
+mp_obj_t mp_native_load_attr_cached(mp_obj_t base, qstr attr, byte *hint);
+void mp_native_store_attr_cached(mp_obj_t base, qstr attr, mp_obj_t value, byte *hint);
+void mp_native_load_method_cached(mp_obj_t base, qstr attr, mp_obj_t *dest, byte *hint);
+#endif
 mp_code_state_t *mp_obj_fun_bc_prepare_codestate(mp_obj_t func, size_t n_args, size_t n_kw, const mp_obj_t *args);
 struct _mp_obj_fun_bc_t;
 void mp_setup_code_state(mp_code_state_t *code_state, struct _mp_obj_fun_bc_t *self, size_t n_args, size_t n_kw, const mp_obj_t *args);
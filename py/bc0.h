@@ -114,4 +114,27 @@
 #define MP_BC_UNARY_OP_MULTI             (0xd0) // + op(7)
 #define MP_BC_BINARY_OP_MULTI            (0xd7) // + op(36)
 
+// Specialised byte-codes that the VM writes over generic ones, for the operands
+// they see, when MICROPY_OPT_QUICKEN_BYTECODE is enabled (see vm.c).  They are
+// never emitted by the compiler nor saved in .mpy files.
+#define MP_BC_BINARY_OP_QUICK                       (0x01) // first of the 15 below
+#define MP_BC_BINARY_OP_ADD_SMALL_INT               (0x01)
+#define MP_BC_BINARY_OP_INPLACE_ADD_SMALL_INT       (0x02)
+#define MP_BC_BINARY_OP_SUBTRACT_SMALL_INT          (0x03)
+#define MP_BC_BINARY_OP_INPLACE_SUBTRACT_SMALL_INT  (0x04)
+#define MP_BC_BINARY_OP_LESS_SMALL_INT              (0x05)
+#define MP_BC_BINARY_OP_MORE_SMALL_INT              (0x06)
+#define MP_BC_BINARY_OP_EQUAL_SMALL_INT             (0x07)
+#define MP_BC_BINARY_OP_LESS_EQUAL_SMALL_INT        (0x08)
+#define MP_BC_BINARY_OP_MORE_EQUAL_SMALL_INT        (0x09)
+#define MP_BC_BINARY_OP_NOT_EQUAL_SMALL_INT         (0x0a)
+#define MP_BC_BINARY_OP_ADD_FLOAT                   (0x0b)
+#define MP_BC_BINARY_OP_INPLACE_ADD_FLOAT           (0x0c)
+#define MP_BC_BINARY_OP_SUBTRACT_FLOAT              (0x0d)
+#define MP_BC_BINARY_OP_MULTIPLY_FLOAT              (0x0e)
+#define MP_BC_BINARY_OP_INPLACE_MULTIPLY_FLOAT      (0x0f)
+#define MP_BC_LOAD_SUBSCR_LIST_INT                  (0x47)
+#define MP_BC_STORE_SUBSCR_LIST_INT                 (0x48)
+#define MP_BC_FOR_ITER_RANGE                        (0x49) // rel byte code offset, 16-bit unsigned
+
 #endif // __MICROPY_INCLUDED_PY_BC0_H__
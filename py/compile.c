@@ -35,6 +35,7 @@
 #include "py/compile.h"
 #include "py/runtime.h"
 #include "py/asmbase.h"
+#include "py/persistentcode.h"
 
 #if MICROPY_ENABLE_COMPILER
 
@@ -70,7 +71,43 @@ typedef enum {
 
 #endif
 
-#if MICROPY_EMIT_NATIVE
+#if MICROPY_EMIT_NATIVE && MICROPY_DYNAMIC_COMPILER
+
+// the dynamic compiler can generate native code for any of the architectures
+// it's built with, selected at runtime by mp_dynamic_compiler.native_arch
+typedef struct _emit_native_table_t {
+    emit_t *(*emit_new)(mp_obj_t *error_slot, mp_uint_t max_num_labels);
+    void (*emit_free)(emit_t *emit);
+    const emit_method_table_t *emit_method_table;
+} emit_native_table_t;
+
+#if MICROPY_EMIT_X64
+STATIC const emit_native_table_t emit_native_table_x64 = {
+    emit_native_x64_new, emit_native_x64_free, &emit_native_x64_method_table,
+};
+#endif
+
+#if MICROPY_EMIT_THUMB
+STATIC const emit_native_table_t emit_native_table_thumb = {
+    emit_native_thumb_new, emit_native_thumb_free, &emit_native_thumb_method_table,
+};
+#endif
+
+STATIC const emit_native_table_t *const emit_native_table[] = {
+    [MP_NATIVE_ARCH_NONE] = NULL,
+    #if MICROPY_EMIT_X64
+    [MP_NATIVE_ARCH_X64] = &emit_native_table_x64,
+    #endif
+    #if MICROPY_EMIT_THUMB
+    [MP_NATIVE_ARCH_ARMV7M] = &emit_native_table_thumb,
+    #endif
+    [MP_NATIVE_ARCH_XTENSA] = NULL,
+};
+
+#define NATIVE_EMITTER(f) emit_native_table[mp_dynamic_compiler.native_arch]->emit_##f
+#define NATIVE_EMITTER_TABLE (emit_native_table[mp_dynamic_compiler.native_arch]->emit_method_table)
+
+#elif MICROPY_EMIT_NATIVE
 // define a macro to access external native emitter
 #if MICROPY_EMIT_X64
 #define NATIVE_EMITTER(f) emit_native_x64_##f
@@ -85,6 +122,7 @@ typedef enum {
 #else
 #error "unknown native emitter"
 #endif
+#define NATIVE_EMITTER_TABLE (&NATIVE_EMITTER(method_table))
 #endif
 
 #if MICROPY_EMIT_INLINE_ASM
@@ -138,6 +176,12 @@ typedef struct _compiler_t {
     emit_inline_asm_t *emit_inline_asm;                                   // current emitter for inline asm
     const emit_inline_asm_method_table_t *emit_inline_asm_method_table;   // current emit method table for inline asm
     #endif
+
+    #if MICROPY_OPT_TIERED_NATIVE
+    mp_obj_t source;                // source to keep with the raw code, for promoting functions
+    mp_int_t tier_scope_index;      // index of the scope being promoted to native code, or -1
+    size_t num_scopes;
+    #endif
 } compiler_t;
 
 STATIC void compile_error_set_line(compiler_t *comp, mp_parse_node_t pn) {
@@ -176,6 +220,17 @@ STATIC void compile_decrease_except_level(compiler_t *comp) {
 }
 
 STATIC scope_t *scope_new_and_link(compiler_t *comp, scope_kind_t kind, mp_parse_node_t pn, uint emit_options) {
+    #if MICROPY_OPT_TIERED_NATIVE
+    if (comp->tier_scope_index >= 0 && emit_options != MP_EMIT_OPT_ASM) {
+        // when promoting a scope only that scope is compiled to native code
+        if ((mp_int_t)comp->num_scopes == comp->tier_scope_index) {
+            emit_options = MP_EMIT_OPT_NATIVE_PYTHON;
+        } else {
+            emit_options = MP_EMIT_OPT_BYTECODE;
+        }
+    }
+    comp->num_scopes += 1;
+    #endif
     scope_t *scope = scope_new(kind, pn, comp->source_file, emit_options);
     scope->parent = comp->scope_cur;
     scope->next = NULL;
@@ -789,6 +844,14 @@ STATIC bool compile_built_in_decorator(compiler_t *comp, int name_len, mp_parse_
         compile_syntax_error(comp, name_nodes[1], "invalid micropython decorator");
     }
 
+    #if MICROPY_EMIT_NATIVE && MICROPY_DYNAMIC_COMPILER
+    if (*emit_options == MP_EMIT_OPT_NATIVE_PYTHON || *emit_options == MP_EMIT_OPT_VIPER) {
+        if (emit_native_table[mp_dynamic_compiler.native_arch] == NULL) {
+            compile_syntax_error(comp, name_nodes[1], "invalid arch");
+        }
+    }
+    #endif
+
     return true;
 }
 
@@ -969,6 +1032,15 @@ STATIC void compile_return_stmt(compiler_t *comp, mp_parse_node_struct_t *pns) {
         compile_syntax_error(comp, (mp_parse_node_t)pns, "'return' outside function");
         return;
     }
+    #if MICROPY_OPT_TIERED_NATIVE
+    if (comp->tier_scope_index >= 0 && comp->cur_except_level > 0
+        && comp->scope_cur->emit_options == MP_EMIT_OPT_NATIVE_PYTHON) {
+        // native code doesn't unwind exception handlers on return, so a
+        // function that does this can't be promoted
+        compile_syntax_error(comp, (mp_parse_node_t)pns, "native return from try");
+        return;
+    }
+    #endif
     if (MP_PARSE_NODE_IS_NULL(pns->nodes[0])) {
         // no argument to 'return', so return None
         EMIT_ARG(load_const_tok, MP_TOKEN_KW_NONE);
@@ -3355,17 +3427,21 @@ STATIC void scope_compute_things(scope_t *scope) {
     }
 }
 
-#if !MICROPY_PERSISTENT_CODE_SAVE
-STATIC
+#if MICROPY_OPT_TIERED_NATIVE
+// Keep the source with the raw code of a scope that is compiled to bytecode
+// and called like a function, so it can be promoted to native code later.
+STATIC void scope_keep_source(compiler_t *comp, scope_t *scope, size_t scope_index) {
+    mp_raw_code_t *rc = scope->raw_code;
+    if (comp->source != MP_OBJ_NULL && scope->kind != SCOPE_MODULE && scope->kind != SCOPE_CLASS
+        && rc->kind == MP_CODE_BYTECODE && !(rc->scope_flags & MP_SCOPE_FLAG_GENERATOR)) {
+        rc->source = comp->source;
+        rc->source_file = comp->source_file;
+        rc->scope_index = scope_index;
+    }
+}
 #endif
-mp_raw_code_t *mp_compile_to_raw_code(mp_parse_tree_t *parse_tree, qstr source_file, uint emit_opt, bool is_repl) {
-    // put compiler state on the stack, it's relatively small
-    compiler_t comp_state = {0};
-    compiler_t *comp = &comp_state;
-
-    comp->source_file = source_file;
-    comp->is_repl = is_repl;
 
+STATIC mp_raw_code_t *compile_to_raw_code(compiler_t *comp, mp_parse_tree_t *parse_tree, uint emit_opt) {
     // create the module scope
     scope_t *module_scope = scope_new_and_link(comp, SCOPE_MODULE, parse_tree->root, emit_opt);
 
@@ -3399,6 +3475,13 @@ mp_raw_code_t *mp_compile_to_raw_code(mp_parse_tree_t *parse_tree, qstr source_f
         scope_compute_things(s);
     }
 
+    #if MICROPY_OPT_TIERED_NATIVE
+    if (comp->tier_scope_index >= 0) {
+        // promoted code uses two more labels, see emitnative.c
+        max_num_labels += 2;
+    }
+    #endif
+
     // set max number of labels now that it's calculated
     emit_bc_set_max_num_labels(emit_bc, max_num_labels);
 
@@ -3442,9 +3525,12 @@ mp_raw_code_t *mp_compile_to_raw_code(mp_parse_tree_t *parse_tree, qstr source_f
                     if (emit_native == NULL) {
                         emit_native = NATIVE_EMITTER(new)(&comp->compile_error, max_num_labels);
                     }
-                    comp->emit_method_table = &NATIVE_EMITTER(method_table);
+                    comp->emit_method_table = NATIVE_EMITTER_TABLE;
                     comp->emit = emit_native;
                     EMIT_ARG(set_native_type, MP_EMIT_NATIVE_TYPE_ENABLE, s->emit_options == MP_EMIT_OPT_VIPER, 0);
+                    #if MICROPY_OPT_TIERED_NATIVE
+                    EMIT_ARG(set_native_type, MP_EMIT_NATIVE_TYPE_TIERED, comp->tier_scope_index >= 0, 0);
+                    #endif
                     break;
 #endif // MICROPY_EMIT_NATIVE
 
@@ -3499,7 +3585,20 @@ mp_raw_code_t *mp_compile_to_raw_code(mp_parse_tree_t *parse_tree, qstr source_f
 
     // free the scopes
     mp_raw_code_t *outer_raw_code = module_scope->raw_code;
+    #if MICROPY_OPT_TIERED_NATIVE
+    size_t scope_index = 0;
+    #endif
     for (scope_t *s = module_scope; s;) {
+        #if MICROPY_OPT_TIERED_NATIVE
+        if (comp->compile_error == MP_OBJ_NULL) {
+            if ((mp_int_t)scope_index == comp->tier_scope_index) {
+                outer_raw_code = s->raw_code;
+            } else {
+                scope_keep_source(comp, s, scope_index);
+            }
+        }
+        scope_index += 1;
+        #endif
         scope_t *next = s->next;
         scope_free(s);
         s = next;
@@ -3512,6 +3611,37 @@ mp_raw_code_t *mp_compile_to_raw_code(mp_parse_tree_t *parse_tree, qstr source_f
     }
 }
 
+#if !MICROPY_PERSISTENT_CODE_SAVE
+STATIC
+#endif
+mp_raw_code_t *mp_compile_to_raw_code(mp_parse_tree_t *parse_tree, qstr source_file, uint emit_opt, bool is_repl) {
+    // put compiler state on the stack, it's relatively small
+    compiler_t comp_state = {0};
+    compiler_t *comp = &comp_state;
+
+    comp->source_file = source_file;
+    comp->is_repl = is_repl;
+    #if MICROPY_OPT_TIERED_NATIVE
+    comp->source = parse_tree->source;
+    comp->tier_scope_index = -1;
+    #endif
+
+    return compile_to_raw_code(comp, parse_tree, emit_opt);
+}
+
+#if MICROPY_OPT_TIERED_NATIVE
+mp_raw_code_t *mp_compile_scope_to_native(mp_parse_tree_t *parse_tree, qstr source_file, size_t scope_index) {
+    compiler_t comp_state = {0};
+    compiler_t *comp = &comp_state;
+
+    comp->source_file = source_file;
+    comp->source = MP_OBJ_NULL;
+    comp->tier_scope_index = scope_index;
+
+    return compile_to_raw_code(comp, parse_tree, MP_EMIT_OPT_BYTECODE);
+}
+#endif
+
 mp_obj_t mp_compile(mp_parse_tree_t *parse_tree, qstr source_file, uint emit_opt, bool is_repl) {
     mp_raw_code_t *rc = mp_compile_to_raw_code(parse_tree, source_file, emit_opt, is_repl);
     // return function that executes the outer module
@@ -48,6 +48,12 @@ mp_obj_t mp_compile(mp_parse_tree_t *parse_tree, qstr source_file, uint emit_opt
 mp_raw_code_t *mp_compile_to_raw_code(mp_parse_tree_t *parse_tree, qstr source_file, uint emit_opt, bool is_repl);
 #endif
 
+#if MICROPY_OPT_TIERED_NATIVE
+// this compiles the module again, with the scope at the given index compiled
+// by the native emitter, and returns the raw code of that scope
+mp_raw_code_t *mp_compile_scope_to_native(mp_parse_tree_t *parse_tree, qstr source_file, size_t scope_index);
+#endif
+
 // this is implemented in runtime.c
 mp_obj_t mp_parse_compile_execute(mp_lexer_t *lex, mp_parse_input_kind_t parse_input_kind, mp_obj_dict_t *globals, mp_obj_dict_t *locals);
 
@@ -56,6 +56,7 @@ typedef enum {
 #define MP_EMIT_NATIVE_TYPE_ENABLE (0)
 #define MP_EMIT_NATIVE_TYPE_RETURN (1)
 #define MP_EMIT_NATIVE_TYPE_ARG    (2)
+#define MP_EMIT_NATIVE_TYPE_TIERED (3)
 
 typedef struct _emit_t emit_t;
 
@@ -34,6 +34,8 @@
 #include "py/emitglue.h"
 #include "py/runtime0.h"
 #include "py/bc.h"
+#include "py/compile.h"
+#include "py/objfun.h"
 
 #if 0 // print debugging info
 #define DEBUG_PRINT (1)
@@ -91,6 +93,9 @@ void mp_emit_glue_assign_native(mp_raw_code_t *rc, mp_raw_code_kind_t kind, void
     rc->data.u_native.fun_data = fun_data;
     rc->data.u_native.const_table = const_table;
     rc->data.u_native.type_sig = type_sig;
+    #if MICROPY_PERSISTENT_CODE_SAVE
+    rc->data.u_native.fun_len = fun_len;
+    #endif
 
 #ifdef DEBUG_PRINT
     DEBUG_printf("assign native: kind=%d fun=%p len=" UINT_FMT " n_pos_args=" UINT_FMT " flags=%x\n", kind, fun_data, fun_len, n_pos_args, (uint)scope_flags);
@@ -107,12 +112,48 @@ void mp_emit_glue_assign_native(mp_raw_code_t *rc, mp_raw_code_kind_t kind, void
     fwrite(fun_data, fun_len, 1, fp_write_code);
     fclose(fp_write_code);
 #endif
-#else
+#elif !MICROPY_PERSISTENT_CODE_SAVE
     (void)fun_len;
 #endif
 }
 #endif
 
+#if MICROPY_OPT_TIERED_NATIVE
+// Compile the given bytecode again with the native emitter, from the source
+// that was retained for it, and return the native code.  Returns NULL if that
+// fails, for example because the function uses something that the native
+// emitter can't do like the VM does, and then it's not tried again.
+const mp_raw_code_t *mp_emit_glue_tier_up(mp_raw_code_t *rc) {
+    #if MICROPY_PY_THREAD
+    mp_thread_mutex_lock(&MP_STATE_VM(tier_up_mutex), 1);
+    #endif
+    if (rc->native == NULL && rc->source != MP_OBJ_NULL) {
+        mp_obj_t source = rc->source;
+        rc->source = MP_OBJ_NULL;
+        nlr_buf_t nlr;
+        if (nlr_push(&nlr) == 0) {
+            mp_buffer_info_t bufinfo;
+            mp_get_buffer_raise(source, &bufinfo, MP_BUFFER_READ);
+            mp_lexer_t *lex = mp_lexer_new_from_str_len(rc->source_file, bufinfo.buf, bufinfo.len, 0);
+            if (lex != NULL) {
+                // the source may have been REPL or eval input, but as file
+                // input it has the same scopes
+                mp_parse_tree_t parse_tree = mp_parse(lex, MP_PARSE_FILE_INPUT);
+                const mp_raw_code_t *native = mp_compile_scope_to_native(&parse_tree, rc->source_file, rc->scope_index);
+                if (native != NULL && native->kind == MP_CODE_NATIVE_PY && native->scope_flags == rc->scope_flags) {
+                    rc->native = native;
+                }
+            }
+            nlr_pop();
+        }
+    }
+    #if MICROPY_PY_THREAD
+    mp_thread_mutex_unlock(&MP_STATE_VM(tier_up_mutex));
+    #endif
+    return rc->native;
+}
+#endif
+
 mp_obj_t mp_make_function_from_raw_code(const mp_raw_code_t *rc, mp_obj_t def_args, mp_obj_t def_kw_args) {
     DEBUG_OP_printf("make_function_from_raw_code %p\n", rc);
     assert(rc != NULL);
@@ -143,6 +184,11 @@ mp_obj_t mp_make_function_from_raw_code(const mp_raw_code_t *rc, mp_obj_t def_ar
             // rc->kind should always be set and BYTECODE is the only remaining case
             assert(rc->kind == MP_CODE_BYTECODE);
             fun = mp_obj_new_fun_bc(def_args, def_kw_args, rc->data.u_byte.bytecode, rc->data.u_byte.const_table);
+            #if MICROPY_OPT_TIERED_NATIVE
+            if (rc->source != MP_OBJ_NULL || rc->native != NULL) {
+                ((mp_obj_fun_bc_t*)MP_OBJ_TO_PTR(fun))->rc = (mp_raw_code_t*)rc;
+            }
+            #endif
             break;
     }
 
@@ -39,6 +39,37 @@ typedef enum {
     MP_CODE_NATIVE_ASM,
 } mp_raw_code_kind_t;
 
+// Native code refers to some things that are only known when it's run, like
+// the values of qstrs and the addresses of objects in the runtime.  When it's
+// saved to a .mpy file each such reference is a word in the code, described
+// by a relocation so that the loader can patch in the right value.
+typedef enum {
+    MP_NATIVE_RELOC_QSTR,           // the qstr arg
+    MP_NATIVE_RELOC_QSTR_OBJ,       // the qstr arg as an object
+    MP_NATIVE_RELOC_FUN_TABLE,      // the address of mp_fun_table
+    MP_NATIVE_RELOC_FUN,            // entry arg of mp_fun_table
+    MP_NATIVE_RELOC_CONST_OBJ,      // constant object arg, an mp_native_const_obj_t
+    MP_NATIVE_RELOC_CONST_TABLE,    // entry arg of the constant table
+    MP_NATIVE_RELOC_CODE,           // the address of the code plus arg (native modules only)
+} mp_native_reloc_kind_t;
+
+typedef enum {
+    MP_NATIVE_CONST_NONE,
+    MP_NATIVE_CONST_FALSE,
+    MP_NATIVE_CONST_TRUE,
+    MP_NATIVE_CONST_ELLIPSIS,
+} mp_native_const_obj_t;
+
+mp_obj_t mp_native_const_obj(mp_native_const_obj_t id);
+
+#if MICROPY_PERSISTENT_CODE_SAVE
+typedef struct _mp_native_reloc_t {
+    uint32_t offset; // of the word in the code, which is aligned
+    uint16_t kind;
+    uint16_t arg;
+} mp_native_reloc_t;
+#endif
+
 typedef struct _mp_raw_code_t {
     mp_raw_code_kind_t kind : 3;
     mp_uint_t scope_flags : 7;
@@ -57,8 +88,26 @@ typedef struct _mp_raw_code_t {
             void *fun_data;
             const mp_uint_t *const_table;
             mp_uint_t type_sig; // for viper, compressed as 2-bit types; ret is MSB, then arg0, arg1, etc
+            #if MICROPY_PERSISTENT_CODE_SAVE
+            mp_uint_t fun_len;
+            mp_uint_t prelude_offset;
+            uint16_t n_obj;
+            uint16_t n_raw_code;
+            mp_uint_t n_reloc;
+            const mp_native_reloc_t *relocs;
+            #endif
         } u_native;
     } data;
+    #if MICROPY_OPT_TIERED_NATIVE
+    // for bytecode that may be promoted to native code: the source of the
+    // module it's in and the index of its scope, then the native code; and
+    // for that native code, the hints of its lookups (see emitnative.c)
+    mp_obj_t source;
+    qstr source_file;
+    mp_uint_t scope_index;
+    const struct _mp_raw_code_t *native;
+    byte *hints;
+    #endif
 } mp_raw_code_t;
 
 mp_raw_code_t *mp_emit_glue_new_raw_code(void);
@@ -71,6 +120,10 @@ void mp_emit_glue_assign_bytecode(mp_raw_code_t *rc, const byte *code, mp_uint_t
     mp_uint_t scope_flags);
 void mp_emit_glue_assign_native(mp_raw_code_t *rc, mp_raw_code_kind_t kind, void *fun_data, mp_uint_t fun_len, const mp_uint_t *const_table, mp_uint_t n_pos_args, mp_uint_t scope_flags, mp_uint_t type_sig);
 
+#if MICROPY_OPT_TIERED_NATIVE
+const mp_raw_code_t *mp_emit_glue_tier_up(mp_raw_code_t *rc);
+#endif
+
 mp_obj_t mp_make_function_from_raw_code(const mp_raw_code_t *rc, mp_obj_t def_args, mp_obj_t def_kw_args);
 mp_obj_t mp_make_closure_from_raw_code(const mp_raw_code_t *rc, mp_uint_t n_closed_over, const mp_obj_t *args);
 
@@ -123,6 +123,17 @@ STATIC byte mp_f_n_args[MP_F_NUMBER_OF] = {
     [MP_F_NEW_CELL] = 1,
     [MP_F_MAKE_CLOSURE_FROM_RAW_CODE] = 3,
     [MP_F_SETUP_CODE_STATE] = 5,
+#if MICROPY_OPT_TIERED_NATIVE
+    [MP_F_NATIVE_LOOP_CHECK] = 0,
+    [MP_F_NATIVE_UNBOUND_LOCAL] = 0,
+    [MP_F_NATIVE_TIER_RAISE] = 4,
+#if MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+    [MP_F_LOAD_GLOBAL_CACHED] = 2,
+    [MP_F_LOAD_ATTR_CACHED] = 3,
+    [MP_F_STORE_ATTR_CACHED] = 4,
+    [MP_F_LOAD_METHOD_CACHED] = 4,
+#endif
+#endif
 };
 
 #include "py/asmx86.h"
@@ -152,10 +163,60 @@ STATIC byte mp_f_n_args[MP_F_NUMBER_OF] = {
 
 #endif
 
+// Viper keeps a float unboxed, as the bits of an mp_float_t in a machine word,
+// and does arithmetic on it with the SSE2 registers of x64
+#define VIPER_FLOAT (N_X64 && MICROPY_PY_BUILTINS_FLOAT && MICROPY_FLOAT_IMPL == MICROPY_FLOAT_IMPL_DOUBLE)
+
 #define EMIT_NATIVE_VIPER_TYPE_ERROR(emit, ...) do { \
         *emit->error_slot = mp_obj_new_exception_msg_varg(&mp_type_ViperTypeError, __VA_ARGS__); \
     } while (0)
 
+#if MICROPY_OPT_TIERED_NATIVE
+
+// A function being promoted to native code is rejected, so it stays as
+// bytecode, if it does something that native code doesn't do like the VM
+#define EMIT_NATIVE_TIER_REJECT(emit, msg) do { \
+        *emit->error_slot = mp_obj_new_exception_msg(&mp_type_NotImplementedError, msg); \
+    } while (0)
+
+// Promoted code jumps to this label, which raises, if a local is unbound
+#define UNBOUND_LOCAL_LABEL(emit) ((emit)->tier_label_base - 1)
+
+// Promoted code catches exceptions at this label, to add the function to
+// their traceback as the VM does, and then raises them again
+#define TIER_RAISE_LABEL(emit) ((emit)->tier_label_base - 2)
+
+// After its state, promoted code keeps the line being run and the nlr_buf_t
+// of the handler that jumps to TIER_RAISE_LABEL
+#define TIER_LINE_LOCAL(emit) (STATE_START + (emit)->n_state)
+#define TIER_NLR_LOCAL(emit) (STATE_START + (emit)->n_state + 1)
+#define TIER_FRAME_WORDS(emit) ((emit)->tiered ? 1 + NLR_BUF_WORDS : 0)
+
+// Test the whole word of an object for NULL, ASM_JUMP_IF_REG_ZERO may only
+// test the low byte
+#if N_X64
+#define ASM_JUMP_IF_OBJ_NULL(as, reg, label) \
+    do { \
+        asm_x64_test_r64_with_r64(as, reg, reg); \
+        asm_x64_jcc_label(as, ASM_X64_CC_JZ, label); \
+    } while (0)
+#elif N_X86
+#define ASM_JUMP_IF_OBJ_NULL(as, reg, label) \
+    do { \
+        asm_x86_test_r32_with_r32(as, reg, reg); \
+        asm_x86_jcc_label(as, ASM_X86_CC_JZ, label); \
+    } while (0)
+#else
+#define ASM_JUMP_IF_OBJ_NULL ASM_JUMP_IF_REG_ZERO
+#endif
+
+// Promoted code does its lookups with the caches of the VM, when it has them
+#define TIER_CACHED_LOOKUPS (MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE)
+
+#else
+#define TIER_CACHED_LOOKUPS (0)
+#endif
+
 typedef enum {
     STACK_VALUE,
     STACK_REG,
@@ -173,6 +234,9 @@ typedef enum {
     VTYPE_PTR8 = 0x00 | MP_NATIVE_TYPE_PTR8,
     VTYPE_PTR16 = 0x00 | MP_NATIVE_TYPE_PTR16,
     VTYPE_PTR32 = 0x00 | MP_NATIVE_TYPE_PTR32,
+    VTYPE_FLOAT = 0x00 | MP_NATIVE_TYPE_FLOAT,
+    VTYPE_PTRF32 = 0x00 | MP_NATIVE_TYPE_PTRF32,
+    VTYPE_PTRF64 = 0x00 | MP_NATIVE_TYPE_PTRF64,
 
     VTYPE_PTR_NONE = 0x50 | MP_NATIVE_TYPE_PTR,
 
@@ -190,6 +254,11 @@ STATIC qstr vtype_to_qstr(vtype_kind_t vtype) {
         case VTYPE_PTR8: return MP_QSTR_ptr8;
         case VTYPE_PTR16: return MP_QSTR_ptr16;
         case VTYPE_PTR32: return MP_QSTR_ptr32;
+        #if VIPER_FLOAT
+        case VTYPE_FLOAT: return MP_QSTR_float;
+        case VTYPE_PTRF32: return MP_QSTR_ptrf32;
+        case VTYPE_PTRF64: return MP_QSTR_ptrf64;
+        #endif
         case VTYPE_PTR_NONE: default: return MP_QSTR_None;
     }
 }
@@ -203,23 +272,70 @@ typedef struct _stack_info_t {
     } data;
 } stack_info_t;
 
+// the callee-saved registers that locals can be kept in
+STATIC const byte local_regs[REG_LOCAL_NUM] = {
+    REG_LOCAL_1, REG_LOCAL_2, REG_LOCAL_3,
+    #if REG_LOCAL_NUM > 3
+    REG_LOCAL_4, REG_LOCAL_5,
+    #endif
+};
+
+// a load or store of a local, at a position in the code
+typedef struct _local_use_t {
+    mp_uint_t pos;
+    mp_uint_t local_num;
+} local_use_t;
+
+// a loop, from the label at its start to the jump back to it
+typedef struct _local_loop_t {
+    mp_uint_t start;
+    mp_uint_t end;
+} local_loop_t;
+
 struct _emit_t {
     mp_obj_t *error_slot;
     int pass;
 
     bool do_viper_types;
+    #if MICROPY_OPT_TIERED_NATIVE
+    bool tiered;
+    mp_uint_t tier_label_base;
+    mp_uint_t tier_num_labels;
+    mp_uint_t tier_num_hints;
+    byte *tier_hints;
+    #endif
 
     vtype_kind_t return_vtype;
 
     mp_uint_t local_vtype_alloc;
     vtype_kind_t *local_vtype;
 
+    // the register that each local is kept in, or -1 if it's in memory; it's
+    // chosen from the uses and loops that the stack size pass records
+    int8_t *local_reg;
+    mp_uint_t n_use;
+    mp_uint_t use_alloc;
+    local_use_t *uses;
+    mp_uint_t n_loop;
+    mp_uint_t loop_alloc;
+    local_loop_t *loops;
+
     mp_uint_t stack_info_alloc;
     stack_info_t *stack_info;
     vtype_kind_t saved_stack_vtype;
 
     int prelude_offset;
     int const_table_offset;
+    #if MICROPY_PERSISTENT_CODE_SAVE
+    // the values which are only known when code saved to a .mpy file is
+    // loaded, and the constants of the function, which go in the file
+    mp_uint_t n_reloc;
+    mp_native_reloc_t *relocs;
+    mp_uint_t ct_cur_obj;
+    mp_uint_t ct_num_obj;
+    mp_uint_t ct_cur_raw_code;
+    mp_uint_t *const_table;
+    #endif
     int n_state;
     int stack_start;
     int stack_size;
@@ -236,6 +352,9 @@ emit_t *EXPORT_FUN(new)(mp_obj_t *error_slot, mp_uint_t max_num_labels) {
     emit->error_slot = error_slot;
     emit->as = m_new0(ASM_T, 1);
     mp_asm_base_init(&emit->as->base, max_num_labels);
+    #if MICROPY_OPT_TIERED_NATIVE
+    emit->tier_label_base = max_num_labels;
+    #endif
     return emit;
 }
 
@@ -243,6 +362,9 @@ void EXPORT_FUN(free)(emit_t *emit) {
     mp_asm_base_deinit(&emit->as->base, false);
     m_del_obj(ASM_T, emit->as);
     m_del(vtype_kind_t, emit->local_vtype, emit->local_vtype_alloc);
+    m_del(int8_t, emit->local_reg, emit->local_vtype_alloc);
+    m_del(local_use_t, emit->uses, emit->use_alloc);
+    m_del(local_loop_t, emit->loops, emit->loop_alloc);
     m_del(stack_info_t, emit->stack_info, emit->stack_info_alloc);
     m_del_obj(emit_t, emit);
 }
@@ -251,8 +373,17 @@ STATIC void emit_native_set_native_type(emit_t *emit, mp_uint_t op, mp_uint_t ar
     switch (op) {
         case MP_EMIT_NATIVE_TYPE_ENABLE:
             emit->do_viper_types = arg1;
+            #if MICROPY_OPT_TIERED_NATIVE
+            emit->tiered = false;
+            #endif
             break;
 
+        #if MICROPY_OPT_TIERED_NATIVE
+        case MP_EMIT_NATIVE_TYPE_TIERED:
+            emit->tiered = arg1;
+            break;
+        #endif
+
         default: {
             vtype_kind_t type;
             switch (arg2) {
@@ -264,6 +395,11 @@ STATIC void emit_native_set_native_type(emit_t *emit, mp_uint_t op, mp_uint_t ar
                 case MP_QSTR_ptr8: type = VTYPE_PTR8; break;
                 case MP_QSTR_ptr16: type = VTYPE_PTR16; break;
                 case MP_QSTR_ptr32: type = VTYPE_PTR32; break;
+                #if VIPER_FLOAT
+                case MP_QSTR_float: type = VTYPE_FLOAT; break;
+                case MP_QSTR_ptrf32: type = VTYPE_PTRF32; break;
+                case MP_QSTR_ptrf64: type = VTYPE_PTRF64; break;
+                #endif
                 default: EMIT_NATIVE_VIPER_TYPE_ERROR(emit, "unknown type '%q'", arg2); return;
             }
             if (op == MP_EMIT_NATIVE_TYPE_RETURN) {
@@ -281,9 +417,169 @@ STATIC void emit_pre_pop_reg(emit_t *emit, vtype_kind_t *vtype, int reg_dest);
 STATIC void emit_post_push_reg(emit_t *emit, vtype_kind_t vtype, int reg);
 STATIC void emit_native_load_fast(emit_t *emit, qstr qst, mp_uint_t local_num);
 STATIC void emit_native_store_fast(emit_t *emit, qstr qst, mp_uint_t local_num);
+STATIC void emit_native_call_ind(emit_t *emit, mp_fun_kind_t fun_kind);
+STATIC void need_reg_single(emit_t *emit, int reg_needed, int skip_stack_pos);
+#if N_THUMB || N_ARM
+STATIC void emit_native_mov_r7_fun_table(emit_t *emit);
+#endif
 
 #define STATE_START (sizeof(mp_code_state_t) / sizeof(mp_uint_t))
 
+// the size of nlr_buf_t in words; code saved to a .mpy file may be for a
+// different machine to the one compiling it, so it's the size on the target
+#if !MICROPY_PERSISTENT_CODE_SAVE
+#define NLR_BUF_WORDS (sizeof(nlr_buf_t) / sizeof(mp_uint_t))
+#elif N_X64
+#define NLR_BUF_WORDS (2 + 8)
+#elif N_X86
+#define NLR_BUF_WORDS (2 + 6)
+#else
+#define NLR_BUF_WORDS (2 + 10)
+#endif
+
+// the stack size pass records where each local is loaded and stored
+STATIC void note_local_use(emit_t *emit, mp_uint_t local_num) {
+    if (emit->pass != MP_PASS_STACK_SIZE) {
+        return;
+    }
+    if (emit->n_use >= emit->use_alloc) {
+        emit->uses = m_renew(local_use_t, emit->uses, emit->use_alloc, emit->use_alloc + 32);
+        emit->use_alloc += 32;
+    }
+    local_use_t *use = &emit->uses[emit->n_use++];
+    use->pos = mp_asm_base_get_code_pos(&emit->as->base);
+    use->local_num = local_num;
+}
+
+// ... and where the loops are, which are jumps back to a label
+STATIC void note_jump(emit_t *emit, mp_uint_t label) {
+    mp_uint_t pos = mp_asm_base_get_code_pos(&emit->as->base);
+    if (emit->pass != MP_PASS_STACK_SIZE || emit->as->base.label_offsets[label] > pos) {
+        return;
+    }
+    if (emit->n_loop >= emit->loop_alloc) {
+        emit->loops = m_renew(local_loop_t, emit->loops, emit->loop_alloc, emit->loop_alloc + 8);
+        emit->loop_alloc += 8;
+    }
+    local_loop_t *loop = &emit->loops[emit->n_loop++];
+    loop->start = emit->as->base.label_offsets[label];
+    loop->end = pos;
+}
+
+// Choose the locals that are kept in registers, by a linear scan over the
+// code of the stack size pass.  Each local is live from its first use to its
+// last, extended over any loop that it's live in, and it's weighted by its
+// uses, with those in loops counting for more.  Locals whose live ranges
+// don't overlap can share a register.
+STATIC void alloc_local_regs(emit_t *emit) {
+    scope_t *scope = emit->scope;
+
+    // nlr restores the callee-saved registers when it catches an exception, so
+    // code with exception handlers keeps all its locals in memory
+    if (scope->exc_stack_size > 0 || *emit->error_slot != MP_OBJ_NULL || scope->num_locals == 0) {
+        return;
+    }
+
+    typedef struct _live_range_t {
+        mp_uint_t start;
+        mp_uint_t end;
+        mp_uint_t weight;
+        mp_uint_t local_num;
+    } live_range_t;
+    live_range_t *ranges = m_new(live_range_t, scope->num_locals);
+    for (mp_uint_t i = 0; i < scope->num_locals; i++) {
+        ranges[i].start = (mp_uint_t)-1;
+        ranges[i].end = 0;
+        ranges[i].weight = 0;
+        ranges[i].local_num = i;
+    }
+    for (mp_uint_t i = 0; i < emit->n_use; i++) {
+        local_use_t *use = &emit->uses[i];
+        live_range_t *r = &ranges[use->local_num];
+        if (use->pos < r->start) {
+            r->start = use->pos;
+        }
+        if (use->pos > r->end) {
+            r->end = use->pos;
+        }
+        mp_uint_t weight = 1;
+        for (mp_uint_t j = 0, depth = 0; j < emit->n_loop && depth < 4; j++) {
+            if (emit->loops[j].start <= use->pos && use->pos <= emit->loops[j].end) {
+                weight *= 8;
+                depth += 1;
+            }
+        }
+        r->weight += weight;
+    }
+
+    // viper arguments are live from the entry, and so are all the locals of
+    // native code, which are loaded from the state then
+    for (mp_uint_t i = 0; i < scope->num_locals; i++) {
+        if (ranges[i].weight > 0 && (!emit->do_viper_types || i < scope->num_pos_args)) {
+            ranges[i].start = 0;
+        }
+    }
+
+    // a local used in a loop may be live around its jump back, so it's live
+    // over the whole loop
+    bool changed;
+    do {
+        changed = false;
+        for (mp_uint_t i = 0; i < scope->num_locals; i++) {
+            live_range_t *r = &ranges[i];
+            for (mp_uint_t j = 0; r->weight > 0 && j < emit->n_loop; j++) {
+                local_loop_t *loop = &emit->loops[j];
+                if (r->start <= loop->end && loop->start <= r->end
+                    && (loop->start < r->start || loop->end > r->end)) {
+                    r->start = MIN(r->start, loop->start);
+                    r->end = MAX(r->end, loop->end);
+                    changed = true;
+                }
+            }
+        }
+    } while (changed);
+
+    // sort by start, there aren't many locals
+    for (mp_uint_t i = 1; i < scope->num_locals; i++) {
+        live_range_t r = ranges[i];
+        mp_uint_t j = i;
+        for (; j > 0 && ranges[j - 1].start > r.start; j--) {
+            ranges[j] = ranges[j - 1];
+        }
+        ranges[j] = r;
+    }
+
+    live_range_t *active[REG_LOCAL_NUM] = {NULL};
+    for (mp_uint_t i = 0; i < scope->num_locals && ranges[i].weight > 0; i++) {
+        live_range_t *r = &ranges[i];
+        int free_reg = -1;
+        int cheapest = -1;
+        for (int j = 0; j < REG_LOCAL_NUM; j++) {
+            if (active[j] != NULL && active[j]->end < r->start) {
+                active[j] = NULL;
+            }
+            if (active[j] == NULL) {
+                if (free_reg < 0) {
+                    free_reg = j;
+                }
+            } else if (cheapest < 0 || active[j]->weight < active[cheapest]->weight) {
+                cheapest = j;
+            }
+        }
+        if (free_reg < 0 && active[cheapest]->weight < r->weight) {
+            // the local using the register is used less, so it goes to memory
+            emit->local_reg[active[cheapest]->local_num] = -1;
+            free_reg = cheapest;
+        }
+        if (free_reg >= 0) {
+            active[free_reg] = r;
+            emit->local_reg[r->local_num] = local_regs[free_reg];
+        }
+    }
+
+    m_del(live_range_t, ranges, scope->num_locals);
+}
+
 STATIC void emit_native_start_pass(emit_t *emit, pass_kind_t pass, scope_t *scope) {
     DEBUG_printf("start_pass(pass=%u, scope=%p)\n", pass, scope);
 
@@ -296,9 +592,20 @@ STATIC void emit_native_start_pass(emit_t *emit, pass_kind_t pass, scope_t *scop
     // allocate memory for keeping track of the types of locals
     if (emit->local_vtype_alloc < scope->num_locals) {
         emit->local_vtype = m_renew(vtype_kind_t, emit->local_vtype, emit->local_vtype_alloc, scope->num_locals);
+        emit->local_reg = m_renew(int8_t, emit->local_reg, emit->local_vtype_alloc, scope->num_locals);
         emit->local_vtype_alloc = scope->num_locals;
     }
 
+    // the stack size pass keeps all locals in memory and records their uses,
+    // and then the following passes keep the chosen ones in registers
+    if (pass <= MP_PASS_STACK_SIZE) {
+        for (mp_uint_t i = 0; i < scope->num_locals; i++) {
+            emit->local_reg[i] = -1;
+        }
+        emit->n_use = 0;
+        emit->n_loop = 0;
+    }
+
     // allocate memory for keeping track of the objects on the stack
     // XXX don't know stack size on entry, and it should be maximum over all scopes
     // XXX this is such a big hack and really needs to be fixed
@@ -333,6 +640,31 @@ STATIC void emit_native_start_pass(emit_t *emit, pass_kind_t pass, scope_t *scop
         emit->stack_info[i].vtype = VTYPE_UNBOUND;
     }
 
+    #if MICROPY_OPT_TIERED_NATIVE
+    if (emit->tiered) {
+        // the previous pass counted the labels of the fast paths and the
+        // hints of the lookups, see tier_fast_path and emit_call_with_imm_arg_and_hint
+        mp_asm_base_t *as = &emit->as->base;
+        if (pass == MP_PASS_CODE_SIZE && emit->tier_label_base + emit->tier_num_labels > as->max_num_labels) {
+            size_t n = emit->tier_label_base + emit->tier_num_labels;
+            as->label_offsets = m_renew(size_t, as->label_offsets, as->max_num_labels, n);
+            as->max_num_labels = n;
+        }
+        emit->tier_hints = NULL;
+        if (pass == MP_PASS_EMIT) {
+            emit->tier_hints = m_new0(byte, emit->tier_num_hints);
+        }
+        emit->tier_num_labels = 0;
+        emit->tier_num_hints = 0;
+    }
+    #endif
+
+    #if MICROPY_PERSISTENT_CODE_SAVE
+    emit->n_reloc = 0;
+    emit->ct_cur_obj = 0;
+    emit->ct_cur_raw_code = 0;
+    #endif
+
     mp_asm_base_start_pass(&emit->as->base, pass == MP_PASS_EMIT ? MP_ASM_PASS_EMIT : MP_ASM_PASS_COMPUTE);
 
     // generate code for entry to function
@@ -345,51 +677,36 @@ STATIC void emit_native_start_pass(emit_t *emit, pass_kind_t pass, scope_t *scop
             return;
         }
 
-        // entry to function
+        // entry to function; each local has a slot, used if it's not in a register
         int num_locals = 0;
         if (pass > MP_PASS_SCOPE) {
-            num_locals = scope->num_locals - REG_LOCAL_NUM;
-            if (num_locals < 0) {
-                num_locals = 0;
-            }
+            num_locals = scope->num_locals;
             emit->stack_start = num_locals;
             num_locals += scope->stack_size;
         }
         ASM_ENTRY(emit->as, num_locals);
 
         // TODO don't load r7 if we don't need it
-        #if N_THUMB
-        asm_thumb_mov_reg_i32(emit->as, ASM_THUMB_REG_R7, (mp_uint_t)mp_fun_table);
-        #elif N_ARM
-        asm_arm_mov_reg_i32(emit->as, ASM_ARM_REG_R7, (mp_uint_t)mp_fun_table);
+        #if N_THUMB || N_ARM
+        emit_native_mov_r7_fun_table(emit);
         #endif
 
         #if N_X86
         for (int i = 0; i < scope->num_pos_args; i++) {
-            if (i == 0) {
-                asm_x86_mov_arg_to_r32(emit->as, i, REG_LOCAL_1);
-            } else if (i == 1) {
-                asm_x86_mov_arg_to_r32(emit->as, i, REG_LOCAL_2);
-            } else if (i == 2) {
-                asm_x86_mov_arg_to_r32(emit->as, i, REG_LOCAL_3);
+            if (emit->local_reg[i] >= 0) {
+                asm_x86_mov_arg_to_r32(emit->as, i, emit->local_reg[i]);
             } else {
                 asm_x86_mov_arg_to_r32(emit->as, i, REG_TEMP0);
-                asm_x86_mov_r32_to_local(emit->as, REG_TEMP0, i - REG_LOCAL_NUM);
+                asm_x86_mov_r32_to_local(emit->as, REG_TEMP0, i);
             }
         }
         #else
+        static const byte arg_regs[] = {REG_ARG_1, REG_ARG_2, REG_ARG_3, REG_ARG_4};
         for (int i = 0; i < scope->num_pos_args; i++) {
-            if (i == 0) {
-                ASM_MOV_REG_REG(emit->as, REG_LOCAL_1, REG_ARG_1);
-            } else if (i == 1) {
-                ASM_MOV_REG_REG(emit->as, REG_LOCAL_2, REG_ARG_2);
-            } else if (i == 2) {
-                ASM_MOV_REG_REG(emit->as, REG_LOCAL_3, REG_ARG_3);
-            } else if (i == 3) {
-                ASM_MOV_REG_TO_LOCAL(emit->as, REG_ARG_4, i - REG_LOCAL_NUM);
+            if (emit->local_reg[i] >= 0) {
+                ASM_MOV_REG_REG(emit->as, emit->local_reg[i], arg_regs[i]);
             } else {
-                // TODO not implemented
-                mp_not_implemented("more than 4 viper args");
+                ASM_MOV_REG_TO_LOCAL(emit->as, arg_regs[i], i);
             }
         }
         #endif
@@ -399,13 +716,15 @@ STATIC void emit_native_start_pass(emit_t *emit, pass_kind_t pass, scope_t *scop
         emit->n_state = scope->num_locals + scope->stack_size;
 
         // allocate space on C-stack for code_state structure, which includes state
+        #if MICROPY_OPT_TIERED_NATIVE
+        ASM_ENTRY(emit->as, STATE_START + emit->n_state + TIER_FRAME_WORDS(emit));
+        #else
         ASM_ENTRY(emit->as, STATE_START + emit->n_state);
+        #endif
 
         // TODO don't load r7 if we don't need it
-        #if N_THUMB
-        asm_thumb_mov_reg_i32(emit->as, ASM_THUMB_REG_R7, (mp_uint_t)mp_fun_table);
-        #elif N_ARM
-        asm_arm_mov_reg_i32(emit->as, ASM_ARM_REG_R7, (mp_uint_t)mp_fun_table);
+        #if N_THUMB || N_ARM
+        emit_native_mov_r7_fun_table(emit);
         #endif
 
         // prepare incoming arguments for call to mp_setup_code_state
@@ -447,17 +766,23 @@ STATIC void emit_native_start_pass(emit_t *emit, pass_kind_t pass, scope_t *scop
         asm_arm_bl_ind(emit->as, mp_fun_table[MP_F_SETUP_CODE_STATE], MP_F_SETUP_CODE_STATE, ASM_ARM_REG_R4);
         asm_arm_pop(emit->as, 1 << REG_RET); // pop dummy (was 5th arg)
         #else
-        ASM_CALL_IND(emit->as, mp_fun_table[MP_F_SETUP_CODE_STATE], MP_F_SETUP_CODE_STATE);
+        emit_native_call_ind(emit, MP_F_SETUP_CODE_STATE);
         #endif
 
-        // cache some locals in registers
-        if (scope->num_locals > 0) {
-            ASM_MOV_LOCAL_TO_REG(emit->as, STATE_START + emit->n_state - 1 - 0, REG_LOCAL_1);
-            if (scope->num_locals > 1) {
-                ASM_MOV_LOCAL_TO_REG(emit->as, STATE_START + emit->n_state - 1 - 1, REG_LOCAL_2);
-                if (scope->num_locals > 2) {
-                    ASM_MOV_LOCAL_TO_REG(emit->as, STATE_START + emit->n_state - 1 - 2, REG_LOCAL_3);
-                }
+        #if MICROPY_OPT_TIERED_NATIVE
+        if (emit->tiered) {
+            // catch all exceptions raised from here on, see TIER_RAISE_LABEL
+            ASM_MOV_IMM_TO_LOCAL_USING(emit->as, 1, TIER_LINE_LOCAL(emit), REG_ARG_1);
+            ASM_MOV_LOCAL_ADDR_TO_REG(emit->as, TIER_NLR_LOCAL(emit), REG_ARG_1);
+            emit_native_call_ind(emit, MP_F_NLR_PUSH);
+            ASM_JUMP_IF_REG_NONZERO(emit->as, REG_RET, TIER_RAISE_LABEL(emit));
+        }
+        #endif
+
+        // cache the chosen locals in registers
+        for (mp_uint_t i = 0; i < scope->num_locals; i++) {
+            if (emit->local_reg[i] >= 0) {
+                ASM_MOV_LOCAL_TO_REG(emit->as, STATE_START + emit->n_state - 1 - i, emit->local_reg[i]);
             }
         }
 
@@ -477,6 +802,23 @@ STATIC void emit_native_end_pass(emit_t *emit) {
         ASM_EXIT(emit->as);
     }
 
+    #if MICROPY_OPT_TIERED_NATIVE
+    if (emit->tiered) {
+        // raise the error for an unbound local; this call doesn't return
+        mp_asm_base_label_assign(&emit->as->base, UNBOUND_LOCAL_LABEL(emit));
+        emit_native_call_ind(emit, MP_F_NATIVE_UNBOUND_LOCAL);
+
+        // add the line being run to the traceback of the exception that was
+        // caught, and raise it again; this call doesn't return either
+        mp_asm_base_label_assign(&emit->as->base, TIER_RAISE_LABEL(emit));
+        ASM_MOV_LOCAL_TO_REG(emit->as, TIER_NLR_LOCAL(emit) + 1, REG_ARG_1); // nlr_buf.ret_val
+        ASM_MOV_LOCAL_TO_REG(emit->as, TIER_LINE_LOCAL(emit), REG_ARG_2);
+        ASM_MOV_IMM_TO_REG(emit->as, emit->scope->source_file, REG_ARG_3);
+        ASM_MOV_IMM_TO_REG(emit->as, emit->scope->simple_name, REG_ARG_4);
+        emit_native_call_ind(emit, MP_F_NATIVE_TIER_RAISE);
+    }
+    #endif
+
     if (!emit->do_viper_types) {
         emit->prelude_offset = mp_asm_base_get_code_pos(&emit->as->base);
         mp_asm_base_data(&emit->as->base, 1, emit->scope->scope_flags);
@@ -510,6 +852,7 @@ STATIC void emit_native_end_pass(emit_t *emit) {
 
         // write argument names as qstr objects
         // see comment in corresponding part of emitbc.c about the logic here
+        // (code saved to a .mpy file has them at the start of its constant table)
         for (int i = 0; i < emit->scope->num_pos_args + emit->scope->num_kwonly_args; i++) {
             qstr qst = MP_QSTR__star_;
             for (int j = 0; j < emit->scope->id_info_len; ++j) {
@@ -519,18 +862,38 @@ STATIC void emit_native_end_pass(emit_t *emit) {
                     break;
                 }
             }
+            #if MICROPY_PERSISTENT_CODE_SAVE
+            if (emit->pass == MP_PASS_EMIT) {
+                emit->const_table[i] = (mp_uint_t)MP_OBJ_NEW_QSTR(qst);
+            }
+            #else
             mp_asm_base_data(&emit->as->base, ASM_WORD_SIZE, (mp_uint_t)MP_OBJ_NEW_QSTR(qst));
+            #endif
         }
 
     }
 
     ASM_END_PASS(emit->as);
 
+    if (emit->pass == MP_PASS_STACK_SIZE) {
+        alloc_local_regs(emit);
+    }
+
     // check stack is back to zero size
     if (emit->stack_size != 0) {
         mp_printf(&mp_plat_print, "ERROR: stack size not back to zero; got %d\n", emit->stack_size);
     }
 
+    #if MICROPY_PERSISTENT_CODE_SAVE
+    assert(emit->pass <= MP_PASS_STACK_SIZE || (emit->ct_num_obj == emit->ct_cur_obj));
+    emit->ct_num_obj = emit->ct_cur_obj;
+    if (emit->pass == MP_PASS_CODE_SIZE) {
+        mp_uint_t n_names = emit->do_viper_types ? 0 : emit->scope->num_pos_args + emit->scope->num_kwonly_args;
+        emit->const_table = m_new0(mp_uint_t, n_names + emit->ct_cur_obj + emit->ct_cur_raw_code);
+        emit->relocs = m_new(mp_native_reloc_t, emit->n_reloc);
+    }
+    #endif
+
     if (emit->pass == MP_PASS_EMIT) {
         void *f = mp_asm_base_get_code(&emit->as->base);
         mp_uint_t f_len = mp_asm_base_get_code_size(&emit->as->base);
@@ -542,10 +905,30 @@ STATIC void emit_native_end_pass(emit_t *emit) {
             type_sig |= (emit->local_vtype[i] & 0xf) << (i * 4 + 4);
         }
 
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        mp_uint_t *const_table = emit->const_table;
+        #else
+        mp_uint_t *const_table = (mp_uint_t*)((byte*)f + emit->const_table_offset);
+        #endif
+
         mp_emit_glue_assign_native(emit->scope->raw_code,
             emit->do_viper_types ? MP_CODE_NATIVE_VIPER : MP_CODE_NATIVE_PY,
-            f, f_len, (mp_uint_t*)((byte*)f + emit->const_table_offset),
+            f, f_len, const_table,
             emit->scope->num_pos_args, emit->scope->scope_flags, type_sig);
+
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        mp_raw_code_t *rc = emit->scope->raw_code;
+        rc->data.u_native.prelude_offset = emit->prelude_offset;
+        rc->data.u_native.n_obj = emit->ct_cur_obj;
+        rc->data.u_native.n_raw_code = emit->ct_cur_raw_code;
+        rc->data.u_native.n_reloc = emit->n_reloc;
+        rc->data.u_native.relocs = emit->relocs;
+        #endif
+        #if MICROPY_OPT_TIERED_NATIVE
+        if (emit->tiered) {
+            emit->scope->raw_code->hints = emit->tier_hints;
+        }
+        #endif
     }
 }
 
@@ -591,8 +974,17 @@ STATIC void emit_native_adjust_stack_size(emit_t *emit, mp_int_t delta) {
 }
 
 STATIC void emit_native_set_source_line(emit_t *emit, mp_uint_t source_line) {
+    #if MICROPY_OPT_TIERED_NATIVE && MICROPY_ENABLE_SOURCE_LINE
+    // promoted code keeps the line for tracebacks, unless compiled with -O3
+    // which drops line numbers from bytecode too
+    if (emit->tiered && MP_STATE_VM(mp_optimise_value) < 3) {
+        need_reg_single(emit, REG_TEMP0, 0);
+        ASM_MOV_IMM_TO_LOCAL_USING(emit->as, source_line, TIER_LINE_LOCAL(emit), REG_TEMP0);
+    }
+    #else
     (void)emit;
     (void)source_line;
+    #endif
 }
 
 /*
@@ -605,28 +997,6 @@ STATIC void emit_pre_raw(emit_t *emit, int stack_size_delta) {
 // this must be called at start of emit functions
 STATIC void emit_native_pre(emit_t *emit) {
     emit->last_emit_was_return_value = false;
-    // settle the stack
-    /*
-    if (regs_needed != 0) {
-        for (int i = 0; i < emit->stack_size; i++) {
-            switch (emit->stack_info[i].kind) {
-                case STACK_VALUE:
-                    break;
-
-                case STACK_REG:
-                    // TODO only push reg if in regs_needed
-                    emit->stack_info[i].kind = STACK_VALUE;
-                    ASM_MOV_REG_TO_LOCAL(emit->as, emit->stack_info[i].data.u_reg, emit->stack_start + i);
-                    break;
-
-                case STACK_IMM:
-                    // don't think we ever need to push imms for settling
-                    //ASM_MOV_IMM_TO_LOCAL(emit->last_imm, emit->stack_start + i);
-                    break;
-            }
-        }
-    }
-    */
 }
 
 // depth==0 is top, depth==1 is before top, etc
@@ -654,10 +1024,21 @@ STATIC void need_reg_single(emit_t *emit, int reg_needed, int skip_stack_pos) {
     }
 }
 
+STATIC bool is_local_reg(int reg) {
+    for (int i = 0; i < REG_LOCAL_NUM; i++) {
+        if (reg == local_regs[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// spills the values in registers that calls don't preserve; values loaded from
+// locals that are kept in callee-saved registers stay there
 STATIC void need_reg_all(emit_t *emit) {
     for (int i = 0; i < emit->stack_size; i++) {
         stack_info_t *si = &emit->stack_info[i];
-        if (si->kind == STACK_REG) {
+        if (si->kind == STACK_REG && !is_local_reg(si->data.u_reg)) {
             si->kind = STACK_VALUE;
             ASM_MOV_REG_TO_LOCAL(emit->as, si->data.u_reg, emit->stack_start + i);
         }
@@ -800,39 +1181,168 @@ STATIC void emit_post_push_reg_reg_reg_reg(emit_t *emit, vtype_kind_t vtypea, in
     emit_post_push_reg(emit, vtyped, regd);
 }
 
+#if MICROPY_PERSISTENT_CODE_SAVE
+// Record a relocation for the word that was just emitted, which is the last
+// word of an aligned immediate load.
+STATIC void emit_native_reloc(emit_t *emit, mp_native_reloc_kind_t kind, mp_uint_t arg) {
+    if (emit->pass == MP_PASS_EMIT) {
+        mp_native_reloc_t *r = &emit->relocs[emit->n_reloc];
+        r->offset = mp_asm_base_get_code_pos(&emit->as->base) - ASM_WORD_SIZE;
+        r->kind = kind;
+        r->arg = arg;
+    }
+    emit->n_reloc += 1;
+}
+#endif
+
+// Load a value that's only known when the code is run.  Code that's saved to
+// a .mpy file has a relocation for it, so the loader can patch in the value.
+STATIC void emit_native_mov_reg_reloc(emit_t *emit, int reg_dest, mp_native_reloc_kind_t kind, mp_uint_t arg, mp_uint_t val) {
+    #if MICROPY_PERSISTENT_CODE_SAVE
+    ASM_MOV_ALIGNED_IMM_TO_REG(emit->as, val, reg_dest);
+    emit_native_reloc(emit, kind, arg);
+    #else
+    (void)arg;
+    if (kind == MP_NATIVE_RELOC_CONST_TABLE) {
+        // objects are stored aligned so that the GC can find them
+        ASM_MOV_ALIGNED_IMM_TO_REG(emit->as, val, reg_dest);
+    } else {
+        ASM_MOV_IMM_TO_REG(emit->as, val, reg_dest);
+    }
+    #endif
+}
+
+STATIC void emit_native_mov_reg_qstr(emit_t *emit, int reg_dest, qstr qst) {
+    emit_native_mov_reg_reloc(emit, reg_dest, MP_NATIVE_RELOC_QSTR, qst, qst);
+}
+
+#if MICROPY_PERSISTENT_CODE_SAVE
+STATIC void emit_native_mov_reg_qstr_obj(emit_t *emit, int reg_dest, qstr qst) {
+    emit_native_mov_reg_reloc(emit, reg_dest, MP_NATIVE_RELOC_QSTR_OBJ, qst, (mp_uint_t)MP_OBJ_NEW_QSTR(qst));
+}
+#endif
+
+STATIC void emit_native_mov_reg_const_obj(emit_t *emit, int reg_dest, mp_native_const_obj_t id) {
+    emit_native_mov_reg_reloc(emit, reg_dest, MP_NATIVE_RELOC_CONST_OBJ, id, (mp_uint_t)mp_native_const_obj(id));
+}
+
+// objects and raw code go in the constant table of the function, in the same
+// order as for bytecode: argument names, then objects, then raw code
+STATIC void emit_native_mov_reg_obj(emit_t *emit, int reg_dest, mp_obj_t obj) {
+    mp_uint_t n = 0;
+    #if MICROPY_PERSISTENT_CODE_SAVE
+    n = (emit->do_viper_types ? 0 : emit->scope->num_pos_args + emit->scope->num_kwonly_args) + emit->ct_cur_obj++;
+    if (emit->pass == MP_PASS_EMIT) {
+        emit->const_table[n] = (mp_uint_t)obj;
+    }
+    #endif
+    emit_native_mov_reg_reloc(emit, reg_dest, MP_NATIVE_RELOC_CONST_TABLE, n, (mp_uint_t)obj);
+}
+
+STATIC void emit_native_mov_reg_raw_code(emit_t *emit, int reg_dest, mp_raw_code_t *rc) {
+    mp_uint_t n = 0;
+    #if MICROPY_PERSISTENT_CODE_SAVE
+    n = (emit->do_viper_types ? 0 : emit->scope->num_pos_args + emit->scope->num_kwonly_args) + emit->ct_num_obj + emit->ct_cur_raw_code++;
+    if (emit->pass == MP_PASS_EMIT) {
+        emit->const_table[n] = (mp_uint_t)(uintptr_t)rc;
+    }
+    #endif
+    emit_native_mov_reg_reloc(emit, reg_dest, MP_NATIVE_RELOC_CONST_TABLE, n, (mp_uint_t)(uintptr_t)rc);
+}
+
+// Push None, False, True or Ellipsis.  Code that's saved to a .mpy file can't
+// have the object as an immediate, so it's loaded into a register.
+STATIC void emit_post_push_const_obj(emit_t *emit, mp_native_const_obj_t id) {
+    #if MICROPY_PERSISTENT_CODE_SAVE
+    need_reg_single(emit, REG_RET, 0);
+    emit_native_mov_reg_const_obj(emit, REG_RET, id);
+    emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
+    #else
+    emit_post_push_imm(emit, VTYPE_PYOBJ, (mp_uint_t)mp_native_const_obj(id));
+    #endif
+}
+
+// load r7 with the address of mp_fun_table, which ARM and Thumb call through
+#if N_THUMB || N_ARM
+STATIC void emit_native_mov_r7_fun_table(emit_t *emit) {
+    #if MICROPY_PERSISTENT_CODE_SAVE && N_THUMB
+    emit_native_mov_reg_reloc(emit, ASM_THUMB_REG_R7, MP_NATIVE_RELOC_FUN_TABLE, 0, (mp_uint_t)mp_fun_table);
+    #elif MICROPY_PERSISTENT_CODE_SAVE
+    emit_native_mov_reg_reloc(emit, ASM_ARM_REG_R7, MP_NATIVE_RELOC_FUN_TABLE, 0, (mp_uint_t)mp_fun_table);
+    #elif N_THUMB
+    asm_thumb_mov_reg_i32(emit->as, ASM_THUMB_REG_R7, (mp_uint_t)mp_fun_table);
+    #else
+    asm_arm_mov_reg_i32(emit->as, ASM_ARM_REG_R7, (mp_uint_t)mp_fun_table);
+    #endif
+}
+#endif
+
+STATIC void emit_native_call_ind(emit_t *emit, mp_fun_kind_t fun_kind) {
+    #if MICROPY_PERSISTENT_CODE_SAVE && N_X64
+    // x64 calls the function at its address, which is patched in by the loader
+    emit_native_mov_reg_reloc(emit, ASM_X64_REG_RAX, MP_NATIVE_RELOC_FUN, fun_kind, (mp_uint_t)mp_fun_table[fun_kind]);
+    asm_x64_call_r64(emit->as, ASM_X64_REG_RAX);
+    #else
+    ASM_CALL_IND(emit->as, mp_fun_table[fun_kind], fun_kind);
+    #endif
+}
+
 STATIC void emit_call(emit_t *emit, mp_fun_kind_t fun_kind) {
     need_reg_all(emit);
-    ASM_CALL_IND(emit->as, mp_fun_table[fun_kind], fun_kind);
+    emit_native_call_ind(emit, fun_kind);
 }
 
 STATIC void emit_call_with_imm_arg(emit_t *emit, mp_fun_kind_t fun_kind, mp_int_t arg_val, int arg_reg) {
     need_reg_all(emit);
     ASM_MOV_IMM_TO_REG(emit->as, arg_val, arg_reg);
-    ASM_CALL_IND(emit->as, mp_fun_table[fun_kind], fun_kind);
+    emit_native_call_ind(emit, fun_kind);
 }
 
-// the first arg is stored in the code aligned on a mp_uint_t boundary
-STATIC void emit_call_with_imm_arg_aligned(emit_t *emit, mp_fun_kind_t fun_kind, mp_int_t arg_val, int arg_reg) {
+STATIC void emit_call_with_qstr_arg(emit_t *emit, mp_fun_kind_t fun_kind, qstr qst, int arg_reg) {
     need_reg_all(emit);
-    ASM_MOV_ALIGNED_IMM_TO_REG(emit->as, arg_val, arg_reg);
-    ASM_CALL_IND(emit->as, mp_fun_table[fun_kind], fun_kind);
+    emit_native_mov_reg_qstr(emit, arg_reg, qst);
+    emit_native_call_ind(emit, fun_kind);
 }
 
 STATIC void emit_call_with_2_imm_args(emit_t *emit, mp_fun_kind_t fun_kind, mp_int_t arg_val1, int arg_reg1, mp_int_t arg_val2, int arg_reg2) {
     need_reg_all(emit);
     ASM_MOV_IMM_TO_REG(emit->as, arg_val1, arg_reg1);
     ASM_MOV_IMM_TO_REG(emit->as, arg_val2, arg_reg2);
-    ASM_CALL_IND(emit->as, mp_fun_table[fun_kind], fun_kind);
+    emit_native_call_ind(emit, fun_kind);
 }
 
-// the first arg is stored in the code aligned on a mp_uint_t boundary
-STATIC void emit_call_with_3_imm_args_and_first_aligned(emit_t *emit, mp_fun_kind_t fun_kind, mp_int_t arg_val1, int arg_reg1, mp_int_t arg_val2, int arg_reg2, mp_int_t arg_val3, int arg_reg3) {
+#if MICROPY_OPT_TIERED_NATIVE
+
+// Promoted code has fast paths with labels of their own, numbered after the
+// labels of the compiler.  The stack size pass only counts them, and then the
+// later passes, which emit the fast paths, have enough labels.
+STATIC bool tier_fast_path(emit_t *emit, mp_uint_t num_labels, mp_uint_t *label) {
+    if (!emit->tiered) {
+        return false;
+    }
+    *label = emit->tier_label_base + emit->tier_num_labels;
+    emit->tier_num_labels += num_labels;
+    return emit->pass > MP_PASS_STACK_SIZE;
+}
+
+#if TIER_CACHED_LOOKUPS
+// Promoted code does its lookups with the caches of the VM, giving each lookup
+// a byte for the hint that the VM keeps in the bytecode.  The bytes are only
+// allocated for the last pass, so the address is loaded with a fixed size.
+STATIC void emit_call_with_imm_arg_and_hint(emit_t *emit, mp_fun_kind_t fun_kind, mp_int_t arg_val, int arg_reg, int hint_reg) {
     need_reg_all(emit);
-    ASM_MOV_ALIGNED_IMM_TO_REG(emit->as, arg_val1, arg_reg1);
-    ASM_MOV_IMM_TO_REG(emit->as, arg_val2, arg_reg2);
-    ASM_MOV_IMM_TO_REG(emit->as, arg_val3, arg_reg3);
-    ASM_CALL_IND(emit->as, mp_fun_table[fun_kind], fun_kind);
+    byte *hint = NULL;
+    if (emit->tier_hints != NULL) {
+        hint = &emit->tier_hints[emit->tier_num_hints];
+    }
+    emit->tier_num_hints += 1;
+    ASM_MOV_IMM_TO_REG(emit->as, arg_val, arg_reg);
+    ASM_MOV_ALIGNED_IMM_TO_REG(emit->as, (mp_uint_t)hint, hint_reg);
+    emit_native_call_ind(emit, fun_kind);
 }
+#endif
+
+#endif
 
 // vtype of all n_pop objects is VTYPE_PYOBJ
 // Will convert any items that are not VTYPE_PYOBJ to this type and put them back on the stack.
@@ -841,9 +1351,14 @@ STATIC void emit_call_with_3_imm_args_and_first_aligned(emit_t *emit, mp_fun_kin
 STATIC void emit_get_stack_pointer_to_reg_for_pop(emit_t *emit, mp_uint_t reg_dest, mp_uint_t n_pop) {
     need_reg_all(emit);
 
-    // First, store any immediate values to their respective place on the stack.
+    // First, store any immediate values, and values in the registers of locals,
+    // to their respective place on the stack.
     for (mp_uint_t i = 0; i < n_pop; i++) {
         stack_info_t *si = &emit->stack_info[emit->stack_size - 1 - i];
+        if (si->kind == STACK_REG) {
+            si->kind = STACK_VALUE;
+            ASM_MOV_REG_TO_LOCAL(emit->as, si->data.u_reg, emit->stack_start + emit->stack_size - 1 - i);
+        }
         // must push any imm's to stack
         // must convert them to VTYPE_PYOBJ for viper code
         if (si->kind == STACK_IMM) {
@@ -853,11 +1368,8 @@ STATIC void emit_get_stack_pointer_to_reg_for_pop(emit_t *emit, mp_uint_t reg_de
                     ASM_MOV_IMM_TO_LOCAL_USING(emit->as, si->data.u_imm, emit->stack_start + emit->stack_size - 1 - i, reg_dest);
                     break;
                 case VTYPE_BOOL:
-                    if (si->data.u_imm == 0) {
-                        ASM_MOV_IMM_TO_LOCAL_USING(emit->as, (mp_uint_t)mp_const_false, emit->stack_start + emit->stack_size - 1 - i, reg_dest);
-                    } else {
-                        ASM_MOV_IMM_TO_LOCAL_USING(emit->as, (mp_uint_t)mp_const_true, emit->stack_start + emit->stack_size - 1 - i, reg_dest);
-                    }
+                    emit_native_mov_reg_const_obj(emit, reg_dest, si->data.u_imm == 0 ? MP_NATIVE_CONST_FALSE : MP_NATIVE_CONST_TRUE);
+                    ASM_MOV_REG_TO_LOCAL(emit->as, reg_dest, emit->stack_start + emit->stack_size - 1 - i);
                     si->vtype = VTYPE_PYOBJ;
                     break;
                 case VTYPE_INT:
@@ -865,6 +1377,12 @@ STATIC void emit_get_stack_pointer_to_reg_for_pop(emit_t *emit, mp_uint_t reg_de
                     ASM_MOV_IMM_TO_LOCAL_USING(emit->as, (uintptr_t)MP_OBJ_NEW_SMALL_INT(si->data.u_imm), emit->stack_start + emit->stack_size - 1 - i, reg_dest);
                     si->vtype = VTYPE_PYOBJ;
                     break;
+                #if VIPER_FLOAT
+                case VTYPE_FLOAT:
+                    // it's converted to an object below, like a float in a register
+                    ASM_MOV_IMM_TO_LOCAL_USING(emit->as, si->data.u_imm, emit->stack_start + emit->stack_size - 1 - i, reg_dest);
+                    break;
+                #endif
                 default:
                     // not handled
                     assert(0);
@@ -923,7 +1441,7 @@ STATIC void emit_native_import_name(emit_t *emit, qstr qst) {
         stack_info_t *top = peek_stack(emit, 0);
         if (top->vtype == VTYPE_PTR_NONE) {
             emit_pre_pop_discard(emit);
-            ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)mp_const_none, REG_ARG_2);
+            emit_native_mov_reg_const_obj(emit, REG_ARG_2, MP_NATIVE_CONST_NONE);
         } else {
             vtype_kind_t vtype_fromlist;
             emit_pre_pop_reg(emit, &vtype_fromlist, REG_ARG_2);
@@ -944,7 +1462,7 @@ STATIC void emit_native_import_name(emit_t *emit, qstr qst) {
         assert(vtype_level == VTYPE_PYOBJ);
     }
 
-    emit_call_with_imm_arg(emit, MP_F_IMPORT_NAME, qst, REG_ARG_1); // arg1 = import name
+    emit_call_with_qstr_arg(emit, MP_F_IMPORT_NAME, qst, REG_ARG_1); // arg1 = import name
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
 
@@ -954,7 +1472,7 @@ STATIC void emit_native_import_from(emit_t *emit, qstr qst) {
     vtype_kind_t vtype_module;
     emit_access_stack(emit, 1, &vtype_module, REG_ARG_1); // arg1 = module
     assert(vtype_module == VTYPE_PYOBJ);
-    emit_call_with_imm_arg(emit, MP_F_IMPORT_FROM, qst, REG_ARG_2); // arg2 = import name
+    emit_call_with_qstr_arg(emit, MP_F_IMPORT_FROM, qst, REG_ARG_2); // arg2 = import name
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
 
@@ -970,29 +1488,24 @@ STATIC void emit_native_import_star(emit_t *emit) {
 STATIC void emit_native_load_const_tok(emit_t *emit, mp_token_kind_t tok) {
     DEBUG_printf("load_const_tok(tok=%u)\n", tok);
     emit_native_pre(emit);
-    vtype_kind_t vtype;
-    mp_uint_t val;
     if (emit->do_viper_types) {
         switch (tok) {
-            case MP_TOKEN_KW_NONE: vtype = VTYPE_PTR_NONE; val = 0; break;
-            case MP_TOKEN_KW_FALSE: vtype = VTYPE_BOOL; val = 0; break;
-            case MP_TOKEN_KW_TRUE: vtype = VTYPE_BOOL; val = 1; break;
-            default:
-                assert(tok == MP_TOKEN_ELLIPSIS);
-                vtype = VTYPE_PYOBJ; val = (mp_uint_t)&mp_const_ellipsis_obj; break;
-        }
-    } else {
-        vtype = VTYPE_PYOBJ;
-        switch (tok) {
-            case MP_TOKEN_KW_NONE: val = (mp_uint_t)mp_const_none; break;
-            case MP_TOKEN_KW_FALSE: val = (mp_uint_t)mp_const_false; break;
-            case MP_TOKEN_KW_TRUE: val = (mp_uint_t)mp_const_true; break;
-            default:
-                assert(tok == MP_TOKEN_ELLIPSIS);
-                val = (mp_uint_t)&mp_const_ellipsis_obj; break;
+            case MP_TOKEN_KW_NONE: emit_post_push_imm(emit, VTYPE_PTR_NONE, 0); return;
+            case MP_TOKEN_KW_FALSE: emit_post_push_imm(emit, VTYPE_BOOL, 0); return;
+            case MP_TOKEN_KW_TRUE: emit_post_push_imm(emit, VTYPE_BOOL, 1); return;
+            default: break;
         }
     }
-    emit_post_push_imm(emit, vtype, val);
+    mp_native_const_obj_t id;
+    switch (tok) {
+        case MP_TOKEN_KW_NONE: id = MP_NATIVE_CONST_NONE; break;
+        case MP_TOKEN_KW_FALSE: id = MP_NATIVE_CONST_FALSE; break;
+        case MP_TOKEN_KW_TRUE: id = MP_NATIVE_CONST_TRUE; break;
+        default:
+            assert(tok == MP_TOKEN_ELLIPSIS);
+            id = MP_NATIVE_CONST_ELLIPSIS; break;
+    }
+    emit_post_push_const_obj(emit, id);
 }
 
 STATIC void emit_native_load_const_small_int(emit_t *emit, mp_int_t arg) {
@@ -1017,18 +1530,53 @@ STATIC void emit_native_load_const_str(emit_t *emit, qstr qst) {
         emit_post_push_imm(emit, VTYPE_PTR, (mp_uint_t)qstr_str(qst));
     } else
     */
+    #if MICROPY_PERSISTENT_CODE_SAVE
+    {
+        need_reg_single(emit, REG_RET, 0);
+        emit_native_mov_reg_qstr_obj(emit, REG_RET, qst);
+        emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
+    }
+    #else
     {
         emit_post_push_imm(emit, VTYPE_PYOBJ, (mp_uint_t)MP_OBJ_NEW_QSTR(qst));
     }
+    #endif
 }
 
 STATIC void emit_native_load_const_obj(emit_t *emit, mp_obj_t obj) {
     emit_native_pre(emit);
+    #if VIPER_FLOAT
+    if (emit->do_viper_types && mp_obj_is_float(obj)) {
+        // viper float constants are native, like int ones
+        union { mp_float_t f; mp_int_t i; } val;
+        val.f = mp_obj_float_get(obj);
+        emit_post_push_imm(emit, VTYPE_FLOAT, val.i);
+        return;
+    }
+    #endif
     need_reg_single(emit, REG_RET, 0);
-    ASM_MOV_ALIGNED_IMM_TO_REG(emit->as, (mp_uint_t)obj, REG_RET);
+    emit_native_mov_reg_obj(emit, REG_RET, obj);
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
 
+#if VIPER_FLOAT
+// Where a float constant meets an object (as an operand, a return value or a
+// local) it's an object too, as it was before viper had native floats
+STATIC void emit_native_box_float_const(emit_t *emit, mp_uint_t depth) {
+    stack_info_t *si = peek_stack(emit, depth);
+    if (si->kind != STACK_IMM || si->vtype != VTYPE_FLOAT) {
+        return;
+    }
+    union { mp_float_t f; mp_int_t i; } val;
+    val.i = si->data.u_imm;
+    need_reg_single(emit, REG_TEMP0, 0);
+    emit_native_mov_reg_obj(emit, REG_TEMP0, mp_obj_new_float(val.f));
+    ASM_MOV_REG_TO_LOCAL(emit->as, REG_TEMP0, emit->stack_start + emit->stack_size - 1 - depth);
+    si->kind = STACK_VALUE;
+    si->vtype = VTYPE_PYOBJ;
+}
+#endif
+
 STATIC void emit_native_load_null(emit_t *emit) {
     emit_native_pre(emit);
     emit_post_push_imm(emit, VTYPE_PYOBJ, 0);
@@ -1041,21 +1589,23 @@ STATIC void emit_native_load_fast(emit_t *emit, qstr qst, mp_uint_t local_num) {
         EMIT_NATIVE_VIPER_TYPE_ERROR(emit, "local '%q' used before type known", qst);
     }
     emit_native_pre(emit);
-    if (local_num == 0) {
-        emit_post_push_reg(emit, vtype, REG_LOCAL_1);
-    } else if (local_num == 1) {
-        emit_post_push_reg(emit, vtype, REG_LOCAL_2);
-    } else if (local_num == 2) {
-        emit_post_push_reg(emit, vtype, REG_LOCAL_3);
-    } else {
+    note_local_use(emit, local_num);
+    int reg = emit->local_reg[local_num];
+    if (reg < 0) {
+        reg = REG_TEMP0;
         need_reg_single(emit, REG_TEMP0, 0);
         if (emit->do_viper_types) {
-            ASM_MOV_LOCAL_TO_REG(emit->as, local_num - REG_LOCAL_NUM, REG_TEMP0);
+            ASM_MOV_LOCAL_TO_REG(emit->as, local_num, REG_TEMP0);
         } else {
             ASM_MOV_LOCAL_TO_REG(emit->as, STATE_START + emit->n_state - 1 - local_num, REG_TEMP0);
         }
-        emit_post_push_reg(emit, vtype, REG_TEMP0);
     }
+    #if MICROPY_OPT_TIERED_NATIVE
+    if (emit->tiered) {
+        ASM_JUMP_IF_OBJ_NULL(emit->as, reg, UNBOUND_LOCAL_LABEL(emit));
+    }
+    #endif
+    emit_post_push_reg(emit, vtype, reg);
 }
 
 STATIC void emit_native_load_deref(emit_t *emit, qstr qst, mp_uint_t local_num) {
@@ -1066,6 +1616,11 @@ STATIC void emit_native_load_deref(emit_t *emit, qstr qst, mp_uint_t local_num)
     int reg_base = REG_RET;
     emit_pre_pop_reg_flexible(emit, &vtype, &reg_base, -1, -1);
     ASM_LOAD_REG_REG_OFFSET(emit->as, REG_RET, reg_base, 1);
+    #if MICROPY_OPT_TIERED_NATIVE
+    if (emit->tiered) {
+        ASM_JUMP_IF_OBJ_NULL(emit->as, REG_RET, UNBOUND_LOCAL_LABEL(emit));
+    }
+    #endif
     // closed over vars are always Python objects
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
@@ -1073,7 +1628,7 @@ STATIC void emit_native_load_deref(emit_t *emit, qstr qst, mp_uint_t local_num)
 STATIC void emit_native_load_name(emit_t *emit, qstr qst) {
     DEBUG_printf("load_name(%s)\n", qstr_str(qst));
     emit_native_pre(emit);
-    emit_call_with_imm_arg(emit, MP_F_LOAD_NAME, qst, REG_ARG_1);
+    emit_call_with_qstr_arg(emit, MP_F_LOAD_NAME, qst, REG_ARG_1);
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
 
@@ -1093,8 +1648,23 @@ STATIC void emit_native_load_global(emit_t *emit, qstr qst) {
         emit_post_push_imm(emit, VTYPE_BUILTIN_CAST, VTYPE_PTR16);
     } else if (emit->do_viper_types && qst == MP_QSTR_ptr32) {
         emit_post_push_imm(emit, VTYPE_BUILTIN_CAST, VTYPE_PTR32);
+    #if VIPER_FLOAT
+    } else if (emit->do_viper_types && qst == MP_QSTR_float) {
+        emit_post_push_imm(emit, VTYPE_BUILTIN_CAST, VTYPE_FLOAT);
+    } else if (emit->do_viper_types && qst == MP_QSTR_ptrf32) {
+        emit_post_push_imm(emit, VTYPE_BUILTIN_CAST, VTYPE_PTRF32);
+    } else if (emit->do_viper_types && qst == MP_QSTR_ptrf64) {
+        emit_post_push_imm(emit, VTYPE_BUILTIN_CAST, VTYPE_PTRF64);
+    #endif
     } else {
-        emit_call_with_imm_arg(emit, MP_F_LOAD_GLOBAL, qst, REG_ARG_1);
+        #if TIER_CACHED_LOOKUPS
+        if (emit->tiered) {
+            emit_call_with_imm_arg_and_hint(emit, MP_F_LOAD_GLOBAL_CACHED, qst, REG_ARG_1, REG_ARG_2);
+            emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
+            return;
+        }
+        #endif
+        emit_call_with_qstr_arg(emit, MP_F_LOAD_GLOBAL, qst, REG_ARG_1);
         emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
     }
 }
@@ -1107,7 +1677,14 @@ STATIC void emit_native_load_attr(emit_t *emit, qstr qst) {
     vtype_kind_t vtype_base;
     emit_pre_pop_reg(emit, &vtype_base, REG_ARG_1); // arg1 = base
     assert(vtype_base == VTYPE_PYOBJ);
-    emit_call_with_imm_arg(emit, MP_F_LOAD_ATTR, qst, REG_ARG_2); // arg2 = attribute name
+    #if TIER_CACHED_LOOKUPS
+    if (emit->tiered) {
+        emit_call_with_imm_arg_and_hint(emit, MP_F_LOAD_ATTR_CACHED, qst, REG_ARG_2, REG_ARG_3);
+        emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
+        return;
+    }
+    #endif
+    emit_call_with_qstr_arg(emit, MP_F_LOAD_ATTR, qst, REG_ARG_2); // arg2 = attribute name
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
 
@@ -1116,7 +1693,13 @@ STATIC void emit_native_load_method(emit_t *emit, qstr qst) {
     emit_pre_pop_reg(emit, &vtype_base, REG_ARG_1); // arg1 = base
     assert(vtype_base == VTYPE_PYOBJ);
     emit_get_stack_pointer_to_reg_for_push(emit, REG_ARG_3, 2); // arg3 = dest ptr
-    emit_call_with_imm_arg(emit, MP_F_LOAD_METHOD, qst, REG_ARG_2); // arg2 = method name
+    #if TIER_CACHED_LOOKUPS
+    if (emit->tiered) {
+        emit_call_with_imm_arg_and_hint(emit, MP_F_LOAD_METHOD_CACHED, qst, REG_ARG_2, REG_ARG_4);
+        return;
+    }
+    #endif
+    emit_call_with_qstr_arg(emit, MP_F_LOAD_METHOD, qst, REG_ARG_2); // arg2 = method name
 }
 
 STATIC void emit_native_load_build_class(emit_t *emit) {
@@ -1125,6 +1708,59 @@ STATIC void emit_native_load_build_class(emit_t *emit) {
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
 
+#if VIPER_FLOAT
+// Loads an element of a ptrf32/ptrf64 array as a double, via xmm0.  The index
+// must be in a register because x64 scales it as part of the address.
+STATIC void emit_native_load_subscr_float(emit_t *emit) {
+    vtype_kind_t vtype_base, vtype_index;
+    int reg_base = REG_ARG_1;
+    int reg_index = REG_ARG_2;
+    emit_pre_pop_reg_flexible(emit, &vtype_index, &reg_index, REG_ARG_1, REG_ARG_1);
+    emit_pre_pop_reg_flexible(emit, &vtype_base, &reg_base, reg_index, reg_index);
+    if (vtype_index != VTYPE_INT && vtype_index != VTYPE_UINT) {
+        EMIT_NATIVE_VIPER_TYPE_ERROR(emit,
+            "can't load with '%q' index", vtype_to_qstr(vtype_index));
+    }
+    need_reg_single(emit, REG_RET, 0);
+    if (vtype_base == VTYPE_PTRF32) {
+        asm_x64_movss_mem_to_xmm(emit->as, reg_base, reg_index, ASM_X64_REG_XMM0);
+        asm_x64_cvtss2sd_xmm_xmm(emit->as, ASM_X64_REG_XMM0, ASM_X64_REG_XMM0);
+    } else {
+        asm_x64_movsd_mem_to_xmm(emit->as, reg_base, reg_index, ASM_X64_REG_XMM0);
+    }
+    asm_x64_movq_xmm_to_r64(emit->as, REG_RET, ASM_X64_REG_XMM0);
+    emit_post_push_reg(emit, VTYPE_FLOAT, REG_RET);
+}
+
+STATIC void emit_native_store_subscr_float(emit_t *emit) {
+    vtype_kind_t vtype_base, vtype_index, vtype_value;
+    int reg_base = REG_ARG_1;
+    int reg_index = REG_ARG_2;
+    int reg_value = REG_ARG_3;
+    emit_pre_pop_reg_flexible(emit, &vtype_index, &reg_index, REG_ARG_1, reg_value);
+    emit_pre_pop_reg_flexible(emit, &vtype_base, &reg_base, reg_index, reg_value);
+    emit_pre_pop_reg_flexible(emit, &vtype_value, &reg_value, reg_base, reg_index);
+    if (vtype_index != VTYPE_INT && vtype_index != VTYPE_UINT) {
+        EMIT_NATIVE_VIPER_TYPE_ERROR(emit,
+            "can't store with '%q' index", vtype_to_qstr(vtype_index));
+    }
+    if (vtype_value == VTYPE_FLOAT) {
+        asm_x64_movq_r64_to_xmm(emit->as, ASM_X64_REG_XMM0, reg_value);
+    } else if (vtype_value == VTYPE_INT) {
+        asm_x64_cvtsi2sd_r64_to_xmm(emit->as, ASM_X64_REG_XMM0, reg_value);
+    } else {
+        EMIT_NATIVE_VIPER_TYPE_ERROR(emit,
+            "can't store '%q'", vtype_to_qstr(vtype_value));
+    }
+    if (vtype_base == VTYPE_PTRF32) {
+        asm_x64_cvtsd2ss_xmm_xmm(emit->as, ASM_X64_REG_XMM0, ASM_X64_REG_XMM0);
+        asm_x64_movss_xmm_to_mem(emit->as, ASM_X64_REG_XMM0, reg_base, reg_index);
+    } else {
+        asm_x64_movsd_xmm_to_mem(emit->as, ASM_X64_REG_XMM0, reg_base, reg_index);
+    }
+}
+#endif
+
 STATIC void emit_native_load_subscr(emit_t *emit) {
     DEBUG_printf("load_subscr\n");
     // need to compile: base[index]
@@ -1147,6 +1783,10 @@ STATIC void emit_native_load_subscr(emit_t *emit) {
         emit_pre_pop_reg(emit, &vtype_base, REG_ARG_1);
         emit_call_with_imm_arg(emit, MP_F_OBJ_SUBSCR, (mp_uint_t)MP_OBJ_SENTINEL, REG_ARG_3);
         emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
+    #if VIPER_FLOAT
+    } else if (vtype_base == VTYPE_PTRF32 || vtype_base == VTYPE_PTRF64) {
+        emit_native_load_subscr_float(emit);
+    #endif
     } else {
         // viper load
         // TODO The different machine architectures have very different
@@ -1160,6 +1800,8 @@ STATIC void emit_native_load_subscr(emit_t *emit) {
             int reg_base = REG_ARG_1;
             int reg_index = REG_ARG_2;
             emit_pre_pop_reg_flexible(emit, &vtype_base, &reg_base, reg_index, reg_index);
+            need_reg_single(emit, reg_index, 0);
+            need_reg_single(emit, REG_RET, 0);
             switch (vtype_base) {
                 case VTYPE_PTR8: {
                     // pointer to 8-bit memory
@@ -1223,6 +1865,7 @@ STATIC void emit_native_load_subscr(emit_t *emit) {
             int reg_index = REG_ARG_2;
             emit_pre_pop_reg_flexible(emit, &vtype_index, &reg_index, REG_ARG_1, REG_ARG_1);
             emit_pre_pop_reg(emit, &vtype_base, REG_ARG_1);
+            need_reg_single(emit, REG_RET, 0);
             if (vtype_index != VTYPE_INT && vtype_index != VTYPE_UINT) {
                 EMIT_NATIVE_VIPER_TYPE_ERROR(emit,
                     "can't load with '%q' index", vtype_to_qstr(vtype_index));
@@ -1262,16 +1905,18 @@ STATIC void emit_native_load_subscr(emit_t *emit) {
 
 STATIC void emit_native_store_fast(emit_t *emit, qstr qst, mp_uint_t local_num) {
     vtype_kind_t vtype;
-    if (local_num == 0) {
-        emit_pre_pop_reg(emit, &vtype, REG_LOCAL_1);
-    } else if (local_num == 1) {
-        emit_pre_pop_reg(emit, &vtype, REG_LOCAL_2);
-    } else if (local_num == 2) {
-        emit_pre_pop_reg(emit, &vtype, REG_LOCAL_3);
+    note_local_use(emit, local_num);
+    #if VIPER_FLOAT
+    if (emit->local_vtype[local_num] == VTYPE_PYOBJ) {
+        emit_native_box_float_const(emit, 0);
+    }
+    #endif
+    if (emit->local_reg[local_num] >= 0) {
+        emit_pre_pop_reg(emit, &vtype, emit->local_reg[local_num]);
     } else {
         emit_pre_pop_reg(emit, &vtype, REG_TEMP0);
         if (emit->do_viper_types) {
-            ASM_MOV_REG_TO_LOCAL(emit->as, REG_TEMP0, local_num - REG_LOCAL_NUM);
+            ASM_MOV_REG_TO_LOCAL(emit->as, REG_TEMP0, local_num);
         } else {
             ASM_MOV_REG_TO_LOCAL(emit->as, REG_TEMP0, STATE_START + emit->n_state - 1 - local_num);
         }
@@ -1309,7 +1954,7 @@ STATIC void emit_native_store_name(emit_t *emit, qstr qst) {
     vtype_kind_t vtype;
     emit_pre_pop_reg(emit, &vtype, REG_ARG_2);
     assert(vtype == VTYPE_PYOBJ);
-    emit_call_with_imm_arg(emit, MP_F_STORE_NAME, qst, REG_ARG_1); // arg1 = name
+    emit_call_with_qstr_arg(emit, MP_F_STORE_NAME, qst, REG_ARG_1); // arg1 = name
     emit_post(emit);
 }
 
@@ -1322,7 +1967,7 @@ STATIC void emit_native_store_global(emit_t *emit, qstr qst) {
         emit_call_with_imm_arg(emit, MP_F_CONVERT_NATIVE_TO_OBJ, vtype, REG_ARG_2); // arg2 = type
         ASM_MOV_REG_REG(emit->as, REG_ARG_2, REG_RET);
     }
-    emit_call_with_imm_arg(emit, MP_F_STORE_GLOBAL, qst, REG_ARG_1); // arg1 = name
+    emit_call_with_qstr_arg(emit, MP_F_STORE_GLOBAL, qst, REG_ARG_1); // arg1 = name
     emit_post(emit);
 }
 
@@ -1331,7 +1976,14 @@ STATIC void emit_native_store_attr(emit_t *emit, qstr qst) {
     emit_pre_pop_reg_reg(emit, &vtype_base, REG_ARG_1, &vtype_val, REG_ARG_3); // arg1 = base, arg3 = value
     assert(vtype_base == VTYPE_PYOBJ);
     assert(vtype_val == VTYPE_PYOBJ);
-    emit_call_with_imm_arg(emit, MP_F_STORE_ATTR, qst, REG_ARG_2); // arg2 = attribute name
+    #if TIER_CACHED_LOOKUPS
+    if (emit->tiered) {
+        emit_call_with_imm_arg_and_hint(emit, MP_F_STORE_ATTR_CACHED, qst, REG_ARG_2, REG_ARG_4);
+        emit_post(emit);
+        return;
+    }
+    #endif
+    emit_call_with_qstr_arg(emit, MP_F_STORE_ATTR, qst, REG_ARG_2); // arg2 = attribute name
     emit_post(emit);
 }
 
@@ -1355,6 +2007,10 @@ STATIC void emit_native_store_subscr(emit_t *emit) {
         }
         emit_pre_pop_reg_reg_reg(emit, &vtype_index, REG_ARG_2, &vtype_base, REG_ARG_1, &vtype_value, REG_ARG_3);
         emit_call(emit, MP_F_OBJ_SUBSCR);
+    #if VIPER_FLOAT
+    } else if (vtype_base == VTYPE_PTRF32 || vtype_base == VTYPE_PTRF64) {
+        emit_native_store_subscr_float(emit);
+    #endif
     } else {
         // viper store
         // TODO The different machine architectures have very different
@@ -1376,6 +2032,7 @@ STATIC void emit_native_store_subscr(emit_t *emit) {
             #else
             emit_pre_pop_reg_flexible(emit, &vtype_value, &reg_value, reg_base, reg_index);
             #endif
+            need_reg_single(emit, reg_index, 0);
             if (vtype_value != VTYPE_BOOL && vtype_value != VTYPE_INT && vtype_value != VTYPE_UINT) {
                 EMIT_NATIVE_VIPER_TYPE_ERROR(emit,
                     "can't store '%q'", vtype_to_qstr(vtype_value));
@@ -1516,6 +2173,16 @@ STATIC void emit_native_store_subscr(emit_t *emit) {
 }
 
 STATIC void emit_native_delete_fast(emit_t *emit, qstr qst, mp_uint_t local_num) {
+    #if MICROPY_OPT_TIERED_NATIVE
+    if (emit->tiered) {
+        // promoted code checks every access, so it can be compliant
+        emit_native_load_fast(emit, qst, local_num);
+        emit_pre_pop_discard(emit);
+        emit_native_load_null(emit);
+        emit_native_store_fast(emit, qst, local_num);
+        return;
+    }
+    #endif
     // TODO: This is not compliant implementation. We could use MP_OBJ_SENTINEL
     // to mark deleted vars but then every var would need to be checked on
     // each access. Very inefficient, so just set value to None to enable GC.
@@ -1528,17 +2195,22 @@ STATIC void emit_native_delete_deref(emit_t *emit, qstr qst, mp_uint_t local_num
     (void)emit;
     (void)qst;
     (void)local_num;
+    #if MICROPY_OPT_TIERED_NATIVE
+    if (emit->tiered) {
+        EMIT_NATIVE_TIER_REJECT(emit, "native del of closed over variable");
+    }
+    #endif
 }
 
 STATIC void emit_native_delete_name(emit_t *emit, qstr qst) {
     emit_native_pre(emit);
-    emit_call_with_imm_arg(emit, MP_F_DELETE_NAME, qst, REG_ARG_1);
+    emit_call_with_qstr_arg(emit, MP_F_DELETE_NAME, qst, REG_ARG_1);
     emit_post(emit);
 }
 
 STATIC void emit_native_delete_global(emit_t *emit, qstr qst) {
     emit_native_pre(emit);
-    emit_call_with_imm_arg(emit, MP_F_DELETE_GLOBAL, qst, REG_ARG_1);
+    emit_call_with_qstr_arg(emit, MP_F_DELETE_GLOBAL, qst, REG_ARG_1);
     emit_post(emit);
 }
 
@@ -1546,7 +2218,10 @@ STATIC void emit_native_delete_attr(emit_t *emit, qstr qst) {
     vtype_kind_t vtype_base;
     emit_pre_pop_reg(emit, &vtype_base, REG_ARG_1); // arg1 = base
     assert(vtype_base == VTYPE_PYOBJ);
-    emit_call_with_2_imm_args(emit, MP_F_STORE_ATTR, qst, REG_ARG_2, (mp_uint_t)MP_OBJ_NULL, REG_ARG_3); // arg2 = attribute name, arg3 = value (null for delete)
+    need_reg_all(emit);
+    emit_native_mov_reg_qstr(emit, REG_ARG_2, qst); // arg2 = attribute name
+    ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)MP_OBJ_NULL, REG_ARG_3); // arg3 = value (null for delete)
+    emit_native_call_ind(emit, MP_F_STORE_ATTR);
     emit_post(emit);
 }
 
@@ -1592,11 +2267,26 @@ STATIC void emit_native_rot_three(emit_t *emit) {
     emit_post_push_reg_reg_reg(emit, vtype0, REG_TEMP0, vtype2, REG_TEMP2, vtype1, REG_TEMP1);
 }
 
+#if MICROPY_OPT_TIERED_NATIVE
+// Promoted code checks for pending exceptions and lets other threads run on
+// each loop iteration, like the VM does
+STATIC void emit_native_tier_loop_check(emit_t *emit, mp_uint_t label) {
+    // a label is behind us if it has already been assigned in this pass
+    if (emit->tiered && emit->as->base.label_offsets[label] <= mp_asm_base_get_code_pos(&emit->as->base)) {
+        emit_call(emit, MP_F_NATIVE_LOOP_CHECK);
+    }
+}
+#else
+#define emit_native_tier_loop_check(emit, label) (void)0
+#endif
+
 STATIC void emit_native_jump(emit_t *emit, mp_uint_t label) {
     DEBUG_printf("jump(label=" UINT_FMT ")\n", label);
     emit_native_pre(emit);
     // need to commit stack because we are jumping elsewhere
     need_stack_settled(emit);
+    emit_native_tier_loop_check(emit, label);
+    note_jump(emit, label);
     ASM_JUMP(emit->as, label);
     emit_post(emit);
 }
@@ -1630,6 +2320,30 @@ STATIC void emit_native_jump_helper(emit_t *emit, bool pop) {
 
 STATIC void emit_native_pop_jump_if(emit_t *emit, bool cond, mp_uint_t label) {
     DEBUG_printf("pop_jump_if(cond=%u, label=" UINT_FMT ")\n", cond, label);
+    emit_native_tier_loop_check(emit, label);
+    note_jump(emit, label);
+    #if MICROPY_OPT_TIERED_NATIVE
+    mp_uint_t l_skip;
+    if (peek_vtype(emit, 0) == VTYPE_PYOBJ && tier_fast_path(emit, 1, &l_skip)) {
+        // test True and False, which comparisons give, without a call
+        vtype_kind_t vtype;
+        emit_pre_pop_reg(emit, &vtype, REG_ARG_1);
+        need_stack_settled(emit);
+        ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)mp_const_true, REG_RET);
+        ASM_JUMP_IF_REG_EQ(emit->as, REG_ARG_1, REG_RET, cond ? label : l_skip);
+        ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)mp_const_false, REG_RET);
+        ASM_JUMP_IF_REG_EQ(emit->as, REG_ARG_1, REG_RET, cond ? l_skip : label);
+        emit_call(emit, MP_F_OBJ_IS_TRUE);
+        if (cond) {
+            ASM_JUMP_IF_REG_NONZERO(emit->as, REG_RET, label);
+        } else {
+            ASM_JUMP_IF_REG_ZERO(emit->as, REG_RET, label);
+        }
+        mp_asm_base_label_assign(&emit->as->base, l_skip);
+        emit_post(emit);
+        return;
+    }
+    #endif
     emit_native_jump_helper(emit, true);
     if (cond) {
         ASM_JUMP_IF_REG_NONZERO(emit->as, REG_RET, label);
@@ -1641,6 +2355,7 @@ STATIC void emit_native_pop_jump_if(emit_t *emit, bool cond, mp_uint_t label) {
 
 STATIC void emit_native_jump_if_or_pop(emit_t *emit, bool cond, mp_uint_t label) {
     DEBUG_printf("jump_if_or_pop(cond=%u, label=" UINT_FMT ")\n", cond, label);
+    note_jump(emit, label);
     emit_native_jump_helper(emit, false);
     if (cond) {
         ASM_JUMP_IF_REG_NONZERO(emit->as, REG_RET, label);
@@ -1653,11 +2368,21 @@ STATIC void emit_native_jump_if_or_pop(emit_t *emit, bool cond, mp_uint_t label)
 
 STATIC void emit_native_break_loop(emit_t *emit, mp_uint_t label, mp_uint_t except_depth) {
     (void)except_depth;
+    #if MICROPY_OPT_TIERED_NATIVE
+    if (emit->tiered && except_depth > 0) {
+        EMIT_NATIVE_TIER_REJECT(emit, "native break out of try");
+    }
+    #endif
     emit_native_jump(emit, label & ~MP_EMIT_BREAK_FROM_FOR); // TODO properly
 }
 
 STATIC void emit_native_continue_loop(emit_t *emit, mp_uint_t label, mp_uint_t except_depth) {
     (void)except_depth;
+    #if MICROPY_OPT_TIERED_NATIVE
+    if (emit->tiered && except_depth > 0) {
+        EMIT_NATIVE_TIER_REJECT(emit, "native continue out of try");
+    }
+    #endif
     emit_native_jump(emit, label); // TODO properly
 }
 
@@ -1670,7 +2395,7 @@ STATIC void emit_native_setup_with(emit_t *emit, mp_uint_t label) {
     emit_access_stack(emit, 1, &vtype, REG_ARG_1); // arg1 = ctx_mgr
     assert(vtype == VTYPE_PYOBJ);
     emit_get_stack_pointer_to_reg_for_push(emit, REG_ARG_3, 2); // arg3 = dest ptr
-    emit_call_with_imm_arg(emit, MP_F_LOAD_METHOD, MP_QSTR___exit__, REG_ARG_2);
+    emit_call_with_qstr_arg(emit, MP_F_LOAD_METHOD, MP_QSTR___exit__, REG_ARG_2);
     // stack: (..., ctx_mgr, __exit__, self)
 
     emit_pre_pop_reg(emit, &vtype, REG_ARG_3); // self
@@ -1683,7 +2408,7 @@ STATIC void emit_native_setup_with(emit_t *emit, mp_uint_t label) {
 
     // get __enter__ method
     emit_get_stack_pointer_to_reg_for_push(emit, REG_ARG_3, 2); // arg3 = dest ptr
-    emit_call_with_imm_arg(emit, MP_F_LOAD_METHOD, MP_QSTR___enter__, REG_ARG_2); // arg2 = method name
+    emit_call_with_qstr_arg(emit, MP_F_LOAD_METHOD, MP_QSTR___enter__, REG_ARG_2); // arg2 = method name
     // stack: (..., __exit__, self, __enter__, self)
 
     // call __enter__ method
@@ -1694,11 +2419,11 @@ STATIC void emit_native_setup_with(emit_t *emit, mp_uint_t label) {
 
     // need to commit stack because we may jump elsewhere
     need_stack_settled(emit);
-    emit_get_stack_pointer_to_reg_for_push(emit, REG_ARG_1, sizeof(nlr_buf_t) / sizeof(mp_uint_t)); // arg1 = pointer to nlr buf
+    emit_get_stack_pointer_to_reg_for_push(emit, REG_ARG_1, NLR_BUF_WORDS); // arg1 = pointer to nlr buf
     emit_call(emit, MP_F_NLR_PUSH);
     ASM_JUMP_IF_REG_NONZERO(emit->as, REG_RET, label);
 
-    emit_access_stack(emit, sizeof(nlr_buf_t) / sizeof(mp_uint_t) + 1, &vtype, REG_RET); // access return value of __enter__
+    emit_access_stack(emit, NLR_BUF_WORDS + 1, &vtype, REG_RET); // access return value of __enter__
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET); // push return value of __enter__
     // stack: (..., __exit__, self, as_value, nlr_buf, as_value)
 }
@@ -1709,13 +2434,13 @@ STATIC void emit_native_with_cleanup(emit_t *emit, mp_uint_t label) {
     // stack: (..., __exit__, self, as_value, nlr_buf)
     emit_native_pre(emit);
     emit_call(emit, MP_F_NLR_POP);
-    adjust_stack(emit, -(mp_int_t)(sizeof(nlr_buf_t) / sizeof(mp_uint_t)) - 1);
+    adjust_stack(emit, -(mp_int_t)(NLR_BUF_WORDS) - 1);
     // stack: (..., __exit__, self)
 
     // call __exit__
-    emit_post_push_imm(emit, VTYPE_PYOBJ, (mp_uint_t)mp_const_none);
-    emit_post_push_imm(emit, VTYPE_PYOBJ, (mp_uint_t)mp_const_none);
-    emit_post_push_imm(emit, VTYPE_PYOBJ, (mp_uint_t)mp_const_none);
+    emit_post_push_const_obj(emit, MP_NATIVE_CONST_NONE);
+    emit_post_push_const_obj(emit, MP_NATIVE_CONST_NONE);
+    emit_post_push_const_obj(emit, MP_NATIVE_CONST_NONE);
     emit_get_stack_pointer_to_reg_for_pop(emit, REG_ARG_3, 5);
     emit_call_with_2_imm_args(emit, MP_F_CALL_METHOD_N_KW, 3, REG_ARG_1, 0, REG_ARG_2);
 
@@ -1749,7 +2474,7 @@ STATIC void emit_native_with_cleanup(emit_t *emit, mp_uint_t label) {
     ASM_LOAD_REG_REG_OFFSET(emit->as, REG_ARG_2, REG_ARG_1, 0); // get type(exc)
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_ARG_2); // push type(exc)
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_ARG_1); // push exc value
-    emit_post_push_imm(emit, VTYPE_PYOBJ, (mp_uint_t)mp_const_none); // traceback info
+    emit_post_push_const_obj(emit, MP_NATIVE_CONST_NONE); // traceback info
     // stack: (..., exc, __exit__, self, type(exc), exc, traceback)
 
     // call __exit__ method
@@ -1766,7 +2491,7 @@ STATIC void emit_native_with_cleanup(emit_t *emit, mp_uint_t label) {
 
     // replace exc with None
     emit_pre_pop_discard(emit);
-    emit_post_push_imm(emit, VTYPE_PYOBJ, (mp_uint_t)mp_const_none);
+    emit_post_push_const_obj(emit, MP_NATIVE_CONST_NONE);
 
     // end of with cleanup nlr_catch block
     emit_native_label_assign(emit, label + 1);
@@ -1776,7 +2501,7 @@ STATIC void emit_native_setup_except(emit_t *emit, mp_uint_t label) {
     emit_native_pre(emit);
     // need to commit stack because we may jump elsewhere
     need_stack_settled(emit);
-    emit_get_stack_pointer_to_reg_for_push(emit, REG_ARG_1, sizeof(nlr_buf_t) / sizeof(mp_uint_t)); // arg1 = pointer to nlr buf
+    emit_get_stack_pointer_to_reg_for_push(emit, REG_ARG_1, NLR_BUF_WORDS); // arg1 = pointer to nlr buf
     emit_call(emit, MP_F_NLR_PUSH);
     ASM_JUMP_IF_REG_NONZERO(emit->as, REG_RET, label);
     emit_post(emit);
@@ -1831,7 +2556,7 @@ STATIC void emit_native_for_iter_end(emit_t *emit) {
 STATIC void emit_native_pop_block(emit_t *emit) {
     emit_native_pre(emit);
     emit_call(emit, MP_F_NLR_POP);
-    adjust_stack(emit, -(mp_int_t)(sizeof(nlr_buf_t) / sizeof(mp_uint_t)) + 1);
+    adjust_stack(emit, -(mp_int_t)(NLR_BUF_WORDS) + 1);
     emit_post(emit);
 }
 
@@ -1840,7 +2565,7 @@ STATIC void emit_native_pop_except(emit_t *emit) {
     /*
     emit_native_pre(emit);
     emit_call(emit, MP_F_NLR_POP);
-    adjust_stack(emit, -(mp_int_t)(sizeof(nlr_buf_t) / sizeof(mp_uint_t)));
+    adjust_stack(emit, -(mp_int_t)(NLR_BUF_WORDS));
     emit_post(emit);
     */
 }
@@ -1851,6 +2576,16 @@ STATIC void emit_native_unary_op(emit_t *emit, mp_unary_op_t op) {
     if (vtype == VTYPE_PYOBJ) {
         emit_call_with_imm_arg(emit, MP_F_UNARY_OP, op, REG_ARG_1);
         emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
+    #if VIPER_FLOAT
+    } else if (vtype == VTYPE_FLOAT && op == MP_UNARY_OP_POSITIVE) {
+        emit_post_push_reg(emit, VTYPE_FLOAT, REG_ARG_2);
+    } else if (vtype == VTYPE_FLOAT && op == MP_UNARY_OP_NEGATIVE) {
+        // flip the sign bit
+        need_reg_single(emit, REG_RET, 0);
+        ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)1 << 63, REG_RET);
+        ASM_XOR_REG_REG(emit->as, REG_RET, REG_ARG_2);
+        emit_post_push_reg(emit, VTYPE_FLOAT, REG_RET);
+    #endif
     } else {
         adjust_stack(emit, 1);
         EMIT_NATIVE_VIPER_TYPE_ERROR(emit,
@@ -1858,8 +2593,147 @@ STATIC void emit_native_unary_op(emit_t *emit, mp_unary_op_t op) {
     }
 }
 
+#if MICROPY_OPT_TIERED_NATIVE && (N_X64 || N_X86)
+// Promoted code adds, subtracts and compares small ints without a call.  The
+// operands are in REG_ARG_2 and REG_ARG_3, and if this returns true then it
+// has emitted the fast path, which leaves the result in REG_RET and jumps to
+// l_done, and the slow path is to follow.
+STATIC bool emit_native_tier_small_int_op(emit_t *emit, mp_binary_op_t op, mp_uint_t *l_done) {
+    bool is_add = op == MP_BINARY_OP_ADD || op == MP_BINARY_OP_INPLACE_ADD;
+    bool is_sub = op == MP_BINARY_OP_SUBTRACT || op == MP_BINARY_OP_INPLACE_SUBTRACT;
+    bool is_cmp = MP_BINARY_OP_LESS <= op && op <= MP_BINARY_OP_NOT_EQUAL;
+    mp_uint_t l_slow;
+    if (!(is_add || is_sub || is_cmp) || !tier_fast_path(emit, 2, &l_slow)) {
+        return false;
+    }
+    *l_done = l_slow + 1;
+    need_reg_all(emit);
+
+    // both operands are small ints if they both have the tag bit set, and then
+    // REG_ARG_1 is left as 1
+    ASM_MOV_IMM_TO_REG(emit->as, 1, REG_ARG_1);
+    ASM_AND_REG_REG(emit->as, REG_ARG_1, REG_ARG_2);
+    ASM_AND_REG_REG(emit->as, REG_ARG_1, REG_ARG_3);
+    ASM_JUMP_IF_OBJ_NULL(emit->as, REG_ARG_1, l_slow);
+
+    if (is_cmp) {
+        // small ints compare the same as their objects; the jumps are for the
+        // opposite of each comparison, see emit_native_binary_op for the order
+        #if N_X64
+        static const byte ccs[6] = {
+            ASM_X64_CC_JGE, ASM_X64_CC_JLE, ASM_X64_CC_JNE,
+            ASM_X64_CC_JG, ASM_X64_CC_JL, ASM_X64_CC_JE,
+        };
+        asm_x64_cmp_r64_with_r64(emit->as, REG_ARG_3, REG_ARG_2);
+        ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)mp_const_false, REG_RET);
+        asm_x64_jcc_label(emit->as, ccs[op - MP_BINARY_OP_LESS], *l_done);
+        #else
+        static const byte ccs[6] = {
+            ASM_X86_CC_JGE, ASM_X86_CC_JLE, ASM_X86_CC_JNE,
+            ASM_X86_CC_JG, ASM_X86_CC_JL, ASM_X86_CC_JE,
+        };
+        asm_x86_cmp_r32_with_r32(emit->as, REG_ARG_3, REG_ARG_2);
+        ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)mp_const_false, REG_RET);
+        asm_x86_jcc_label(emit->as, ccs[op - MP_BINARY_OP_LESS], *l_done);
+        #endif
+        ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)mp_const_true, REG_RET);
+    } else {
+        // (2a + 1) - 1 + (2b + 1) is 2(a + b) + 1, and (2a + 1) - (2b + 1) + 1
+        // is 2(a - b) + 1, which can only overflow before adding the 1
+        ASM_MOV_REG_REG(emit->as, REG_RET, REG_ARG_2);
+        if (is_add) {
+            ASM_SUB_REG_REG(emit->as, REG_RET, REG_ARG_1);
+            ASM_ADD_REG_REG(emit->as, REG_RET, REG_ARG_3);
+        } else {
+            ASM_SUB_REG_REG(emit->as, REG_RET, REG_ARG_3);
+        }
+        #if N_X64
+        asm_x64_jcc_label(emit->as, ASM_X64_CC_JO, l_slow);
+        #else
+        asm_x86_jcc_label(emit->as, ASM_X86_CC_JO, l_slow);
+        #endif
+        if (is_sub) {
+            ASM_ADD_REG_REG(emit->as, REG_RET, REG_ARG_1);
+        }
+    }
+    ASM_JUMP(emit->as, *l_done);
+    mp_asm_base_label_assign(&emit->as->base, l_slow);
+    return true;
+}
+#endif
+
+#if VIPER_FLOAT
+// Does arithmetic and comparisons on floats, promoting an int operand.  The
+// operands go in xmm0 and xmm1 and the result comes back to a general register.
+STATIC void emit_native_binary_op_float(emit_t *emit, mp_binary_op_t op) {
+    vtype_kind_t vtype_lhs, vtype_rhs;
+    int reg_rhs = REG_ARG_3;
+    int reg_lhs = REG_ARG_2;
+    emit_pre_pop_reg_flexible(emit, &vtype_rhs, &reg_rhs, REG_RET, REG_ARG_2);
+    emit_pre_pop_reg_flexible(emit, &vtype_lhs, &reg_lhs, reg_rhs, reg_rhs);
+    need_reg_single(emit, REG_RET, 0);
+    if (vtype_lhs == VTYPE_FLOAT) {
+        asm_x64_movq_r64_to_xmm(emit->as, ASM_X64_REG_XMM0, reg_lhs);
+    } else {
+        asm_x64_cvtsi2sd_r64_to_xmm(emit->as, ASM_X64_REG_XMM0, reg_lhs);
+    }
+    if (vtype_rhs == VTYPE_FLOAT) {
+        asm_x64_movq_r64_to_xmm(emit->as, ASM_X64_REG_XMM1, reg_rhs);
+    } else {
+        asm_x64_cvtsi2sd_r64_to_xmm(emit->as, ASM_X64_REG_XMM1, reg_rhs);
+    }
+    if (op == MP_BINARY_OP_ADD || op == MP_BINARY_OP_INPLACE_ADD) {
+        asm_x64_addsd_xmm_xmm(emit->as, ASM_X64_REG_XMM0, ASM_X64_REG_XMM1);
+    } else if (op == MP_BINARY_OP_SUBTRACT || op == MP_BINARY_OP_INPLACE_SUBTRACT) {
+        asm_x64_subsd_xmm_xmm(emit->as, ASM_X64_REG_XMM0, ASM_X64_REG_XMM1);
+    } else if (op == MP_BINARY_OP_MULTIPLY || op == MP_BINARY_OP_INPLACE_MULTIPLY) {
+        asm_x64_mulsd_xmm_xmm(emit->as, ASM_X64_REG_XMM0, ASM_X64_REG_XMM1);
+    } else if (op == MP_BINARY_OP_TRUE_DIVIDE || op == MP_BINARY_OP_INPLACE_TRUE_DIVIDE) {
+        // like C, dividing by zero gives an inf or a nan rather than raising
+        asm_x64_divsd_xmm_xmm(emit->as, ASM_X64_REG_XMM0, ASM_X64_REG_XMM1);
+    } else if (MP_BINARY_OP_LESS <= op && op <= MP_BINARY_OP_NOT_EQUAL) {
+        // cmpsd only has less-than forms, so "more" swaps the operands; the
+        // result is all ones for true, which is negated to give 1
+        static byte ops[6] = {
+            ASM_X64_CMP_LT,
+            ASM_X64_CMP_LT,
+            ASM_X64_CMP_EQ,
+            ASM_X64_CMP_LE,
+            ASM_X64_CMP_LE,
+            ASM_X64_CMP_NEQ,
+        };
+        int cmp_type = ops[op - MP_BINARY_OP_LESS];
+        int reg_res = ASM_X64_REG_XMM0;
+        if (op == MP_BINARY_OP_MORE || op == MP_BINARY_OP_MORE_EQUAL) {
+            asm_x64_cmpsd_xmm_xmm(emit->as, cmp_type, ASM_X64_REG_XMM1, ASM_X64_REG_XMM0);
+            reg_res = ASM_X64_REG_XMM1;
+        } else {
+            asm_x64_cmpsd_xmm_xmm(emit->as, cmp_type, ASM_X64_REG_XMM0, ASM_X64_REG_XMM1);
+        }
+        asm_x64_movq_xmm_to_r64(emit->as, REG_RET, reg_res);
+        asm_x64_neg_r64(emit->as, REG_RET);
+        emit_post_push_reg(emit, VTYPE_BOOL, REG_RET);
+        return;
+    } else {
+        adjust_stack(emit, 1);
+        EMIT_NATIVE_VIPER_TYPE_ERROR(emit,
+            "binary op %q not implemented", mp_binary_op_method_name[op]);
+        return;
+    }
+    asm_x64_movq_xmm_to_r64(emit->as, REG_RET, ASM_X64_REG_XMM0);
+    emit_post_push_reg(emit, VTYPE_FLOAT, REG_RET);
+}
+#endif
+
 STATIC void emit_native_binary_op(emit_t *emit, mp_binary_op_t op) {
     DEBUG_printf("binary_op(" UINT_FMT ")\n", op);
+    #if VIPER_FLOAT
+    if (peek_vtype(emit, 1) == VTYPE_PYOBJ) {
+        emit_native_box_float_const(emit, 0);
+    } else if (peek_vtype(emit, 0) == VTYPE_PYOBJ) {
+        emit_native_box_float_const(emit, 1);
+    }
+    #endif
     vtype_kind_t vtype_lhs = peek_vtype(emit, 1);
     vtype_kind_t vtype_rhs = peek_vtype(emit, 0);
     if (vtype_lhs == VTYPE_INT && vtype_rhs == VTYPE_INT) {
@@ -1997,8 +2871,23 @@ STATIC void emit_native_binary_op(emit_t *emit, mp_binary_op_t op) {
             EMIT_NATIVE_VIPER_TYPE_ERROR(emit,
                 "binary op %q not implemented", mp_binary_op_method_name[op]);
         }
+    #if VIPER_FLOAT
+    } else if ((vtype_lhs == VTYPE_FLOAT || vtype_rhs == VTYPE_FLOAT)
+        && (vtype_lhs == VTYPE_FLOAT || vtype_lhs == VTYPE_INT)
+        && (vtype_rhs == VTYPE_FLOAT || vtype_rhs == VTYPE_INT)) {
+        emit_native_binary_op_float(emit, op);
+    #endif
     } else if (vtype_lhs == VTYPE_PYOBJ && vtype_rhs == VTYPE_PYOBJ) {
         emit_pre_pop_reg_reg(emit, &vtype_rhs, REG_ARG_3, &vtype_lhs, REG_ARG_2);
+        #if MICROPY_OPT_TIERED_NATIVE && (N_X64 || N_X86)
+        mp_uint_t l_done;
+        if (emit_native_tier_small_int_op(emit, op, &l_done)) {
+            emit_call_with_imm_arg(emit, MP_F_BINARY_OP, op, REG_ARG_1);
+            mp_asm_base_label_assign(&emit->as->base, l_done);
+            emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
+            return;
+        }
+        #endif
         bool invert = false;
         if (op == MP_BINARY_OP_NOT_IN) {
             invert = true;
@@ -2070,7 +2959,9 @@ STATIC void emit_native_build_slice(emit_t *emit, mp_uint_t n_args) {
         emit_pre_pop_reg_reg(emit, &vtype_stop, REG_ARG_2, &vtype_start, REG_ARG_1); // arg1 = start, arg2 = stop
         assert(vtype_start == VTYPE_PYOBJ);
         assert(vtype_stop == VTYPE_PYOBJ);
-        emit_call_with_imm_arg(emit, MP_F_NEW_SLICE, (mp_uint_t)mp_const_none, REG_ARG_3); // arg3 = step
+        need_reg_all(emit);
+        emit_native_mov_reg_const_obj(emit, REG_ARG_3, MP_NATIVE_CONST_NONE); // arg3 = step
+        emit_native_call_ind(emit, MP_F_NEW_SLICE);
         emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
     } else {
         assert(n_args == 3);
@@ -2136,14 +3027,18 @@ STATIC void emit_native_make_function(emit_t *emit, scope_t *scope, mp_uint_t n_
     // call runtime, with type info for args, or don't support dict/default params, or only support Python objects for them
     emit_native_pre(emit);
     if (n_pos_defaults == 0 && n_kw_defaults == 0) {
-        emit_call_with_3_imm_args_and_first_aligned(emit, MP_F_MAKE_FUNCTION_FROM_RAW_CODE, (mp_uint_t)scope->raw_code, REG_ARG_1, (mp_uint_t)MP_OBJ_NULL, REG_ARG_2, (mp_uint_t)MP_OBJ_NULL, REG_ARG_3);
+        need_reg_all(emit);
+        ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)MP_OBJ_NULL, REG_ARG_2);
+        ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)MP_OBJ_NULL, REG_ARG_3);
     } else {
         vtype_kind_t vtype_def_tuple, vtype_def_dict;
         emit_pre_pop_reg_reg(emit, &vtype_def_dict, REG_ARG_3, &vtype_def_tuple, REG_ARG_2);
         assert(vtype_def_tuple == VTYPE_PYOBJ);
         assert(vtype_def_dict == VTYPE_PYOBJ);
-        emit_call_with_imm_arg_aligned(emit, MP_F_MAKE_FUNCTION_FROM_RAW_CODE, (mp_uint_t)scope->raw_code, REG_ARG_1);
+        need_reg_all(emit);
     }
+    emit_native_mov_reg_raw_code(emit, REG_ARG_1, scope->raw_code);
+    emit_native_call_ind(emit, MP_F_MAKE_FUNCTION_FROM_RAW_CODE);
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
 
@@ -2156,11 +3051,35 @@ STATIC void emit_native_make_closure(emit_t *emit, scope_t *scope, mp_uint_t n_c
         emit_get_stack_pointer_to_reg_for_pop(emit, REG_ARG_3, n_closed_over + 2);
         ASM_MOV_IMM_TO_REG(emit->as, 0x100 | n_closed_over, REG_ARG_2);
     }
-    ASM_MOV_ALIGNED_IMM_TO_REG(emit->as, (mp_uint_t)scope->raw_code, REG_ARG_1);
-    ASM_CALL_IND(emit->as, mp_fun_table[MP_F_MAKE_CLOSURE_FROM_RAW_CODE], MP_F_MAKE_CLOSURE_FROM_RAW_CODE);
+    emit_native_mov_reg_raw_code(emit, REG_ARG_1, scope->raw_code);
+    emit_native_call_ind(emit, MP_F_MAKE_CLOSURE_FROM_RAW_CODE);
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
 
+#if VIPER_FLOAT
+// A cast between a float and an int converts the value, rather than just
+// reinterpreting the bits like the other casts do.
+STATIC void emit_native_cast_float(emit_t *emit, vtype_kind_t vtype_cast) {
+    vtype_kind_t vtype;
+    int reg_arg = REG_ARG_1;
+    emit_pre_pop_reg_flexible(emit, &vtype, &reg_arg, REG_RET, REG_RET);
+    emit_pre_pop_discard(emit);
+    need_reg_single(emit, REG_RET, 0);
+    if (vtype_cast == VTYPE_FLOAT && (vtype == VTYPE_BOOL || vtype == VTYPE_INT)) {
+        asm_x64_cvtsi2sd_r64_to_xmm(emit->as, ASM_X64_REG_XMM0, reg_arg);
+        asm_x64_movq_xmm_to_r64(emit->as, REG_RET, ASM_X64_REG_XMM0);
+    } else if (vtype == VTYPE_FLOAT && (vtype_cast == VTYPE_INT || vtype_cast == VTYPE_UINT)) {
+        // truncates towards zero, like int() of a float object
+        asm_x64_movq_r64_to_xmm(emit->as, ASM_X64_REG_XMM0, reg_arg);
+        asm_x64_cvttsd2si_xmm_to_r64(emit->as, REG_RET, ASM_X64_REG_XMM0);
+    } else {
+        EMIT_NATIVE_VIPER_TYPE_ERROR(emit,
+            "can't convert '%q' to '%q'", vtype_to_qstr(vtype), vtype_to_qstr(vtype_cast));
+    }
+    emit_post_push_reg(emit, vtype_cast, REG_RET);
+}
+#endif
+
 STATIC void emit_native_call_function(emit_t *emit, mp_uint_t n_positional, mp_uint_t n_keyword, mp_uint_t star_flags) {
     DEBUG_printf("call_function(n_pos=" UINT_FMT ", n_kw=" UINT_FMT ", star_flags=" UINT_FMT ")\n", n_positional, n_keyword, star_flags);
 
@@ -2175,6 +3094,13 @@ STATIC void emit_native_call_function(emit_t *emit, mp_uint_t n_positional, mp_u
         assert(!star_flags);
         DEBUG_printf("  cast to %d\n", vtype_fun);
         vtype_kind_t vtype_cast = peek_stack(emit, 1)->data.u_imm;
+        #if VIPER_FLOAT
+        vtype_kind_t vtype_arg = peek_vtype(emit, 0);
+        if (vtype_arg != VTYPE_PYOBJ && (vtype_arg == VTYPE_FLOAT) != (vtype_cast == VTYPE_FLOAT)) {
+            emit_native_cast_float(emit, vtype_cast);
+            return;
+        }
+        #endif
         switch (peek_vtype(emit, 0)) {
             case VTYPE_PYOBJ: {
                 vtype_kind_t vtype;
@@ -2192,6 +3118,11 @@ STATIC void emit_native_call_function(emit_t *emit, mp_uint_t n_positional, mp_u
             case VTYPE_PTR16:
             case VTYPE_PTR32:
             case VTYPE_PTR_NONE:
+            #if VIPER_FLOAT
+            case VTYPE_FLOAT:
+            case VTYPE_PTRF32:
+            case VTYPE_PTRF64:
+            #endif
                 emit_fold_stack_top(emit, REG_ARG_1);
                 emit_post_top_set_vtype(emit, vtype_cast);
                 break;
@@ -2234,11 +3165,16 @@ STATIC void emit_native_return_value(emit_t *emit) {
         if (peek_vtype(emit, 0) == VTYPE_PTR_NONE) {
             emit_pre_pop_discard(emit);
             if (emit->return_vtype == VTYPE_PYOBJ) {
-                ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)mp_const_none, REG_RET);
+                emit_native_mov_reg_const_obj(emit, REG_RET, MP_NATIVE_CONST_NONE);
             } else {
                 ASM_MOV_IMM_TO_REG(emit->as, 0, REG_RET);
             }
         } else {
+            #if VIPER_FLOAT
+            if (emit->return_vtype == VTYPE_PYOBJ) {
+                emit_native_box_float_const(emit, 0);
+            }
+            #endif
             vtype_kind_t vtype;
             emit_pre_pop_reg(emit, &vtype, REG_RET);
             if (vtype != emit->return_vtype) {
@@ -2251,6 +3187,15 @@ STATIC void emit_native_return_value(emit_t *emit) {
         vtype_kind_t vtype;
         emit_pre_pop_reg(emit, &vtype, REG_RET);
         assert(vtype == VTYPE_PYOBJ);
+        #if MICROPY_OPT_TIERED_NATIVE
+        if (emit->tiered) {
+            // remove the handler set up on entry, which is the innermost one
+            // because promoted code doesn't return from inside a try
+            ASM_MOV_REG_TO_LOCAL(emit->as, REG_RET, TIER_LINE_LOCAL(emit));
+            emit_native_call_ind(emit, MP_F_NLR_POP);
+            ASM_MOV_LOCAL_TO_REG(emit->as, TIER_LINE_LOCAL(emit), REG_RET);
+        }
+        #endif
     }
     emit->last_emit_was_return_value = true;
     //ASM_BREAK_POINT(emit->as); // to insert a break-point for debugging
@@ -2258,6 +3203,13 @@ STATIC void emit_native_return_value(emit_t *emit) {
 }
 
 STATIC void emit_native_raise_varargs(emit_t *emit, mp_uint_t n_args) {
+    #if MICROPY_OPT_TIERED_NATIVE
+    if (emit->tiered && n_args != 1) {
+        EMIT_NATIVE_TIER_REJECT(emit, "native re-raise");
+        adjust_stack(emit, -(mp_int_t)n_args);
+        return;
+    }
+    #endif
     assert(n_args == 1);
     vtype_kind_t vtype_exc;
     emit_pre_pop_reg(emit, &vtype_exc, REG_ARG_1); // arg1 = object to raise
@@ -32,6 +32,7 @@
 #include "py/gc.h"
 #include "py/obj.h"
 #include "py/runtime.h"
+#include "py/mphal.h"
 
 #if MICROPY_ENABLE_GC
 
@@ -72,26 +73,62 @@
 #define ATB_3_IS_FREE(a) (((a) & ATB_MASK_3) == 0)
 
 #define BLOCK_SHIFT(block) (2 * ((block) & (BLOCKS_PER_ATB - 1)))
-#define ATB_GET_KIND(block) ((MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] >> BLOCK_SHIFT(block)) & 3)
-#define ATB_ANY_TO_FREE(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] &= (~(AT_MARK << BLOCK_SHIFT(block))); } while (0)
-#define ATB_FREE_TO_HEAD(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] |= (AT_HEAD << BLOCK_SHIFT(block)); } while (0)
-#define ATB_FREE_TO_TAIL(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] |= (AT_TAIL << BLOCK_SHIFT(block)); } while (0)
-#define ATB_HEAD_TO_MARK(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] |= (AT_MARK << BLOCK_SHIFT(block)); } while (0)
-#define ATB_MARK_TO_HEAD(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] &= (~(AT_TAIL << BLOCK_SHIFT(block))); } while (0)
-
-#define BLOCK_FROM_PTR(ptr) (((byte*)(ptr) - MP_STATE_MEM(gc_pool_start)) / BYTES_PER_BLOCK)
-#define PTR_FROM_BLOCK(block) (((block) * BYTES_PER_BLOCK + (uintptr_t)MP_STATE_MEM(gc_pool_start)))
+#define ATB_GET_KIND(area, block) (((area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] >> BLOCK_SHIFT(block)) & 3)
+#define ATB_ANY_TO_FREE(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] &= (~(AT_MARK << BLOCK_SHIFT(block))); } while (0)
+#define ATB_FREE_TO_HEAD(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] |= (AT_HEAD << BLOCK_SHIFT(block)); } while (0)
+#define ATB_FREE_TO_TAIL(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] |= (AT_TAIL << BLOCK_SHIFT(block)); } while (0)
+#define ATB_HEAD_TO_MARK(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] |= (AT_MARK << BLOCK_SHIFT(block)); } while (0)
+#define ATB_MARK_TO_HEAD(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] &= (~(AT_TAIL << BLOCK_SHIFT(block))); } while (0)
+
+// The ATB can also be accessed a machine word at a time (an ATW), covering
+// BLOCKS_PER_ATW blocks.  The field of each block is at an even bit position
+// regardless of endianness, so the following masks can be used to classify
+// all the blocks of a word at once; each has a bit set at the low bit of the
+// field of every block of the given kind.
+#define BLOCKS_PER_ATW (BLOCKS_PER_ATB * sizeof(uintptr_t))
+#define ATW_LO ((uintptr_t)-1 / 3) // 0x5555...
+#define ATW_FREE_MASK(w) (~((w) | ((w) >> 1)) & ATW_LO)
+#define ATW_HEAD_MASK(w) ((w) & ~((w) >> 1) & ATW_LO)
+#define ATW_TAIL_MASK(w) (~(w) & ((w) >> 1) & ATW_LO)
+#define ATW_MARK_MASK(w) ((w) & ((w) >> 1) & ATW_LO)
+
+// the ATB may not be word aligned, and memcpy keeps this free of aliasing issues
+static inline uintptr_t atw_get(mp_state_mem_area_t *area, size_t block) {
+    uintptr_t w;
+    memcpy(&w, &area->gc_alloc_table_start[block / BLOCKS_PER_ATB], sizeof(w));
+    return w;
+}
+
+static inline void atw_set(mp_state_mem_area_t *area, size_t block, uintptr_t w) {
+    memcpy(&area->gc_alloc_table_start[block / BLOCKS_PER_ATB], &w, sizeof(w));
+}
+
+#if MICROPY_GC_INCREMENTAL
+// while a sweep is pending, live objects not yet swept are still marked
+#define ATB_IS_ALLOCATED_HEAD(area, block) (ATB_GET_KIND(area, block) & AT_HEAD)
+#else
+#define ATB_IS_ALLOCATED_HEAD(area, block) (ATB_GET_KIND(area, block) == AT_HEAD)
+#endif
+
+#define BLOCK_FROM_PTR(area, ptr) (((byte*)(ptr) - (area)->gc_pool_start) / BYTES_PER_BLOCK)
+#define PTR_FROM_BLOCK(area, block) (((block) * BYTES_PER_BLOCK + (uintptr_t)(area)->gc_pool_start))
 #define ATB_FROM_BLOCK(bl) ((bl) / BLOCKS_PER_ATB)
 
+#if MICROPY_GC_SPLIT_HEAP
+#define NEXT_AREA(area) ((area)->next)
+#else
+#define NEXT_AREA(area) (NULL)
+#endif
+
 #if MICROPY_ENABLE_FINALISER
 // FTB = finaliser table byte
 // if set, then the corresponding block may have a finaliser
 
 #define BLOCKS_PER_FTB (8)
 
-#define FTB_GET(block) ((MP_STATE_MEM(gc_finaliser_table_start)[(block) / BLOCKS_PER_FTB] >> ((block) & 7)) & 1)
-#define FTB_SET(block) do { MP_STATE_MEM(gc_finaliser_table_start)[(block) / BLOCKS_PER_FTB] |= (1 << ((block) & 7)); } while (0)
-#define FTB_CLEAR(block) do { MP_STATE_MEM(gc_finaliser_table_start)[(block) / BLOCKS_PER_FTB] &= (~(1 << ((block) & 7))); } while (0)
+#define FTB_GET(area, block) (((area)->gc_finaliser_table_start[(block) / BLOCKS_PER_FTB] >> ((block) & 7)) & 1)
+#define FTB_SET(area, block) do { (area)->gc_finaliser_table_start[(block) / BLOCKS_PER_FTB] |= (1 << ((block) & 7)); } while (0)
+#define FTB_CLEAR(area, block) do { (area)->gc_finaliser_table_start[(block) / BLOCKS_PER_FTB] &= (~(1 << ((block) & 7))); } while (0)
 #endif
 
 #if MICROPY_PY_THREAD && !MICROPY_PY_THREAD_GIL
@@ -102,8 +139,183 @@
 #define GC_EXIT()
 #endif
 
+#if MICROPY_GC_SIZE_CLASSES
+// Segregated free lists.  Every free block belongs to exactly one free run,
+// a maximal sequence of free blocks (adjacent runs are always coalesced), and
+// every free run is in the doubly-linked list for its size class.  The list
+// is threaded through the runs themselves: the first block of a run holds the
+// next/prev links and the length of the run, and the last word of the last
+// block holds the first block of the run, so a run can be found from either
+// end.  Classes 0-7 hold runs of exactly 1-8 blocks, and after that each
+// class holds runs of up to twice the length of the previous one.
+
+#define GC_NUM_FREE_LISTS (32)
+#define GC_NUM_EXACT_FREE_LISTS (8)
+#define FREE_RUN_NIL ((size_t)-1)
+
+#define FREE_RUN_NEXT(area, block) (((size_t*)PTR_FROM_BLOCK(area, block))[0])
+#define FREE_RUN_PREV(area, block) (((size_t*)PTR_FROM_BLOCK(area, block))[1])
+#define FREE_RUN_LEN(area, block) (((size_t*)PTR_FROM_BLOCK(area, block))[2])
+#define FREE_RUN_START(area, last_block) (((size_t*)PTR_FROM_BLOCK(area, (last_block) + 1))[-1])
+
+STATIC size_t gc_free_list_class(size_t n_blocks) {
+    if (n_blocks <= GC_NUM_EXACT_FREE_LISTS) {
+        return n_blocks - 1;
+    }
+    size_t c = GC_NUM_EXACT_FREE_LISTS - 1;
+    for (n_blocks = (n_blocks - 1) / GC_NUM_EXACT_FREE_LISTS; n_blocks != 0; n_blocks >>= 1) {
+        c += 1;
+    }
+    return c < GC_NUM_FREE_LISTS ? c : GC_NUM_FREE_LISTS - 1;
+}
+
+STATIC void gc_free_list_reset(mp_state_mem_area_t *area) {
+    for (size_t c = 0; c < GC_NUM_FREE_LISTS; c++) {
+        area->gc_free_list[c] = FREE_RUN_NIL;
+    }
+    area->gc_free_list_nonempty = 0;
+}
+
+// add a free run to the head of its list; the run must not have free neighbours
+STATIC void gc_free_list_link(mp_state_mem_area_t *area, size_t block, size_t n_blocks) {
+    size_t c = gc_free_list_class(n_blocks);
+    size_t next = area->gc_free_list[c];
+    FREE_RUN_NEXT(area, block) = next;
+    FREE_RUN_PREV(area, block) = FREE_RUN_NIL;
+    FREE_RUN_LEN(area, block) = n_blocks;
+    FREE_RUN_START(area, block + n_blocks - 1) = block;
+    if (next != FREE_RUN_NIL) {
+        FREE_RUN_PREV(area, next) = block;
+    }
+    area->gc_free_list[c] = block;
+    area->gc_free_list_nonempty |= (uint32_t)1 << c;
+}
+
+STATIC void gc_free_list_unlink(mp_state_mem_area_t *area, size_t block) {
+    size_t next = FREE_RUN_NEXT(area, block);
+    size_t prev = FREE_RUN_PREV(area, block);
+    if (next != FREE_RUN_NIL) {
+        FREE_RUN_PREV(area, next) = prev;
+    }
+    if (prev != FREE_RUN_NIL) {
+        FREE_RUN_NEXT(area, prev) = next;
+    } else {
+        size_t c = gc_free_list_class(FREE_RUN_LEN(area, block));
+        area->gc_free_list[c] = next;
+        if (next == FREE_RUN_NIL) {
+            area->gc_free_list_nonempty &= ~((uint32_t)1 << c);
+        }
+    }
+}
+
+// blocks that were just marked free in the ATB are added to the free lists,
+// merging them with the runs on either side
+STATIC void gc_free_list_add(mp_state_mem_area_t *area, size_t block, size_t n_blocks) {
+    size_t end = block + n_blocks;
+    if (end < area->gc_alloc_table_byte_len * BLOCKS_PER_ATB && ATB_GET_KIND(area, end) == AT_FREE) {
+        // the next block must be the start of a run
+        gc_free_list_unlink(area, end);
+        n_blocks += FREE_RUN_LEN(area, end);
+    }
+    if (block > 0 && ATB_GET_KIND(area, block - 1) == AT_FREE) {
+        // the previous block must be the end of a run
+        size_t prev = FREE_RUN_START(area, block - 1);
+        gc_free_list_unlink(area, prev);
+        n_blocks += block - prev;
+        block = prev;
+    }
+    gc_free_list_link(area, block, n_blocks);
+}
+
+// find and remove a run of at least n_blocks free blocks, returning its first
+// block; the rest of the run stays in the free lists
+STATIC size_t gc_free_list_take(mp_state_mem_area_t *area, size_t n_blocks) {
+    size_t c = gc_free_list_class(n_blocks);
+    size_t block = FREE_RUN_NIL;
+    if (c >= GC_NUM_EXACT_FREE_LISTS) {
+        // runs in this class may be too small, so only look at a few of them
+        block = area->gc_free_list[c];
+        for (int i = 0; i < 4 && block != FREE_RUN_NIL && FREE_RUN_LEN(area, block) < n_blocks; i++) {
+            block = FREE_RUN_NEXT(area, block);
+        }
+        if (block != FREE_RUN_NIL && FREE_RUN_LEN(area, block) < n_blocks) {
+            block = FREE_RUN_NIL;
+        }
+        c += 1;
+    }
+    if (block == FREE_RUN_NIL) {
+        // any run in the smallest non-empty class at or above c will do
+        uint32_t classes = c < GC_NUM_FREE_LISTS ? area->gc_free_list_nonempty >> c : 0;
+        if (classes == 0) {
+            return FREE_RUN_NIL;
+        }
+        while ((classes & 1) == 0) {
+            classes >>= 1;
+            c += 1;
+        }
+        block = area->gc_free_list[c];
+    }
+    size_t len = FREE_RUN_LEN(area, block);
+    gc_free_list_unlink(area, block);
+    if (len > n_blocks) {
+        gc_free_list_link(area, block + n_blocks, len - n_blocks);
+    }
+    return block;
+}
+#endif
+
+// Count the consecutive tail blocks starting at the given block.
+STATIC size_t gc_atb_tail_run_len(mp_state_mem_area_t *area, size_t block) {
+    size_t max_block = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+    size_t bl = block;
+    for (;;) {
+        if (bl % BLOCKS_PER_ATW == 0) {
+            // skip whole words of tail blocks
+            while (bl + BLOCKS_PER_ATW <= max_block && ATW_TAIL_MASK(atw_get(area, bl)) == ATW_LO) {
+                bl += BLOCKS_PER_ATW;
+            }
+        }
+        if (bl >= max_block || ATB_GET_KIND(area, bl) != AT_TAIL) {
+            return bl - block;
+        }
+        bl += 1;
+    }
+}
+
+// Set n_blocks blocks starting at block, which must all be free, to tail.
+STATIC void gc_atb_free_to_tail_run(mp_state_mem_area_t *area, size_t block, size_t n_blocks) {
+    size_t end = block + n_blocks;
+    for (; block < end && block % BLOCKS_PER_ATB != 0; block++) {
+        ATB_FREE_TO_TAIL(area, block);
+    }
+    if (block < end) {
+        size_t n_bytes = (end - block) / BLOCKS_PER_ATB;
+        memset(&area->gc_alloc_table_start[block / BLOCKS_PER_ATB], 0xaa, n_bytes);
+        block += n_bytes * BLOCKS_PER_ATB;
+    }
+    for (; block < end; block++) {
+        ATB_FREE_TO_TAIL(area, block);
+    }
+}
+
+// Set n_blocks blocks starting at block to free.
+STATIC void gc_atb_any_to_free_run(mp_state_mem_area_t *area, size_t block, size_t n_blocks) {
+    size_t end = block + n_blocks;
+    for (; block < end && block % BLOCKS_PER_ATB != 0; block++) {
+        ATB_ANY_TO_FREE(area, block);
+    }
+    if (block < end) {
+        size_t n_bytes = (end - block) / BLOCKS_PER_ATB;
+        memset(&area->gc_alloc_table_start[block / BLOCKS_PER_ATB], 0, n_bytes);
+        block += n_bytes * BLOCKS_PER_ATB;
+    }
+    for (; block < end; block++) {
+        ATB_ANY_TO_FREE(area, block);
+    }
+}
+
 // TODO waste less memory; currently requires that all entries in alloc_table have a corresponding block in pool
-void gc_init(void *start, void *end) {
+STATIC void gc_setup_area(mp_state_mem_area_t *area, void *start, void *end) {
     // align end pointer on block boundary
     end = (void*)((uintptr_t)end & (~(BYTES_PER_BLOCK - 1)));
     DEBUG_printf("Initializing GC heap: %p..%p = " UINT_FMT " bytes\n", start, end, (byte*)end - (byte*)start);
@@ -115,36 +327,71 @@ void gc_init(void *start, void *end) {
     // => T = A * (1 + BLOCKS_PER_ATB / BLOCKS_PER_FTB + BLOCKS_PER_ATB * BYTES_PER_BLOCK)
     size_t total_byte_len = (byte*)end - (byte*)start;
 #if MICROPY_ENABLE_FINALISER
-    MP_STATE_MEM(gc_alloc_table_byte_len) = total_byte_len * BITS_PER_BYTE / (BITS_PER_BYTE + BITS_PER_BYTE * BLOCKS_PER_ATB / BLOCKS_PER_FTB + BITS_PER_BYTE * BLOCKS_PER_ATB * BYTES_PER_BLOCK);
+    area->gc_alloc_table_byte_len = total_byte_len * BITS_PER_BYTE / (BITS_PER_BYTE + BITS_PER_BYTE * BLOCKS_PER_ATB / BLOCKS_PER_FTB + BITS_PER_BYTE * BLOCKS_PER_ATB * BYTES_PER_BLOCK);
 #else
-    MP_STATE_MEM(gc_alloc_table_byte_len) = total_byte_len / (1 + BITS_PER_BYTE / 2 * BYTES_PER_BLOCK);
+    area->gc_alloc_table_byte_len = total_byte_len / (1 + BITS_PER_BYTE / 2 * BYTES_PER_BLOCK);
 #endif
 
-    MP_STATE_MEM(gc_alloc_table_start) = (byte*)start;
+    area->gc_alloc_table_start = (byte*)start;
 
 #if MICROPY_ENABLE_FINALISER
-    size_t gc_finaliser_table_byte_len = (MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB + BLOCKS_PER_FTB - 1) / BLOCKS_PER_FTB;
-    MP_STATE_MEM(gc_finaliser_table_start) = MP_STATE_MEM(gc_alloc_table_start) + MP_STATE_MEM(gc_alloc_table_byte_len);
+    size_t gc_finaliser_table_byte_len = (area->gc_alloc_table_byte_len * BLOCKS_PER_ATB + BLOCKS_PER_FTB - 1) / BLOCKS_PER_FTB;
+    area->gc_finaliser_table_start = area->gc_alloc_table_start + area->gc_alloc_table_byte_len;
 #endif
 
-    size_t gc_pool_block_len = MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB;
-    MP_STATE_MEM(gc_pool_start) = (byte*)end - gc_pool_block_len * BYTES_PER_BLOCK;
-    MP_STATE_MEM(gc_pool_end) = end;
+    size_t gc_pool_block_len = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+    area->gc_pool_start = (byte*)end - gc_pool_block_len * BYTES_PER_BLOCK;
+    area->gc_pool_end = end;
 
 #if MICROPY_ENABLE_FINALISER
-    assert(MP_STATE_MEM(gc_pool_start) >= MP_STATE_MEM(gc_finaliser_table_start) + gc_finaliser_table_byte_len);
+    assert(area->gc_pool_start >= area->gc_finaliser_table_start + gc_finaliser_table_byte_len);
 #endif
 
     // clear ATBs
-    memset(MP_STATE_MEM(gc_alloc_table_start), 0, MP_STATE_MEM(gc_alloc_table_byte_len));
+    memset(area->gc_alloc_table_start, 0, area->gc_alloc_table_byte_len);
 
 #if MICROPY_ENABLE_FINALISER
     // clear FTBs
-    memset(MP_STATE_MEM(gc_finaliser_table_start), 0, gc_finaliser_table_byte_len);
+    memset(area->gc_finaliser_table_start, 0, gc_finaliser_table_byte_len);
 #endif
 
     // set last free ATB index to start of heap
-    MP_STATE_MEM(gc_last_free_atb_index) = 0;
+    area->gc_last_free_atb_index = 0;
+
+    #if MICROPY_GC_SIZE_CLASSES
+    // the whole pool is one free run (the run header and trailer need 4 words)
+    assert(WORDS_PER_BLOCK >= 4);
+    gc_free_list_reset(area);
+    gc_free_list_link(area, 0, gc_pool_block_len);
+    #endif
+
+    #if MICROPY_GC_INCREMENTAL
+    // no sweep pending
+    area->gc_sweep_block = gc_pool_block_len;
+    #endif
+
+    #if MICROPY_GC_SPLIT_HEAP
+    area->next = NULL;
+    #endif
+
+    #if MICROPY_GC_SPLIT_HEAP_AUTO
+    area->gc_auto_added = false;
+    #endif
+
+    DEBUG_printf("GC layout:\n");
+    DEBUG_printf("  alloc table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_alloc_table_start, area->gc_alloc_table_byte_len, area->gc_alloc_table_byte_len * BLOCKS_PER_ATB);
+#if MICROPY_ENABLE_FINALISER
+    DEBUG_printf("  finaliser table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_finaliser_table_start, gc_finaliser_table_byte_len, gc_finaliser_table_byte_len * BLOCKS_PER_FTB);
+#endif
+    DEBUG_printf("  pool at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_pool_start, gc_pool_block_len * BYTES_PER_BLOCK, gc_pool_block_len);
+}
+
+void gc_init(void *start, void *end) {
+    gc_setup_area(&MP_STATE_MEM(area), start, end);
+
+    #if MICROPY_GC_INCREMENTAL
+    MP_STATE_MEM(gc_sweep_area) = NULL;
+    #endif
 
     // unlock the GC
     MP_STATE_MEM(gc_lock_depth) = 0;
@@ -157,151 +404,820 @@ void gc_init(void *start, void *end) {
     MP_STATE_MEM(gc_alloc_threshold) = (size_t)-1;
     MP_STATE_MEM(gc_alloc_amount) = 0;
     #endif
-
-    #if MICROPY_PY_THREAD
-    mp_thread_mutex_init(&MP_STATE_MEM(gc_mutex));
+
+    #if MICROPY_PY_THREAD
+    mp_thread_mutex_init(&MP_STATE_MEM(gc_mutex));
+    #endif
+
+    #if MICROPY_GC_PARALLEL_MARK
+    mp_thread_mutex_init(&MP_STATE_MEM(gc_mark_mutex));
+    #endif
+}
+
+#if MICROPY_GC_SPLIT_HEAP
+STATIC void gc_add_area(void *start, void *end, bool auto_added) {
+    // the area structure itself goes at the (word aligned) start of the region
+    mp_state_mem_area_t *area = (mp_state_mem_area_t*)(((uintptr_t)start + sizeof(uintptr_t) - 1) & ~(sizeof(uintptr_t) - 1));
+    gc_setup_area(area, area + 1, end);
+    #if MICROPY_GC_SPLIT_HEAP_AUTO
+    area->gc_auto_added = auto_added;
+    #else
+    (void)auto_added;
+    #endif
+
+    // append it to the list of areas
+    GC_ENTER();
+    mp_state_mem_area_t *prev = &MP_STATE_MEM(area);
+    while (prev->next != NULL) {
+        prev = prev->next;
+    }
+    prev->next = area;
+    GC_EXIT();
+}
+
+void gc_add_region(void *start, void *end) {
+    gc_add_area(start, end, false);
+}
+#endif
+
+#if MICROPY_GC_SPLIT_HEAP_AUTO
+// Try to get a new region of memory from the port that can hold an object of
+// n_bytes.  The heap grows by half its current size each time if it can, and
+// otherwise by less, down to what the object needs, so that memory the port
+// has left (under a limit on the size of the heap, say) still gets used.
+STATIC bool gc_try_add_heap(size_t n_bytes) {
+    size_t total = 0;
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        total += area->gc_pool_end - area->gc_alloc_table_start;
+    }
+    // allow for the area structure, the alloc and finaliser tables, and alignment
+    size_t min_size = sizeof(mp_state_mem_area_t) + n_bytes + n_bytes / 16 + 4 * BYTES_PER_BLOCK;
+    min_size = (min_size + BYTES_PER_BLOCK - 1) & (~(BYTES_PER_BLOCK - 1));
+    size_t size = total / 2;
+    void *start = NULL;
+    for (;;) {
+        size = (size + BYTES_PER_BLOCK - 1) & (~(BYTES_PER_BLOCK - 1));
+        if (size < min_size) {
+            size = min_size;
+        }
+        start = MP_PLAT_ALLOC_HEAP(size);
+        if (start != NULL || size == min_size) {
+            break;
+        }
+        size /= 2;
+    }
+    if (start == NULL) {
+        return false;
+    }
+    DEBUG_printf("gc_try_add_heap(" UINT_FMT "): added %p, " UINT_FMT " bytes\n", n_bytes, start, size);
+    gc_add_area(start, (byte*)start + size, true);
+    return true;
+}
+
+STATIC bool gc_area_is_free(mp_state_mem_area_t *area) {
+    for (size_t i = 0; i < area->gc_alloc_table_byte_len; i++) {
+        if (area->gc_alloc_table_start[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Give back to the port the regions that it provided which hold no objects.
+// Must be called with the GC mutex held and only once sweeping is complete.
+STATIC void gc_release_free_areas(void) {
+    mp_state_mem_area_t *prev = &MP_STATE_MEM(area);
+    while (prev->next != NULL) {
+        mp_state_mem_area_t *area = prev->next;
+        if (area->gc_auto_added && gc_area_is_free(area)) {
+            DEBUG_printf("gc_release_free_areas(): releasing %p\n", area);
+            prev->next = area->next;
+            MP_PLAT_FREE_HEAP(area, area->gc_pool_end - (byte*)area);
+        } else {
+            prev = area;
+        }
+    }
+}
+#endif
+
+void gc_lock(void) {
+    GC_ENTER();
+    MP_STATE_MEM(gc_lock_depth)++;
+    GC_EXIT();
+}
+
+void gc_unlock(void) {
+    GC_ENTER();
+    MP_STATE_MEM(gc_lock_depth)--;
+    GC_EXIT();
+}
+
+bool gc_is_locked(void) {
+    return MP_STATE_MEM(gc_lock_depth) != 0;
+}
+
+// Return the area of the heap containing the block that ptr points to the
+// start of, or NULL if ptr is not such a pointer.
+static inline mp_state_mem_area_t *gc_get_ptr_area(const void *ptr) {
+    if (((uintptr_t)(ptr) & (BYTES_PER_BLOCK - 1)) != 0) {
+        // must be aligned on a block
+        return NULL;
+    }
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        if (ptr >= (void*)area->gc_pool_start && ptr < (void*)area->gc_pool_end) {
+            return area;
+        }
+    }
+    return NULL;
+}
+
+#if MICROPY_GC_ARENA
+// whether the current collection is of an arena, see gc_arena_exit
+#define GC_COLLECTING_ARENA() (MP_STATE_MEM(gc_local_end) != NULL)
+#else
+#define GC_COLLECTING_ARENA() (false)
+#endif
+
+#if MICROPY_GC_PARALLEL_MARK
+// While marking in parallel the auxiliary stack is shared between threads
+#define GC_MARK_ENTER() do { if (MP_STATE_MEM(gc_mark_parallel)) { mp_thread_mutex_lock(&MP_STATE_MEM(gc_mark_mutex), 1); } } while (0)
+#define GC_MARK_EXIT() do { if (MP_STATE_MEM(gc_mark_parallel)) { mp_thread_mutex_unlock(&MP_STATE_MEM(gc_mark_mutex)); } } while (0)
+#else
+#define GC_MARK_ENTER()
+#define GC_MARK_EXIT()
+#endif
+
+#if MICROPY_GC_AUX_STACK
+STATIC void gc_aux_stack_free(void) {
+    if (MP_STATE_MEM(gc_aux_stack) != NULL) {
+        MP_PLAT_FREE_GC_STACK(MP_STATE_MEM(gc_aux_stack), MP_STATE_MEM(gc_aux_stack_alloc) * sizeof(size_t));
+        MP_STATE_MEM(gc_aux_stack) = NULL;
+        MP_STATE_MEM(gc_aux_stack_alloc) = 0;
+    }
+}
+
+// Push n entries onto the auxiliary stack, growing it if needed.  Returns
+// false if it couldn't be grown.
+STATIC bool gc_aux_stack_push(const size_t *items, size_t n) {
+    size_t len = MP_STATE_MEM(gc_aux_stack_len);
+    if (len + n > MP_STATE_MEM(gc_aux_stack_alloc)) {
+        size_t new_alloc = MAX(MP_STATE_MEM(gc_aux_stack_alloc) * 2, MAX(len + n, 4096));
+        size_t *aux = MP_PLAT_ALLOC_GC_STACK(new_alloc * sizeof(size_t));
+        if (aux == NULL) {
+            return false;
+        }
+        if (len > 0) {
+            memcpy(aux, MP_STATE_MEM(gc_aux_stack), len * sizeof(size_t));
+        }
+        gc_aux_stack_free();
+        MP_STATE_MEM(gc_aux_stack) = aux;
+        MP_STATE_MEM(gc_aux_stack_alloc) = new_alloc;
+    }
+    memcpy(MP_STATE_MEM(gc_aux_stack) + len, items, n * sizeof(size_t));
+    MP_STATE_MEM(gc_aux_stack_len) = len + n;
+    return true;
+}
+
+// Refill an empty mark stack from the auxiliary stack.  Returns false if
+// there was nothing to refill it with.
+STATIC bool gc_mark_stack_refill(size_t *stack, size_t **sp) {
+    GC_MARK_ENTER();
+    size_t n = MIN(MP_STATE_MEM(gc_aux_stack_len), (MICROPY_ALLOC_GC_STACK_SIZE + 1) / 2);
+    if (n > 0) {
+        MP_STATE_MEM(gc_aux_stack_len) -= n;
+        memcpy(stack, MP_STATE_MEM(gc_aux_stack) + MP_STATE_MEM(gc_aux_stack_len), n * sizeof(size_t));
+    }
+    GC_MARK_EXIT();
+    *sp = stack + n;
+    return n > 0;
+}
+#endif
+
+#if MICROPY_GC_PARALLEL_MARK
+STATIC void gc_mark_parallel_start(void);
+
+// Turn an unmarked head into a marked head, atomically because other threads
+// may be marking blocks with the same ATB.  Returns false if another thread
+// marked it first.
+static inline bool gc_atb_head_try_mark(mp_state_mem_area_t *area, size_t block) {
+    byte bit = AT_TAIL << BLOCK_SHIFT(block);
+    return !(__atomic_fetch_or(&area->gc_alloc_table_start[block / BLOCKS_PER_ATB], bit, __ATOMIC_RELAXED) & bit);
+}
+#endif
+
+// Called when a mark stack is full and ptr, which is already marked, needs
+// to be pushed on it.
+STATIC void gc_mark_stack_full(size_t *stack, size_t **sp, size_t ptr) {
+    #if MICROPY_GC_AUX_STACK
+    // move the older half of the stack to the auxiliary stack
+    const size_t n = (MICROPY_ALLOC_GC_STACK_SIZE + 1) / 2;
+    GC_MARK_ENTER();
+    bool pushed = gc_aux_stack_push(stack, n);
+    GC_MARK_EXIT();
+    if (pushed) {
+        memmove(stack, stack + n, (MICROPY_ALLOC_GC_STACK_SIZE - n) * sizeof(size_t));
+        *sp -= n;
+        *(*sp)++ = ptr;
+        #if MICROPY_GC_PARALLEL_MARK
+        // there's now enough work to share with the helper threads
+        gc_mark_parallel_start();
+        #endif
+        return;
+    }
+    #endif
+    // its children will be found by gc_deal_with_stack_overflow
+    MP_STATE_MEM(gc_stack_overflow) = 1;
+    (void)stack;
+    (void)sp;
+    (void)ptr;
+}
+
+// If ptr points to an unmarked head then mark it and push it on the given
+// mark stack.
+static inline void gc_mark_and_push(void *ptr, size_t *stack, size_t **sp) {
+    mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+    if (area == NULL) {
+        return;
+    }
+    #if MICROPY_GC_ARENA
+    if (GC_COLLECTING_ARENA()
+        && ((byte*)ptr < MP_STATE_MEM(gc_local_start) || (byte*)ptr >= MP_STATE_MEM(gc_local_end))) {
+        // only the arena being collected is marked
+        return;
+    }
+    #endif
+    size_t block = BLOCK_FROM_PTR(area, ptr);
+    if (ATB_GET_KIND(area, block) != AT_HEAD) {
+        return;
+    }
+    DEBUG_printf("gc_mark(%p)\n", ptr);
+    #if MICROPY_GC_PARALLEL_MARK
+    if (MP_STATE_MEM(gc_mark_parallel)) {
+        if (!gc_atb_head_try_mark(area, block)) {
+            return;
+        }
+    } else
+    #endif
+    {
+        ATB_HEAD_TO_MARK(area, block);
+    }
+    if (*sp < stack + MICROPY_ALLOC_GC_STACK_SIZE) {
+        *(*sp)++ = (size_t)ptr;
+    } else {
+        gc_mark_stack_full(stack, sp, (size_t)ptr);
+    }
+}
+
+// ptr should be of type void*
+#define VERIFY_MARK_AND_PUSH(ptr) gc_mark_and_push(ptr, MP_STATE_MEM(gc_stack), &MP_STATE_MEM(gc_sp))
+
+#if MICROPY_GC_PARALLEL_MARK
+// Move the older half of a mark stack to the auxiliary stack, for idle
+// threads to take.
+STATIC void gc_mark_stack_share(size_t *stack, size_t **sp) {
+    size_t n = (*sp - stack) / 2;
+    mp_thread_mutex_lock(&MP_STATE_MEM(gc_mark_mutex), 1);
+    bool pushed = gc_aux_stack_push(stack, n);
+    mp_thread_mutex_unlock(&MP_STATE_MEM(gc_mark_mutex));
+    if (pushed) {
+        memmove(stack, stack + n, (*sp - stack - n) * sizeof(size_t));
+        *sp -= n;
+    }
+}
+#endif
+
+// Trace the children of the blocks on the given mark stack, and those moved
+// to the auxiliary stack, until there are none left.
+STATIC void gc_mark_drain(size_t *stack, size_t **sp) {
+    for (;;) {
+        while (*sp > stack) {
+            // pop the next object off the stack
+            void **ptrs = (void**)*--*sp;
+            mp_state_mem_area_t *area = gc_get_ptr_area(ptrs);
+            size_t block = BLOCK_FROM_PTR(area, ptrs);
+
+            // work out number of consecutive blocks in the chain starting with this one
+            size_t n_blocks = 1 + gc_atb_tail_run_len(area, block + 1);
+
+            // check this block's children
+            for (size_t i = n_blocks * BYTES_PER_BLOCK / sizeof(void*); i > 0; i--, ptrs++) {
+                gc_mark_and_push(*ptrs, stack, sp);
+            }
+
+            #if MICROPY_GC_PARALLEL_MARK
+            // give some of our work to any threads that have run out
+            if (MP_STATE_MEM(gc_mark_parallel) && MP_STATE_MEM(gc_aux_stack_len) == 0
+                && MP_STATE_MEM(gc_mark_busy) < MP_STATE_MEM(gc_mark_threads) && *sp - stack >= 2) {
+                gc_mark_stack_share(stack, sp);
+            }
+            #endif
+        }
+        #if MICROPY_GC_AUX_STACK
+        if (gc_mark_stack_refill(stack, sp)) {
+            continue;
+        }
+        #endif
+        break;
+    }
+}
+
+#if MICROPY_GC_PARALLEL_MARK
+// Called by a thread that has run out of marking work.  Waits for another
+// thread to share some, returning true, or for all threads to run out, in
+// which case marking is finished and it returns false.
+STATIC bool gc_mark_wait_for_work(void) {
+    bool have_work = true;
+    mp_thread_mutex_lock(&MP_STATE_MEM(gc_mark_mutex), 1);
+    MP_STATE_MEM(gc_mark_busy) -= 1;
+    while (MP_STATE_MEM(gc_aux_stack_len) == 0) {
+        if (MP_STATE_MEM(gc_mark_busy) == 0) {
+            have_work = false;
+            break;
+        }
+        mp_thread_mutex_unlock(&MP_STATE_MEM(gc_mark_mutex));
+        gc_mark_yield();
+        mp_thread_mutex_lock(&MP_STATE_MEM(gc_mark_mutex), 1);
+    }
+    if (have_work) {
+        MP_STATE_MEM(gc_mark_busy) += 1;
+    }
+    mp_thread_mutex_unlock(&MP_STATE_MEM(gc_mark_mutex));
+    return have_work;
+}
+
+// Wake the port's helper threads to mark in parallel with this one.
+STATIC void gc_mark_parallel_start(void) {
+    if (MP_STATE_MEM(gc_mark_parallel)) {
+        return;
+    }
+    MP_STATE_MEM(gc_mark_busy) = 1;
+    MP_STATE_MEM(gc_mark_finished) = 0;
+    MP_STATE_MEM(gc_mark_threads) = 1;
+    MP_STATE_MEM(gc_mark_parallel) = true;
+    size_t n = gc_mark_workers_start();
+    if (n == 0) {
+        MP_STATE_MEM(gc_mark_parallel) = false;
+        return;
+    }
+    MP_STATE_MEM(gc_mark_threads) = 1 + n;
+}
+
+// Finish marking once the calling thread has drained its stack, then wait
+// for the helper threads to be done.
+STATIC void gc_mark_parallel_end(size_t *stack, size_t **sp) {
+    while (gc_mark_wait_for_work()) {
+        gc_mark_drain(stack, sp);
+    }
+    for (;;) {
+        mp_thread_mutex_lock(&MP_STATE_MEM(gc_mark_mutex), 1);
+        bool done = MP_STATE_MEM(gc_mark_finished) == MP_STATE_MEM(gc_mark_threads) - 1;
+        mp_thread_mutex_unlock(&MP_STATE_MEM(gc_mark_mutex));
+        if (done) {
+            break;
+        }
+        gc_mark_yield();
+    }
+    MP_STATE_MEM(gc_mark_parallel) = false;
+}
+
+void gc_mark_worker(void) {
+    size_t stack[MICROPY_ALLOC_GC_STACK_SIZE];
+    size_t *sp = stack;
+    mp_thread_mutex_lock(&MP_STATE_MEM(gc_mark_mutex), 1);
+    MP_STATE_MEM(gc_mark_busy) += 1;
+    mp_thread_mutex_unlock(&MP_STATE_MEM(gc_mark_mutex));
+    do {
+        gc_mark_drain(stack, &sp);
+    } while (gc_mark_wait_for_work());
+    mp_thread_mutex_lock(&MP_STATE_MEM(gc_mark_mutex), 1);
+    MP_STATE_MEM(gc_mark_finished) += 1;
+    mp_thread_mutex_unlock(&MP_STATE_MEM(gc_mark_mutex));
+}
+#endif
+
+STATIC void gc_drain_stack(void) {
+    gc_mark_drain(MP_STATE_MEM(gc_stack), &MP_STATE_MEM(gc_sp));
+    #if MICROPY_GC_PARALLEL_MARK
+    if (MP_STATE_MEM(gc_mark_parallel)) {
+        gc_mark_parallel_end(MP_STATE_MEM(gc_stack), &MP_STATE_MEM(gc_sp));
+    }
+    #endif
+}
+
+STATIC void gc_deal_with_stack_overflow(void) {
+    while (MP_STATE_MEM(gc_stack_overflow)) {
+        MP_STATE_MEM(gc_stack_overflow) = 0;
+        MP_STATE_MEM(gc_sp) = MP_STATE_MEM(gc_stack);
+
+        // scan entire memory looking for blocks which have been marked but not their children
+        for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+            for (size_t block = 0; block < area->gc_alloc_table_byte_len * BLOCKS_PER_ATB; block++) {
+                // trace (again) if mark bit set
+                if (ATB_GET_KIND(area, block) == AT_MARK) {
+                    *MP_STATE_MEM(gc_sp)++ = PTR_FROM_BLOCK(area, block);
+                    gc_drain_stack();
+                }
+            }
+        }
+    }
+}
+
+#if MICROPY_ENABLE_FINALISER
+// call the __del__ method (if any) of the object at an unmarked head block
+STATIC void gc_call_finaliser(mp_state_mem_area_t *area, size_t block) {
+    if (FTB_GET(area, block)) {
+        #if MICROPY_PY_THREAD
+        // TODO need to think about reentrancy with finaliser code
+        assert(!"finaliser with threading not implemented");
+        #endif
+        mp_obj_base_t *obj = (mp_obj_base_t*)PTR_FROM_BLOCK(area, block);
+        if (obj->type != NULL) {
+            // if the object has a type then see if it has a __del__ method
+            mp_obj_t dest[2];
+            mp_load_method_maybe(MP_OBJ_FROM_PTR(obj), MP_QSTR___del__, dest);
+            if (dest[0] != MP_OBJ_NULL) {
+                // load_method returned a method
+                #if MICROPY_GC_STATS
+                MP_STATE_MEM(gc_stats_finalisers)++;
+                #endif
+                mp_call_method_n_kw(0, 0, dest);
+            }
+        }
+        // clear finaliser flag
+        FTB_CLEAR(area, block);
+    }
+}
+#endif
+
+#if MICROPY_GC_STATS
+STATIC void gc_stats_add_sweep_time(mp_uint_t start) {
+    mp_uint_t t = mp_hal_ticks_us() - start;
+    MP_STATE_MEM(gc_stats_sweep_us) += t;
+    if (t > MP_STATE_MEM(gc_stats_sweep_us_max)) {
+        MP_STATE_MEM(gc_stats_sweep_us_max) = t;
+    }
+}
+
+STATIC void gc_stats_sweep_done(void) {
+    MP_STATE_MEM(gc_stats_last_blocks) = MP_STATE_MEM(gc_stats_sweep_blocks);
+    MP_STATE_MEM(gc_stats_total_blocks) += MP_STATE_MEM(gc_stats_sweep_blocks);
+    MP_STATE_MEM(gc_stats_sweep_blocks) = 0;
+}
+#endif
+
+#if !MICROPY_GC_INCREMENTAL
+STATIC void gc_sweep_area(mp_state_mem_area_t *area) {
+    #if MICROPY_GC_SIZE_CLASSES
+    // the free lists are rebuilt from scratch
+    gc_free_list_reset(area);
+    size_t free_run = 0;
+    #endif
+    // free unmarked heads and their tails
+    size_t max_block = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+    for (size_t block = 0; block < max_block;) {
+        if (block % BLOCKS_PER_ATW == 0 && block + BLOCKS_PER_ATW <= max_block) {
+            // try to deal with a whole word of blocks at once
+            uintptr_t w = atw_get(area, block);
+            if (w == 0) {
+                // all free
+                #if MICROPY_GC_SIZE_CLASSES
+                free_run += BLOCKS_PER_ATW;
+                #endif
+                block += BLOCKS_PER_ATW;
+                continue;
+            }
+            if (ATW_HEAD_MASK(w) == 0 && ATW_FREE_MASK(w) == 0) {
+                // all live: unmark the heads
+                atw_set(area, block, w & ~(ATW_MARK_MASK(w) << 1));
+                #if MICROPY_GC_SIZE_CLASSES
+                if (free_run > 0) {
+                    gc_free_list_link(area, block - free_run, free_run);
+                    free_run = 0;
+                }
+                #endif
+                block += BLOCKS_PER_ATW;
+                continue;
+            }
+        }
+
+        switch (ATB_GET_KIND(area, block)) {
+            case AT_HEAD: {
+                #if MICROPY_ENABLE_FINALISER
+                gc_call_finaliser(area, block);
+                #endif
+                DEBUG_printf("gc_sweep(%x)\n", PTR_FROM_BLOCK(area, block));
+                #if MICROPY_PY_GC_COLLECT_RETVAL
+                MP_STATE_MEM(gc_collected)++;
+                #endif
+                // free the head and its tail blocks
+                size_t n_blocks = 1 + gc_atb_tail_run_len(area, block + 1);
+                gc_atb_any_to_free_run(area, block, n_blocks);
+                #if MICROPY_GC_STATS
+                MP_STATE_MEM(gc_stats_sweep_blocks) += n_blocks;
+                #endif
+                #if MICROPY_GC_SIZE_CLASSES
+                free_run += n_blocks;
+                #endif
+                block += n_blocks;
+                continue;
+            }
+
+            case AT_MARK:
+                ATB_MARK_TO_HEAD(area, block);
+                break;
+
+            case AT_FREE:
+                #if MICROPY_GC_SIZE_CLASSES
+                free_run += 1;
+                #endif
+                block += 1;
+                continue;
+
+            default:
+                // tail of a live object
+                break;
+        }
+        #if MICROPY_GC_SIZE_CLASSES
+        if (free_run > 0) {
+            gc_free_list_link(area, block - free_run, free_run);
+            free_run = 0;
+        }
+        #endif
+        block += 1;
+    }
+    #if MICROPY_GC_SIZE_CLASSES
+    if (free_run > 0) {
+        gc_free_list_link(area, max_block - free_run, free_run);
+    }
+    #endif
+}
+
+STATIC void gc_sweep(void) {
+    #if MICROPY_PY_GC_COLLECT_RETVAL
+    MP_STATE_MEM(gc_collected) = 0;
+    #endif
+    #if MICROPY_GC_STATS
+    mp_uint_t start = mp_hal_ticks_us();
+    #endif
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        gc_sweep_area(area);
+    }
+    #if MICROPY_GC_STATS
+    gc_stats_add_sweep_time(start);
+    gc_stats_sweep_done();
+    #endif
+}
+
+#else // MICROPY_GC_INCREMENTAL
+
+// With the incremental collector the sweep is done lazily after the mark.
+// In each area, blocks below gc_sweep_block have been swept; above it, marked
+// heads are live and unmarked heads are garbage.  To keep this true, memory
+// that is allocated above the sweep point is allocated already marked
+// ("black"), and gc_free, gc_nbytes and gc_realloc accept marked heads.
+
+// Sweep the objects in an area starting at its sweep point, until at least
+// n_blocks blocks have been looked at.  Returns the number looked at.
+STATIC size_t gc_sweep_area_some(mp_state_mem_area_t *area, size_t n_blocks) {
+    size_t max_block = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+    size_t start = area->gc_sweep_block;
+    size_t block = start;
+    size_t end = max_block - block > n_blocks ? block + n_blocks : max_block;
+    while (block < end) {
+        if (block % BLOCKS_PER_ATW == 0 && block + BLOCKS_PER_ATW <= max_block) {
+            // if there are no unmarked heads in this word then all we need to
+            // do is unmark the heads (any tails belong to live objects)
+            uintptr_t w = atw_get(area, block);
+            if (ATW_HEAD_MASK(w) == 0) {
+                atw_set(area, block, w & ~(ATW_MARK_MASK(w) << 1));
+                block += BLOCKS_PER_ATW;
+                continue;
+            }
+        }
+
+        switch (ATB_GET_KIND(area, block)) {
+            case AT_HEAD: {
+                #if MICROPY_ENABLE_FINALISER
+                gc_call_finaliser(area, block);
+                #endif
+                DEBUG_printf("gc_sweep(%x)\n", PTR_FROM_BLOCK(area, block));
+                #if MICROPY_PY_GC_COLLECT_RETVAL
+                MP_STATE_MEM(gc_collected)++;
+                #endif
+                // free the head and its tail blocks
+                size_t n_free = 1 + gc_atb_tail_run_len(area, block + 1);
+                gc_atb_any_to_free_run(area, block, n_free);
+                #if MICROPY_GC_STATS
+                MP_STATE_MEM(gc_stats_sweep_blocks) += n_free;
+                #endif
+                #if MICROPY_GC_SIZE_CLASSES
+                gc_free_list_add(area, block, n_free);
+                #else
+                if (block / BLOCKS_PER_ATB < area->gc_last_free_atb_index) {
+                    area->gc_last_free_atb_index = block / BLOCKS_PER_ATB;
+                }
+                #endif
+                block += n_free;
+                break;
+            }
+
+            case AT_MARK:
+                ATB_MARK_TO_HEAD(area, block);
+                block += 1;
+                break;
+
+            default:
+                // free blocks, and tail blocks of live objects
+                block += 1;
+                break;
+        }
+    }
+    area->gc_sweep_block = block;
+    return block - start;
+}
+
+// Sweep at least n_blocks blocks, moving on through the areas as each one is
+// done.  Returns true if the sweep is complete.
+STATIC bool gc_sweep_some(size_t n_blocks) {
+    mp_state_mem_area_t *area = MP_STATE_MEM(gc_sweep_area);
+    if (area == NULL) {
+        return true;
+    }
+    #if MICROPY_GC_STATS
+    mp_uint_t start = mp_hal_ticks_us();
+    #endif
+    for (;;) {
+        size_t n_swept = gc_sweep_area_some(area, n_blocks);
+        n_blocks = n_swept < n_blocks ? n_blocks - n_swept : 0;
+        if (area->gc_sweep_block < area->gc_alloc_table_byte_len * BLOCKS_PER_ATB) {
+            // more to do in this area
+            MP_STATE_MEM(gc_sweep_area) = area;
+            #if MICROPY_GC_STATS
+            gc_stats_add_sweep_time(start);
+            #endif
+            return false;
+        }
+        area = NEXT_AREA(area);
+        if (area == NULL) {
+            break;
+        }
+    }
+    MP_STATE_MEM(gc_sweep_area) = NULL;
+    #if MICROPY_GC_STATS
+    gc_stats_add_sweep_time(start);
+    gc_stats_sweep_done();
+    #endif
+    #if MICROPY_GC_SPLIT_HEAP_AUTO
+    gc_release_free_areas();
     #endif
-
-    DEBUG_printf("GC layout:\n");
-    DEBUG_printf("  alloc table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", MP_STATE_MEM(gc_alloc_table_start), MP_STATE_MEM(gc_alloc_table_byte_len), MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB);
-#if MICROPY_ENABLE_FINALISER
-    DEBUG_printf("  finaliser table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", MP_STATE_MEM(gc_finaliser_table_start), gc_finaliser_table_byte_len, gc_finaliser_table_byte_len * BLOCKS_PER_FTB);
-#endif
-    DEBUG_printf("  pool at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", MP_STATE_MEM(gc_pool_start), gc_pool_block_len * BYTES_PER_BLOCK, gc_pool_block_len);
+    return true;
 }
 
-void gc_lock(void) {
-    GC_ENTER();
+// do some of the pending sweep, with the GC locked so finalisers can't allocate
+STATIC void gc_sweep_incremental(size_t n_blocks) {
     MP_STATE_MEM(gc_lock_depth)++;
-    GC_EXIT();
+    gc_sweep_some(n_blocks);
+    MP_STATE_MEM(gc_lock_depth)--;
 }
 
-void gc_unlock(void) {
+#define GC_SWEEP_PENDING() (MP_STATE_MEM(gc_sweep_area) != NULL)
+
+bool gc_sweep_step(size_t n_blocks) {
     GC_ENTER();
-    MP_STATE_MEM(gc_lock_depth)--;
+    if (MP_STATE_MEM(gc_lock_depth) == 0 && GC_SWEEP_PENDING()) {
+        gc_sweep_incremental(n_blocks);
+    }
+    bool done = !GC_SWEEP_PENDING();
     GC_EXIT();
+    return done;
 }
 
-bool gc_is_locked(void) {
-    return MP_STATE_MEM(gc_lock_depth) != 0;
-}
-
-// ptr should be of type void*
-#define VERIFY_PTR(ptr) ( \
-        ((uintptr_t)(ptr) & (BYTES_PER_BLOCK - 1)) == 0      /* must be aligned on a block */ \
-        && ptr >= (void*)MP_STATE_MEM(gc_pool_start)     /* must be above start of pool */ \
-        && ptr < (void*)MP_STATE_MEM(gc_pool_end)        /* must be below end of pool */ \
-    )
-
-// ptr should be of type void*
-#define VERIFY_MARK_AND_PUSH(ptr) \
-    do { \
-        if (VERIFY_PTR(ptr)) { \
-            size_t _block = BLOCK_FROM_PTR(ptr); \
-            if (ATB_GET_KIND(_block) == AT_HEAD) { \
-                /* an unmarked head, mark it, and push it on gc stack */ \
-                DEBUG_printf("gc_mark(%p)\n", ptr); \
-                ATB_HEAD_TO_MARK(_block); \
-                if (MP_STATE_MEM(gc_sp) < &MP_STATE_MEM(gc_stack)[MICROPY_ALLOC_GC_STACK_SIZE]) { \
-                    *MP_STATE_MEM(gc_sp)++ = _block; \
-                } else { \
-                    MP_STATE_MEM(gc_stack_overflow) = 1; \
-                } \
-            } \
-        } \
-    } while (0)
-
-STATIC void gc_drain_stack(void) {
-    while (MP_STATE_MEM(gc_sp) > MP_STATE_MEM(gc_stack)) {
-        // pop the next block off the stack
-        size_t block = *--MP_STATE_MEM(gc_sp);
-
-        // work out number of consecutive blocks in the chain starting with this one
-        size_t n_blocks = 0;
-        do {
-            n_blocks += 1;
-        } while (ATB_GET_KIND(block + n_blocks) == AT_TAIL);
+#endif // MICROPY_GC_INCREMENTAL
 
-        // check this block's children
-        void **ptrs = (void**)PTR_FROM_BLOCK(block);
-        for (size_t i = n_blocks * BYTES_PER_BLOCK / sizeof(void*); i > 0; i--, ptrs++) {
-            void *ptr = *ptrs;
-            VERIFY_MARK_AND_PUSH(ptr);
-        }
+#if MICROPY_GC_ARENA
+// Free n_blocks allocated blocks starting at block.
+STATIC void gc_free_run(mp_state_mem_area_t *area, size_t block, size_t n_blocks) {
+    gc_atb_any_to_free_run(area, block, n_blocks);
+    #if MICROPY_GC_SIZE_CLASSES
+    gc_free_list_add(area, block, n_blocks);
+    #else
+    if (block / BLOCKS_PER_ATB < area->gc_last_free_atb_index) {
+        area->gc_last_free_atb_index = block / BLOCKS_PER_ATB;
     }
+    #endif
 }
 
-STATIC void gc_deal_with_stack_overflow(void) {
-    while (MP_STATE_MEM(gc_stack_overflow)) {
-        MP_STATE_MEM(gc_stack_overflow) = 0;
-        MP_STATE_MEM(gc_sp) = MP_STATE_MEM(gc_stack);
-
-        // scan entire memory looking for blocks which have been marked but not their children
-        for (size_t block = 0; block < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB; block++) {
-            // trace (again) if mark bit set
-            if (ATB_GET_KIND(block) == AT_MARK) {
-                *MP_STATE_MEM(gc_sp)++ = block;
-                gc_drain_stack();
+// When collecting an arena, every allocated block outside it is treated as a
+// root, so that objects that are referenced from the rest of the heap survive.
+// Only words that point into the arena need to be looked at further.
+STATIC void gc_collect_outside_local(void) {
+    uintptr_t start = (uintptr_t)MP_STATE_MEM(gc_local_start);
+    uintptr_t len = (uintptr_t)MP_STATE_MEM(gc_local_end) - start;
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        size_t max_block = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+        for (size_t block = 0; block < max_block; block++) {
+            if (block % BLOCKS_PER_ATW == 0 && block + BLOCKS_PER_ATW <= max_block && atw_get(area, block) == 0) {
+                // skip a whole word of free blocks
+                block += BLOCKS_PER_ATW - 1;
+                continue;
+            }
+            uintptr_t *ptrs = (uintptr_t*)PTR_FROM_BLOCK(area, block);
+            if (ATB_GET_KIND(area, block) == AT_FREE || (uintptr_t)ptrs - start < len) {
+                continue;
+            }
+            for (size_t i = 0; i < WORDS_PER_BLOCK; i++) {
+                if (ptrs[i] - start < len) {
+                    VERIFY_MARK_AND_PUSH((void*)ptrs[i]);
+                    gc_drain_stack();
+                }
             }
         }
     }
 }
 
-STATIC void gc_sweep(void) {
+// Sweep the arena being collected, returning the number of objects in it
+// that survived.
+STATIC size_t gc_sweep_local(void) {
     #if MICROPY_PY_GC_COLLECT_RETVAL
     MP_STATE_MEM(gc_collected) = 0;
     #endif
-    // free unmarked heads and their tails
-    int free_tail = 0;
-    for (size_t block = 0; block < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB; block++) {
-        switch (ATB_GET_KIND(block)) {
-            case AT_HEAD:
-#if MICROPY_ENABLE_FINALISER
-                if (FTB_GET(block)) {
-                    #if MICROPY_PY_THREAD
-                    // TODO need to think about reentrancy with finaliser code
-                    assert(!"finaliser with threading not implemented");
-                    #endif
-                    mp_obj_base_t *obj = (mp_obj_base_t*)PTR_FROM_BLOCK(block);
-                    if (obj->type != NULL) {
-                        // if the object has a type then see if it has a __del__ method
-                        mp_obj_t dest[2];
-                        mp_load_method_maybe(MP_OBJ_FROM_PTR(obj), MP_QSTR___del__, dest);
-                        if (dest[0] != MP_OBJ_NULL) {
-                            // load_method returned a method
-                            mp_call_method_n_kw(0, 0, dest);
-                        }
-                    }
-                    // clear finaliser flag
-                    FTB_CLEAR(block);
-                }
-#endif
-                free_tail = 1;
-                DEBUG_printf("gc_sweep(%x)\n", PTR_FROM_BLOCK(block));
+    #if MICROPY_GC_STATS
+    mp_uint_t start = mp_hal_ticks_us();
+    #endif
+    mp_state_mem_area_t *area = MP_STATE_MEM(gc_local_area);
+    size_t block = BLOCK_FROM_PTR(area, MP_STATE_MEM(gc_local_start));
+    size_t end = BLOCK_FROM_PTR(area, MP_STATE_MEM(gc_local_end));
+    size_t n_live = 0;
+    while (block < end) {
+        switch (ATB_GET_KIND(area, block)) {
+            case AT_HEAD: {
+                #if MICROPY_ENABLE_FINALISER
+                gc_call_finaliser(area, block);
+                #endif
                 #if MICROPY_PY_GC_COLLECT_RETVAL
                 MP_STATE_MEM(gc_collected)++;
                 #endif
-                // fall through to free the head
-
-            case AT_TAIL:
-                if (free_tail) {
-                    ATB_ANY_TO_FREE(block);
-                }
+                size_t n_blocks = 1 + gc_atb_tail_run_len(area, block + 1);
+                #if MICROPY_GC_STATS
+                MP_STATE_MEM(gc_stats_sweep_blocks) += n_blocks;
+                #endif
+                gc_free_run(area, block, n_blocks);
+                block += n_blocks;
                 break;
+            }
 
             case AT_MARK:
-                ATB_MARK_TO_HEAD(block);
-                free_tail = 0;
+                ATB_MARK_TO_HEAD(area, block);
+                n_live += 1;
+                block += 1;
+                break;
+
+            default:
+                block += 1;
                 break;
         }
     }
+    MP_STATE_MEM(gc_local_end) = NULL;
+    #if MICROPY_GC_STATS
+    gc_stats_add_sweep_time(start);
+    gc_stats_sweep_done();
+    #endif
+    return n_live;
 }
+#endif
 
 void gc_collect_start(void) {
     GC_ENTER();
     MP_STATE_MEM(gc_lock_depth)++;
+    #if MICROPY_GC_INCREMENTAL
+    // finish the sweep of the previous collection before marking again
+    gc_sweep_some((size_t)-1);
+    #endif
+    #if MICROPY_GC_ARENA
+    gc_arena_t *arena = MP_STATE_THREAD(gc_arena);
+    if (arena != NULL && arena->exiting) {
+        // only collect the blocks that were allocated from the arena; the
+        // unused part is freed
+        mp_state_mem_area_t *area = arena->area;
+        size_t end_block = arena->end_block;
+        if (arena->reserve != NULL) {
+            end_block = BLOCK_FROM_PTR(area, arena->reserve);
+            gc_free_run(area, end_block, arena->end_block - end_block);
+            arena->reserve = NULL;
+        }
+        MP_STATE_MEM(gc_local_area) = area;
+        MP_STATE_MEM(gc_local_start) = (byte*)PTR_FROM_BLOCK(area, arena->start_block);
+        MP_STATE_MEM(gc_local_end) = (byte*)PTR_FROM_BLOCK(area, end_block);
+    }
+    #endif
     #if MICROPY_GC_ALLOC_THRESHOLD
-    MP_STATE_MEM(gc_alloc_amount) = 0;
+    if (!GC_COLLECTING_ARENA()) {
+        MP_STATE_MEM(gc_alloc_amount) = 0;
+    }
+    #endif
+    #if MICROPY_GC_STATS
+    MP_STATE_MEM(gc_stats_collections)++;
+    MP_STATE_MEM(gc_stats_mark_start) = mp_hal_ticks_us();
     #endif
     MP_STATE_MEM(gc_stack_overflow) = 0;
     MP_STATE_MEM(gc_sp) = MP_STATE_MEM(gc_stack);
@@ -310,6 +1226,12 @@ void gc_collect_start(void) {
     // dict_globals, then the root pointer section of mp_state_vm.
     void **ptrs = (void**)(void*)&mp_state_ctx;
     gc_collect_root(ptrs, offsetof(mp_state_ctx_t, vm.qstr_last_chunk) / sizeof(void*));
+    #if MICROPY_GC_TLAB
+    gc_collect_tlab();
+    #endif
+    #if MICROPY_GC_ARENA
+    gc_collect_arenas();
+    #endif
 }
 
 void gc_collect_root(void **ptrs, size_t len) {
@@ -320,69 +1242,223 @@ void gc_collect_root(void **ptrs, size_t len) {
     }
 }
 
+#if MICROPY_GC_TLAB
+void gc_collect_tlab(void) {
+    mp_state_thread_t *ts = mp_thread_get_state();
+    void *ptr = ts->gc_tlab_ptr;
+    void *end = ts->gc_tlab_end;
+    #if MICROPY_GC_ARENA
+    if (GC_COLLECTING_ARENA()
+        && ((byte*)end <= MP_STATE_MEM(gc_local_start) || (byte*)ptr >= MP_STATE_MEM(gc_local_end))) {
+        // the collection of an arena doesn't free anything outside it, so
+        // the buffer can be kept
+        return;
+    }
+    #endif
+    ts->gc_tlab_ptr = NULL;
+    ts->gc_tlab_end = NULL;
+    // This may interrupt the thread in the middle of taking a block from the
+    // buffer (see gc_alloc), so keep the block it is about to get alive.  The
+    // rest of the buffer is unreferenced and gets swept as normal.
+    if (ptr < end) {
+        gc_collect_root(&ptr, 1);
+    }
+}
+#endif
+
+#if MICROPY_GC_ARENA
+void gc_collect_arenas(void) {
+    // the thread state only has a pointer into the object holding each arena,
+    // which doesn't keep it alive
+    for (gc_arena_t *arena = MP_STATE_THREAD(gc_arena); arena != NULL; arena = arena->prev) {
+        gc_collect_root(&arena->owner, 1);
+    }
+}
+#endif
+
 void gc_collect_end(void) {
+    #if MICROPY_GC_ARENA
+    if (GC_COLLECTING_ARENA()) {
+        gc_collect_outside_local();
+    }
+    #endif
     gc_deal_with_stack_overflow();
-    gc_sweep();
-    MP_STATE_MEM(gc_last_free_atb_index) = 0;
+    #if MICROPY_GC_AUX_STACK
+    gc_aux_stack_free();
+    #endif
+    #if MICROPY_GC_STATS
+    mp_uint_t t = mp_hal_ticks_us() - MP_STATE_MEM(gc_stats_mark_start);
+    MP_STATE_MEM(gc_stats_mark_us) += t;
+    if (t > MP_STATE_MEM(gc_stats_mark_us_max)) {
+        MP_STATE_MEM(gc_stats_mark_us_max) = t;
+    }
+    #endif
+    #if MICROPY_GC_ARENA
+    if (GC_COLLECTING_ARENA()) {
+        gc_arena_t *arena = MP_STATE_THREAD(gc_arena);
+        arena->escaped = gc_sweep_local();
+        arena->exiting = false;
+    } else
+    #endif
+    {
+        #if MICROPY_GC_INCREMENTAL
+        // start the sweep; it's done a bit at a time by subsequent allocations
+        #if MICROPY_PY_GC_COLLECT_RETVAL
+        MP_STATE_MEM(gc_collected) = 0;
+        #endif
+        for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+            area->gc_sweep_block = 0;
+        }
+        MP_STATE_MEM(gc_sweep_area) = &MP_STATE_MEM(area);
+        #else
+        gc_sweep();
+        #if MICROPY_GC_SPLIT_HEAP_AUTO
+        gc_release_free_areas();
+        #endif
+        #endif
+    }
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        area->gc_last_free_atb_index = 0;
+    }
+    #if MICROPY_GC_STATS
+    // the collection may have been caused by any allocation, so the callback
+    // can't run here; it's run by gc_stats_run_callback once that's safe
+    mp_obj_t callback = MP_STATE_VM(gc_callback);
+    if (callback != MP_OBJ_NULL && callback != mp_const_none) {
+        MP_STATE_MEM(gc_callback_pending) = true;
+    }
+    #endif
     MP_STATE_MEM(gc_lock_depth)--;
     GC_EXIT();
 }
 
+#if MICROPY_GC_STATS
+// Call the function set by gc.callback, if a collection has ended since it was
+// last called.  This runs Python code so must only be called where the VM
+// could make a call, not from within the allocator.
+void gc_stats_run_callback(void) {
+    if (!MP_STATE_MEM(gc_callback_pending) || MP_STATE_MEM(gc_lock_depth) > 0) {
+        return;
+    }
+    MP_STATE_MEM(gc_callback_pending) = false;
+    mp_obj_t callback = MP_STATE_VM(gc_callback);
+    if (callback == MP_OBJ_NULL || callback == mp_const_none) {
+        return;
+    }
+    // the callback is replaced by None while it runs, so that a collection it
+    // causes doesn't call it again
+    MP_STATE_VM(gc_callback) = mp_const_none;
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_call_function_0(callback);
+        nlr_pop();
+    } else {
+        // the callback runs between arbitrary opcodes, so exceptions can't
+        // propagate from here
+        mp_printf(&mp_plat_print, "Exception in gc callback:\n");
+        mp_obj_print_exception(&mp_plat_print, MP_OBJ_FROM_PTR(nlr.ret_val));
+    }
+    if (MP_STATE_VM(gc_callback) == mp_const_none) {
+        MP_STATE_VM(gc_callback) = callback;
+    }
+}
+
+void gc_stats(gc_stats_t *stats) {
+    GC_ENTER();
+    stats->collections = MP_STATE_MEM(gc_stats_collections);
+    stats->finalisers = MP_STATE_MEM(gc_stats_finalisers);
+    stats->mark_us = MP_STATE_MEM(gc_stats_mark_us);
+    stats->sweep_us = MP_STATE_MEM(gc_stats_sweep_us);
+    stats->mark_us_max = MP_STATE_MEM(gc_stats_mark_us_max);
+    stats->sweep_us_max = MP_STATE_MEM(gc_stats_sweep_us_max);
+    stats->reclaimed_blocks = MP_STATE_MEM(gc_stats_last_blocks);
+    stats->reclaimed_total = MP_STATE_MEM(gc_stats_total_blocks);
+
+    // histogram of the lengths of the runs of free blocks
+    memset(stats->free_runs, 0, sizeof(stats->free_runs));
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        size_t max_block = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+        size_t run = 0;
+        for (size_t block = 0; block <= max_block; block++) {
+            if (block < max_block && ATB_GET_KIND(area, block) == AT_FREE) {
+                run += 1;
+            } else if (run > 0) {
+                size_t i = 0;
+                while (run >>= 1) {
+                    i += 1;
+                }
+                stats->free_runs[MIN(i, GC_STATS_FREE_RUNS - 1)] += 1;
+            }
+        }
+    }
+    GC_EXIT();
+}
+#endif
+
 void gc_info(gc_info_t *info) {
     GC_ENTER();
-    info->total = MP_STATE_MEM(gc_pool_end) - MP_STATE_MEM(gc_pool_start);
+    info->total = 0;
     info->used = 0;
     info->free = 0;
     info->max_free = 0;
     info->num_1block = 0;
     info->num_2block = 0;
     info->max_block = 0;
-    bool finish = false;
-    for (size_t block = 0, len = 0, len_free = 0; !finish;) {
-        size_t kind = ATB_GET_KIND(block);
-        switch (kind) {
-            case AT_FREE:
-                info->free += 1;
-                len_free += 1;
-                len = 0;
-                break;
-
-            case AT_HEAD:
-                info->used += 1;
-                len = 1;
-                break;
-
-            case AT_TAIL:
-                info->used += 1;
-                len += 1;
-                break;
-
-            case AT_MARK:
-                // shouldn't happen
-                break;
-        }
-
-        block++;
-        finish = (block == MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB);
-        // Get next block type if possible
-        if (!finish) {
-            kind = ATB_GET_KIND(block);
-        }
-
-        if (finish || kind == AT_FREE || kind == AT_HEAD) {
-            if (len == 1) {
-                info->num_1block += 1;
-            } else if (len == 2) {
-                info->num_2block += 1;
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        info->total += area->gc_pool_end - area->gc_pool_start;
+        bool finish = false;
+        for (size_t block = 0, len = 0, len_free = 0; !finish;) {
+            size_t kind = ATB_GET_KIND(area, block);
+            switch (kind) {
+                case AT_FREE:
+                    info->free += 1;
+                    len_free += 1;
+                    len = 0;
+                    break;
+
+                case AT_HEAD:
+                #if MICROPY_GC_INCREMENTAL
+                // marked heads are live objects that haven't been swept yet
+                case AT_MARK:
+                #endif
+                    info->used += 1;
+                    len = 1;
+                    break;
+
+                case AT_TAIL:
+                    info->used += 1;
+                    len += 1;
+                    break;
+
+                #if !MICROPY_GC_INCREMENTAL
+                case AT_MARK:
+                    // shouldn't happen
+                    break;
+                #endif
             }
-            if (len > info->max_block) {
-                info->max_block = len;
+
+            block++;
+            finish = (block == area->gc_alloc_table_byte_len * BLOCKS_PER_ATB);
+            // Get next block type if possible
+            if (!finish) {
+                kind = ATB_GET_KIND(area, block);
             }
-            if (finish || kind == AT_HEAD) {
-                if (len_free > info->max_free) {
-                    info->max_free = len_free;
+
+            if (finish || kind == AT_FREE || ATB_IS_ALLOCATED_HEAD(area, block)) {
+                if (len == 1) {
+                    info->num_1block += 1;
+                } else if (len == 2) {
+                    info->num_2block += 1;
+                }
+                if (len > info->max_block) {
+                    info->max_block = len;
+                }
+                if (finish || ATB_IS_ALLOCATED_HEAD(area, block)) {
+                    if (len_free > info->max_free) {
+                        info->max_free = len_free;
+                    }
+                    len_free = 0;
                 }
-                len_free = 0;
             }
         }
     }
@@ -392,7 +1468,7 @@ void gc_info(gc_info_t *info) {
     GC_EXIT();
 }
 
-void *gc_alloc(size_t n_bytes, bool has_finaliser) {
+STATIC void *gc_alloc_run(size_t n_bytes, bool has_finaliser, bool can_collect) {
     size_t n_blocks = ((n_bytes + BYTES_PER_BLOCK - 1) & (~(BYTES_PER_BLOCK - 1))) / BYTES_PER_BLOCK;
     DEBUG_printf("gc_alloc(" UINT_FMT " bytes -> " UINT_FMT " blocks)\n", n_bytes, n_blocks);
 
@@ -409,11 +1485,17 @@ void *gc_alloc(size_t n_bytes, bool has_finaliser) {
         return NULL;
     }
 
+    #if !MICROPY_GC_SIZE_CLASSES
     size_t i;
+    size_t n_free;
+    #endif
     size_t end_block;
     size_t start_block;
-    size_t n_free = 0;
-    int collected = !MP_STATE_MEM(gc_auto_collect_enabled);
+    mp_state_mem_area_t *area;
+    int collected = !can_collect || !MP_STATE_MEM(gc_auto_collect_enabled);
+    #if MICROPY_GC_SPLIT_HEAP_AUTO
+    bool added = false;
+    #endif
 
     #if MICROPY_GC_ALLOC_THRESHOLD
     if (!collected && MP_STATE_MEM(gc_alloc_amount) >= MP_STATE_MEM(gc_alloc_threshold)) {
@@ -423,20 +1505,74 @@ void *gc_alloc(size_t n_bytes, bool has_finaliser) {
     }
     #endif
 
+    #if MICROPY_GC_INCREMENTAL
+    // pay for this allocation with a proportional amount of sweeping
+    if (GC_SWEEP_PENDING()) {
+        gc_sweep_incremental(n_blocks * MICROPY_GC_INCREMENTAL_SWEEP_RATIO);
+    }
+    #endif
+
     for (;;) {
 
-        // look for a run of n_blocks available blocks
-        for (i = MP_STATE_MEM(gc_last_free_atb_index); i < MP_STATE_MEM(gc_alloc_table_byte_len); i++) {
-            byte a = MP_STATE_MEM(gc_alloc_table_start)[i];
-            if (ATB_0_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 0; goto found; } } else { n_free = 0; }
-            if (ATB_1_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 1; goto found; } } else { n_free = 0; }
-            if (ATB_2_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 2; goto found; } } else { n_free = 0; }
-            if (ATB_3_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 3; goto found; } } else { n_free = 0; }
+        for (area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+            #if MICROPY_GC_SIZE_CLASSES
+            // take a run of n_blocks blocks from the free lists
+            start_block = gc_free_list_take(area, n_blocks);
+            if (start_block != FREE_RUN_NIL) {
+                end_block = start_block + n_blocks - 1;
+                goto found_run;
+            }
+            #else
+            // look for a run of n_blocks available blocks
+            n_free = 0;
+            for (i = area->gc_last_free_atb_index; i < area->gc_alloc_table_byte_len; i++) {
+                if (i % sizeof(uintptr_t) == 0 && i + sizeof(uintptr_t) <= area->gc_alloc_table_byte_len) {
+                    // skip over whole words that are completely free or completely used
+                    uintptr_t w = atw_get(area, i * BLOCKS_PER_ATB);
+                    if (w == 0) {
+                        if (n_free + BLOCKS_PER_ATW >= n_blocks) {
+                            i = i * BLOCKS_PER_ATB + n_blocks - n_free - 1;
+                            n_free = n_blocks;
+                            goto found;
+                        }
+                        n_free += BLOCKS_PER_ATW;
+                        i += sizeof(uintptr_t) - 1;
+                        continue;
+                    }
+                    if (ATW_FREE_MASK(w) == 0) {
+                        n_free = 0;
+                        i += sizeof(uintptr_t) - 1;
+                        continue;
+                    }
+                }
+                byte a = area->gc_alloc_table_start[i];
+                if (ATB_0_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 0; goto found; } } else { n_free = 0; }
+                if (ATB_1_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 1; goto found; } } else { n_free = 0; }
+                if (ATB_2_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 2; goto found; } } else { n_free = 0; }
+                if (ATB_3_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 3; goto found; } } else { n_free = 0; }
+            }
+            #endif
+        }
+
+        #if MICROPY_GC_INCREMENTAL
+        // sweep some more before resorting to a new collection
+        if (GC_SWEEP_PENDING()) {
+            gc_sweep_incremental(MICROPY_GC_INCREMENTAL_SWEEP_CHUNK);
+            continue;
         }
+        #endif
 
         GC_EXIT();
         // nothing found!
         if (collected) {
+            #if MICROPY_GC_SPLIT_HEAP_AUTO
+            // try to grow the heap, once
+            if (can_collect && !added && gc_try_add_heap(n_bytes)) {
+                added = true;
+                GC_ENTER();
+                continue;
+            }
+            #endif
             return NULL;
         }
         DEBUG_printf("gc_alloc(" UINT_FMT "): no free mem, triggering GC\n", n_bytes);
@@ -445,6 +1581,9 @@ void *gc_alloc(size_t n_bytes, bool has_finaliser) {
         GC_ENTER();
     }
 
+    #if MICROPY_GC_SIZE_CLASSES
+found_run:
+    #else
     // found, ending at block i inclusive
 found:
     // get starting and end blocks, both inclusive
@@ -457,21 +1596,26 @@ found:
     // before this one.  Also, whenever we free or shink a block we must check
     // if this index needs adjusting (see gc_realloc and gc_free).
     if (n_free == 1) {
-        MP_STATE_MEM(gc_last_free_atb_index) = (i + 1) / BLOCKS_PER_ATB;
+        area->gc_last_free_atb_index = (i + 1) / BLOCKS_PER_ATB;
     }
+    #endif
 
     // mark first block as used head
-    ATB_FREE_TO_HEAD(start_block);
+    ATB_FREE_TO_HEAD(area, start_block);
 
-    // mark rest of blocks as used tail
-    // TODO for a run of many blocks can make this more efficient
-    for (size_t bl = start_block + 1; bl <= end_block; bl++) {
-        ATB_FREE_TO_TAIL(bl);
+    #if MICROPY_GC_INCREMENTAL
+    // allocate black if the sweep has yet to reach this memory
+    if (start_block >= area->gc_sweep_block) {
+        ATB_HEAD_TO_MARK(area, start_block);
     }
+    #endif
+
+    // mark rest of blocks as used tail
+    gc_atb_free_to_tail_run(area, start_block + 1, end_block - start_block);
 
     // get pointer to first block
     // we must create this pointer before unlocking the GC so a collection can find it
-    void *ret_ptr = (void*)(MP_STATE_MEM(gc_pool_start) + start_block * BYTES_PER_BLOCK);
+    void *ret_ptr = (void*)(area->gc_pool_start + start_block * BYTES_PER_BLOCK);
     DEBUG_printf("gc_alloc(%p)\n", ret_ptr);
 
     #if MICROPY_GC_ALLOC_THRESHOLD
@@ -498,7 +1642,7 @@ found:
         ((mp_obj_base_t*)ret_ptr)->type = NULL;
         // set mp_obj flag only if it has a finaliser
         GC_ENTER();
-        FTB_SET(start_block);
+        FTB_SET(area, start_block);
         GC_EXIT();
     }
     #else
@@ -512,6 +1656,148 @@ found:
     return ret_ptr;
 }
 
+#if MICROPY_GC_TLAB
+// Give the calling thread a new allocation buffer and return its first block.
+// The buffer is a run of blocks that are each set up as a single-block head,
+// so the thread can hand them out one at a time without touching the GC
+// tables.  No collection is done to find the buffer.
+STATIC void *gc_tlab_refill(mp_state_thread_t *ts) {
+    byte *ptr = gc_alloc_run(MICROPY_GC_TLAB_BLOCKS * BYTES_PER_BLOCK, false, false);
+    if (ptr == NULL) {
+        return NULL;
+    }
+    memset(ptr, 0, MICROPY_GC_TLAB_BLOCKS * BYTES_PER_BLOCK);
+
+    GC_ENTER();
+    mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+    size_t block = BLOCK_FROM_PTR(area, ptr);
+    for (size_t n = 1; n < MICROPY_GC_TLAB_BLOCKS; n++) {
+        ATB_ANY_TO_FREE(area, block + n);
+        ATB_FREE_TO_HEAD(area, block + n);
+        #if MICROPY_GC_INCREMENTAL
+        // the sweep point may be part way through the buffer, so each
+        // block is allocated black or not on its own
+        if (block + n >= area->gc_sweep_block) {
+            ATB_HEAD_TO_MARK(area, block + n);
+        }
+        #endif
+    }
+    // this must be set while the GC is locked so a collection retires it
+    ts->gc_tlab_ptr = ptr + BYTES_PER_BLOCK;
+    ts->gc_tlab_end = ptr + MICROPY_GC_TLAB_BLOCKS * BYTES_PER_BLOCK;
+    GC_EXIT();
+
+    return ptr;
+}
+#endif
+
+#if MICROPY_GC_ARENA
+// Start allocating from a new arena of n_bytes, reserved as a single object.
+// Objects are then allocated from the start of the unused part of the arena
+// by splitting its head, until the arena is exited.  owner is the heap object
+// that arena is part of.  Returns false if the memory can't be reserved.
+bool gc_arena_enter(gc_arena_t *arena, void *owner, size_t n_bytes) {
+    size_t n_blocks = (n_bytes + BYTES_PER_BLOCK - 1) / BYTES_PER_BLOCK;
+    byte *ptr = gc_alloc_run(n_blocks * BYTES_PER_BLOCK, false, true);
+    if (ptr == NULL) {
+        return false;
+    }
+    memset(ptr, 0, n_blocks * BYTES_PER_BLOCK);
+
+    GC_ENTER();
+    mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+    arena->prev = MP_STATE_THREAD(gc_arena);
+    arena->owner = owner;
+    arena->area = area;
+    arena->start_block = BLOCK_FROM_PTR(area, ptr);
+    arena->end_block = arena->start_block + n_blocks;
+    arena->reserve = ptr;
+    arena->exiting = false;
+    arena->escaped = 0;
+    MP_STATE_THREAD(gc_arena) = arena;
+    GC_EXIT();
+
+    return true;
+}
+
+// Stop allocating from the arena and free the objects allocated from it that
+// are no longer referenced, without collecting the rest of the heap.  Returns
+// the number of objects that are still referenced, which stay allocated.
+size_t gc_arena_exit(gc_arena_t *arena) {
+    if (arena->reserve == (void*)PTR_FROM_BLOCK(arena->area, arena->start_block)) {
+        // nothing was allocated from it
+        gc_free(arena->reserve);
+        arena->reserve = NULL;
+    } else {
+        arena->exiting = true;
+        gc_collect();
+    }
+    MP_STATE_THREAD(gc_arena) = arena->prev;
+    return arena->escaped;
+}
+
+STATIC void *gc_arena_alloc(gc_arena_t *arena, size_t n_bytes) {
+    size_t n_blocks = (n_bytes + BYTES_PER_BLOCK - 1) / BYTES_PER_BLOCK;
+    GC_ENTER();
+    byte *ptr = arena->reserve;
+    if (ptr == NULL || n_blocks == 0 || MP_STATE_MEM(gc_lock_depth) > 0) {
+        GC_EXIT();
+        return NULL;
+    }
+    mp_state_mem_area_t *area = arena->area;
+    size_t block = BLOCK_FROM_PTR(area, ptr) + n_blocks;
+    if (block > arena->end_block) {
+        // doesn't fit
+        GC_EXIT();
+        return NULL;
+    }
+    if (block == arena->end_block) {
+        arena->reserve = NULL;
+    } else {
+        // the rest of the unused part gets a new head
+        ATB_ANY_TO_FREE(area, block);
+        ATB_FREE_TO_HEAD(area, block);
+        #if MICROPY_GC_INCREMENTAL
+        if (block >= area->gc_sweep_block) {
+            ATB_HEAD_TO_MARK(area, block);
+        }
+        #endif
+        arena->reserve = (void*)PTR_FROM_BLOCK(area, block);
+    }
+    GC_EXIT();
+    return ptr;
+}
+#endif
+
+void *gc_alloc(size_t n_bytes, bool has_finaliser) {
+    #if MICROPY_GC_ARENA
+    // objects with finalisers are always allocated from the heap
+    gc_arena_t *arena = MP_STATE_THREAD(gc_arena);
+    if (arena != NULL && !has_finaliser) {
+        void *ptr = gc_arena_alloc(arena, n_bytes);
+        if (ptr != NULL) {
+            return ptr;
+        }
+    }
+    #endif
+    #if MICROPY_GC_TLAB
+    // take single-block objects from the thread's allocation buffer, unlocked
+    if (n_bytes - 1 < BYTES_PER_BLOCK && !has_finaliser && MP_STATE_MEM(gc_lock_depth) == 0) {
+        mp_state_thread_t *ts = mp_thread_get_state();
+        byte *ptr = ts->gc_tlab_ptr;
+        if (ptr < ts->gc_tlab_end) {
+            ts->gc_tlab_ptr = ptr + BYTES_PER_BLOCK;
+            return ptr;
+        }
+        ptr = gc_tlab_refill(ts);
+        if (ptr != NULL) {
+            return ptr;
+        }
+    }
+    #endif
+    return gc_alloc_run(n_bytes, has_finaliser, true);
+}
+
 /*
 void *gc_alloc(mp_uint_t n_bytes) {
     return _gc_alloc(n_bytes, false);
@@ -534,22 +1820,25 @@ void gc_free(void *ptr) {
 
     DEBUG_printf("gc_free(%p)\n", ptr);
 
-    if (VERIFY_PTR(ptr)) {
-        size_t block = BLOCK_FROM_PTR(ptr);
-        if (ATB_GET_KIND(block) == AT_HEAD) {
+    mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+    if (area != NULL) {
+        size_t block = BLOCK_FROM_PTR(area, ptr);
+        if (ATB_IS_ALLOCATED_HEAD(area, block)) {
             #if MICROPY_ENABLE_FINALISER
-            FTB_CLEAR(block);
+            FTB_CLEAR(area, block);
             #endif
             // set the last_free pointer to this block if it's earlier in the heap
-            if (block / BLOCKS_PER_ATB < MP_STATE_MEM(gc_last_free_atb_index)) {
-                MP_STATE_MEM(gc_last_free_atb_index) = block / BLOCKS_PER_ATB;
+            if (block / BLOCKS_PER_ATB < area->gc_last_free_atb_index) {
+                area->gc_last_free_atb_index = block / BLOCKS_PER_ATB;
             }
 
             // free head and all of its tail blocks
-            do {
-                ATB_ANY_TO_FREE(block);
-                block += 1;
-            } while (ATB_GET_KIND(block) == AT_TAIL);
+            size_t n_blocks = 1 + gc_atb_tail_run_len(area, block + 1);
+            gc_atb_any_to_free_run(area, block, n_blocks);
+
+            #if MICROPY_GC_SIZE_CLASSES
+            gc_free_list_add(area, block, n_blocks);
+            #endif
 
             GC_EXIT();
 
@@ -570,14 +1859,12 @@ void gc_free(void *ptr) {
 
 size_t gc_nbytes(const void *ptr) {
     GC_ENTER();
-    if (VERIFY_PTR(ptr)) {
-        size_t block = BLOCK_FROM_PTR(ptr);
-        if (ATB_GET_KIND(block) == AT_HEAD) {
+    mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+    if (area != NULL) {
+        size_t block = BLOCK_FROM_PTR(area, ptr);
+        if (ATB_IS_ALLOCATED_HEAD(area, block)) {
             // work out number of consecutive blocks in the chain starting with this on
-            size_t n_blocks = 0;
-            do {
-                n_blocks += 1;
-            } while (ATB_GET_KIND(block + n_blocks) == AT_TAIL);
+            size_t n_blocks = 1 + gc_atb_tail_run_len(area, block + 1);
             GC_EXIT();
             return n_blocks * BYTES_PER_BLOCK;
         }
@@ -600,7 +1887,7 @@ void *gc_realloc(void *ptr, mp_uint_t n_bytes) {
             has_finaliser = false;
         } else {
 #if MICROPY_ENABLE_FINALISER
-            has_finaliser = FTB_GET(BLOCK_FROM_PTR((mp_uint_t)ptr));
+            has_finaliser = FTB_GET(area, BLOCK_FROM_PTR(area, (mp_uint_t)ptr));
 #else
             has_finaliser = false;
 #endif
@@ -631,18 +1918,20 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
 
     void *ptr = ptr_in;
 
+    GC_ENTER();
+
     // sanity check the ptr
-    if (!VERIFY_PTR(ptr)) {
+    mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+    if (area == NULL) {
+        GC_EXIT();
         return NULL;
     }
 
     // get first block
-    size_t block = BLOCK_FROM_PTR(ptr);
-
-    GC_ENTER();
+    size_t block = BLOCK_FROM_PTR(area, ptr);
 
     // sanity check the ptr is pointing to the head of a block
-    if (ATB_GET_KIND(block) != AT_HEAD) {
+    if (!ATB_IS_ALLOCATED_HEAD(area, block)) {
         GC_EXIT();
         return NULL;
     }
@@ -662,24 +1951,21 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     // total size of the existing memory chunk so we can correctly and
     // efficiently shrink it (see below for shrinking code).
     size_t n_free   = 0;
-    size_t n_blocks = 1; // counting HEAD block
-    size_t max_block = MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB;
-    for (size_t bl = block + n_blocks; bl < max_block; bl++) {
-        byte block_type = ATB_GET_KIND(bl);
-        if (block_type == AT_TAIL) {
-            n_blocks++;
-            continue;
-        }
-        if (block_type == AT_FREE) {
-            n_free++;
-            if (n_blocks + n_free >= new_blocks) {
-                // stop as soon as we find enough blocks for n_bytes
-                break;
-            }
-            continue;
+    size_t n_blocks = 1 + gc_atb_tail_run_len(area, block + 1); // counting HEAD block
+    size_t max_block = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+    #if MICROPY_GC_SIZE_CLASSES
+    // any free blocks that follow are the start of a free run of known length
+    if (block + n_blocks < max_block && ATB_GET_KIND(area, block + n_blocks) == AT_FREE) {
+        n_free = FREE_RUN_LEN(area, block + n_blocks);
+    }
+    #else
+    for (size_t bl = block + n_blocks; bl < max_block && n_blocks + n_free < new_blocks; bl++) {
+        if (ATB_GET_KIND(area, bl) != AT_FREE) {
+            break;
         }
-        break;
+        n_free++;
     }
+    #endif
 
     // return original ptr if it already has the requested number of blocks
     if (new_blocks == n_blocks) {
@@ -690,15 +1976,17 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     // check if we can shrink the allocated area
     if (new_blocks < n_blocks) {
         // free unneeded tail blocks
-        for (size_t bl = block + new_blocks, count = n_blocks - new_blocks; count > 0; bl++, count--) {
-            ATB_ANY_TO_FREE(bl);
-        }
+        gc_atb_any_to_free_run(area, block + new_blocks, n_blocks - new_blocks);
 
         // set the last_free pointer to end of this block if it's earlier in the heap
-        if ((block + new_blocks) / BLOCKS_PER_ATB < MP_STATE_MEM(gc_last_free_atb_index)) {
-            MP_STATE_MEM(gc_last_free_atb_index) = (block + new_blocks) / BLOCKS_PER_ATB;
+        if ((block + new_blocks) / BLOCKS_PER_ATB < area->gc_last_free_atb_index) {
+            area->gc_last_free_atb_index = (block + new_blocks) / BLOCKS_PER_ATB;
         }
 
+        #if MICROPY_GC_SIZE_CLASSES
+        gc_free_list_add(area, block + new_blocks, n_blocks - new_blocks);
+        #endif
+
         GC_EXIT();
 
         #if EXTENSIVE_HEAP_PROFILING
@@ -710,11 +1998,18 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
 
     // check if we can expand in place
     if (new_blocks <= n_blocks + n_free) {
-        // mark few more blocks as used tail
-        for (size_t bl = block + n_blocks; bl < block + new_blocks; bl++) {
-            assert(ATB_GET_KIND(bl) == AT_FREE);
-            ATB_FREE_TO_TAIL(bl);
+        #if MICROPY_GC_SIZE_CLASSES
+        // the free blocks that follow are the start of a free run
+        size_t run = block + n_blocks;
+        size_t run_len = FREE_RUN_LEN(area, run);
+        gc_free_list_unlink(area, run);
+        if (run_len > new_blocks - n_blocks) {
+            gc_free_list_link(area, block + new_blocks, run_len - (new_blocks - n_blocks));
         }
+        #endif
+
+        // mark few more blocks as used tail
+        gc_atb_free_to_tail_run(area, block + n_blocks, new_blocks - n_blocks);
 
         GC_EXIT();
 
@@ -734,7 +2029,7 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     }
 
     #if MICROPY_ENABLE_FINALISER
-    bool ftb_state = FTB_GET(block);
+    bool ftb_state = FTB_GET(area, block);
     #else
     bool ftb_state = false;
     #endif
@@ -773,110 +2068,112 @@ void gc_dump_info(void) {
 void gc_dump_alloc_table(void) {
     GC_ENTER();
     static const size_t DUMP_BYTES_PER_LINE = 64;
-    #if !EXTENSIVE_HEAP_PROFILING
-    // When comparing heap output we don't want to print the starting
-    // pointer of the heap because it changes from run to run.
-    mp_printf(&mp_plat_print, "GC memory layout; from %p:", MP_STATE_MEM(gc_pool_start));
-    #endif
-    for (size_t bl = 0; bl < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB; bl++) {
-        if (bl % DUMP_BYTES_PER_LINE == 0) {
-            // a new line of blocks
-            {
-                // check if this line contains only free blocks
-                size_t bl2 = bl;
-                while (bl2 < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB && ATB_GET_KIND(bl2) == AT_FREE) {
-                    bl2++;
-                }
-                if (bl2 - bl >= 2 * DUMP_BYTES_PER_LINE) {
-                    // there are at least 2 lines containing only free blocks, so abbreviate their printing
-                    mp_printf(&mp_plat_print, "\n       (%u lines all free)", (uint)(bl2 - bl) / DUMP_BYTES_PER_LINE);
-                    bl = bl2 & (~(DUMP_BYTES_PER_LINE - 1));
-                    if (bl >= MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB) {
-                        // got to end of heap
-                        break;
-                    }
-                }
-            }
-            // print header for new line of blocks
-            // (the cast to uint32_t is for 16-bit ports)
-            //mp_printf(&mp_plat_print, "\n%05x: ", (uint)(PTR_FROM_BLOCK(bl) & (uint32_t)0xfffff));
-            mp_printf(&mp_plat_print, "\n%05x: ", (uint)((bl * BYTES_PER_BLOCK) & (uint32_t)0xfffff));
-        }
-        int c = ' ';
-        switch (ATB_GET_KIND(bl)) {
-            case AT_FREE: c = '.'; break;
-            /* this prints out if the object is reachable from BSS or STACK (for unix only)
-            case AT_HEAD: {
-                c = 'h';
-                void **ptrs = (void**)(void*)&mp_state_ctx;
-                mp_uint_t len = offsetof(mp_state_ctx_t, vm.stack_top) / sizeof(mp_uint_t);
-                for (mp_uint_t i = 0; i < len; i++) {
-                    mp_uint_t ptr = (mp_uint_t)ptrs[i];
-                    if (VERIFY_PTR(ptr) && BLOCK_FROM_PTR(ptr) == bl) {
-                        c = 'B';
-                        break;
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        #if !EXTENSIVE_HEAP_PROFILING
+        // When comparing heap output we don't want to print the starting
+        // pointer of the heap because it changes from run to run.
+        mp_printf(&mp_plat_print, "GC memory layout; from %p:", area->gc_pool_start);
+        #endif
+        for (size_t bl = 0; bl < area->gc_alloc_table_byte_len * BLOCKS_PER_ATB; bl++) {
+            if (bl % DUMP_BYTES_PER_LINE == 0) {
+                // a new line of blocks
+                {
+                    // check if this line contains only free blocks
+                    size_t bl2 = bl;
+                    while (bl2 < area->gc_alloc_table_byte_len * BLOCKS_PER_ATB && ATB_GET_KIND(area, bl2) == AT_FREE) {
+                        bl2++;
                     }
-                }
-                if (c == 'h') {
-                    ptrs = (void**)&c;
-                    len = ((mp_uint_t)MP_STATE_THREAD(stack_top) - (mp_uint_t)&c) / sizeof(mp_uint_t);
-                    for (mp_uint_t i = 0; i < len; i++) {
-                        mp_uint_t ptr = (mp_uint_t)ptrs[i];
-                        if (VERIFY_PTR(ptr) && BLOCK_FROM_PTR(ptr) == bl) {
-                            c = 'S';
+                    if (bl2 - bl >= 2 * DUMP_BYTES_PER_LINE) {
+                        // there are at least 2 lines containing only free blocks, so abbreviate their printing
+                        mp_printf(&mp_plat_print, "\n       (%u lines all free)", (uint)(bl2 - bl) / DUMP_BYTES_PER_LINE);
+                        bl = bl2 & (~(DUMP_BYTES_PER_LINE - 1));
+                        if (bl >= area->gc_alloc_table_byte_len * BLOCKS_PER_ATB) {
+                            // got to end of heap
                             break;
                         }
                     }
                 }
-                break;
+                // print header for new line of blocks
+                // (the cast to uint32_t is for 16-bit ports)
+                //mp_printf(&mp_plat_print, "\n%05x: ", (uint)(PTR_FROM_BLOCK(area, bl) & (uint32_t)0xfffff));
+                mp_printf(&mp_plat_print, "\n%05x: ", (uint)((bl * BYTES_PER_BLOCK) & (uint32_t)0xfffff));
             }
-            */
-            /* this prints the uPy object type of the head block */
-            case AT_HEAD: {
-                void **ptr = (void**)(MP_STATE_MEM(gc_pool_start) + bl * BYTES_PER_BLOCK);
-                if (*ptr == &mp_type_tuple) { c = 'T'; }
-                else if (*ptr == &mp_type_list) { c = 'L'; }
-                else if (*ptr == &mp_type_dict) { c = 'D'; }
-                else if (*ptr == &mp_type_str || *ptr == &mp_type_bytes) { c = 'S'; }
-                #if MICROPY_PY_BUILTINS_BYTEARRAY
-                else if (*ptr == &mp_type_bytearray) { c = 'A'; }
-                #endif
-                #if MICROPY_PY_ARRAY
-                else if (*ptr == &mp_type_array) { c = 'A'; }
-                #endif
-                #if MICROPY_PY_BUILTINS_FLOAT
-                else if (*ptr == &mp_type_float) { c = 'F'; }
-                #endif
-                else if (*ptr == &mp_type_fun_bc) { c = 'B'; }
-                else if (*ptr == &mp_type_module) { c = 'M'; }
-                else {
+            int c = ' ';
+            switch (ATB_GET_KIND(area, bl)) {
+                case AT_FREE: c = '.'; break;
+                /* this prints out if the object is reachable from BSS or STACK (for unix only)
+                case AT_HEAD: {
                     c = 'h';
-                    #if 0
-                    // This code prints "Q" for qstr-pool data, and "q" for qstr-str
-                    // data.  It can be useful to see how qstrs are being allocated,
-                    // but is disabled by default because it is very slow.
-                    for (qstr_pool_t *pool = MP_STATE_VM(last_pool); c == 'h' && pool != NULL; pool = pool->prev) {
-                        if ((qstr_pool_t*)ptr == pool) {
-                            c = 'Q';
+                    void **ptrs = (void**)(void*)&mp_state_ctx;
+                    mp_uint_t len = offsetof(mp_state_ctx_t, vm.stack_top) / sizeof(mp_uint_t);
+                    for (mp_uint_t i = 0; i < len; i++) {
+                        mp_uint_t ptr = (mp_uint_t)ptrs[i];
+                        if (gc_get_ptr_area((void*)ptr) == area && BLOCK_FROM_PTR(area, ptr) == bl) {
+                            c = 'B';
                             break;
                         }
-                        for (const byte **q = pool->qstrs, **q_top = pool->qstrs + pool->len; q < q_top; q++) {
-                            if ((const byte*)ptr == *q) {
-                                c = 'q';
+                    }
+                    if (c == 'h') {
+                        ptrs = (void**)&c;
+                        len = ((mp_uint_t)MP_STATE_THREAD(stack_top) - (mp_uint_t)&c) / sizeof(mp_uint_t);
+                        for (mp_uint_t i = 0; i < len; i++) {
+                            mp_uint_t ptr = (mp_uint_t)ptrs[i];
+                            if (gc_get_ptr_area((void*)ptr) == area && BLOCK_FROM_PTR(area, ptr) == bl) {
+                                c = 'S';
                                 break;
                             }
                         }
                     }
+                    break;
+                }
+                */
+                /* this prints the uPy object type of the head block */
+                case AT_HEAD: {
+                    void **ptr = (void**)(area->gc_pool_start + bl * BYTES_PER_BLOCK);
+                    if (*ptr == &mp_type_tuple) { c = 'T'; }
+                    else if (*ptr == &mp_type_list) { c = 'L'; }
+                    else if (*ptr == &mp_type_dict) { c = 'D'; }
+                    else if (*ptr == &mp_type_str || *ptr == &mp_type_bytes) { c = 'S'; }
+                    #if MICROPY_PY_BUILTINS_BYTEARRAY
+                    else if (*ptr == &mp_type_bytearray) { c = 'A'; }
                     #endif
+                    #if MICROPY_PY_ARRAY
+                    else if (*ptr == &mp_type_array) { c = 'A'; }
+                    #endif
+                    #if MICROPY_PY_BUILTINS_FLOAT
+                    else if (*ptr == &mp_type_float) { c = 'F'; }
+                    #endif
+                    else if (*ptr == &mp_type_fun_bc) { c = 'B'; }
+                    else if (*ptr == &mp_type_module) { c = 'M'; }
+                    else {
+                        c = 'h';
+                        #if 0
+                        // This code prints "Q" for qstr-pool data, and "q" for qstr-str
+                        // data.  It can be useful to see how qstrs are being allocated,
+                        // but is disabled by default because it is very slow.
+                        for (qstr_pool_t *pool = MP_STATE_VM(last_pool); c == 'h' && pool != NULL; pool = pool->prev) {
+                            if ((qstr_pool_t*)ptr == pool) {
+                                c = 'Q';
+                                break;
+                            }
+                            for (const byte **q = pool->qstrs, **q_top = pool->qstrs + pool->len; q < q_top; q++) {
+                                if ((const byte*)ptr == *q) {
+                                    c = 'q';
+                                    break;
+                                }
+                            }
+                        }
+                        #endif
+                    }
+                    break;
                 }
-                break;
+                case AT_TAIL: c = '='; break;
+                case AT_MARK: c = 'm'; break;
             }
-            case AT_TAIL: c = '='; break;
-            case AT_MARK: c = 'm'; break;
+            mp_printf(&mp_plat_print, "%c", c);
         }
-        mp_printf(&mp_plat_print, "%c", c);
+        mp_print_str(&mp_plat_print, "\n");
     }
-    mp_print_str(&mp_plat_print, "\n");
     GC_EXIT();
 }
 
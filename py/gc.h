@@ -33,6 +33,12 @@
 
 void gc_init(void *start, void *end);
 
+#if MICROPY_GC_SPLIT_HEAP
+// Add another region of memory to the heap; it need not be contiguous with
+// the existing heap.
+void gc_add_region(void *start, void *end);
+#endif
+
 // These lock/unlock functions can be nested.
 // They can be used to prevent the GC from allocating/freeing.
 void gc_lock(void);
@@ -45,6 +51,36 @@ void gc_collect_start(void);
 void gc_collect_root(void **ptrs, size_t len);
 void gc_collect_end(void);
 
+#if MICROPY_GC_PARALLEL_MARK
+// For parallel marking the port provides helper threads: gc_mark_workers_start
+// makes each of them call gc_mark_worker once and returns how many there are,
+// and gc_mark_yield is called by threads waiting for work.  As marking may be
+// done in a signal handler, gc_mark_workers_start must be signal safe.
+size_t gc_mark_workers_start(void);
+void gc_mark_yield(void);
+void gc_mark_worker(void);
+#endif
+
+#if MICROPY_GC_TLAB
+// Retire the allocation buffer of the calling thread.  The collecting thread's
+// buffer is retired by gc_collect_start; every other thread must call this
+// while its registers and stack are being scanned.
+void gc_collect_tlab(void);
+#endif
+
+#if MICROPY_GC_ARENA
+// Mark the objects holding the arenas the calling thread has entered.  Like
+// gc_collect_tlab, this is done for the collecting thread by gc_collect_start
+// and must be called by every other thread while it's being scanned.
+void gc_collect_arenas(void);
+#endif
+
+#if MICROPY_GC_INCREMENTAL
+// Sweep at least n_blocks blocks of a pending sweep (pass (size_t)-1 to
+// finish it).  Returns true if there is no more sweeping to do.
+bool gc_sweep_step(size_t n_blocks);
+#endif
+
 void *gc_alloc(size_t n_bytes, bool has_finaliser);
 void gc_free(void *ptr); // does not call finaliser
 size_t gc_nbytes(const void *ptr);
@@ -61,6 +97,43 @@ typedef struct _gc_info_t {
 } gc_info_t;
 
 void gc_info(gc_info_t *info);
+
+#if MICROPY_GC_ARENA
+typedef struct _gc_arena_t {
+    struct _gc_arena_t *prev;   // the arena that was active when this one was entered
+    void *owner;                // the heap object holding the arena, kept alive while it's entered
+    struct _mp_state_mem_area_t *area;
+    size_t start_block;
+    size_t end_block;
+    void *reserve;              // first block of the unused part, or NULL if all used
+    bool exiting;               // set while the arena is being collected
+    size_t escaped;             // number of objects that survived the collection
+} gc_arena_t;
+
+bool gc_arena_enter(gc_arena_t *arena, void *owner, size_t n_bytes);
+size_t gc_arena_exit(gc_arena_t *arena);
+#endif
+
+#if MICROPY_GC_STATS
+#define GC_STATS_FREE_RUNS (16)
+
+typedef struct _gc_stats_t {
+    size_t collections;
+    size_t finalisers;          // number of __del__ methods called
+    uint64_t mark_us;           // total time spent marking
+    uint64_t sweep_us;          // total time spent sweeping
+    mp_uint_t mark_us_max;      // longest mark
+    mp_uint_t sweep_us_max;     // longest sweep (or sweep step, if incremental)
+    size_t reclaimed_blocks;    // blocks freed by the last complete sweep
+    uint64_t reclaimed_total;   // blocks freed by all sweeps
+    // number of runs of free blocks with length from 2**i to 2**(i+1)-1 (the
+    // last entry counts all longer runs)
+    size_t free_runs[GC_STATS_FREE_RUNS];
+} gc_stats_t;
+
+void gc_stats(gc_stats_t *stats);
+void gc_stats_run_callback(void);
+#endif
 void gc_dump_info(void);
 void gc_dump_alloc_table(void);
 
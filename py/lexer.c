@@ -127,6 +127,17 @@ STATIC bool is_tail_of_identifier(mp_lexer_t *lex) {
     return is_head_of_identifier(lex) || is_digit(lex);
 }
 
+STATIC unichar read_byte(mp_lexer_t *lex) {
+    unichar c = lex->reader.readbyte(lex->reader.data);
+    #if MICROPY_OPT_TIERED_NATIVE
+    // keep a copy of the source so it can be compiled again later
+    if (c != MP_LEXER_EOF) {
+        vstr_add_byte(&lex->source, c);
+    }
+    #endif
+    return c;
+}
+
 STATIC void next_char(mp_lexer_t *lex) {
     if (lex->chr0 == '\n') {
         // a new line
@@ -142,7 +153,7 @@ STATIC void next_char(mp_lexer_t *lex) {
 
     lex->chr0 = lex->chr1;
     lex->chr1 = lex->chr2;
-    lex->chr2 = lex->reader.readbyte(lex->reader.data);
+    lex->chr2 = read_byte(lex);
 
     if (lex->chr0 == '\r') {
         // CR is a new line, converted to LF
@@ -150,7 +161,7 @@ STATIC void next_char(mp_lexer_t *lex) {
         if (lex->chr1 == '\n') {
             // CR LF is a single new line
             lex->chr1 = lex->chr2;
-            lex->chr2 = lex->reader.readbyte(lex->reader.data);
+            lex->chr2 = read_byte(lex);
         }
     }
 
@@ -706,6 +717,9 @@ mp_lexer_t *mp_lexer_new(qstr src_name, mp_reader_t reader) {
     lex->num_indent_level = 1;
     lex->indent_level = m_new_maybe(uint16_t, lex->alloc_indent_level);
     vstr_init(&lex->vstr, 32);
+    #if MICROPY_OPT_TIERED_NATIVE
+    vstr_init(&lex->source, 32);
+    #endif
 
     // check for memory allocation error
     // note: vstr_init above may fail on malloc, but so may mp_lexer_next_token_into below
@@ -718,9 +732,9 @@ mp_lexer_t *mp_lexer_new(qstr src_name, mp_reader_t reader) {
     lex->indent_level[0] = 0;
 
     // preload characters
-    lex->chr0 = reader.readbyte(reader.data);
-    lex->chr1 = reader.readbyte(reader.data);
-    lex->chr2 = reader.readbyte(reader.data);
+    lex->chr0 = read_byte(lex);
+    lex->chr1 = read_byte(lex);
+    lex->chr2 = read_byte(lex);
 
     // if input stream is 0, 1 or 2 characters long and doesn't end in a newline, then insert a newline at the end
     if (lex->chr0 == MP_LEXER_EOF) {
@@ -783,6 +797,9 @@ void mp_lexer_free(mp_lexer_t *lex) {
     if (lex) {
         lex->reader.close(lex->reader.data);
         vstr_clear(&lex->vstr);
+        #if MICROPY_OPT_TIERED_NATIVE
+        vstr_clear(&lex->source);
+        #endif
         m_del(uint16_t, lex->indent_level, lex->alloc_indent_level);
         m_del_obj(mp_lexer_t, lex);
     }
@@ -165,6 +165,9 @@ typedef struct _mp_lexer_t {
     mp_uint_t tok_column;       // token source column
     mp_token_kind_t tok_kind;   // token kind
     vstr_t vstr;                // token data
+    #if MICROPY_OPT_TIERED_NATIVE
+    vstr_t source;              // copy of the source read so far
+    #endif
 } mp_lexer_t;
 
 mp_lexer_t *mp_lexer_new(qstr src_name, mp_reader_t reader);
@@ -150,6 +150,30 @@ def print_qstr_data(qcfgs, qstrs):
         qbytes = make_bytes(cfg_bytes_len, cfg_bytes_hash, qstr)
         print('QDEF(MP_QSTR_%s, %s)' % (ident, qbytes))
 
+    print_qstr_hash_index(cfg_bytes_hash, qstrs)
+
+def print_qstr_hash_index(cfg_bytes_hash, qstrs):
+    # open-addressed hash index of the qstrs, used by qstr_find_strn(); each
+    # slot holds a qstr (or 0 if empty) and a qstr is looked up by probing
+    # linearly from its hash modulo the (power of 2) size of the index
+    size = 16
+    while size < 2 * (len(qstrs) + 1):
+        size *= 2
+    assert len(qstrs) < 0x10000
+    index = [0] * size
+    for order, ident, qstr in qstrs.values():
+        i = compute_hash(bytes_cons(qstr, 'utf8'), cfg_bytes_hash) & (size - 1)
+        while index[i] != 0:
+            i = (i + 1) & (size - 1)
+        # qstr 0 is MP_QSTR_NULL, so the qstrs above are numbered from 1
+        index[i] = order + 1
+
+    print('')
+    print('#ifdef QHASH')
+    for q in index:
+        print('QHASH(%u)' % q)
+    print('#endif')
+
 def do_work(infiles):
     qcfgs, qstrs = parse_input_headers(infiles)
     print_qstr_data(qcfgs, qstrs)
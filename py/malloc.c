@@ -31,6 +31,7 @@
 #include "py/mpconfig.h"
 #include "py/misc.h"
 #include "py/mpstate.h"
+#include "py/allocprof.h"
 
 #if 0 // print debugging info
 #define DEBUG_printf DEBUG_printf
@@ -81,6 +82,7 @@ void *m_malloc(size_t num_bytes) {
     MP_STATE_MEM(current_bytes_allocated) += num_bytes;
     UPDATE_PEAK();
 #endif
+    MP_ALLOC_PROFILE_RECORD(ptr, num_bytes);
     DEBUG_printf("malloc %d : %p\n", num_bytes, ptr);
     return ptr;
 }
@@ -92,6 +94,9 @@ void *m_malloc_maybe(size_t num_bytes) {
     MP_STATE_MEM(current_bytes_allocated) += num_bytes;
     UPDATE_PEAK();
 #endif
+    if (ptr != NULL) {
+        MP_ALLOC_PROFILE_RECORD(ptr, num_bytes);
+    }
     DEBUG_printf("malloc %d : %p\n", num_bytes, ptr);
     return ptr;
 }
@@ -107,6 +112,7 @@ void *m_malloc_with_finaliser(size_t num_bytes) {
     MP_STATE_MEM(current_bytes_allocated) += num_bytes;
     UPDATE_PEAK();
 #endif
+    MP_ALLOC_PROFILE_RECORD(ptr, num_bytes);
     DEBUG_printf("malloc %d : %p\n", num_bytes, ptr);
     return ptr;
 }
@@ -144,6 +150,9 @@ void *m_realloc(void *ptr, size_t new_num_bytes) {
     MP_STATE_MEM(current_bytes_allocated) += diff;
     UPDATE_PEAK();
 #endif
+    if (new_ptr != NULL) {
+        MP_ALLOC_PROFILE_RECORD(new_ptr, new_num_bytes);
+    }
     DEBUG_printf("realloc %p, %d, %d : %p\n", ptr, old_num_bytes, new_num_bytes, new_ptr);
     return new_ptr;
 }
@@ -168,6 +177,9 @@ void *m_realloc_maybe(void *ptr, size_t new_num_bytes, bool allow_move) {
         UPDATE_PEAK();
     }
 #endif
+    if (new_ptr != NULL) {
+        MP_ALLOC_PROFILE_RECORD(new_ptr, new_num_bytes);
+    }
     DEBUG_printf("realloc %p, %d, %d : %p\n", ptr, old_num_bytes, new_num_bytes, new_ptr);
     return new_ptr;
 }
@@ -33,6 +33,28 @@
 #include "py/misc.h"
 #include "py/runtime0.h"
 #include "py/runtime.h"
+#include "py/mpstate.h"
+
+#if MICROPY_OPT_MAP_LOOKUP_CACHE
+// The entry of the map lookup cache for a key in a map; the low bits of the key
+// are its object tag and those of the map are zero due to alignment.
+#define MAP_LOOKUP_CACHE_ENTRY(map, index) \
+    (&MP_STATE_VM(map_lookup_cache)[(((uintptr_t)(index) >> 2) ^ ((uintptr_t)(map) >> 4)) & (MICROPY_OPT_MAP_LOOKUP_CACHE_SIZE - 1)])
+#endif
+
+#if MICROPY_OPT_LOAD_GLOBAL_CACHE
+// Adding or removing a key may move the elements of a map, so for versioned maps
+// (those of module globals) it changes the version that the LOAD_GLOBAL caches
+// check before using the elements they remember.  Storing to an existing key
+// doesn't move anything, so it needs no new version.
+#define MAP_KEYS_CHANGED(map) do { \
+        if ((map)->is_versioned) { \
+            MP_STATE_VM(map_keys_version)++; \
+        } \
+    } while (0)
+#else
+#define MAP_KEYS_CHANGED(map) (void)0
+#endif
 
 // Fixed empty map. Useful when need to call kw-receiving functions
 // without any keywords from C, etc.
@@ -70,7 +92,166 @@ STATIC mp_uint_t get_hash_alloc_greater_or_equal_to(mp_uint_t x) {
 /******************************************************************************/
 /* map                                                                        */
 
+#if MICROPY_MAP_COMPACT && !MICROPY_MAP_ORDERED_INDEX
+#error MICROPY_MAP_COMPACT needs MICROPY_MAP_ORDERED_INDEX
+#endif
+
+// get hash of index, with fast path for common case of qstr
+static inline mp_uint_t map_hash(mp_obj_t index) {
+    if (MP_OBJ_IS_QSTR(index)) {
+        return qstr_hash(MP_OBJ_QSTR_VALUE(index));
+    } else {
+        return MP_OBJ_SMALL_INT_VALUE(mp_unary_op(MP_UNARY_OP_HASH, index));
+    }
+}
+
+#if MICROPY_MAP_ORDERED_INDEX
+
+// An ordered map (and with MICROPY_MAP_COMPACT, any map) that grows to
+// MAP_INDEX_MIN elements gets a hash index, stored in the same allocation just
+// after its table of alloc elements.  The index starts with the number of
+// elements of the table that have been filled, including removed elements,
+// which stay in the table with MP_OBJ_SENTINEL as their key until the table is
+// compacted so that removing an element isn't linear.  Then come the slots,
+// each 0 if it's empty or 1 + the position of an element in the table, and 1,
+// 2 or 4 bytes wide depending on alloc.  Maps without an index are searched
+// linearly, and have no removed elements.
+#define MAP_INDEX_MIN (16)
+
+typedef struct _map_index_t {
+    size_t filled;
+    byte slots[];
+} map_index_t;
+
+#define MAP_INDEX(map) ((map_index_t*)((map)->table + (map)->alloc))
+
+STATIC size_t map_index_slots(size_t alloc) {
+    // keep the index at most 2/3 full
+    size_t n = MAP_INDEX_MIN;
+    while (n < alloc + alloc / 2) {
+        n *= 2;
+    }
+    return n;
+}
+
+STATIC size_t map_index_width(size_t alloc) {
+    return alloc <= 0xff ? 1 : alloc <= 0xffff ? 2 : 4;
+}
+
+// number of mp_map_elem_t that the table of an ordered map is allocated with
+STATIC size_t map_ordered_table_len(size_t alloc, bool is_indexed) {
+    if (!is_indexed) {
+        return alloc;
+    }
+    size_t index_len = sizeof(map_index_t) + map_index_slots(alloc) * map_index_width(alloc);
+    return alloc + (index_len + sizeof(mp_map_elem_t) - 1) / sizeof(mp_map_elem_t);
+}
+
+#define map_table_len(map) map_ordered_table_len((map)->alloc, (map)->is_indexed)
+
+// number of elements of the table of an ordered map that have been filled
+STATIC size_t map_ordered_filled(const mp_map_t *map) {
+    return map->is_indexed ? MAP_INDEX(map)->filled : map->used;
+}
+
+STATIC size_t map_index_get(const map_index_t *index, size_t width, size_t i) {
+    if (width == 1) {
+        return index->slots[i];
+    } else if (width == 2) {
+        return ((const uint16_t*)index->slots)[i];
+    } else {
+        return ((const uint32_t*)index->slots)[i];
+    }
+}
+
+STATIC void map_index_set(map_index_t *index, size_t width, size_t i, size_t val) {
+    if (width == 1) {
+        index->slots[i] = val;
+    } else if (width == 2) {
+        ((uint16_t*)index->slots)[i] = val;
+    } else {
+        ((uint32_t*)index->slots)[i] = val;
+    }
+}
+
+// The slot to start probing at; the low bits of the hash of an object that
+// has no __hash__ (its address) are all zero, so higher bits are mixed in.
+static inline size_t map_index_start(mp_uint_t hash, size_t mask) {
+    return (hash ^ (hash >> 5)) & mask;
+}
+
+STATIC void map_index_insert(mp_map_t *map, size_t pos, mp_uint_t hash) {
+    map_index_t *index = MAP_INDEX(map);
+    size_t width = map_index_width(map->alloc);
+    size_t mask = map_index_slots(map->alloc) - 1;
+    size_t i = map_index_start(hash, mask);
+    while (map_index_get(index, width, i) != 0) {
+        i = (i + 1) & mask;
+    }
+    map_index_set(index, width, i, pos + 1);
+}
+
+STATIC mp_map_elem_t *map_index_find(mp_map_t *map, mp_obj_t key, bool compare_only_ptrs) {
+    const map_index_t *index = MAP_INDEX(map);
+    size_t width = map_index_width(map->alloc);
+    size_t mask = map_index_slots(map->alloc) - 1;
+    size_t pos;
+    for (size_t i = map_index_start(map_hash(key), mask); (pos = map_index_get(index, width, i)) != 0; i = (i + 1) & mask) {
+        mp_map_elem_t *elem = &map->table[pos - 1];
+        if (elem->key == key || (!compare_only_ptrs && elem->key != MP_OBJ_SENTINEL && mp_obj_equal(elem->key, key))) {
+            return elem;
+        }
+    }
+    return NULL;
+}
+
+// Make room to add an element to an ordered map whose table is all filled.
+// If enough of its elements were removed the table is just compacted, else
+// small maps grow by a GC block at a time (as hash tables do), and big ones by
+// half their size so that building them isn't quadratic.
+STATIC void map_ordered_grow(mp_map_t *map) {
+    size_t filled = map_ordered_filled(map);
+    size_t new_alloc = map->alloc;
+    if (map->used >= map->alloc - map->alloc / 4) {
+        new_alloc += new_alloc < MAP_INDEX_MIN ? 2 : new_alloc / 2;
+    }
+    bool is_indexed = new_alloc >= MAP_INDEX_MIN;
+    size_t new_len = map_ordered_table_len(new_alloc, is_indexed);
+    if (new_alloc != map->alloc) {
+        map->table = m_renew(mp_map_elem_t, map->table, map_table_len(map), new_len);
+    }
+    // squeeze out removed elements, keeping the rest in order
+    size_t used = 0;
+    for (size_t pos = 0; pos < filled; pos++) {
+        if (map->table[pos].key != MP_OBJ_SENTINEL) {
+            map->table[used++] = map->table[pos];
+        }
+    }
+    assert(used == map->used);
+    map->alloc = new_alloc;
+    map->is_indexed = is_indexed;
+    mp_seq_clear(map->table, used, new_len, sizeof(*map->table));
+    if (is_indexed) {
+        // all keys were hashed when they were added, so this can't raise
+        MAP_INDEX(map)->filled = used;
+        for (size_t pos = 0; pos < used; pos++) {
+            map_index_insert(map, pos, map_hash(map->table[pos].key));
+        }
+    }
+}
+
+#else
+
+#define map_table_len(map) ((map)->alloc)
+
+#endif
+
 void mp_map_init(mp_map_t *map, mp_uint_t n) {
+    #if MICROPY_MAP_COMPACT
+    map->is_indexed = n >= MAP_INDEX_MIN;
+    map->table = n == 0 ? NULL : m_new0(mp_map_elem_t, map_ordered_table_len(n, map->is_indexed));
+    map->alloc = n;
+    #else
     if (n == 0) {
         map->alloc = 0;
         map->table = NULL;
@@ -78,10 +259,14 @@ void mp_map_init(mp_map_t *map, mp_uint_t n) {
         map->alloc = n;
         map->table = m_new0(mp_map_elem_t, map->alloc);
     }
+    map->is_indexed = 0;
+    #endif
     map->used = 0;
     map->all_keys_are_qstrs = 1;
     map->is_fixed = 0;
     map->is_ordered = 0;
+    map->is_split = 0;
+    map->is_versioned = 0;
 }
 
 void mp_map_init_fixed_table(mp_map_t *map, mp_uint_t n, const mp_obj_t *table) {
@@ -90,9 +275,34 @@ void mp_map_init_fixed_table(mp_map_t *map, mp_uint_t n, const mp_obj_t *table)
     map->all_keys_are_qstrs = 1;
     map->is_fixed = 1;
     map->is_ordered = 1;
+    map->is_indexed = 0;
+    map->is_split = 0;
+    map->is_versioned = 0;
     map->table = (mp_map_elem_t*)table;
 }
 
+void mp_map_init_copy(mp_map_t *map, const mp_map_t *src) {
+    size_t len = map_table_len(src);
+    map->table = m_new(mp_map_elem_t, len);
+    memcpy(map->table, src->table, len * sizeof(mp_map_elem_t));
+    map->alloc = src->alloc;
+    map->used = src->used;
+    map->all_keys_are_qstrs = src->all_keys_are_qstrs;
+    map->is_fixed = 0;
+    map->is_ordered = src->is_ordered;
+    map->is_indexed = src->is_indexed;
+    map->is_split = 0;
+    map->is_versioned = 0;
+}
+
+#if MICROPY_OPT_LOAD_GLOBAL_CACHE
+void mp_map_set_versioned(mp_map_t *map) {
+    map->is_versioned = 1;
+    // a LOAD_GLOBAL cache may remember a map that was freed and was at this address
+    MP_STATE_VM(map_keys_version)++;
+}
+#endif
+
 mp_map_t *mp_map_new(mp_uint_t n) {
     mp_map_t *map = m_new(mp_map_t, 1);
     mp_map_init(map, n);
@@ -102,9 +312,11 @@ mp_map_t *mp_map_new(mp_uint_t n) {
 // Differentiate from mp_map_clear() - semantics is different
 void mp_map_deinit(mp_map_t *map) {
     if (!map->is_fixed) {
-        m_del(mp_map_elem_t, map->table, map->alloc);
+        m_del(mp_map_elem_t, map->table, map_table_len(map));
     }
     map->used = map->alloc = 0;
+    map->is_indexed = 0;
+    MAP_KEYS_CHANGED(map);
 }
 
 void mp_map_free(mp_map_t *map) {
@@ -114,15 +326,18 @@ void mp_map_free(mp_map_t *map) {
 
 void mp_map_clear(mp_map_t *map) {
     if (!map->is_fixed) {
-        m_del(mp_map_elem_t, map->table, map->alloc);
+        m_del(mp_map_elem_t, map->table, map_table_len(map));
     }
     map->alloc = 0;
     map->used = 0;
     map->all_keys_are_qstrs = 1;
     map->is_fixed = 0;
+    map->is_indexed = 0;
     map->table = NULL;
+    MAP_KEYS_CHANGED(map);
 }
 
+#if !MICROPY_MAP_COMPACT
 STATIC void mp_map_rehash(mp_map_t *map) {
     mp_uint_t old_alloc = map->alloc;
     mp_uint_t new_alloc = get_hash_alloc_greater_or_equal_to(map->alloc + 1);
@@ -140,6 +355,7 @@ STATIC void mp_map_rehash(mp_map_t *map) {
     }
     m_del(mp_map_elem_t, old_table, old_alloc);
 }
+#endif
 
 // MP_MAP_LOOKUP behaviour:
 //  - returns NULL if not found, else the slot it was found in with key,value non-null
@@ -173,28 +389,91 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
         }
     }
 
-    // if the map is an ordered array then we must do a brute force linear search
-    if (map->is_ordered) {
-        for (mp_map_elem_t *elem = &map->table[0], *top = &map->table[map->used]; elem < top; elem++) {
-            if (elem->key == index || (!compare_only_ptrs && mp_obj_equal(elem->key, index))) {
-                if (MP_UNLIKELY(lookup_kind == MP_MAP_LOOKUP_REMOVE_IF_FOUND)) {
+    // if the map is an ordered array then we must do a brute force linear search,
+    // or use its hash index if it has one; with MICROPY_MAP_COMPACT all maps are
+    // ordered arrays (in the order that keys were added)
+    #if !MICROPY_MAP_COMPACT
+    if (map->is_ordered)
+    #endif
+    {
+        #if MICROPY_OPT_MAP_LOOKUP_CACHE
+        // try the position the key was last found at in this map, if any;
+        // this is only a hint so it's checked, and never needs invalidating.
+        // The cache is shared by all threads, so the hint is read only once.
+        uint16_t *cache = MAP_LOOKUP_CACHE_ENTRY(map, index);
+        uint16_t hint = *cache;
+        if (hint < map->alloc && map->table[hint].key == index
+            && MP_LIKELY(lookup_kind != MP_MAP_LOOKUP_REMOVE_IF_FOUND)) {
+            return &map->table[hint];
+        }
+        #endif
+        mp_map_elem_t *elem = NULL;
+        #if MICROPY_MAP_ORDERED_INDEX
+        if (map->is_indexed) {
+            elem = map_index_find(map, index, compare_only_ptrs);
+        } else
+        #endif
+        {
+            for (mp_map_elem_t *e = &map->table[0], *top = &map->table[map->used]; e < top; e++) {
+                if (e->key == index || (!compare_only_ptrs && mp_obj_equal(e->key, index))) {
+                    elem = e;
+                    break;
+                }
+            }
+        }
+        if (elem != NULL) {
+            #if MICROPY_OPT_MAP_LOOKUP_CACHE
+            *cache = elem - map->table;
+            #endif
+            if (MP_UNLIKELY(lookup_kind == MP_MAP_LOOKUP_REMOVE_IF_FOUND)) {
+                --map->used;
+                MAP_KEYS_CHANGED(map);
+                #if MICROPY_MAP_ORDERED_INDEX
+                if (map->is_indexed) {
+                    // leave the removed element in the table (see above)
                     elem->key = MP_OBJ_SENTINEL;
                     // keep elem->value so that caller can access it if needed
+                    return elem;
                 }
-                return elem;
+                #endif
+                // remove the found element by moving the rest of the array down
+                mp_obj_t value = elem->value;
+                memmove(elem, elem + 1, (&map->table[map->used] - elem) * sizeof(*elem));
+                // put the found element after the end so the caller can access it if needed
+                elem = &map->table[map->used];
+                elem->key = MP_OBJ_NULL;
+                elem->value = value;
             }
+            return elem;
         }
         if (MP_LIKELY(lookup_kind != MP_MAP_LOOKUP_ADD_IF_NOT_FOUND)) {
             return NULL;
         }
-        // TODO shrink array down over any previously-freed slots
+        #if MICROPY_MAP_ORDERED_INDEX
+        // the key is hashed even if the map has no index yet, so that an
+        // unhashable key is rejected before it's in the map rather than when
+        // the index is built
+        mp_uint_t hash = map_hash(index);
+        if (map_ordered_filled(map) == map->alloc) {
+            map_ordered_grow(map);
+        }
+        if (map->is_indexed) {
+            elem = map->table + MAP_INDEX(map)->filled++;
+            map_index_insert(map, elem - map->table, hash);
+        } else {
+            elem = map->table + map->used;
+        }
+        #else
         if (map->used == map->alloc) {
             // TODO: Alloc policy
             map->alloc += 4;
             map->table = m_renew(mp_map_elem_t, map->table, map->used, map->alloc);
             mp_seq_clear(map->table, map->used, map->alloc, sizeof(*map->table));
         }
-        mp_map_elem_t *elem = map->table + map->used++;
+        elem = map->table + map->used;
+        #endif
+        map->used++;
+        MAP_KEYS_CHANGED(map);
         elem->key = index;
         if (!MP_OBJ_IS_QSTR(index)) {
             map->all_keys_are_qstrs = 0;
@@ -202,6 +481,7 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
         return elem;
     }
 
+    #if !MICROPY_MAP_COMPACT
     // map is a hash table (not an ordered array), so do a hash lookup
 
     if (map->alloc == 0) {
@@ -212,13 +492,7 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
         }
     }
 
-    // get hash of index, with fast path for common case of qstr
-    mp_uint_t hash;
-    if (MP_OBJ_IS_QSTR(index)) {
-        hash = qstr_hash(MP_OBJ_QSTR_VALUE(index));
-    } else {
-        hash = MP_OBJ_SMALL_INT_VALUE(mp_unary_op(MP_UNARY_OP_HASH, index));
-    }
+    mp_uint_t hash = map_hash(index);
 
     mp_uint_t pos = hash % map->alloc;
     mp_uint_t start_pos = pos;
@@ -229,6 +503,7 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
             // found NULL slot, so index is not in table
             if (lookup_kind == MP_MAP_LOOKUP_ADD_IF_NOT_FOUND) {
                 map->used += 1;
+                MAP_KEYS_CHANGED(map);
                 if (avail_slot == NULL) {
                     avail_slot = slot;
                 }
@@ -252,6 +527,7 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
             if (lookup_kind == MP_MAP_LOOKUP_REMOVE_IF_FOUND) {
                 // delete element in this slot
                 map->used--;
+                MAP_KEYS_CHANGED(map);
                 if (map->table[(pos + 1) % map->alloc].key == MP_OBJ_NULL) {
                     // optimisation if next slot is empty
                     slot->key = MP_OBJ_NULL;
@@ -272,6 +548,7 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
                 if (avail_slot != NULL) {
                     // there was an available slot, so use that
                     map->used++;
+                    MAP_KEYS_CHANGED(map);
                     avail_slot->key = index;
                     avail_slot->value = MP_OBJ_NULL;
                     if (!MP_OBJ_IS_QSTR(index)) {
@@ -289,6 +566,7 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
             }
         }
     }
+    #endif
 }
 
 /******************************************************************************/
@@ -197,7 +197,7 @@ STATIC mp_obj_t mp_builtin_dir(size_t n_args, const mp_obj_t *args) {
     // TODO make this function more general and less of a hack
 
     mp_obj_dict_t *dict = NULL;
-    mp_map_t *members = NULL;
+    mp_obj_instance_t *inst = NULL;
     if (n_args == 0) {
         // make a list of names in the local name space
         dict = mp_locals_get();
@@ -217,8 +217,7 @@ STATIC mp_obj_t mp_builtin_dir(size_t n_args, const mp_obj_t *args) {
             }
         }
         if (mp_obj_is_instance_type(mp_obj_get_type(args[0]))) {
-            mp_obj_instance_t *inst = MP_OBJ_TO_PTR(args[0]);
-            members = &inst->members;
+            inst = MP_OBJ_TO_PTR(args[0]);
         }
     }
 
@@ -230,11 +229,11 @@ STATIC mp_obj_t mp_builtin_dir(size_t n_args, const mp_obj_t *args) {
             }
         }
     }
-    if (members != NULL) {
-        for (mp_uint_t i = 0; i < members->alloc; i++) {
-            if (MP_MAP_SLOT_IS_FILLED(members, i)) {
-                mp_obj_list_append(dir, members->table[i].key);
-            }
+    if (inst != NULL) {
+        size_t cur = 0;
+        mp_obj_t member[2];
+        while (mp_obj_instance_member_next(inst, &cur, member)) {
+            mp_obj_list_append(dir, member[0]);
         }
     }
     return dir;
@@ -26,7 +26,10 @@
 
 #include "py/mpstate.h"
 #include "py/obj.h"
+#include "py/runtime.h"
+#include "py/smallint.h"
 #include "py/gc.h"
+#include "py/mphal.h"
 
 #if MICROPY_PY_GC && MICROPY_ENABLE_GC
 
@@ -36,6 +39,13 @@
 /// Run a garbage collection.
 STATIC mp_obj_t py_gc_collect(void) {
     gc_collect();
+#if MICROPY_GC_INCREMENTAL
+    // finish the sweep so all garbage is reclaimed when we return
+    gc_sweep_step((size_t)-1);
+#endif
+#if MICROPY_GC_STATS
+    gc_stats_run_callback();
+#endif
 #if MICROPY_PY_GC_COLLECT_RETVAL
     return MP_OBJ_NEW_SMALL_INT(MP_STATE_MEM(gc_collected));
 #else
@@ -44,6 +54,39 @@ STATIC mp_obj_t py_gc_collect(void) {
 }
 MP_DEFINE_CONST_FUN_OBJ_0(gc_collect_obj, py_gc_collect);
 
+#if MICROPY_GC_INCREMENTAL
+/// \function mark()
+/// Run the mark phase of a garbage collection, leaving the sweep of the heap
+/// pending.  The mark is atomic and takes time proportional to the live data;
+/// the sweep is then done by sweep_step() or by later allocations.
+STATIC mp_obj_t py_gc_mark(void) {
+    gc_collect();
+#if MICROPY_GC_STATS
+    gc_stats_run_callback();
+#endif
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_0(gc_mark_obj, py_gc_mark);
+
+/// \function sweep_step(budget_us)
+/// Sweep part of the heap after a mark, taking roughly budget_us microseconds
+/// (at least one chunk of blocks is swept).  Returns True when there is no
+/// more sweeping to do.
+STATIC mp_obj_t py_gc_sweep_step(mp_obj_t budget_in) {
+    mp_int_t budget = mp_obj_get_int(budget_in);
+    if (budget < 0) {
+        mp_raise_ValueError("negative budget");
+    }
+    mp_uint_t start = mp_hal_ticks_us();
+    bool done;
+    do {
+        done = gc_sweep_step(1024);
+    } while (!done && mp_hal_ticks_us() - start < (mp_uint_t)budget);
+    return mp_obj_new_bool(done);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(gc_sweep_step_obj, py_gc_sweep_step);
+#endif
+
 /// \function disable()
 /// Disable the garbage collector.
 STATIC mp_obj_t gc_disable(void) {
@@ -102,9 +145,65 @@ STATIC mp_obj_t gc_threshold(size_t n_args, const mp_obj_t *args) {
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(gc_threshold_obj, 0, 1, gc_threshold);
 #endif
 
+#if MICROPY_GC_STATS
+STATIC mp_obj_t gc_stats_new_int(uint64_t val) {
+    if (val <= (uint64_t)MP_SMALL_INT_MAX) {
+        return MP_OBJ_NEW_SMALL_INT(val);
+    }
+    return mp_obj_new_int_from_ull(val);
+}
+
+STATIC void gc_stats_store(mp_obj_t dict, qstr key, uint64_t val) {
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(key), gc_stats_new_int(val));
+}
+
+/// \function stats()
+/// Return a dict of statistics about garbage collections: the number of
+/// collections, the total and longest times spent marking and sweeping,
+/// the memory reclaimed by the last collection and by all of them, the
+/// number of finalisers run, and a histogram of the lengths of the runs of
+/// free blocks in the heap (entry i counts runs of 2**i to 2**(i+1)-1 blocks).
+STATIC mp_obj_t gc_stats_func(void) {
+    gc_stats_t stats;
+    gc_stats(&stats);
+    mp_obj_t dict = mp_obj_new_dict(10);
+    gc_stats_store(dict, MP_QSTR_collections, stats.collections);
+    gc_stats_store(dict, MP_QSTR_mark_us, stats.mark_us);
+    gc_stats_store(dict, MP_QSTR_mark_us_max, stats.mark_us_max);
+    gc_stats_store(dict, MP_QSTR_sweep_us, stats.sweep_us);
+    gc_stats_store(dict, MP_QSTR_sweep_us_max, stats.sweep_us_max);
+    gc_stats_store(dict, MP_QSTR_reclaimed_blocks, stats.reclaimed_blocks);
+    gc_stats_store(dict, MP_QSTR_reclaimed_bytes, (uint64_t)stats.reclaimed_blocks * MICROPY_BYTES_PER_GC_BLOCK);
+    gc_stats_store(dict, MP_QSTR_reclaimed_total, stats.reclaimed_total * MICROPY_BYTES_PER_GC_BLOCK);
+    gc_stats_store(dict, MP_QSTR_finalisers, stats.finalisers);
+    mp_obj_t free_runs[GC_STATS_FREE_RUNS];
+    for (size_t i = 0; i < GC_STATS_FREE_RUNS; i++) {
+        free_runs[i] = gc_stats_new_int(stats.free_runs[i]);
+    }
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_free_runs), mp_obj_new_tuple(GC_STATS_FREE_RUNS, free_runs));
+    return dict;
+}
+MP_DEFINE_CONST_FUN_OBJ_0(gc_stats_obj, gc_stats_func);
+
+/// \function callback(func)
+/// Set a function to be called with no arguments after each collection, or
+/// remove it if func is None.  It's called by the VM between opcodes once the
+/// allocation that caused the collection has returned, so it may allocate.
+/// Exceptions raised by it are printed and ignored.
+STATIC mp_obj_t gc_callback(mp_obj_t func_in) {
+    MP_STATE_VM(gc_callback) = func_in == mp_const_none ? MP_OBJ_NULL : func_in;
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(gc_callback_obj, gc_callback);
+#endif
+
 STATIC const mp_rom_map_elem_t mp_module_gc_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_gc) },
     { MP_ROM_QSTR(MP_QSTR_collect), MP_ROM_PTR(&gc_collect_obj) },
+    #if MICROPY_GC_INCREMENTAL
+    { MP_ROM_QSTR(MP_QSTR_mark), MP_ROM_PTR(&gc_mark_obj) },
+    { MP_ROM_QSTR(MP_QSTR_sweep_step), MP_ROM_PTR(&gc_sweep_step_obj) },
+    #endif
     { MP_ROM_QSTR(MP_QSTR_disable), MP_ROM_PTR(&gc_disable_obj) },
     { MP_ROM_QSTR(MP_QSTR_enable), MP_ROM_PTR(&gc_enable_obj) },
     { MP_ROM_QSTR(MP_QSTR_isenabled), MP_ROM_PTR(&gc_isenabled_obj) },
@@ -113,6 +212,10 @@ STATIC const mp_rom_map_elem_t mp_module_gc_globals_table[] = {
     #if MICROPY_GC_ALLOC_THRESHOLD
     { MP_ROM_QSTR(MP_QSTR_threshold), MP_ROM_PTR(&gc_threshold_obj) },
     #endif
+    #if MICROPY_GC_STATS
+    { MP_ROM_QSTR(MP_QSTR_stats), MP_ROM_PTR(&gc_stats_obj) },
+    { MP_ROM_QSTR(MP_QSTR_callback), MP_ROM_PTR(&gc_callback_obj) },
+    #endif
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_gc_globals, mp_module_gc_globals_table);
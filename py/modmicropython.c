@@ -28,8 +28,10 @@
 
 #include "py/mpstate.h"
 #include "py/builtin.h"
+#include "py/runtime.h"
 #include "py/stackctrl.h"
 #include "py/gc.h"
+#include "py/allocprof.h"
 
 // Various builtins specific to MicroPython runtime,
 // living in micropython module
@@ -124,6 +126,100 @@ STATIC mp_obj_t mp_micropython_heap_unlock(void) {
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(mp_micropython_heap_unlock_obj, mp_micropython_heap_unlock);
 #endif
 
+#if MICROPY_PY_MICROPYTHON_ALLOC_PROFILE
+STATIC mp_obj_t mp_micropython_alloc_profile(mp_obj_t cmd_in) {
+    qstr cmd = mp_obj_str_get_qstr(cmd_in);
+    if (cmd == MP_QSTR_start) {
+        mp_alloc_profile_start();
+    } else if (cmd == MP_QSTR_stop) {
+        mp_alloc_profile_stop();
+    } else if (cmd == MP_QSTR_snapshot) {
+        return mp_alloc_profile_snapshot();
+    } else {
+        mp_raise_ValueError("bad command");
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mp_micropython_alloc_profile_obj, mp_micropython_alloc_profile);
+#endif
+
+#if MICROPY_GC_ARENA
+typedef struct _mp_obj_arena_t {
+    mp_obj_base_t base;
+    size_t size;
+    bool entered;
+    bool reserved;
+    gc_arena_t arena;
+} mp_obj_arena_t;
+
+STATIC mp_obj_t arena___enter__(mp_obj_t self_in) {
+    mp_obj_arena_t *self = MP_OBJ_TO_PTR(self_in);
+    if (self->entered) {
+        mp_raise_ValueError("arena already active");
+    }
+    // if the memory can't be reserved then objects come from the heap as usual
+    self->entered = true;
+    self->reserved = gc_arena_enter(&self->arena, self, self->size);
+    return self_in;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(arena___enter___obj, arena___enter__);
+
+STATIC mp_obj_t arena___exit__(size_t n_args, const mp_obj_t *args) {
+    (void)n_args;
+    mp_obj_arena_t *self = MP_OBJ_TO_PTR(args[0]);
+    if (!self->entered || (self->reserved && MP_STATE_THREAD(gc_arena) != &self->arena)) {
+        // arenas must be exited in the reverse order they were entered, by the same thread
+        mp_raise_ValueError("arena not active");
+    }
+    self->entered = false;
+    if (self->reserved) {
+        gc_arena_exit(&self->arena);
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(arena___exit___obj, 4, 4, arena___exit__);
+
+// the number of objects allocated from the arena that were still referenced
+// when it was exited
+STATIC mp_obj_t arena_escaped(mp_obj_t self_in) {
+    mp_obj_arena_t *self = MP_OBJ_TO_PTR(self_in);
+    return MP_OBJ_NEW_SMALL_INT(self->arena.escaped);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(arena_escaped_obj, arena_escaped);
+
+STATIC const mp_rom_map_elem_t arena_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___enter__), MP_ROM_PTR(&arena___enter___obj) },
+    { MP_ROM_QSTR(MP_QSTR___exit__), MP_ROM_PTR(&arena___exit___obj) },
+    { MP_ROM_QSTR(MP_QSTR_escaped), MP_ROM_PTR(&arena_escaped_obj) },
+};
+
+STATIC MP_DEFINE_CONST_DICT(arena_locals_dict, arena_locals_dict_table);
+
+STATIC const mp_obj_type_t mp_type_arena = {
+    { &mp_type_type },
+    .name = MP_QSTR_arena,
+    .locals_dict = (mp_obj_dict_t*)&arena_locals_dict,
+};
+
+// micropython.arena(size) returns a context manager; while it's active,
+// objects allocated by the thread come from a reserved run of size bytes, and
+// on exit those that are no longer referenced are freed straight away
+STATIC mp_obj_t mp_micropython_arena(mp_obj_t size_in) {
+    mp_int_t size = mp_obj_get_int(size_in);
+    if (size <= 0) {
+        mp_raise_ValueError("size must be positive");
+    }
+    mp_obj_arena_t *o = m_new_obj(mp_obj_arena_t);
+    o->base.type = &mp_type_arena;
+    o->size = size;
+    o->entered = false;
+    o->reserved = false;
+    o->arena.escaped = 0;
+    return MP_OBJ_FROM_PTR(o);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mp_micropython_arena_obj, mp_micropython_arena);
+#endif
+
 #if MICROPY_ENABLE_EMERGENCY_EXCEPTION_BUF && (MICROPY_EMERGENCY_EXCEPTION_BUF_SIZE == 0)
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mp_alloc_emergency_exception_buf_obj, mp_alloc_emergency_exception_buf);
 #endif
@@ -151,6 +247,12 @@ STATIC const mp_rom_map_elem_t mp_module_micropython_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_heap_lock), MP_ROM_PTR(&mp_micropython_heap_lock_obj) },
     { MP_ROM_QSTR(MP_QSTR_heap_unlock), MP_ROM_PTR(&mp_micropython_heap_unlock_obj) },
     #endif
+    #if MICROPY_PY_MICROPYTHON_ALLOC_PROFILE
+    { MP_ROM_QSTR(MP_QSTR_alloc_profile), MP_ROM_PTR(&mp_micropython_alloc_profile_obj) },
+    #endif
+    #if MICROPY_GC_ARENA
+    { MP_ROM_QSTR(MP_QSTR_arena), MP_ROM_PTR(&mp_micropython_arena_obj) },
+    #endif
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_micropython_globals, mp_module_micropython_globals_table);
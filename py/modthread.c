@@ -161,6 +161,9 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_thread_stack_size_obj, 0, 1, mod_
 
 typedef struct _thread_entry_args_t {
     size_t stack_size;
+    #if MICROPY_OPT_CLASS_LOOKUP_CACHE || MICROPY_OPT_INLINE_ATTR_CACHE || MICROPY_OPT_LOAD_GLOBAL_CACHE
+    mp_lookup_caches_t *lookup_caches;
+    #endif
     mp_obj_t fun;
     size_t n_args;
     size_t n_kw;
@@ -175,6 +178,20 @@ STATIC void *thread_entry(void *args_in) {
     mp_state_thread_t ts;
     mp_thread_set_state(&ts);
 
+    #if MICROPY_PY_MICROPYTHON_ALLOC_PROFILE
+    ts.current_code_state = NULL;
+    #endif
+    #if MICROPY_GC_ARENA
+    ts.gc_arena = NULL;
+    #endif
+    #if MICROPY_GC_TLAB
+    ts.gc_tlab_ptr = NULL;
+    ts.gc_tlab_end = NULL;
+    #endif
+    #if MICROPY_OPT_CLASS_LOOKUP_CACHE || MICROPY_OPT_INLINE_ATTR_CACHE || MICROPY_OPT_LOAD_GLOBAL_CACHE
+    ts.lookup_caches = args->lookup_caches;
+    #endif
+
     mp_stack_set_top(&ts + 1); // need to include ts in root-pointer scan
     mp_stack_set_limit(args->stack_size);
 
@@ -263,6 +280,10 @@ STATIC mp_obj_t mod_thread_start_new_thread(size_t n_args, const mp_obj_t *args)
     // set the function for thread entry
     th_args->fun = args[0];
 
+    #if MICROPY_OPT_CLASS_LOOKUP_CACHE || MICROPY_OPT_INLINE_ATTR_CACHE || MICROPY_OPT_LOAD_GLOBAL_CACHE
+    th_args->lookup_caches = m_new0(mp_lookup_caches_t, 1);
+    #endif
+
     // spawn the thread!
     mp_thread_create(thread_entry, th_args, &th_args->stack_size);
 
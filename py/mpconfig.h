@@ -123,6 +123,87 @@
 #define MICROPY_GC_ALLOC_THRESHOLD (1)
 #endif
 
+// Keep the free runs of blocks in free lists segregated by run length, so
+// that allocation doesn't need a linear scan of the allocation table.  The
+// list links are stored in the free blocks themselves, so this needs blocks
+// of at least 4 words.
+#ifndef MICROPY_GC_SIZE_CLASSES
+#define MICROPY_GC_SIZE_CLASSES (0)
+#endif
+
+// Sweep the heap incrementally after the (atomic) mark phase: a bounded number
+// of blocks is swept on each allocation, and gc.mark() and gc.sweep_step(budget_us)
+// can be used to run the mark and then sweep in time slices.
+#ifndef MICROPY_GC_INCREMENTAL
+#define MICROPY_GC_INCREMENTAL (0)
+#endif
+
+// Number of blocks swept for each block allocated while a sweep is pending
+#ifndef MICROPY_GC_INCREMENTAL_SWEEP_RATIO
+#define MICROPY_GC_INCREMENTAL_SWEEP_RATIO (16)
+#endif
+
+// Number of blocks swept at a time when an allocation can't be satisfied
+// while a sweep is pending
+#ifndef MICROPY_GC_INCREMENTAL_SWEEP_CHUNK
+#define MICROPY_GC_INCREMENTAL_SWEEP_CHUNK (4096)
+#endif
+
+// Whether the GC heap can be made of more than one area of memory, added
+// with gc_add_region
+#ifndef MICROPY_GC_SPLIT_HEAP
+#define MICROPY_GC_SPLIT_HEAP (0)
+#endif
+
+// Whether the GC heap grows automatically, when a collection can't free
+// enough memory, by adding regions obtained with MP_PLAT_ALLOC_HEAP.
+// Regions added this way are given back with MP_PLAT_FREE_HEAP once a
+// collection leaves them completely free.  Requires MICROPY_GC_SPLIT_HEAP.
+#ifndef MICROPY_GC_SPLIT_HEAP_AUTO
+#define MICROPY_GC_SPLIT_HEAP_AUTO (0)
+#endif
+
+// Whether each thread takes single-block objects from its own buffer of heap
+// blocks, so that most allocations don't need the GC mutex.  Requires
+// MICROPY_PY_THREAD, and the port must call gc_collect_tlab() from each
+// thread whose registers and stack it scans during a collection.
+#ifndef MICROPY_GC_TLAB
+#define MICROPY_GC_TLAB (0)
+#endif
+
+// Number of blocks in a thread's allocation buffer
+#ifndef MICROPY_GC_TLAB_BLOCKS
+#define MICROPY_GC_TLAB_BLOCKS (64)
+#endif
+
+// Whether the GC moves entries that don't fit on its mark stack to an
+// auxiliary stack, grown with MP_PLAT_ALLOC_GC_STACK, instead of rescanning
+// the heap for them once marking is done.  The rescan is still used if the
+// auxiliary stack can't be grown.
+#ifndef MICROPY_GC_AUX_STACK
+#define MICROPY_GC_AUX_STACK (0)
+#endif
+
+// Whether the GC can mark in parallel, on helper threads provided by the
+// port (see gc_mark_workers_start).  Requires MICROPY_PY_THREAD and
+// MICROPY_GC_AUX_STACK, through which the threads share their work.
+#ifndef MICROPY_GC_PARALLEL_MARK
+#define MICROPY_GC_PARALLEL_MARK (0)
+#endif
+
+// Whether to support arenas, runs of blocks that a thread allocates from
+// for a while and that are then collected on their own (see gc_arena_enter),
+// and provide micropython.arena()
+#ifndef MICROPY_GC_ARENA
+#define MICROPY_GC_ARENA (0)
+#endif
+
+// Whether to keep statistics about collections (see gc_stats), and provide
+// gc.stats() and gc.callback().  Requires mp_hal_ticks_us.
+#ifndef MICROPY_GC_STATS
+#define MICROPY_GC_STATS (0)
+#endif
+
 // Number of bytes to allocate initially when creating new chunks to store
 // interned string data.  Smaller numbers lead to more chunks being needed
 // and more wastage at the end of the chunk.  Larger numbers lead to wasted
@@ -211,6 +292,14 @@
 #define MICROPY_QSTR_BYTES_IN_HASH (2)
 #endif
 
+// Whether to find qstrs through a hash index instead of scanning the pools.
+// The index of the ROM qstrs is generated by makeqstrdata.py, and the one of
+// the qstrs interned at runtime is kept on the heap.  Works best with 2 byte
+// hashes.
+#ifndef MICROPY_QSTR_HASH_INDEX
+#define MICROPY_QSTR_HASH_INDEX (0)
+#endif
+
 // Avoid using C stack when making Python function calls. C stack still
 // may be used if there's no free heap.
 #ifndef MICROPY_STACKLESS
@@ -384,6 +473,112 @@
 #define MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE (0)
 #endif
 
+// Whether the VM rewrites generic opcodes in the bytecode with ones specialised
+// for the operands that they see (small ints, floats, lists indexed by small
+// ints and ranges), which go back to the generic opcodes when they see other
+// operands.  Like MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE, which it needs,
+// this writes to the bytecode, so the bytecode can't be in ROM.
+#ifndef MICROPY_OPT_QUICKEN_BYTECODE
+#define MICROPY_OPT_QUICKEN_BYTECODE (0)
+#endif
+
+// Whether to remember where keys were last found in ordered maps, which
+// include the fixed maps of builtin modules and types and the builtins
+// table, so that looking them up again doesn't need a linear search.  The
+// cache is shared by all maps and uses 2 bytes of RAM per entry.
+#ifndef MICROPY_OPT_MAP_LOOKUP_CACHE
+#define MICROPY_OPT_MAP_LOOKUP_CACHE (0)
+#endif
+
+// Number of entries in the map lookup cache, must be a power of 2
+#ifndef MICROPY_OPT_MAP_LOOKUP_CACHE_SIZE
+#define MICROPY_OPT_MAP_LOOKUP_CACHE_SIZE (256)
+#endif
+
+// Whether to cache where attributes were found by looking them up in classes
+// and their bases, so that looking them up again doesn't walk the bases.  The
+// cache is kept per thread and uses 5 words of RAM per entry.
+#ifndef MICROPY_OPT_CLASS_LOOKUP_CACHE
+#define MICROPY_OPT_CLASS_LOOKUP_CACHE (0)
+#endif
+
+// Number of entries in the class lookup cache, must be a power of 2
+#ifndef MICROPY_OPT_CLASS_LOOKUP_CACHE_SIZE
+#define MICROPY_OPT_CLASS_LOOKUP_CACHE_SIZE (32)
+#endif
+
+// Whether the LOAD_ATTR, STORE_ATTR and LOAD_METHOD opcodes have inline caches
+// of the last 4 types that they saw, so that members of instances and methods
+// are found without a lookup.  The caches are kept per thread, in a table that
+// uses 6 words of RAM per entry.  This needs MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE,
+// MICROPY_OPT_CLASS_LOOKUP_CACHE and MICROPY_INSTANCE_SHARED_KEYS.
+#ifndef MICROPY_OPT_INLINE_ATTR_CACHE
+#define MICROPY_OPT_INLINE_ATTR_CACHE (0)
+#endif
+
+// Number of entries in the inline attribute cache table, must be a power of 2
+#ifndef MICROPY_OPT_INLINE_ATTR_CACHE_SIZE
+#define MICROPY_OPT_INLINE_ATTR_CACHE_SIZE (128)
+#endif
+
+// Whether the LOAD_GLOBAL and LOAD_NAME opcodes cache where they found names in
+// the globals or builtins, so that loading them again, while no global has been
+// added or removed, doesn't need a lookup.  The caches are kept per thread, in
+// a table that uses 3 words of RAM per entry.  This needs
+// MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE.
+#ifndef MICROPY_OPT_LOAD_GLOBAL_CACHE
+#define MICROPY_OPT_LOAD_GLOBAL_CACHE (0)
+#endif
+
+// Number of entries in the LOAD_GLOBAL cache table, must be a power of 2
+#ifndef MICROPY_OPT_LOAD_GLOBAL_CACHE_SIZE
+#define MICROPY_OPT_LOAD_GLOBAL_CACHE_SIZE (64)
+#endif
+
+// Whether bytecode functions that are called often, or that loop a lot, are
+// recompiled with the native emitter and then run as native code.  This
+// retains the source of compiled modules so it can be compiled again, and
+// needs a native emitter.
+#ifndef MICROPY_OPT_TIERED_NATIVE
+#define MICROPY_OPT_TIERED_NATIVE (0)
+#endif
+#if MICROPY_OPT_TIERED_NATIVE && !MICROPY_EMIT_NATIVE
+#error MICROPY_OPT_TIERED_NATIVE needs a native emitter
+#endif
+
+// Number of calls plus loop iterations after which a function is promoted
+#ifndef MICROPY_OPT_TIERED_NATIVE_THRESHOLD
+#define MICROPY_OPT_TIERED_NATIVE_THRESHOLD (1000)
+#endif
+
+// Whether ordered maps (such as OrderedDict and keyword argument maps) that
+// grow big get a hash index, so that looking keys up in them isn't linear.
+#ifndef MICROPY_MAP_ORDERED_INDEX
+#define MICROPY_MAP_ORDERED_INDEX (0)
+#endif
+
+// Whether all maps (and so dicts) are kept like ordered maps, with their
+// elements in a dense table in the order that they were added and, once they
+// grow big, a hash index of 1, 2 or 4 byte slots.  This needs
+// MICROPY_MAP_ORDERED_INDEX.  Otherwise maps that aren't ordered are open
+// addressed hash tables.
+#ifndef MICROPY_MAP_COMPACT
+#define MICROPY_MAP_COMPACT (0)
+#endif
+
+// Whether instances of classes share the keys of their members, which are
+// kept once in the class, so that each instance only stores their values.
+// An instance gets a map of its own if its class gets too many keys.
+#ifndef MICROPY_INSTANCE_SHARED_KEYS
+#define MICROPY_INSTANCE_SHARED_KEYS (0)
+#endif
+
+// Whether classes can have __slots__, so that their instances can only have
+// those members, and store them inline.  This needs MICROPY_INSTANCE_SHARED_KEYS.
+#ifndef MICROPY_INSTANCE_SLOTS
+#define MICROPY_INSTANCE_SLOTS (0)
+#endif
+
 // Whether to use fast versions of bitwise operations (and, or, xor) when the
 // arguments are both positive.  Increases Thumb2 code size by about 250 bytes.
 #ifndef MICROPY_OPT_MPZ_BITWISE
@@ -790,6 +985,17 @@ typedef double mp_float_t;
 #define MICROPY_PY_MICROPYTHON_MEM_INFO (0)
 #endif
 
+// Whether to provide micropython.alloc_profile, which records the number of
+// allocations and bytes allocated at each bytecode location and for each type
+#ifndef MICROPY_PY_MICROPYTHON_ALLOC_PROFILE
+#define MICROPY_PY_MICROPYTHON_ALLOC_PROFILE (0)
+#endif
+
+// Number of bytecode locations that the allocation profiler can record
+#ifndef MICROPY_ALLOC_PROFILE_SITES
+#define MICROPY_ALLOC_PROFILE_SITES (512)
+#endif
+
 // Whether to provide "array" module. Note that large chunk of the
 // underlying code is shared with "bytearray" builtin type, so to
 // get real savings, it should be disabled too.
@@ -1133,6 +1339,27 @@ typedef double mp_float_t;
 #define MP_PLAT_FREE_EXEC(ptr, size) m_del(byte, ptr, size)
 #endif
 
+// These MP_PLAT_*_HEAP macros provide memory to grow the GC heap with when
+// MICROPY_GC_SPLIT_HEAP_AUTO is enabled; the default is to provide none.
+#ifndef MP_PLAT_ALLOC_HEAP
+#define MP_PLAT_ALLOC_HEAP(size) (NULL)
+#endif
+
+#ifndef MP_PLAT_FREE_HEAP
+#define MP_PLAT_FREE_HEAP(ptr, size) (void)0
+#endif
+
+// These MP_PLAT_*_GC_STACK macros provide memory for the auxiliary GC mark
+// stack when MICROPY_GC_AUX_STACK is enabled.  They may be called while the
+// registers and stack of a thread are scanned, eg from a signal handler.
+#ifndef MP_PLAT_ALLOC_GC_STACK
+#define MP_PLAT_ALLOC_GC_STACK(size) (NULL)
+#endif
+
+#ifndef MP_PLAT_FREE_GC_STACK
+#define MP_PLAT_FREE_GC_STACK(ptr, size) (void)0
+#endif
+
 // This macro is used to do all output (except when MICROPY_PY_IO is defined)
 #ifndef MP_PLAT_PRINT_STRN
 #define MP_PLAT_PRINT_STRN(str, len) mp_hal_stdout_tx_strn_cooked(str, len)
@@ -46,16 +46,15 @@ typedef struct mp_dynamic_compiler_t {
     uint8_t small_int_bits; // must be <= host small_int_bits
     bool opt_cache_map_lookup_in_bytecode;
     bool py_builtins_str_unicode;
+    uint8_t native_arch; // one of MP_NATIVE_ARCH_xxx
 } mp_dynamic_compiler_t;
 extern mp_dynamic_compiler_t mp_dynamic_compiler;
 #endif
 
-// This structure hold information about the memory allocation system.
-typedef struct _mp_state_mem_t {
-    #if MICROPY_MEM_STATS
-    size_t total_bytes_allocated;
-    size_t current_bytes_allocated;
-    size_t peak_bytes_allocated;
+// This structure holds the state of one contiguous area of the GC heap.
+typedef struct _mp_state_mem_area_t {
+    #if MICROPY_GC_SPLIT_HEAP
+    struct _mp_state_mem_area_t *next;
     #endif
 
     byte *gc_alloc_table_start;
@@ -66,11 +65,57 @@ typedef struct _mp_state_mem_t {
     byte *gc_pool_start;
     byte *gc_pool_end;
 
+    size_t gc_last_free_atb_index;
+
+    #if MICROPY_GC_INCREMENTAL
+    // next block to be swept; equal to the number of blocks if not sweeping
+    size_t gc_sweep_block;
+    #endif
+
+    #if MICROPY_GC_SIZE_CLASSES
+    // heads of the free lists (see gc.c), and a bitmap of the non-empty ones
+    size_t gc_free_list[32];
+    uint32_t gc_free_list_nonempty;
+    #endif
+
+    #if MICROPY_GC_SPLIT_HEAP_AUTO
+    // set if the area was added by the GC to grow the heap, and can be released
+    bool gc_auto_added;
+    #endif
+} mp_state_mem_area_t;
+
+// This structure hold information about the memory allocation system.
+typedef struct _mp_state_mem_t {
+    #if MICROPY_MEM_STATS
+    size_t total_bytes_allocated;
+    size_t current_bytes_allocated;
+    size_t peak_bytes_allocated;
+    #endif
+
+    // the first (and, without MICROPY_GC_SPLIT_HEAP, only) area of the heap
+    mp_state_mem_area_t area;
+
     int gc_stack_overflow;
     size_t gc_stack[MICROPY_ALLOC_GC_STACK_SIZE];
     size_t *gc_sp;
     uint16_t gc_lock_depth;
 
+    #if MICROPY_GC_AUX_STACK
+    // entries that didn't fit on gc_stack, only allocated during a collection
+    size_t *gc_aux_stack;
+    size_t gc_aux_stack_len;
+    size_t gc_aux_stack_alloc;
+    #endif
+
+    #if MICROPY_GC_PARALLEL_MARK
+    // state of parallel marking, protected by gc_mark_mutex
+    volatile bool gc_mark_parallel;
+    volatile size_t gc_mark_busy;
+    size_t gc_mark_threads;
+    size_t gc_mark_finished;
+    mp_thread_mutex_t gc_mark_mutex;
+    #endif
+
     // This variable controls auto garbage collection.  If set to 0 then the
     // GC won't automatically run when gc_alloc can't find enough blocks.  But
     // you can still allocate/free memory and also explicitly call gc_collect.
@@ -81,18 +126,105 @@ typedef struct _mp_state_mem_t {
     size_t gc_alloc_threshold;
     #endif
 
-    size_t gc_last_free_atb_index;
+    #if MICROPY_GC_INCREMENTAL
+    // first area with a pending sweep, or NULL if not sweeping
+    mp_state_mem_area_t *gc_sweep_area;
+    #endif
 
     #if MICROPY_PY_GC_COLLECT_RETVAL
     size_t gc_collected;
     #endif
 
+    #if MICROPY_GC_ARENA
+    // the blocks being collected by a collection of an arena, see gc_arena_exit
+    mp_state_mem_area_t *gc_local_area;
+    byte *gc_local_start;
+    byte *gc_local_end;
+    #endif
+
+    #if MICROPY_GC_STATS
+    // statistics about collections, see gc_stats
+    size_t gc_stats_collections;
+    size_t gc_stats_finalisers;
+    uint64_t gc_stats_mark_us;
+    uint64_t gc_stats_sweep_us;
+    mp_uint_t gc_stats_mark_us_max;
+    mp_uint_t gc_stats_sweep_us_max;
+    mp_uint_t gc_stats_mark_start;
+    // blocks freed by the sweep in progress, the last complete one, and all of them
+    size_t gc_stats_sweep_blocks;
+    size_t gc_stats_last_blocks;
+    uint64_t gc_stats_total_blocks;
+    // set when a collection ends and gc.callback has to be called
+    volatile bool gc_callback_pending;
+    #endif
+
     #if MICROPY_PY_THREAD
     // This is a global mutex used to make the GC thread-safe.
     mp_thread_mutex_t gc_mutex;
     #endif
 } mp_state_mem_t;
 
+#if MICROPY_OPT_CLASS_LOOKUP_CACHE
+// An attribute that was looked up in a class, and where it was found: value is
+// the member found in the locals of found_type, or MP_OBJ_SENTINEL for a slot
+// of a native type, and found_type is NULL if it wasn't found.
+typedef struct _mp_class_lookup_cache_entry_t {
+    const mp_obj_type_t *type;
+    qstr attr;
+    mp_uint_t meth_offset;
+    mp_uint_t version;
+    const mp_obj_type_t *found_type;
+    mp_obj_t value;
+} mp_class_lookup_cache_entry_t;
+#endif
+
+#if MICROPY_OPT_INLINE_ATTR_CACHE
+// A type that was seen by the opcode at ip, looking up attr.  For members of
+// instances, keys is the instance_keys of the class and data is the index of
+// the member; for methods, value is the method and data is the class lookup
+// version, and keys is the instance_keys of the class (NULL for native types).
+typedef struct _mp_attr_cache_entry_t {
+    const byte *ip;
+    qstr attr;
+    const mp_obj_type_t *type;
+    const mp_map_t *keys;
+    mp_uint_t data;
+    mp_obj_t value;
+} mp_attr_cache_entry_t;
+#endif
+
+#if MICROPY_OPT_LOAD_GLOBAL_CACHE
+// Where a global name was found when looked up with dict as the globals: elem
+// is an element of dict, of the builtins override dict or of the builtins
+// table, valid as long as the map keys version is still version.
+typedef struct _mp_global_cache_entry_t {
+    const mp_obj_dict_t *dict;
+    mp_uint_t version;
+    const mp_map_elem_t *elem;
+} mp_global_cache_entry_t;
+#endif
+
+#if MICROPY_OPT_CLASS_LOOKUP_CACHE || MICROPY_OPT_INLINE_ATTR_CACHE || MICROPY_OPT_LOAD_GLOBAL_CACHE
+// The lookup caches of a thread.  They are too big to go on the stack of the
+// thread with its mp_state_thread_t, so they're allocated on the heap when the
+// thread is started, except for the main thread's, which are in mp_state_vm.
+typedef struct _mp_lookup_caches_t {
+    #if MICROPY_OPT_CLASS_LOOKUP_CACHE
+    // see mp_obj_class_lookup
+    mp_class_lookup_cache_entry_t class_lookup[MICROPY_OPT_CLASS_LOOKUP_CACHE_SIZE];
+    #endif
+    #if MICROPY_OPT_INLINE_ATTR_CACHE
+    // see vm.c
+    mp_attr_cache_entry_t attr[MICROPY_OPT_INLINE_ATTR_CACHE_SIZE];
+    #endif
+    #if MICROPY_OPT_LOAD_GLOBAL_CACHE
+    // see vm.c
+    mp_global_cache_entry_t global[MICROPY_OPT_LOAD_GLOBAL_CACHE_SIZE];
+    #endif
+} mp_lookup_caches_t;
+#endif
+
 // This structure hold runtime and VM information.  It includes a section
 // which contains root pointers that must be scanned by the GC.
 typedef struct _mp_state_vm_t {
@@ -104,6 +236,11 @@ typedef struct _mp_state_vm_t {
 
     qstr_pool_t *last_pool;
 
+    #if MICROPY_QSTR_HASH_INDEX
+    // hash index of the qstrs in the runtime pools, or NULL if there is none
+    qstr_hash_index_t *qstr_hash_index;
+    #endif
+
     // non-heap memory for creating an exception if we can't allocate RAM
     mp_obj_exception_t mp_emergency_exception_obj;
 
@@ -165,6 +302,21 @@ typedef struct _mp_state_vm_t {
     struct _mp_vfs_mount_t *vfs_mount_table;
     #endif
 
+    #if MICROPY_PY_MICROPYTHON_ALLOC_PROFILE
+    struct _mp_alloc_profile_t *alloc_profile;
+    #endif
+
+    #if MICROPY_GC_STATS
+    // called after each collection, if not MP_OBJ_NULL
+    mp_obj_t gc_callback;
+    #endif
+
+    #if MICROPY_OPT_CLASS_LOOKUP_CACHE || MICROPY_OPT_INLINE_ATTR_CACHE || MICROPY_OPT_LOAD_GLOBAL_CACHE
+    // the lookup caches of the main thread, which refer to objects that
+    // must be kept while they're in the caches
+    mp_lookup_caches_t main_lookup_caches;
+    #endif
+
     //
     // END ROOT POINTER SECTION
     ////////////////////////////////////////////////////////////
@@ -175,13 +327,45 @@ typedef struct _mp_state_vm_t {
     size_t qstr_last_alloc;
     size_t qstr_last_used;
 
+    #if MICROPY_QSTR_HASH_INDEX
+    // number of slots of qstr_hash_index that are used (see qstr.c)
+    size_t qstr_hash_index_len;
+    #endif
+
     #if MICROPY_PY_THREAD
     // This is a global mutex used to make qstr interning thread-safe.
     mp_thread_mutex_t qstr_mutex;
     #endif
 
+    #if MICROPY_PY_THREAD && MICROPY_INSTANCE_SHARED_KEYS
+    // protects replacing the instance_keys of classes, see objtype.c
+    mp_thread_mutex_t instance_keys_mutex;
+    #endif
+
+    #if MICROPY_PY_THREAD && MICROPY_OPT_TIERED_NATIVE
+    // serialises promoting functions to native code, see emitglue.c
+    mp_thread_mutex_t tier_up_mutex;
+    #endif
+
     mp_uint_t mp_optimise_value;
 
+    #if MICROPY_OPT_MAP_LOOKUP_CACHE
+    // where keys were last found in ordered maps, see mp_map_lookup
+    uint16_t map_lookup_cache[MICROPY_OPT_MAP_LOOKUP_CACHE_SIZE];
+    #endif
+
+    #if MICROPY_OPT_CLASS_LOOKUP_CACHE
+    // changed whenever the attributes of a class may have changed, which
+    // invalidates the entries of the class lookup caches
+    mp_uint_t class_lookup_version;
+    #endif
+
+    #if MICROPY_OPT_LOAD_GLOBAL_CACHE
+    // changed whenever a key is added to or removed from a versioned map,
+    // which invalidates the entries of the LOAD_GLOBAL caches
+    mp_uint_t map_keys_version;
+    #endif
+
     // size of the emergency exception buf, if it's dynamically allocated
     #if MICROPY_ENABLE_EMERGENCY_EXCEPTION_BUF && MICROPY_EMERGENCY_EXCEPTION_BUF_SIZE == 0
     mp_int_t mp_emergency_exception_buf_size;
@@ -191,6 +375,11 @@ typedef struct _mp_state_vm_t {
     // This is a global mutex used to make the VM/runtime thread-safe.
     mp_thread_mutex_t gil_mutex;
     #endif
+
+    #if MICROPY_PY_MICROPYTHON_ALLOC_PROFILE
+    // whether allocations are being recorded in alloc_profile
+    bool alloc_profile_active;
+    #endif
 } mp_state_vm_t;
 
 // This structure holds state that is specific to a given thread.
@@ -206,6 +395,26 @@ typedef struct _mp_state_thread_t {
     #if MICROPY_STACK_CHECK
     size_t stack_limit;
     #endif
+
+    #if MICROPY_PY_MICROPYTHON_ALLOC_PROFILE
+    // the bytecode being executed, if any
+    struct _mp_code_state_t *current_code_state;
+    #endif
+
+    #if MICROPY_GC_ARENA
+    // the arena the thread is allocating from, if any
+    struct _gc_arena_t *gc_arena;
+    #endif
+
+    #if MICROPY_GC_TLAB
+    // the thread's allocation buffer, see gc_alloc
+    byte *gc_tlab_ptr;
+    byte *gc_tlab_end;
+    #endif
+
+    #if MICROPY_OPT_CLASS_LOOKUP_CACHE || MICROPY_OPT_INLINE_ATTR_CACHE || MICROPY_OPT_LOAD_GLOBAL_CACHE
+    mp_lookup_caches_t *lookup_caches;
+    #endif
 } mp_state_thread_t;
 
 // This structure combines the above 3 structures, and adds the local
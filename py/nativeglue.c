@@ -40,6 +40,14 @@
 #define DEBUG_printf(...) (void)0
 #endif
 
+#if MICROPY_PY_BUILTINS_FLOAT && (MICROPY_EMIT_NATIVE || MICROPY_EMIT_INLINE_ASM)
+// viper keeps a float in a machine word
+typedef union _native_float_t {
+    mp_float_t f;
+    mp_uint_t u;
+} native_float_t;
+#endif
+
 #if MICROPY_EMIT_NATIVE
 
 // convert a Micro Python object to a valid native value based on type
@@ -50,6 +58,13 @@ mp_uint_t mp_convert_obj_to_native(mp_obj_t obj, mp_uint_t type) {
         case MP_NATIVE_TYPE_BOOL:
         case MP_NATIVE_TYPE_INT:
         case MP_NATIVE_TYPE_UINT: return mp_obj_get_int_truncated(obj);
+        #if MICROPY_PY_BUILTINS_FLOAT
+        case MP_NATIVE_TYPE_FLOAT: {
+            native_float_t val = {0};
+            val.f = mp_obj_get_float(obj);
+            return val.u;
+        }
+        #endif
         default: { // cast obj to a pointer
             mp_buffer_info_t bufinfo;
             if (mp_get_buffer(obj, &bufinfo, MP_BUFFER_RW)) {
@@ -74,6 +89,13 @@ mp_obj_t mp_convert_native_to_obj(mp_uint_t val, mp_uint_t type) {
         case MP_NATIVE_TYPE_BOOL: return mp_obj_new_bool(val);
         case MP_NATIVE_TYPE_INT: return mp_obj_new_int(val);
         case MP_NATIVE_TYPE_UINT: return mp_obj_new_int_from_uint(val);
+        #if MICROPY_PY_BUILTINS_FLOAT
+        case MP_NATIVE_TYPE_FLOAT: {
+            native_float_t f = {0};
+            f.u = val;
+            return mp_obj_new_float(f.f);
+        }
+        #endif
         default: // a pointer
             // we return just the value of the pointer as an integer
             return mp_obj_new_int_from_uint(val);
@@ -98,6 +120,65 @@ void mp_native_raise(mp_obj_t o) {
     }
 }
 
+// the constant objects that native code refers to by MP_NATIVE_RELOC_CONST_OBJ
+mp_obj_t mp_native_const_obj(mp_native_const_obj_t id) {
+    switch (id) {
+        case MP_NATIVE_CONST_NONE: return mp_const_none;
+        case MP_NATIVE_CONST_FALSE: return mp_const_false;
+        case MP_NATIVE_CONST_TRUE: return mp_const_true;
+        default: return MP_OBJ_FROM_PTR(&mp_const_ellipsis_obj);
+    }
+}
+
+#if MICROPY_OPT_TIERED_NATIVE
+
+#if MICROPY_PY_THREAD_GIL
+// the GIL is held while this is updated
+STATIC uint8_t native_gil_divisor;
+#endif
+
+// called by promoted code on each loop iteration, like the VM does
+STATIC void mp_native_loop_check(void) {
+    MICROPY_VM_HOOK_LOOP
+    if (MP_STATE_VM(mp_pending_exception) != MP_OBJ_NULL) {
+        mp_obj_t obj = MP_STATE_VM(mp_pending_exception);
+        MP_STATE_VM(mp_pending_exception) = MP_OBJ_NULL;
+        nlr_raise(obj);
+    }
+    #if MICROPY_PY_THREAD_GIL
+    // releasing the GIL costs more than a loop iteration of native code, so
+    // only do it every so often
+    if ((++native_gil_divisor & 31) == 0) {
+        MP_THREAD_GIL_EXIT();
+        MP_THREAD_GIL_ENTER();
+    }
+    #endif
+}
+
+// called by promoted code when it loads a local that is unbound
+STATIC void mp_native_unbound_local(void) {
+    nlr_raise(mp_obj_new_exception_msg(&mp_type_NameError, "local variable referenced before assignment"));
+}
+
+// called by promoted code with an exception that it caught, to add the line
+// that was running to the traceback like the VM does
+STATIC NORETURN void mp_native_tier_raise(mp_obj_t exc, mp_uint_t line, qstr file, qstr block) {
+    if (MP_OBJ_TO_PTR(exc) != &mp_const_GeneratorExit_obj && MP_OBJ_TO_PTR(exc) != &mp_const_MemoryError_obj) {
+        mp_obj_exception_add_traceback(exc, file, line, block);
+    }
+    nlr_jump(MP_OBJ_TO_PTR(exc));
+}
+
+#endif
+
+#if !MICROPY_PY_BUILTINS_SET || !MICROPY_PY_BUILTINS_SLICE
+// stands in for the functions of features that are disabled, which native
+// code loaded from a .mpy file may still call
+STATIC void mp_native_not_enabled(void) {
+    mp_not_implemented("feature not enabled");
+}
+#endif
+
 // these must correspond to the respective enum in runtime0.h
 void *const mp_fun_table[MP_F_NUMBER_OF] = {
     mp_convert_obj_to_native,
@@ -122,6 +203,9 @@ void *const mp_fun_table[MP_F_NUMBER_OF] = {
 #if MICROPY_PY_BUILTINS_SET
     mp_obj_new_set,
     mp_obj_set_store,
+#else
+    mp_native_not_enabled,
+    mp_native_not_enabled,
 #endif
     mp_make_function_from_raw_code,
     mp_native_call_function_n_kw,
@@ -137,6 +221,8 @@ void *const mp_fun_table[MP_F_NUMBER_OF] = {
     mp_import_all,
 #if MICROPY_PY_BUILTINS_SLICE
     mp_obj_new_slice,
+#else
+    mp_native_not_enabled,
 #endif
     mp_unpack_sequence,
     mp_unpack_ex,
@@ -145,6 +231,34 @@ void *const mp_fun_table[MP_F_NUMBER_OF] = {
     mp_obj_new_cell,
     mp_make_closure_from_raw_code,
     mp_setup_code_state,
+    (void*)&mp_type_fun_builtin_0,
+    (void*)&mp_type_fun_builtin_1,
+    (void*)&mp_type_fun_builtin_2,
+    (void*)&mp_type_fun_builtin_3,
+    (void*)&mp_type_fun_builtin_var,
+    mp_arg_check_num,
+    mp_obj_get_int,
+    mp_obj_new_int,
+    mp_obj_new_int_from_uint,
+    mp_obj_len,
+    mp_obj_str_get_data,
+    mp_obj_new_str,
+    mp_obj_new_bytes,
+    mp_get_buffer_raise,
+    m_malloc,
+    mp_raise_ValueError,
+    mp_raise_TypeError,
+#if MICROPY_OPT_TIERED_NATIVE
+    mp_native_loop_check,
+    mp_native_unbound_local,
+    mp_native_tier_raise,
+#if MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+    mp_native_load_global_cached,
+    mp_native_load_attr_cached,
+    mp_native_store_attr_cached,
+    mp_native_load_method_cached,
+#endif
+#endif
 };
 
 /*
@@ -0,0 +1,51 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2016 Damien P. George
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef MICROPY_INCLUDED_PY_NATMOD_H
+#define MICROPY_INCLUDED_PY_NATMOD_H
+
+// This is the header for native modules: C code that is compiled to
+// position-independent machine code and linked into a .mpy file by
+// tools/mpy_ld.py, so that it can be imported like a module written in
+// Python.  See examples/natmod for how to build one.
+//
+// A native module can only use the runtime functions and objects that are
+// in mp_fun_table (see runtime0.h), and the linker points its references to
+// them at the entries of the table.  The module must define
+//
+//     mp_obj_t mpy_init(void);
+//
+// which is called when the module is imported, with the module's globals
+// current, and which stores the members of the module with mp_store_name.
+// Static data is allowed, but it must not point to objects on the heap.
+
+#include "py/runtime.h"
+
+// The linker generates this header, which defines MP_QSTR_xxx for each qstr
+// that the module uses as a reference to a word that the loader fills in
+// with the number of the qstr.
+#include "genhdr/natmod_qstrs.h"
+
+#endif // MICROPY_INCLUDED_PY_NATMOD_H
@@ -356,7 +356,10 @@ typedef struct _mp_map_t {
     mp_uint_t all_keys_are_qstrs : 1;
     mp_uint_t is_fixed : 1;     // a fixed array that can't be modified; must also be ordered
     mp_uint_t is_ordered : 1;   // an ordered array
-    mp_uint_t used : (8 * sizeof(mp_uint_t) - 3);
+    mp_uint_t is_indexed : 1;   // an ordered array with a hash index after the table (see map.c)
+    mp_uint_t is_split : 1;     // the table holds only values, the keys are elsewhere (see objtype.c)
+    mp_uint_t is_versioned : 1; // adding or removing a key changes the map keys version (see map.c)
+    mp_uint_t used : (8 * sizeof(mp_uint_t) - 6);
     mp_uint_t alloc;
     mp_map_elem_t *table;
 } mp_map_t;
@@ -375,6 +378,11 @@ static inline bool MP_MAP_SLOT_IS_FILLED(const mp_map_t *map, mp_uint_t pos) { r
 
 void mp_map_init(mp_map_t *map, mp_uint_t n);
 void mp_map_init_fixed_table(mp_map_t *map, mp_uint_t n, const mp_obj_t *table);
+void mp_map_init_copy(mp_map_t *map, const mp_map_t *src);
+#if MICROPY_OPT_LOAD_GLOBAL_CACHE
+// make adding or removing keys change the map keys version (see map.c)
+void mp_map_set_versioned(mp_map_t *map);
+#endif
 mp_map_t *mp_map_new(mp_uint_t n);
 void mp_map_deinit(mp_map_t *map);
 void mp_map_free(mp_map_t *map);
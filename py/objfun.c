@@ -31,6 +31,7 @@
 #include "py/nlr.h"
 #include "py/objtuple.h"
 #include "py/objfun.h"
+#include "py/emitglue.h"
 #include "py/runtime0.h"
 #include "py/runtime.h"
 #include "py/bc.h"
@@ -200,11 +201,55 @@ STATIC void dump_args(const mp_obj_t *a, mp_uint_t sz) {
 // Set this to enable a simple stack overflow check.
 #define VM_DETECT_STACK_OVERFLOW (0)
 
+#if MICROPY_OPT_TIERED_NATIVE
+
+STATIC mp_obj_t fun_native_call(mp_obj_t self_in, size_t n_args, size_t n_kw, const mp_obj_t *args);
+
+// Promote the function to native code.  The native code runs from a copy of
+// the function object, which is published with a single store so that other
+// threads can keep running the bytecode while this happens.
+STATIC bool fun_bc_tier_up(mp_obj_fun_bc_t *self) {
+    mp_raw_code_t *rc = self->rc;
+    const mp_raw_code_t *native = mp_emit_glue_tier_up(rc);
+    if (native == NULL) {
+        // stay as bytecode for good
+        self->rc = NULL;
+        return false;
+    }
+
+    // work out how many default args to copy across from the bytecode prelude
+    const byte *ip = rc->data.u_byte.bytecode;
+    mp_decode_uint(&ip); // skip n_state
+    mp_decode_uint(&ip); // skip n_exc_stack
+    size_t n_extra_args = ip[3] + ((ip[0] & MP_SCOPE_FLAG_DEFKWARGS) != 0);
+
+    mp_obj_fun_bc_t *o = m_new_obj_var(mp_obj_fun_bc_t, mp_obj_t, n_extra_args);
+    o->base.type = &mp_type_fun_native;
+    o->globals = self->globals;
+    o->bytecode = native->data.u_native.fun_data;
+    o->const_table = native->data.u_native.const_table;
+    o->rc = NULL;
+    o->native = NULL;
+    o->hotness = 0;
+    memcpy(o->extra_args, self->extra_args, n_extra_args * sizeof(mp_obj_t));
+    self->native = o;
+    return true;
+}
+
+#endif
+
 #if MICROPY_STACKLESS
 mp_code_state_t *mp_obj_fun_bc_prepare_codestate(mp_obj_t self_in, size_t n_args, size_t n_kw, const mp_obj_t *args) {
     MP_STACK_CHECK();
     mp_obj_fun_bc_t *self = MP_OBJ_TO_PTR(self_in);
 
+    #if MICROPY_OPT_TIERED_NATIVE
+    if (self->native != NULL) {
+        // native code can't be run stacklessly, so have the caller call it
+        return NULL;
+    }
+    #endif
+
     // get start of bytecode
     const byte *ip = self->bytecode;
 
@@ -243,6 +288,17 @@ STATIC mp_obj_t fun_bc_call(mp_obj_t self_in, size_t n_args, size_t n_kw, const
     mp_obj_fun_bc_t *self = MP_OBJ_TO_PTR(self_in);
     DEBUG_printf("Func n_def_args: %d\n", self->n_def_args);
 
+    #if MICROPY_OPT_TIERED_NATIVE
+    // functions made from raw code that another function object already
+    // promoted get promoted on their first call
+    if (self->native != NULL
+        || (self->rc != NULL
+            && (self->rc->native != NULL || ++self->hotness >= MICROPY_OPT_TIERED_NATIVE_THRESHOLD)
+            && fun_bc_tier_up(self))) {
+        return fun_native_call(MP_OBJ_FROM_PTR(self->native), n_args, n_kw, args);
+    }
+    #endif
+
     // get start of bytecode
     const byte *ip = self->bytecode;
 
@@ -366,6 +422,11 @@ mp_obj_t mp_obj_new_fun_bc(mp_obj_t def_args_in, mp_obj_t def_kw_args, const byt
     o->globals = mp_globals_get();
     o->bytecode = code;
     o->const_table = const_table;
+    #if MICROPY_OPT_TIERED_NATIVE
+    o->rc = NULL;
+    o->native = NULL;
+    o->hotness = 0;
+    #endif
     if (def_args != NULL) {
         memcpy(o->extra_args, def_args->items, n_def_args * sizeof(mp_obj_t));
     }
@@ -384,7 +445,23 @@ STATIC mp_obj_t fun_native_call(mp_obj_t self_in, size_t n_args, size_t n_kw, co
     MP_STACK_CHECK();
     mp_obj_fun_bc_t *self = self_in;
     mp_call_fun_t fun = MICROPY_MAKE_POINTER_CALLABLE((void*)self->bytecode);
-    return fun(self_in, n_args, n_kw, args);
+
+    // execute the native code with the correct globals context
+    mp_obj_dict_t *old_globals = mp_globals_get();
+    if (self->globals == old_globals) {
+        return fun(self_in, n_args, n_kw, args);
+    }
+    mp_globals_set(self->globals);
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_obj_t ret = fun(self_in, n_args, n_kw, args);
+        nlr_pop();
+        mp_globals_set(old_globals);
+        return ret;
+    } else {
+        mp_globals_set(old_globals);
+        nlr_jump(nlr.ret_val);
+    }
 }
 
 STATIC const mp_obj_type_t mp_type_fun_native = {
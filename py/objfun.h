@@ -33,6 +33,11 @@ typedef struct _mp_obj_fun_bc_t {
     mp_obj_dict_t *globals;         // the context within which this function was defined
     const byte *bytecode;           // bytecode for the function
     const mp_uint_t *const_table;   // constant table
+    #if MICROPY_OPT_TIERED_NATIVE
+    struct _mp_raw_code_t *rc;      // raw code, if it may be promoted to native code
+    struct _mp_obj_fun_bc_t *native; // native version of the function, once promoted
+    mp_uint_t hotness;              // number of calls and loop iterations so far
+    #endif
     // the following extra_args array is allocated space to take (in order):
     //  - values of positional default args (if any)
     //  - a single slot for default kw args dict (if it has them)
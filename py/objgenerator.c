@@ -34,6 +34,7 @@
 #include "py/bc.h"
 #include "py/objgenerator.h"
 #include "py/objfun.h"
+#include "py/gc.h"
 
 /******************************************************************************/
 /* generator wrapper                                                          */
@@ -46,6 +47,10 @@ typedef struct _mp_obj_gen_wrap_t {
 typedef struct _mp_obj_gen_instance_t {
     mp_obj_base_t base;
     mp_obj_dict_t *globals;
+    #if MICROPY_GC_ARENA
+    // the arena the generator was allocating from when it last yielded
+    gc_arena_t *gc_arena;
+    #endif
     mp_code_state_t code_state;
 } mp_obj_gen_instance_t;
 
@@ -67,6 +72,9 @@ STATIC mp_obj_t gen_wrap_call(mp_obj_t self_in, size_t n_args, size_t n_kw, cons
     o->base.type = &mp_type_gen_instance;
 
     o->globals = self_fun->globals;
+    #if MICROPY_GC_ARENA
+    o->gc_arena = NULL;
+    #endif
     o->code_state.n_state = n_state;
     o->code_state.ip = (byte*)(ip - self_fun->bytecode); // offset to prelude
     mp_setup_code_state(&o->code_state, self_fun, n_args, n_kw, args);
@@ -112,7 +120,19 @@ mp_vm_return_kind_t mp_obj_gen_resume(mp_obj_t self_in, mp_obj_t send_value, mp_
     }
     mp_obj_dict_t *old_globals = mp_globals_get();
     mp_globals_set(self->globals);
+    #if MICROPY_GC_ARENA
+    // a generator has its own arenas, so that the caller doesn't allocate from
+    // one the generator is suspended in (which may never be exited if the
+    // generator is dropped), and the arenas a generator enters are only ever
+    // chained to each other
+    gc_arena_t *old_arena = MP_STATE_THREAD(gc_arena);
+    MP_STATE_THREAD(gc_arena) = self->gc_arena;
+    #endif
     mp_vm_return_kind_t ret_kind = mp_execute_bytecode(&self->code_state, throw_value);
+    #if MICROPY_GC_ARENA
+    self->gc_arena = MP_STATE_THREAD(gc_arena);
+    MP_STATE_THREAD(gc_arena) = old_arena;
+    #endif
     mp_globals_set(old_globals);
 
     switch (ret_kind) {
@@ -29,18 +29,11 @@
 #include "py/nlr.h"
 #include "py/runtime0.h"
 #include "py/runtime.h"
+#include "py/objrange.h"
 
 /******************************************************************************/
 /* range iterator                                                             */
 
-typedef struct _mp_obj_range_it_t {
-    mp_obj_base_t base;
-    // TODO make these values generic objects or something
-    mp_int_t cur;
-    mp_int_t stop;
-    mp_int_t step;
-} mp_obj_range_it_t;
-
 STATIC mp_obj_t range_it_iternext(mp_obj_t o_in) {
     mp_obj_range_it_t *o = MP_OBJ_TO_PTR(o_in);
     if ((o->step > 0 && o->cur < o->stop) || (o->step < 0 && o->cur > o->stop)) {
@@ -52,7 +45,7 @@ STATIC mp_obj_t range_it_iternext(mp_obj_t o_in) {
     }
 }
 
-STATIC const mp_obj_type_t range_it_type = {
+const mp_obj_type_t mp_type_range_it = {
     { &mp_type_type },
     .name = MP_QSTR_iterator,
     .getiter = mp_identity,
@@ -61,7 +54,7 @@ STATIC const mp_obj_type_t range_it_type = {
 
 STATIC mp_obj_t mp_obj_new_range_iterator(mp_int_t cur, mp_int_t stop, mp_int_t step) {
     mp_obj_range_it_t *o = m_new_obj(mp_obj_range_it_t);
-    o->base.type = &range_it_type;
+    o->base.type = &mp_type_range_it;
     o->cur = cur;
     o->stop = stop;
     o->step = step;
@@ -49,13 +49,193 @@ STATIC mp_obj_t static_class_method_make_new(const mp_obj_type_t *self_in, size_
 // instance object
 
 STATIC mp_obj_t mp_obj_new_instance(const mp_obj_type_t *class, uint subobjs) {
+    #if MICROPY_INSTANCE_SLOTS
+    const mp_obj_class_t *cls = (const mp_obj_class_t*)class;
+    if (cls->has_slots) {
+        // the values of the slots start where members.alloc would be (classes
+        // with native bases don't get slots, so there are no subobjs)
+        size_t n = cls->instance_keys->used;
+        size_t size = offsetof(mp_obj_instance_t, members.alloc) + n * sizeof(mp_obj_t);
+        mp_obj_instance_t *o = m_malloc0(MAX(size, sizeof(mp_obj_instance_t)));
+        o->base.type = class;
+        mp_map_init(&o->members, 0);
+        o->members.is_split = 1;
+        o->members.is_fixed = 1;
+        mp_seq_clear(mp_obj_instance_split_value(o, 0), 0, n, sizeof(mp_obj_t));
+        return MP_OBJ_FROM_PTR(o);
+    }
+    #endif
     mp_obj_instance_t *o = m_new_obj_var(mp_obj_instance_t, mp_obj_t, subobjs);
     o->base.type = class;
     mp_map_init(&o->members, 0);
+    #if MICROPY_INSTANCE_SHARED_KEYS
+    o->members.is_split = 1;
+    #endif
     mp_seq_clear(o->subobj, 0, subobjs, sizeof(*o->subobj));
     return MP_OBJ_FROM_PTR(o);
 }
 
+#if MICROPY_INSTANCE_SHARED_KEYS
+
+// When a class has this many keys, instances that need more get their own map
+#define INSTANCE_SHARED_KEYS_MAX (32)
+
+#if MICROPY_PY_THREAD
+#define INSTANCE_KEYS_ENTER() mp_thread_mutex_lock(&MP_STATE_VM(instance_keys_mutex), 1)
+#define INSTANCE_KEYS_EXIT() mp_thread_mutex_unlock(&MP_STATE_VM(instance_keys_mutex))
+#else
+#define INSTANCE_KEYS_ENTER()
+#define INSTANCE_KEYS_EXIT()
+#endif
+
+STATIC mp_map_t *instance_keys(const mp_obj_instance_t *self) {
+    return ((mp_obj_class_t*)self->base.type)->instance_keys;
+}
+
+// Add a key to those shared by the instances of a class, unless it has too many
+// keys, and return its element.  Instances can be used by other threads, so the
+// keys are copied and the copy swapped in, and the old keys left to the GC.
+STATIC mp_map_elem_t *instance_add_key(mp_obj_class_t *cls, mp_obj_t key) {
+    for (;;) {
+        mp_map_t *keys = cls->instance_keys;
+        mp_map_elem_t *elem = mp_map_lookup(keys, key, MP_MAP_LOOKUP);
+        if (elem != NULL || keys->used >= INSTANCE_SHARED_KEYS_MAX) {
+            return elem;
+        }
+        mp_map_t *new_keys = m_new_obj(mp_map_t);
+        mp_map_init_copy(new_keys, keys);
+        elem = mp_map_lookup(new_keys, key, MP_MAP_LOOKUP_ADD_IF_NOT_FOUND);
+        elem->value = MP_OBJ_NEW_SMALL_INT(new_keys->used - 1);
+        INSTANCE_KEYS_ENTER();
+        bool swapped = cls->instance_keys == keys;
+        if (swapped) {
+            cls->instance_keys = new_keys;
+        }
+        INSTANCE_KEYS_EXIT();
+        if (swapped) {
+            return elem;
+        }
+        // another thread added a key first, so try again with its keys
+    }
+}
+
+// Give an instance a map of its own, with the members that it has.
+STATIC void instance_unsplit(mp_obj_instance_t *self) {
+    mp_map_t map;
+    mp_map_init(&map, self->members.used + 1);
+    size_t cur = 0;
+    mp_obj_t member[2];
+    while (mp_obj_instance_member_next(self, &cur, member)) {
+        mp_map_lookup(&map, member[0], MP_MAP_LOOKUP_ADD_IF_NOT_FOUND)->value = member[1];
+    }
+    m_del(mp_obj_t, self->members.table, self->members.alloc);
+    self->members = map;
+}
+
+#endif
+
+// Find the value of a member of an instance, or NULL if it has no such member.
+STATIC mp_obj_t *instance_lookup_member(mp_obj_instance_t *self, qstr attr) {
+    #if MICROPY_INSTANCE_SHARED_KEYS
+    if (self->members.is_split) {
+        mp_map_elem_t *elem = mp_map_lookup(instance_keys(self), MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP);
+        if (elem != NULL) {
+            mp_obj_t *value = mp_obj_instance_split_value(self, MP_OBJ_SMALL_INT_VALUE(elem->value));
+            if (value != NULL && *value != MP_OBJ_NULL) {
+                return value;
+            }
+        }
+        return NULL;
+    }
+    #endif
+    mp_map_elem_t *elem = mp_map_lookup(&self->members, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP);
+    return elem != NULL ? &elem->value : NULL;
+}
+
+// Store a member of an instance; returns false if it can't have this member.
+STATIC bool instance_store_member(mp_obj_instance_t *self, qstr attr, mp_obj_t value) {
+    #if MICROPY_INSTANCE_SHARED_KEYS
+    if (self->members.is_split) {
+        mp_obj_class_t *cls = (mp_obj_class_t*)self->base.type;
+        mp_map_elem_t *elem;
+        #if MICROPY_INSTANCE_SLOTS
+        if (cls->has_slots) {
+            elem = mp_map_lookup(cls->instance_keys, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP);
+            if (elem == NULL) {
+                return false;
+            }
+        } else
+        #endif
+        {
+            elem = instance_add_key(cls, MP_OBJ_NEW_QSTR(attr));
+        }
+        if (elem != NULL) {
+            mp_uint_t i = MP_OBJ_SMALL_INT_VALUE(elem->value);
+            mp_obj_t *slot = mp_obj_instance_split_value(self, i);
+            if (slot == NULL) {
+                // make room for all the keys that the class has, filling a GC block
+                size_t new_alloc = (cls->instance_keys->used + 3) & ~3;
+                mp_obj_t *values = m_renew(mp_obj_t, (mp_obj_t*)self->members.table, self->members.alloc, new_alloc);
+                mp_seq_clear(values, self->members.alloc, new_alloc, sizeof(*values));
+                self->members.table = (mp_map_elem_t*)values;
+                self->members.alloc = new_alloc;
+                slot = &values[i];
+            }
+            if (*slot == MP_OBJ_NULL) {
+                self->members.used++;
+            }
+            *slot = value;
+            return true;
+        }
+        instance_unsplit(self);
+    }
+    #endif
+    mp_map_lookup(&self->members, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP_ADD_IF_NOT_FOUND)->value = value;
+    return true;
+}
+
+STATIC bool instance_delete_member(mp_obj_instance_t *self, qstr attr) {
+    #if MICROPY_INSTANCE_SHARED_KEYS
+    if (self->members.is_split) {
+        mp_obj_t *value = instance_lookup_member(self, attr);
+        if (value == NULL) {
+            return false;
+        }
+        *value = MP_OBJ_NULL;
+        self->members.used--;
+        return true;
+    }
+    #endif
+    return mp_map_lookup(&self->members, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP_REMOVE_IF_FOUND) != NULL;
+}
+
+bool mp_obj_instance_member_next(mp_obj_instance_t *self, size_t *cur, mp_obj_t *dest) {
+    mp_map_t *map = &self->members;
+    #if MICROPY_INSTANCE_SHARED_KEYS
+    if (map->is_split) {
+        map = instance_keys(self);
+    }
+    #endif
+    for (size_t i = *cur; i < map->alloc; i++) {
+        if (MP_MAP_SLOT_IS_FILLED(map, i)) {
+            dest[0] = map->table[i].key;
+            dest[1] = map->table[i].value;
+            #if MICROPY_INSTANCE_SHARED_KEYS
+            if (self->members.is_split) {
+                mp_obj_t *value = mp_obj_instance_split_value(self, MP_OBJ_SMALL_INT_VALUE(dest[1]));
+                if (value == NULL || *value == MP_OBJ_NULL) {
+                    continue;
+                }
+                dest[1] = *value;
+            }
+            #endif
+            *cur = i + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
 STATIC int instance_count_native_bases(const mp_obj_type_t *type, const mp_obj_type_t **last_native_base) {
     mp_uint_t len = type->bases_tuple->len;
     mp_obj_t *items = type->bases_tuple->items;
@@ -99,11 +279,49 @@ struct class_lookup_data {
     mp_uint_t meth_offset;
     mp_obj_t *dest;
     bool is_type;
+    #if MICROPY_OPT_CLASS_LOOKUP_CACHE
+    // where the attribute was found, and whether that depends on the object
+    const mp_obj_type_t *found_type;
+    mp_obj_t found_value;
+    bool depends_on_obj;
+    #endif
 };
 
-STATIC void mp_obj_class_lookup(struct class_lookup_data  *lookup, const mp_obj_type_t *type) {
-    assert(lookup->dest[0] == MP_OBJ_NULL);
-    assert(lookup->dest[1] == MP_OBJ_NULL);
+// Set lookup->dest to the member value found in the locals of type (or to
+// MP_OBJ_SENTINEL for a special method slot of a native type).
+STATIC void class_lookup_found(struct class_lookup_data *lookup, const mp_obj_type_t *type, mp_obj_t value) {
+    #if MICROPY_OPT_CLASS_LOOKUP_CACHE
+    lookup->found_type = type;
+    lookup->found_value = value;
+    #endif
+    if (value == MP_OBJ_SENTINEL) {
+        lookup->dest[0] = MP_OBJ_SENTINEL;
+        return;
+    }
+    if (lookup->is_type) {
+        // If we look up a class method, we need to return original type for which we
+        // do a lookup, not a (base) type in which we found the class method.
+        const mp_obj_type_t *org_type = (const mp_obj_type_t*)lookup->obj;
+        mp_convert_member_lookup(MP_OBJ_NULL, org_type, value, lookup->dest);
+    } else {
+        mp_obj_instance_t *obj = lookup->obj;
+        mp_obj_t obj_obj;
+        if (obj != NULL && mp_obj_is_native_type(type) && type != &mp_type_object /* object is not a real type */) {
+            // If we're dealing with native base class, then it applies to native sub-object
+            obj_obj = obj->subobj[0];
+        } else {
+            obj_obj = MP_OBJ_FROM_PTR(obj);
+        }
+        mp_convert_member_lookup(obj_obj, type, value, lookup->dest);
+    }
+#if DEBUG_PRINT
+    printf("mp_obj_class_lookup: Returning: ");
+    mp_obj_print(lookup->dest[0], PRINT_REPR); printf(" ");
+    mp_obj_print(lookup->dest[1], PRINT_REPR); printf("\n");
+#endif
+}
+
+STATIC void class_lookup_walk(struct class_lookup_data  *lookup, const mp_obj_type_t *type) {
     for (;;) {
         // Optimize special method lookup for native types
         // This avoids extra method_name => slot lookup. On the other hand,
@@ -112,7 +330,7 @@ STATIC void mp_obj_class_lookup(struct class_lookup_data  *lookup, const mp_obj_
         if (lookup->meth_offset != 0 && mp_obj_is_native_type(type)) {
             if (*(void**)((char*)type + lookup->meth_offset) != NULL) {
                 DEBUG_printf("mp_obj_class_lookup: matched special meth slot for %s\n", qstr_str(lookup->attr));
-                lookup->dest[0] = MP_OBJ_SENTINEL;
+                class_lookup_found(lookup, type, MP_OBJ_SENTINEL);
                 return;
             }
         }
@@ -123,27 +341,7 @@ STATIC void mp_obj_class_lookup(struct class_lookup_data  *lookup, const mp_obj_
             mp_map_t *locals_map = &type->locals_dict->map;
             mp_map_elem_t *elem = mp_map_lookup(locals_map, MP_OBJ_NEW_QSTR(lookup->attr), MP_MAP_LOOKUP);
             if (elem != NULL) {
-                if (lookup->is_type) {
-                    // If we look up a class method, we need to return original type for which we
-                    // do a lookup, not a (base) type in which we found the class method.
-                    const mp_obj_type_t *org_type = (const mp_obj_type_t*)lookup->obj;
-                    mp_convert_member_lookup(MP_OBJ_NULL, org_type, elem->value, lookup->dest);
-                } else {
-                    mp_obj_instance_t *obj = lookup->obj;
-                    mp_obj_t obj_obj;
-                    if (obj != NULL && mp_obj_is_native_type(type) && type != &mp_type_object /* object is not a real type */) {
-                        // If we're dealing with native base class, then it applies to native sub-object
-                        obj_obj = obj->subobj[0];
-                    } else {
-                        obj_obj = MP_OBJ_FROM_PTR(obj);
-                    }
-                    mp_convert_member_lookup(obj_obj, type, elem->value, lookup->dest);
-                }
-#if DEBUG_PRINT
-                printf("mp_obj_class_lookup: Returning: ");
-                mp_obj_print(lookup->dest[0], PRINT_REPR); printf(" ");
-                mp_obj_print(lookup->dest[1], PRINT_REPR); printf("\n");
-#endif
+                class_lookup_found(lookup, type, elem->value);
                 return;
             }
         }
@@ -151,10 +349,15 @@ STATIC void mp_obj_class_lookup(struct class_lookup_data  *lookup, const mp_obj_
         // Previous code block takes care about attributes defined in .locals_dict,
         // but some attributes of native types may be handled using .load_attr method,
         // so make sure we try to lookup those too.
-        if (lookup->obj != NULL && !lookup->is_type && mp_obj_is_native_type(type) && type != &mp_type_object /* object is not a real type */) {
-            mp_load_method_maybe(lookup->obj->subobj[0], lookup->attr, lookup->dest);
-            if (lookup->dest[0] != MP_OBJ_NULL) {
-                return;
+        if (mp_obj_is_native_type(type) && type != &mp_type_object /* object is not a real type */) {
+            #if MICROPY_OPT_CLASS_LOOKUP_CACHE
+            lookup->depends_on_obj = true;
+            #endif
+            if (lookup->obj != NULL && !lookup->is_type) {
+                mp_load_method_maybe(lookup->obj->subobj[0], lookup->attr, lookup->dest);
+                if (lookup->dest[0] != MP_OBJ_NULL) {
+                    return;
+                }
             }
         }
 
@@ -177,7 +380,7 @@ STATIC void mp_obj_class_lookup(struct class_lookup_data  *lookup, const mp_obj_
                 // Not a "real" type
                 continue;
             }
-            mp_obj_class_lookup(lookup, bt);
+            class_lookup_walk(lookup, bt);
             if (lookup->dest[0] != MP_OBJ_NULL) {
                 return;
             }
@@ -193,6 +396,49 @@ STATIC void mp_obj_class_lookup(struct class_lookup_data  *lookup, const mp_obj_
     }
 }
 
+#if MICROPY_OPT_CLASS_LOOKUP_CACHE
+#define CLASS_LOOKUP_CACHE_ENTRY(type, attr, meth_offset) \
+    (&MP_STATE_THREAD(lookup_caches)->class_lookup[(((uintptr_t)(type) >> 4) ^ ((attr) * 7) ^ (meth_offset)) & (MICROPY_OPT_CLASS_LOOKUP_CACHE_SIZE - 1)])
+
+// Any change to the attributes of a class may change where an attribute is found
+// in its subclasses, and classes don't know their subclasses, so every change
+// invalidates all the cached lookups.  A new class may be at the address of one
+// that has been freed, so that does too.
+STATIC void class_lookup_cache_invalidate(void) {
+    MP_STATE_VM(class_lookup_version)++;
+}
+#endif
+
+STATIC void mp_obj_class_lookup(struct class_lookup_data  *lookup, const mp_obj_type_t *type) {
+    assert(lookup->dest[0] == MP_OBJ_NULL);
+    assert(lookup->dest[1] == MP_OBJ_NULL);
+    #if MICROPY_OPT_CLASS_LOOKUP_CACHE
+    mp_uint_t version = MP_STATE_VM(class_lookup_version);
+    mp_class_lookup_cache_entry_t *entry = CLASS_LOOKUP_CACHE_ENTRY(type, lookup->attr, lookup->meth_offset);
+    if (entry->type == type && entry->attr == lookup->attr
+        && entry->meth_offset == lookup->meth_offset && entry->version == version) {
+        if (entry->found_type != NULL) {
+            class_lookup_found(lookup, entry->found_type, entry->value);
+        }
+        return;
+    }
+    lookup->found_type = NULL;
+    lookup->depends_on_obj = false;
+    class_lookup_walk(lookup, type);
+    if (!lookup->depends_on_obj) {
+        // the version was read before the walk, in case a class was changed meanwhile
+        entry->type = type;
+        entry->attr = lookup->attr;
+        entry->meth_offset = lookup->meth_offset;
+        entry->version = version;
+        entry->found_type = lookup->found_type;
+        entry->value = lookup->found_value;
+    }
+    #else
+    class_lookup_walk(lookup, type);
+    #endif
+}
+
 STATIC void instance_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
     mp_obj_instance_t *self = MP_OBJ_TO_PTR(self_in);
     qstr meth = (kind == PRINT_STR) ? MP_QSTR___str__ : MP_QSTR___repr__;
@@ -463,24 +709,23 @@ STATIC void mp_obj_instance_load_attr(mp_obj_t self_in, qstr attr, mp_obj_t *des
     assert(mp_obj_is_instance_type(mp_obj_get_type(self_in)));
     mp_obj_instance_t *self = MP_OBJ_TO_PTR(self_in);
 
-    mp_map_elem_t *elem = mp_map_lookup(&self->members, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP);
-    if (elem != NULL) {
+    mp_obj_t *value = instance_lookup_member(self, attr);
+    if (value != NULL) {
         // object member, always treated as a value
         // TODO should we check for properties?
-        dest[0] = elem->value;
+        dest[0] = *value;
         return;
     }
 #if MICROPY_CPYTHON_COMPAT
-    if (attr == MP_QSTR___dict__) {
+    if (attr == MP_QSTR___dict__ && !self->members.is_fixed) {
         // Create a new dict with a copy of the instance's map items.
         // This creates, unlike CPython, a 'read-only' __dict__: modifying
         // it will not result in modifications to the actual instance members.
-        mp_map_t *map = &self->members;
-        mp_obj_t attr_dict = mp_obj_new_dict(map->used);
-        for (mp_uint_t i = 0; i < map->alloc; ++i) {
-            if (MP_MAP_SLOT_IS_FILLED(map, i)) {
-                mp_obj_dict_store(attr_dict, map->table[i].key, map->table[i].value);
-            }
+        mp_obj_t attr_dict = mp_obj_new_dict(self->members.used);
+        size_t cur = 0;
+        mp_obj_t member[2];
+        while (mp_obj_instance_member_next(self, &cur, member)) {
+            mp_obj_dict_store(attr_dict, member[0], member[1]);
         }
         dest[0] = attr_dict;
         return;
@@ -626,12 +871,10 @@ STATIC bool mp_obj_instance_store_attr(mp_obj_t self_in, qstr attr, mp_obj_t val
 
     if (value == MP_OBJ_NULL) {
         // delete attribute
-        mp_map_elem_t *elem = mp_map_lookup(&self->members, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP_REMOVE_IF_FOUND);
-        return elem != NULL;
+        return instance_delete_member(self, attr);
     } else {
         // store attribute
-        mp_map_lookup(&self->members, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP_ADD_IF_NOT_FOUND)->value = value;
-        return true;
+        return instance_store_member(self, attr, value);
     }
 }
 
@@ -850,6 +1093,9 @@ STATIC void type_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
                 mp_map_elem_t *elem = mp_map_lookup(locals_map, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP_REMOVE_IF_FOUND);
                 // note that locals_map may be in ROM, so remove will fail in that case
                 if (elem != NULL) {
+                    #if MICROPY_OPT_CLASS_LOOKUP_CACHE
+                    class_lookup_cache_invalidate();
+                    #endif
                     dest[0] = MP_OBJ_NULL; // indicate success
                 }
             } else {
@@ -858,6 +1104,9 @@ STATIC void type_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
                 // note that locals_map may be in ROM, so add will fail in that case
                 if (elem != NULL) {
                     elem->value = dest[1];
+                    #if MICROPY_OPT_CLASS_LOOKUP_CACHE
+                    class_lookup_cache_invalidate();
+                    #endif
                     dest[0] = MP_OBJ_NULL; // indicate success
                 }
             }
@@ -875,6 +1124,61 @@ const mp_obj_type_t mp_type_type = {
     .attr = type_attr,
 };
 
+#if MICROPY_INSTANCE_SLOTS
+// Give a class the keys of its slots if it has __slots__, and all its bases
+// are slotted (or object), so that its instances can store them inline.
+STATIC void instance_init_slots(mp_obj_class_t *cls) {
+    mp_map_elem_t *elem = mp_map_lookup(&cls->type.locals_dict->map, MP_OBJ_NEW_QSTR(MP_QSTR___slots__), MP_MAP_LOOKUP);
+    if (elem == NULL) {
+        return;
+    }
+    mp_obj_tuple_t *bases = cls->type.bases_tuple;
+    for (size_t i = 0; i < bases->len; i++) {
+        const mp_obj_type_t *bt = MP_OBJ_TO_PTR(bases->items[i]);
+        if (bt != &mp_type_object && (mp_obj_is_native_type(bt) || !((mp_obj_class_t*)bt)->has_slots)) {
+            return;
+        }
+    }
+
+    mp_map_t *keys = cls->instance_keys;
+    for (size_t i = 0; i < bases->len; i++) {
+        const mp_obj_type_t *bt = MP_OBJ_TO_PTR(bases->items[i]);
+        if (bt != &mp_type_object) {
+            mp_map_t *base_keys = ((mp_obj_class_t*)bt)->instance_keys;
+            for (size_t j = 0; j < base_keys->alloc; j++) {
+                if (MP_MAP_SLOT_IS_FILLED(base_keys, j)) {
+                    mp_map_elem_t *e = mp_map_lookup(keys, base_keys->table[j].key, MP_MAP_LOOKUP_ADD_IF_NOT_FOUND);
+                    if (e->value == MP_OBJ_NULL) {
+                        e->value = MP_OBJ_NEW_SMALL_INT(keys->used - 1);
+                    }
+                }
+            }
+        }
+    }
+
+    // __slots__ is a single name or an iterable of names
+    mp_obj_t slots = elem->value;
+    if (MP_OBJ_IS_STR(slots)) {
+        slots = mp_obj_new_tuple(1, &slots);
+    }
+    mp_obj_t iter = mp_getiter(slots);
+    mp_obj_t item;
+    while ((item = mp_iternext(iter)) != MP_OBJ_STOP_ITERATION) {
+        qstr attr = mp_obj_str_get_qstr(item);
+        if (attr == MP_QSTR___dict__) {
+            // instances need a dict after all
+            mp_map_clear(keys);
+            return;
+        }
+        mp_map_elem_t *e = mp_map_lookup(keys, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP_ADD_IF_NOT_FOUND);
+        if (e->value == MP_OBJ_NULL) {
+            e->value = MP_OBJ_NEW_SMALL_INT(keys->used - 1);
+        }
+    }
+    cls->has_slots = true;
+}
+#endif
+
 mp_obj_t mp_obj_new_type(qstr name, mp_obj_t bases_tuple, mp_obj_t locals_dict) {
     assert(MP_OBJ_IS_TYPE(bases_tuple, &mp_type_tuple)); // Micro Python restriction, for now
     assert(MP_OBJ_IS_TYPE(locals_dict, &mp_type_dict)); // Micro Python restriction, for now
@@ -899,7 +1203,13 @@ mp_obj_t mp_obj_new_type(qstr name, mp_obj_t bases_tuple, mp_obj_t locals_dict)
         }
     }
 
+    #if MICROPY_INSTANCE_SHARED_KEYS
+    mp_obj_class_t *cls = m_new0(mp_obj_class_t, 1);
+    cls->instance_keys = mp_map_new(0);
+    mp_obj_type_t *o = &cls->type;
+    #else
     mp_obj_type_t *o = m_new0(mp_obj_type_t, 1);
+    #endif
     o->base.type = &mp_type_type;
     o->name = name;
     o->print = instance_print;
@@ -928,6 +1238,10 @@ mp_obj_t mp_obj_new_type(qstr name, mp_obj_t bases_tuple, mp_obj_t locals_dict)
         mp_raise_msg(&mp_type_TypeError, "multiple bases have instance lay-out conflict");
     }
 
+    #if MICROPY_INSTANCE_SLOTS
+    instance_init_slots(cls);
+    #endif
+
     mp_map_t *locals_map = &o->locals_dict->map;
     mp_map_elem_t *elem = mp_map_lookup(locals_map, MP_OBJ_NEW_QSTR(MP_QSTR___new__), MP_MAP_LOOKUP);
     if (elem != NULL) {
@@ -938,6 +1252,10 @@ mp_obj_t mp_obj_new_type(qstr name, mp_obj_t bases_tuple, mp_obj_t locals_dict)
         }
     }
 
+    #if MICROPY_OPT_CLASS_LOOKUP_CACHE
+    class_lookup_cache_invalidate();
+    #endif
+
     return MP_OBJ_FROM_PTR(o);
 }
 
@@ -37,6 +37,78 @@ typedef struct _mp_obj_instance_t {
     // TODO maybe cache __getattr__ and __setattr__ for efficient lookup of them
 } mp_obj_instance_t;
 
+#if MICROPY_INSTANCE_SHARED_KEYS
+// A class made by mp_obj_new_type.  The members of its instances start off
+// split: the keys are kept in instance_keys, each with the index of its value,
+// and the table of the members map of each instance holds just the values
+// (MP_OBJ_NULL if unset), in an array of alloc entries.  instance_keys is
+// never changed, only replaced, so it can be used without a lock.
+//
+// With MICROPY_INSTANCE_SLOTS, the keys of a class with __slots__ are its
+// slots, which are fixed when it's made.  Its instances store the values
+// inline, starting where members.alloc would be, and have is_fixed set in
+// members to say so.
+typedef struct _mp_obj_class_t {
+    mp_obj_type_t type;
+    mp_map_t *instance_keys;
+    #if MICROPY_INSTANCE_SLOTS
+    bool has_slots;
+    #endif
+} mp_obj_class_t;
+
+// Get where the value of the member with the given index in the instance_keys
+// of its class is stored in a split instance, or NULL if there's no room yet.
+static inline mp_obj_t *mp_obj_instance_split_value(mp_obj_instance_t *self, mp_uint_t i) {
+    #if MICROPY_INSTANCE_SLOTS
+    if (self->members.is_fixed) {
+        return (mp_obj_t*)&self->members.alloc + i;
+    }
+    #endif
+    if (i >= self->members.alloc) {
+        return NULL;
+    }
+    return (mp_obj_t*)self->members.table + i;
+}
+#endif
+
+// get the key and value of the next member of an instance in dest[0] and dest[1];
+// *cur should be 0 for the first call, and false is returned when there are no more
+bool mp_obj_instance_member_next(mp_obj_instance_t *self, size_t *cur, mp_obj_t *dest);
+
+#if MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+// Look up an existing member of an instance for the VM, using the position of
+// the key that's cached in the bytecode; returns NULL if there's no such member.
+static inline mp_obj_t *mp_obj_instance_lookup_cached(mp_obj_instance_t *self, mp_obj_t key, byte *cache) {
+    mp_map_t *map = &self->members;
+    #if MICROPY_INSTANCE_SHARED_KEYS
+    if (map->is_split) {
+        map = ((mp_obj_class_t*)self->base.type)->instance_keys;
+    }
+    #endif
+    mp_uint_t x = *cache;
+    mp_map_elem_t *elem;
+    if (x < map->alloc && map->table[x].key == key) {
+        elem = &map->table[x];
+    } else {
+        elem = mp_map_lookup(map, key, MP_MAP_LOOKUP);
+        if (elem == NULL) {
+            return NULL;
+        }
+        *cache = elem - &map->table[0];
+    }
+    #if MICROPY_INSTANCE_SHARED_KEYS
+    if (self->members.is_split) {
+        mp_obj_t *value = mp_obj_instance_split_value(self, MP_OBJ_SMALL_INT_VALUE(elem->value));
+        if (value == NULL || *value == MP_OBJ_NULL) {
+            return NULL;
+        }
+        return value;
+    }
+    #endif
+    return &elem->value;
+}
+#endif
+
 // this needs to be exposed for MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE to work
 void mp_obj_instance_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest);
 
@@ -1114,6 +1114,9 @@ mp_parse_tree_t mp_parse(mp_lexer_t *lex, mp_parse_input_kind_t input_kind) {
         assert(parser.result_stack_top == 1);
         exc = MP_OBJ_NULL;
         parser.tree.root = parser.result_stack[0];
+        #if MICROPY_OPT_TIERED_NATIVE
+        parser.tree.source = mp_obj_new_str_from_vstr(&mp_type_bytes, &lex->source);
+        #endif
     }
 
     // free the memory that we don't need anymore
@@ -97,6 +97,9 @@ typedef enum {
 typedef struct _mp_parse_t {
     mp_parse_node_t root;
     struct _mp_parse_chunk_t *chunk;
+    #if MICROPY_OPT_TIERED_NATIVE
+    mp_obj_t source; // bytes object with the source that was parsed
+    #endif
 } mp_parse_tree_t;
 
 // the parser will raise an exception if an error occurred
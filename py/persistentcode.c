@@ -29,15 +29,19 @@
 #include <string.h>
 #include <assert.h>
 
+#include "py/nlr.h"
 #include "py/reader.h"
 #include "py/emitglue.h"
 #include "py/persistentcode.h"
 #include "py/bc.h"
+#include "py/runtime0.h"
 
 #if MICROPY_PERSISTENT_CODE_LOAD || MICROPY_PERSISTENT_CODE_SAVE
 
 #include "py/smallint.h"
 
+#define MPY_VERSION (1)
+
 // The feature flags byte encodes the compile-time config options that
 // affect the generate bytecode.
 #define MPY_FEATURE_FLAGS ( \
@@ -50,6 +54,21 @@
     | ((MICROPY_PY_BUILTINS_STR_UNICODE_DYNAMIC) << 1) \
     )
 
+// The architecture of native code that this build can load, which goes in
+// bits 2 and up of the feature flags of a .mpy file that has native code.
+// The code depends on the layout of nlr_buf_t and mp_code_state_t, and on the
+// encoding of small ints, so configs that change these can't load it.
+#if !MICROPY_EMIT_NATIVE || MICROPY_NLR_SETJMP || MICROPY_STACKLESS \
+    || (MICROPY_OBJ_REPR != MICROPY_OBJ_REPR_A && MICROPY_OBJ_REPR != MICROPY_OBJ_REPR_C)
+#define MPY_FEATURE_ARCH (MP_NATIVE_ARCH_NONE)
+#elif MICROPY_EMIT_X64 && !defined(__CYGWIN__)
+#define MPY_FEATURE_ARCH (MP_NATIVE_ARCH_X64)
+#elif MICROPY_EMIT_THUMB
+#define MPY_FEATURE_ARCH (MP_NATIVE_ARCH_ARMV7M)
+#else
+#define MPY_FEATURE_ARCH (MP_NATIVE_ARCH_NONE)
+#endif
+
 #if MICROPY_PERSISTENT_CODE_LOAD || (MICROPY_PERSISTENT_CODE_SAVE && !MICROPY_DYNAMIC_COMPILER)
 // The bytecode will depend on the number of bits in a small-int, and
 // this function computes that (could make it a fixed constant, but it
@@ -162,9 +181,29 @@ STATIC void load_bytecode_qstrs(mp_reader_t *reader, byte *ip, byte *ip_top) {
     }
 }
 
-STATIC mp_raw_code_t *load_raw_code(mp_reader_t *reader) {
+STATIC mp_raw_code_t *load_raw_code(mp_reader_t *reader);
+
+STATIC mp_uint_t *load_const_table(mp_reader_t *reader, mp_uint_t n_names, mp_uint_t *n_obj_out, mp_uint_t *n_raw_code_out) {
+    mp_uint_t n_obj = read_uint(reader);
+    mp_uint_t n_raw_code = read_uint(reader);
+    mp_uint_t *const_table = m_new(mp_uint_t, n_names + n_obj + n_raw_code);
+    mp_uint_t *ct = const_table;
+    for (mp_uint_t i = 0; i < n_names; ++i) {
+        *ct++ = (mp_uint_t)MP_OBJ_NEW_QSTR(load_qstr(reader));
+    }
+    for (mp_uint_t i = 0; i < n_obj; ++i) {
+        *ct++ = (mp_uint_t)load_obj(reader);
+    }
+    for (mp_uint_t i = 0; i < n_raw_code; ++i) {
+        *ct++ = (mp_uint_t)(uintptr_t)load_raw_code(reader);
+    }
+    *n_obj_out = n_obj;
+    *n_raw_code_out = n_raw_code;
+    return const_table;
+}
+
+STATIC mp_raw_code_t *load_raw_code_bytecode(mp_reader_t *reader, mp_uint_t bc_len) {
     // load bytecode
-    mp_uint_t bc_len = read_uint(reader);
     byte *bytecode = m_new(byte, bc_len);
     read_bytes(reader, bytecode, bc_len);
 
@@ -182,19 +221,8 @@ STATIC mp_raw_code_t *load_raw_code(mp_reader_t *reader) {
     load_bytecode_qstrs(reader, (byte*)ip, bytecode + bc_len);
 
     // load constant table
-    mp_uint_t n_obj = read_uint(reader);
-    mp_uint_t n_raw_code = read_uint(reader);
-    mp_uint_t *const_table = m_new(mp_uint_t, prelude.n_pos_args + prelude.n_kwonly_args + n_obj + n_raw_code);
-    mp_uint_t *ct = const_table;
-    for (mp_uint_t i = 0; i < prelude.n_pos_args + prelude.n_kwonly_args; ++i) {
-        *ct++ = (mp_uint_t)MP_OBJ_NEW_QSTR(load_qstr(reader));
-    }
-    for (mp_uint_t i = 0; i < n_obj; ++i) {
-        *ct++ = (mp_uint_t)load_obj(reader);
-    }
-    for (mp_uint_t i = 0; i < n_raw_code; ++i) {
-        *ct++ = (mp_uint_t)(uintptr_t)load_raw_code(reader);
-    }
+    mp_uint_t n_obj, n_raw_code;
+    mp_uint_t *const_table = load_const_table(reader, prelude.n_pos_args + prelude.n_kwonly_args, &n_obj, &n_raw_code);
 
     // create raw_code and return it
     mp_raw_code_t *rc = mp_emit_glue_new_raw_code();
@@ -206,15 +234,135 @@ STATIC mp_raw_code_t *load_raw_code(mp_reader_t *reader) {
     return rc;
 }
 
+#if MPY_FEATURE_ARCH != MP_NATIVE_ARCH_NONE
+STATIC mp_raw_code_t *load_raw_code_native(mp_reader_t *reader, mp_raw_code_kind_t kind, mp_uint_t fun_len) {
+    // load machine code into executable memory
+    byte *fun_data;
+    size_t fun_alloc;
+    MP_PLAT_ALLOC_EXEC(fun_len, (void**)&fun_data, &fun_alloc);
+    if (fun_data == NULL) {
+        m_malloc_fail(fun_len);
+    }
+    read_bytes(reader, fun_data, fun_len);
+
+    // link global qstr ids into the prelude, which native Python code has
+    mp_uint_t n_names = 0;
+    if (kind == MP_CODE_NATIVE_PY) {
+        qstr simple_name = load_qstr(reader);
+        qstr source_file = load_qstr(reader);
+        mp_uint_t prelude_offset = read_uint(reader);
+        if (prelude_offset + 9 > fun_len) {
+            mp_raise_ValueError("invalid .mpy file");
+        }
+        byte *ip = fun_data + prelude_offset;
+        n_names = ip[1] + ip[2];
+        ip[5] = simple_name; ip[6] = simple_name >> 8;
+        ip[7] = source_file; ip[8] = source_file >> 8;
+    }
+    mp_uint_t scope_flags = read_uint(reader);
+    mp_uint_t n_pos_args = read_uint(reader);
+    mp_uint_t type_sig = 0;
+    if (kind == MP_CODE_NATIVE_VIPER) {
+        type_sig = read_uint(reader);
+    }
+
+    // load constant table
+    mp_uint_t n_obj, n_raw_code;
+    mp_uint_t *const_table = load_const_table(reader, n_names, &n_obj, &n_raw_code);
+
+    // patch in the values that the code refers to
+    mp_uint_t n_reloc = read_uint(reader);
+    for (mp_uint_t i = 0; i < n_reloc; ++i) {
+        mp_uint_t r = read_uint(reader);
+        mp_uint_t offset = r >> 3;
+        mp_uint_t arg;
+        mp_uint_t val;
+        switch (r & 7) {
+            case MP_NATIVE_RELOC_QSTR:
+                val = load_qstr(reader);
+                break;
+            case MP_NATIVE_RELOC_QSTR_OBJ:
+                val = (mp_uint_t)MP_OBJ_NEW_QSTR(load_qstr(reader));
+                break;
+            case MP_NATIVE_RELOC_FUN_TABLE:
+                val = (mp_uint_t)mp_fun_table;
+                break;
+            case MP_NATIVE_RELOC_FUN:
+                // only the entries that don't depend on the config can be used
+                arg = read_uint(reader);
+                if (arg > MP_F_RAISE_TYPE_ERROR) {
+                    mp_raise_ValueError("incompatible .mpy file");
+                }
+                val = (mp_uint_t)mp_fun_table[arg];
+                break;
+            case MP_NATIVE_RELOC_CONST_OBJ:
+                val = (mp_uint_t)mp_native_const_obj(read_uint(reader));
+                break;
+            case MP_NATIVE_RELOC_CONST_TABLE:
+                arg = read_uint(reader);
+                if (arg >= n_names + n_obj + n_raw_code) {
+                    mp_raise_ValueError("invalid .mpy file");
+                }
+                val = const_table[arg];
+                break;
+            case MP_NATIVE_RELOC_CODE:
+                // a pointer into the code itself, or into the data that a
+                // native module keeps after its code, so the code must stay
+                // where it was loaded
+                arg = read_uint(reader);
+                if (arg > fun_len) {
+                    mp_raise_ValueError("invalid .mpy file");
+                }
+                val = (mp_uint_t)(fun_data + arg);
+                break;
+            default:
+                mp_raise_ValueError("invalid .mpy file");
+        }
+        if (offset + sizeof(mp_uint_t) > fun_len) {
+            mp_raise_ValueError("invalid .mpy file");
+        }
+        *(mp_uint_t*)(fun_data + offset) = val;
+    }
+
+    #if defined(MP_PLAT_COMMIT_EXEC)
+    fun_data = MP_PLAT_COMMIT_EXEC(fun_data, fun_alloc);
+    #endif
+
+    // create raw_code and return it
+    mp_raw_code_t *rc = mp_emit_glue_new_raw_code();
+    mp_emit_glue_assign_native(rc, kind, fun_data, fun_len, const_table, n_pos_args, scope_flags, type_sig);
+    return rc;
+}
+#endif
+
+STATIC mp_raw_code_t *load_raw_code(mp_reader_t *reader) {
+    // the kind of code is in the low 2 bits, and its length in the rest
+    mp_uint_t kind_len = read_uint(reader);
+    mp_raw_code_kind_t kind = MP_CODE_BYTECODE + (kind_len & 3);
+    mp_uint_t len = kind_len >> 2;
+    if (kind == MP_CODE_BYTECODE) {
+        return load_raw_code_bytecode(reader, len);
+    }
+    #if MPY_FEATURE_ARCH != MP_NATIVE_ARCH_NONE
+    if (kind == MP_CODE_NATIVE_PY || kind == MP_CODE_NATIVE_VIPER) {
+        return load_raw_code_native(reader, kind, len);
+    }
+    #endif
+    mp_raise_ValueError("invalid .mpy file");
+}
+
 mp_raw_code_t *mp_raw_code_load(mp_reader_t *reader) {
     byte header[4];
     read_bytes(reader, header, sizeof(header));
-    if (strncmp((char*)header, "M\x00", 2) != 0) {
+    if (header[0] != 'M' || header[1] != MPY_VERSION) {
         mp_raise_ValueError("invalid .mpy file");
     }
-    if (header[2] != MPY_FEATURE_FLAGS || header[3] > mp_small_int_bits()) {
+    if ((header[2] & 3) != MPY_FEATURE_FLAGS || header[3] > mp_small_int_bits()) {
         mp_raise_ValueError("incompatible .mpy file");
     }
+    if ((header[2] >> 2) != MP_NATIVE_ARCH_NONE && (header[2] >> 2) != MPY_FEATURE_ARCH) {
+        mp_raise_ValueError("incompatible .mpy arch");
+    }
     mp_raw_code_t *rc = load_raw_code(reader);
     reader->close(reader->data);
     return rc;
@@ -317,13 +465,100 @@ STATIC void save_bytecode_qstrs(mp_print_t *print, const byte *ip, const byte *i
     }
 }
 
+STATIC void save_raw_code(mp_print_t *print, mp_raw_code_t *rc);
+
+STATIC void save_const_table(mp_print_t *print, const mp_uint_t *const_table, mp_uint_t n_names, mp_uint_t n_obj, mp_uint_t n_raw_code) {
+    mp_print_uint(print, n_obj);
+    mp_print_uint(print, n_raw_code);
+    for (uint i = 0; i < n_names; ++i) {
+        mp_obj_t o = (mp_obj_t)*const_table++;
+        save_qstr(print, MP_OBJ_QSTR_VALUE(o));
+    }
+    for (uint i = 0; i < n_obj; ++i) {
+        save_obj(print, (mp_obj_t)*const_table++);
+    }
+    for (uint i = 0; i < n_raw_code; ++i) {
+        save_raw_code(print, (mp_raw_code_t*)(uintptr_t)*const_table++);
+    }
+}
+
+#if MICROPY_EMIT_NATIVE
+// the size of the words in the code that the loader patches
+STATIC size_t native_word_size(void) {
+    #if MICROPY_DYNAMIC_COMPILER
+    return mp_dynamic_compiler.native_arch == MP_NATIVE_ARCH_X64 ? 8 : 4;
+    #else
+    return sizeof(mp_uint_t);
+    #endif
+}
+
+STATIC void save_raw_code_native(mp_print_t *print, mp_raw_code_t *rc) {
+    // save machine code, with the words that the loader patches zeroed so that
+    // the file doesn't depend on where things are in memory when it's saved
+    const byte *fun_data = rc->data.u_native.fun_data;
+    mp_uint_t fun_len = rc->data.u_native.fun_len;
+    mp_print_uint(print, (fun_len << 2) | (rc->kind - MP_CODE_BYTECODE));
+    const mp_native_reloc_t *relocs = rc->data.u_native.relocs;
+    static const byte zero[8] = {0};
+    size_t pos = 0;
+    for (mp_uint_t i = 0; i < rc->data.u_native.n_reloc; ++i) {
+        mp_print_bytes(print, fun_data + pos, relocs[i].offset - pos);
+        mp_print_bytes(print, zero, native_word_size());
+        pos = relocs[i].offset + native_word_size();
+    }
+    mp_print_bytes(print, fun_data + pos, fun_len - pos);
+
+    // save qstrs of the prelude, and where it is
+    mp_uint_t n_names = 0;
+    if (rc->kind == MP_CODE_NATIVE_PY) {
+        const byte *ip = fun_data + rc->data.u_native.prelude_offset;
+        n_names = ip[1] + ip[2];
+        save_qstr(print, ip[5] | (ip[6] << 8)); // simple_name
+        save_qstr(print, ip[7] | (ip[8] << 8)); // source_file
+        mp_print_uint(print, rc->data.u_native.prelude_offset);
+    }
+    mp_print_uint(print, rc->scope_flags);
+    mp_print_uint(print, rc->n_pos_args);
+    if (rc->kind == MP_CODE_NATIVE_VIPER) {
+        mp_print_uint(print, rc->data.u_native.type_sig);
+    }
+
+    save_const_table(print, rc->data.u_native.const_table, n_names,
+        rc->data.u_native.n_obj, rc->data.u_native.n_raw_code);
+
+    // save relocations, each with the offset of its word and its kind, then its arg
+    mp_print_uint(print, rc->data.u_native.n_reloc);
+    for (mp_uint_t i = 0; i < rc->data.u_native.n_reloc; ++i) {
+        const mp_native_reloc_t *r = &relocs[i];
+        mp_print_uint(print, (r->offset << 3) | r->kind);
+        switch (r->kind) {
+            case MP_NATIVE_RELOC_QSTR:
+            case MP_NATIVE_RELOC_QSTR_OBJ:
+                save_qstr(print, r->arg);
+                break;
+            case MP_NATIVE_RELOC_FUN_TABLE:
+                break;
+            default:
+                mp_print_uint(print, r->arg);
+                break;
+        }
+    }
+}
+#endif
+
 STATIC void save_raw_code(mp_print_t *print, mp_raw_code_t *rc) {
+    #if MICROPY_EMIT_NATIVE
+    if (rc->kind == MP_CODE_NATIVE_PY || rc->kind == MP_CODE_NATIVE_VIPER) {
+        save_raw_code_native(print, rc);
+        return;
+    }
+    #endif
     if (rc->kind != MP_CODE_BYTECODE) {
-        mp_raise_ValueError("can only save bytecode");
+        mp_raise_ValueError("can only save bytecode and native code");
     }
 
     // save bytecode
-    mp_print_uint(print, rc->data.u_byte.bc_len);
+    mp_print_uint(print, rc->data.u_byte.bc_len << 2); // the kind is 0 for bytecode
     mp_print_bytes(print, rc->data.u_byte.bytecode, rc->data.u_byte.bc_len);
 
     // extract prelude
@@ -338,34 +573,49 @@ STATIC void save_raw_code(mp_print_t *print, mp_raw_code_t *rc) {
     save_bytecode_qstrs(print, ip, rc->data.u_byte.bytecode + rc->data.u_byte.bc_len);
 
     // save constant table
-    mp_print_uint(print, rc->data.u_byte.n_obj);
-    mp_print_uint(print, rc->data.u_byte.n_raw_code);
-    const mp_uint_t *const_table = rc->data.u_byte.const_table;
-    for (uint i = 0; i < prelude.n_pos_args + prelude.n_kwonly_args; ++i) {
-        mp_obj_t o = (mp_obj_t)*const_table++;
-        save_qstr(print, MP_OBJ_QSTR_VALUE(o));
-    }
-    for (uint i = 0; i < rc->data.u_byte.n_obj; ++i) {
-        save_obj(print, (mp_obj_t)*const_table++);
+    save_const_table(print, rc->data.u_byte.const_table, prelude.n_pos_args + prelude.n_kwonly_args,
+        rc->data.u_byte.n_obj, rc->data.u_byte.n_raw_code);
+}
+
+// whether the code, or any code nested in it, is native
+STATIC bool raw_code_has_native(mp_raw_code_t *rc) {
+    if (rc->kind != MP_CODE_BYTECODE) {
+        return true;
     }
+    const byte *ip = rc->data.u_byte.bytecode;
+    const byte *ip2;
+    bytecode_prelude_t prelude;
+    extract_prelude(&ip, &ip2, &prelude);
+    const mp_uint_t *ct = rc->data.u_byte.const_table + prelude.n_pos_args + prelude.n_kwonly_args
+        + rc->data.u_byte.n_obj;
     for (uint i = 0; i < rc->data.u_byte.n_raw_code; ++i) {
-        save_raw_code(print, (mp_raw_code_t*)(uintptr_t)*const_table++);
+        if (raw_code_has_native((mp_raw_code_t*)(uintptr_t)*ct++)) {
+            return true;
+        }
     }
+    return false;
 }
 
 void mp_raw_code_save(mp_raw_code_t *rc, mp_print_t *print) {
     // header contains:
     //  byte  'M'
     //  byte  version
-    //  byte  feature flags
+    //  byte  feature flags, with the native arch in bits 2 and up
     //  byte  number of bits in a small int
-    byte header[4] = {'M', 0, MPY_FEATURE_FLAGS_DYNAMIC,
+    byte header[4] = {'M', MPY_VERSION, MPY_FEATURE_FLAGS_DYNAMIC,
         #if MICROPY_DYNAMIC_COMPILER
         mp_dynamic_compiler.small_int_bits,
         #else
         mp_small_int_bits(),
         #endif
     };
+    if (raw_code_has_native(rc)) {
+        #if MICROPY_DYNAMIC_COMPILER
+        header[2] |= mp_dynamic_compiler.native_arch << 2;
+        #else
+        header[2] |= MPY_FEATURE_ARCH << 2;
+        #endif
+    }
     mp_print_bytes(print, header, sizeof(header));
 
     save_raw_code(print, rc);
@@ -30,6 +30,15 @@
 #include "py/reader.h"
 #include "py/emitglue.h"
 
+// The architecture of the native code in a .mpy file, if it has any; these
+// are macros so that the config can be tested against them
+#define MP_NATIVE_ARCH_NONE     (0)
+#define MP_NATIVE_ARCH_X86      (1)
+#define MP_NATIVE_ARCH_X64      (2)
+#define MP_NATIVE_ARCH_ARMV6    (3)
+#define MP_NATIVE_ARCH_ARMV7M   (4)
+#define MP_NATIVE_ARCH_XTENSA   (5)
+
 mp_raw_code_t *mp_raw_code_load(mp_reader_t *reader);
 mp_raw_code_t *mp_raw_code_load_mem(const byte *buf, size_t len);
 mp_raw_code_t *mp_raw_code_load_file(const char *filename);
@@ -111,6 +111,7 @@ PY_O_BASENAME = \
 	nlrsetjmp.o \
 	malloc.o \
 	gc.o \
+	allocprof.o \
 	qstr.o \
 	vstr.o \
 	mpprint.o \
@@ -32,8 +32,8 @@
 #include "py/qstr.h"
 #include "py/gc.h"
 
-// NOTE: we are using linear arrays to store and search for qstr's (unique strings, interned strings)
-// ultimately we will replace this with a static hash table of some kind
+// NOTE: we are using linear arrays to store qstr's (unique strings, interned strings)
+// with MICROPY_QSTR_HASH_INDEX they are found through a hash index, else by a linear search
 // also probably need to include the length in the string data, to allow null bytes in the string
 
 #if 0 // print debugging info
@@ -116,10 +116,31 @@ extern const qstr_pool_t MICROPY_QSTR_EXTRA_POOL;
 #define CONST_POOL mp_qstr_const_pool
 #endif
 
+#if MICROPY_QSTR_HASH_INDEX
+// Open-addressed hash index of mp_qstr_const_pool, generated by makeqstrdata.py.
+// Each slot holds a qstr, or 0 if it is empty, and a qstr is found by probing
+// linearly from its hash modulo the size of the index.  The qstrs interned at
+// runtime are indexed in the same way by MP_STATE_VM(qstr_hash_index).
+STATIC const uint16_t qstr_const_hash_index[] = {
+#ifndef NO_QSTR
+#define QDEF(id, str)
+#define QHASH(q) q,
+#include "genhdr/qstrdefs.generated.h"
+#undef QHASH
+#undef QDEF
+#endif
+};
+#endif
+
 void qstr_init(void) {
     MP_STATE_VM(last_pool) = (qstr_pool_t*)&CONST_POOL; // we won't modify the const_pool since it has no allocated room left
     MP_STATE_VM(qstr_last_chunk) = NULL;
 
+    #if MICROPY_QSTR_HASH_INDEX
+    MP_STATE_VM(qstr_hash_index) = NULL;
+    MP_STATE_VM(qstr_hash_index_len) = 0;
+    #endif
+
     #if MICROPY_PY_THREAD
     mp_thread_mutex_init(&MP_STATE_VM(qstr_mutex));
     #endif
@@ -137,6 +158,68 @@ STATIC const byte *find_qstr(qstr q) {
     return 0;
 }
 
+#if MICROPY_QSTR_HASH_INDEX
+// Lookups read the index without taking qstr_mutex, so a new index is only
+// published once it's filled in, and an old one is left for the GC to free
+// because another thread may still be probing it.
+#if MICROPY_PY_THREAD
+#define QSTR_HASH_INDEX_GET() __atomic_load_n(&MP_STATE_VM(qstr_hash_index), __ATOMIC_ACQUIRE)
+#define QSTR_HASH_INDEX_SET(index) __atomic_store_n(&MP_STATE_VM(qstr_hash_index), (index), __ATOMIC_RELEASE)
+#else
+#define QSTR_HASH_INDEX_GET() (MP_STATE_VM(qstr_hash_index))
+#define QSTR_HASH_INDEX_SET(index) (MP_STATE_VM(qstr_hash_index) = (index))
+#endif
+
+STATIC void qstr_hash_index_insert(qstr_hash_index_t *index, qstr q, mp_uint_t hash) {
+    size_t mask = index->alloc - 1;
+    size_t i = hash & mask;
+    while (index->table[i] != 0) {
+        i = (i + 1) & mask;
+    }
+    index->table[i] = q;
+}
+
+// Add a qstr that was just interned to the index of the runtime qstrs.  When
+// the index is full a bigger one is built from the pools.  If that can't be
+// allocated then the runtime pools are searched linearly until it can be, and
+// qstr_hash_index_len is the number of qstrs there were at the last attempt.
+// qstr_mutex must be taken while in this function
+STATIC void qstr_hash_index_add(qstr q, const byte *q_ptr) {
+    qstr_hash_index_t *index = MP_STATE_VM(qstr_hash_index);
+    size_t alloc = index == NULL ? 0 : index->alloc;
+    if (2 * (MP_STATE_VM(qstr_hash_index_len) + 1) <= alloc) {
+        qstr_hash_index_insert(index, q, Q_GET_HASH(q_ptr));
+        MP_STATE_VM(qstr_hash_index_len) += 1;
+        return;
+    }
+
+    // the index must hold all the runtime qstrs, including this one
+    size_t len = q + 1 - (CONST_POOL.total_prev_len + CONST_POOL.len);
+    if (alloc == 0 && len < 2 * MP_STATE_VM(qstr_hash_index_len)) {
+        // the index couldn't be allocated last time, wait for more qstrs before trying again
+        return;
+    }
+    size_t new_alloc = alloc == 0 ? 32 : 2 * alloc;
+    while (2 * len > new_alloc) {
+        new_alloc *= 2;
+    }
+    MP_STATE_VM(qstr_hash_index_len) = len;
+    index = m_new_obj_var_maybe(qstr_hash_index_t, qstr, new_alloc);
+    if (index == NULL) {
+        QSTR_HASH_INDEX_SET(NULL);
+        return;
+    }
+    index->alloc = new_alloc;
+    memset(index->table, 0, new_alloc * sizeof(qstr));
+    for (qstr_pool_t *pool = MP_STATE_VM(last_pool); pool != &CONST_POOL; pool = pool->prev) {
+        for (size_t i = 0; i < pool->len; i++) {
+            qstr_hash_index_insert(index, pool->total_prev_len + i, Q_GET_HASH(pool->qstrs[i]));
+        }
+    }
+    QSTR_HASH_INDEX_SET(index);
+}
+#endif
+
 // qstr_mutex must be taken while in this function
 STATIC qstr qstr_add(const byte *q_ptr) {
     DEBUG_printf("QSTR: add hash=%d len=%d data=%.*s\n", Q_GET_HASH(q_ptr), Q_GET_LENGTH(q_ptr), Q_GET_LENGTH(q_ptr), Q_GET_DATA(q_ptr));
@@ -158,26 +241,70 @@ STATIC qstr qstr_add(const byte *q_ptr) {
 
     // add the new qstr
     MP_STATE_VM(last_pool)->qstrs[MP_STATE_VM(last_pool)->len++] = q_ptr;
+    qstr q = MP_STATE_VM(last_pool)->total_prev_len + MP_STATE_VM(last_pool)->len - 1;
+
+    #if MICROPY_QSTR_HASH_INDEX
+    qstr_hash_index_add(q, q_ptr);
+    #endif
 
     // return id for the newly-added qstr
-    return MP_STATE_VM(last_pool)->total_prev_len + MP_STATE_VM(last_pool)->len - 1;
+    return q;
+}
+
+#define QSTR_EQUAL(qd, hash, str, len) (Q_GET_HASH(qd) == (hash) && Q_GET_LENGTH(qd) == (len) && memcmp(Q_GET_DATA(qd), (str), (len)) == 0)
+
+// search the pools from pool down to (but not including) end for the data
+STATIC qstr qstr_find_in_pools(const qstr_pool_t *pool, const qstr_pool_t *end, mp_uint_t str_hash, const char *str, size_t str_len) {
+    for (; pool != end; pool = pool->prev) {
+        for (const byte *const *q = pool->qstrs, *const *q_top = pool->qstrs + pool->len; q < q_top; q++) {
+            if (QSTR_EQUAL(*q, str_hash, str, str_len)) {
+                return pool->total_prev_len + (q - pool->qstrs);
+            }
+        }
+    }
+    return 0;
 }
 
 qstr qstr_find_strn(const char *str, size_t str_len) {
     // work out hash of str
     mp_uint_t str_hash = qstr_compute_hash((const byte*)str, str_len);
 
-    // search pools for the data
-    for (qstr_pool_t *pool = MP_STATE_VM(last_pool); pool != NULL; pool = pool->prev) {
-        for (const byte **q = pool->qstrs, **q_top = pool->qstrs + pool->len; q < q_top; q++) {
-            if (Q_GET_HASH(*q) == str_hash && Q_GET_LENGTH(*q) == str_len && memcmp(Q_GET_DATA(*q), str, str_len) == 0) {
-                return pool->total_prev_len + (q - pool->qstrs);
+    #if MICROPY_QSTR_HASH_INDEX
+    // search the runtime pools, through their index if there is one
+    qstr q;
+    const qstr_hash_index_t *index = QSTR_HASH_INDEX_GET();
+    if (index != NULL) {
+        size_t mask = index->alloc - 1;
+        for (size_t i = str_hash & mask; (q = index->table[i]) != 0; i = (i + 1) & mask) {
+            if (QSTR_EQUAL(find_qstr(q), str_hash, str, str_len)) {
+                return q;
             }
         }
+    } else {
+        q = qstr_find_in_pools(MP_STATE_VM(last_pool), &CONST_POOL, str_hash, str, str_len);
+        if (q != 0) {
+            return q;
+        }
     }
 
-    // not found; return null qstr
+    // search the ROM pools; the extra pool isn't indexed
+    #ifdef MICROPY_QSTR_EXTRA_POOL
+    q = qstr_find_in_pools(&CONST_POOL, &mp_qstr_const_pool, str_hash, str, str_len);
+    if (q != 0) {
+        return q;
+    }
+    #endif
+    size_t mask = MP_ARRAY_SIZE(qstr_const_hash_index) - 1;
+    for (size_t i = str_hash & mask; (q = qstr_const_hash_index[i]) != 0; i = (i + 1) & mask) {
+        if (QSTR_EQUAL(mp_qstr_const_pool.qstrs[q], str_hash, str, str_len)) {
+            return q;
+        }
+    }
     return 0;
+    #else
+    // search pools for the data
+    return qstr_find_in_pools(MP_STATE_VM(last_pool), NULL, str_hash, str, str_len);
+    #endif
 }
 
 qstr qstr_from_str(const char *str) {
@@ -55,6 +55,13 @@ typedef struct _qstr_pool_t {
     const byte *qstrs[];
 } qstr_pool_t;
 
+// An index of the runtime qstrs; see qstr.c.  The table and its size are one
+// object so that a lookup always sees a size that matches the table.
+typedef struct _qstr_hash_index_t {
+    size_t alloc;
+    qstr table[];
+} qstr_hash_index_t;
+
 #define QSTR_FROM_STR_STATIC(s) (qstr_from_strn((s), strlen(s)))
 
 void qstr_init(void);
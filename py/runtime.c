@@ -85,11 +85,19 @@ void mp_init(void) {
     // optimization disabled by default
     MP_STATE_VM(mp_optimise_value) = 0;
 
+    #if MICROPY_OPT_CLASS_LOOKUP_CACHE || MICROPY_OPT_INLINE_ATTR_CACHE || MICROPY_OPT_LOAD_GLOBAL_CACHE
+    memset(&MP_STATE_VM(main_lookup_caches), 0, sizeof(MP_STATE_VM(main_lookup_caches)));
+    MP_STATE_THREAD(lookup_caches) = &MP_STATE_VM(main_lookup_caches);
+    #endif
+
     // init global module dict
     mp_obj_dict_init(&MP_STATE_VM(mp_loaded_modules_dict), 3);
 
     // initialise the __main__ module
     mp_obj_dict_init(&MP_STATE_VM(dict_main), 1);
+    #if MICROPY_OPT_LOAD_GLOBAL_CACHE
+    mp_map_set_versioned(&MP_STATE_VM(dict_main).map);
+    #endif
     mp_obj_dict_store(MP_OBJ_FROM_PTR(&MP_STATE_VM(dict_main)), MP_OBJ_NEW_QSTR(MP_QSTR___name__), MP_OBJ_NEW_QSTR(MP_QSTR___main__));
 
     // locals = globals for outer module (see Objects/frameobject.c/PyFrame_New())
@@ -111,10 +119,22 @@ void mp_init(void) {
     MP_STATE_VM(vfs_mount_table) = NULL;
     #endif
 
+    #if MICROPY_GC_STATS
+    MP_STATE_VM(gc_callback) = MP_OBJ_NULL;
+    #endif
+
     #if MICROPY_PY_THREAD_GIL
     mp_thread_mutex_init(&MP_STATE_VM(gil_mutex));
     #endif
 
+    #if MICROPY_PY_THREAD && MICROPY_INSTANCE_SHARED_KEYS
+    mp_thread_mutex_init(&MP_STATE_VM(instance_keys_mutex));
+    #endif
+
+    #if MICROPY_PY_THREAD && MICROPY_OPT_TIERED_NATIVE
+    mp_thread_mutex_init(&MP_STATE_VM(tier_up_mutex));
+    #endif
+
     MP_THREAD_GIL_ENTER();
 }
 
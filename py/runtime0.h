@@ -41,6 +41,9 @@
 #define MP_NATIVE_TYPE_PTR8 (0x05)
 #define MP_NATIVE_TYPE_PTR16 (0x06)
 #define MP_NATIVE_TYPE_PTR32 (0x07)
+#define MP_NATIVE_TYPE_FLOAT (0x08) // the bits of an mp_float_t
+#define MP_NATIVE_TYPE_PTRF32 (0x09)
+#define MP_NATIVE_TYPE_PTRF64 (0x0a)
 
 typedef enum {
     MP_UNARY_OP_BOOL, // __bool__
@@ -99,6 +102,10 @@ typedef enum {
     MP_BINARY_OP_IS_NOT,
 } mp_binary_op_t;
 
+// The entries up to MP_F_RAISE_TYPE_ERROR don't depend on the config, because
+// native code saved in .mpy files refers to them by index.  The ones after
+// MP_F_SETUP_CODE_STATE aren't used by the emitters; they are there so that
+// native modules linked by tools/mpy_ld.py can use them.
 typedef enum {
     MP_F_CONVERT_OBJ_TO_NATIVE = 0,
     MP_F_CONVERT_NATIVE_TO_OBJ,
@@ -119,10 +126,8 @@ typedef enum {
     MP_F_LIST_APPEND,
     MP_F_BUILD_MAP,
     MP_F_STORE_MAP,
-#if MICROPY_PY_BUILTINS_SET
     MP_F_BUILD_SET,
     MP_F_STORE_SET,
-#endif
     MP_F_MAKE_FUNCTION_FROM_RAW_CODE,
     MP_F_NATIVE_CALL_FUNCTION_N_KW,
     MP_F_CALL_METHOD_N_KW,
@@ -135,9 +140,7 @@ typedef enum {
     MP_F_IMPORT_NAME,
     MP_F_IMPORT_FROM,
     MP_F_IMPORT_ALL,
-#if MICROPY_PY_BUILTINS_SLICE
     MP_F_NEW_SLICE,
-#endif
     MP_F_UNPACK_SEQUENCE,
     MP_F_UNPACK_EX,
     MP_F_DELETE_NAME,
@@ -145,6 +148,34 @@ typedef enum {
     MP_F_NEW_CELL,
     MP_F_MAKE_CLOSURE_FROM_RAW_CODE,
     MP_F_SETUP_CODE_STATE,
+    MP_F_TYPE_FUN_BUILTIN_0,
+    MP_F_TYPE_FUN_BUILTIN_1,
+    MP_F_TYPE_FUN_BUILTIN_2,
+    MP_F_TYPE_FUN_BUILTIN_3,
+    MP_F_TYPE_FUN_BUILTIN_VAR,
+    MP_F_ARG_CHECK_NUM,
+    MP_F_OBJ_GET_INT,
+    MP_F_OBJ_NEW_INT,
+    MP_F_OBJ_NEW_INT_FROM_UINT,
+    MP_F_OBJ_LEN,
+    MP_F_OBJ_STR_GET_DATA,
+    MP_F_OBJ_NEW_STR,
+    MP_F_OBJ_NEW_BYTES,
+    MP_F_GET_BUFFER_RAISE,
+    MP_F_MALLOC,
+    MP_F_RAISE_VALUE_ERROR,
+    MP_F_RAISE_TYPE_ERROR,
+#if MICROPY_OPT_TIERED_NATIVE
+    MP_F_NATIVE_LOOP_CHECK,
+    MP_F_NATIVE_UNBOUND_LOCAL,
+    MP_F_NATIVE_TIER_RAISE,
+#if MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+    MP_F_LOAD_GLOBAL_CACHED,
+    MP_F_LOAD_ATTR_CACHED,
+    MP_F_STORE_ATTR_CACHED,
+    MP_F_LOAD_METHOD_CACHED,
+#endif
+#endif
     MP_F_NUMBER_OF,
 } mp_fun_kind_t;
 
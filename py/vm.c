@@ -30,12 +30,19 @@
 #include <assert.h>
 
 #include "py/mpstate.h"
+#include "py/gc.h"
 #include "py/nlr.h"
 #include "py/emitglue.h"
 #include "py/objtype.h"
+#include "py/runtime0.h"
 #include "py/runtime.h"
+#include "py/smallint.h"
 #include "py/bc0.h"
 #include "py/bc.h"
+#include "py/builtin.h"
+#include "py/objfun.h"
+#include "py/objlist.h"
+#include "py/objrange.h"
 
 #if 0
 #define TRACE(ip) printf("sp=%d ", (int)(sp - code_state->sp)); mp_bytecode_print2(ip, 1, code_state->const_table);
@@ -120,6 +127,287 @@ typedef enum {
     exc_sp--; /* pop back to previous exception handler */ \
     CLEAR_SYS_EXC_INFO() /* just clear sys.exc_info(), not compliant, but it shouldn't be used in 1st place */
 
+#if MICROPY_OPT_TIERED_NATIVE
+// Loop iterations count towards the hotness of a function, which is promoted
+// to native code by fun_bc_call when it gets hot enough
+#define COUNT_BACK_EDGE() do { \
+    if ((mp_int_t)slab < 0) { \
+        ++code_state->fun_bc->hotness; \
+    } \
+} while (0)
+#else
+#define COUNT_BACK_EDGE()
+#endif
+
+#if MICROPY_OPT_INLINE_ATTR_CACHE
+// The inline caches of the LOAD_ATTR, STORE_ATTR and LOAD_METHOD opcodes are
+// kept in a table per thread, rather than in the bytecode, which may be in ROM
+// and is shared by threads.  Each opcode gets ATTR_CACHE_WAYS entries found
+// from its address, holding the last types that it saw, most recent first.
+#define ATTR_CACHE_WAYS (4)
+#define ATTR_CACHE_ENTRIES(ip) \
+    (&MP_STATE_THREAD(lookup_caches)->attr[((uintptr_t)(ip) * ATTR_CACHE_WAYS) & (MICROPY_OPT_INLINE_ATTR_CACHE_SIZE - ATTR_CACHE_WAYS)])
+
+STATIC mp_attr_cache_entry_t *attr_cache_new_entry(const byte *ip, qstr attr, const mp_obj_type_t *type) {
+    mp_attr_cache_entry_t *e = ATTR_CACHE_ENTRIES(ip);
+    if (e[0].ip != ip || e[0].type != type) {
+        memmove(&e[1], &e[0], (ATTR_CACHE_WAYS - 1) * sizeof(*e));
+    }
+    e[0].ip = ip;
+    e[0].attr = attr;
+    e[0].type = type;
+    return &e[0];
+}
+
+// Find an existing member of an instance, using the inline cache of the opcode
+// at ip and then the position of the key that's cached in the bytecode there.
+STATIC mp_obj_t *attr_cache_lookup_member(mp_obj_instance_t *self, qstr attr, const byte *ip) {
+    if (!self->members.is_split) {
+        return mp_obj_instance_lookup_cached(self, MP_OBJ_NEW_QSTR(attr), (byte*)ip);
+    }
+    const mp_map_t *keys = ((mp_obj_class_t*)self->base.type)->instance_keys;
+    mp_attr_cache_entry_t *e = ATTR_CACHE_ENTRIES(ip);
+    for (size_t i = 0; i < ATTR_CACHE_WAYS; i++, e++) {
+        // the keys of a class are replaced, not changed, so they give the index
+        if (e->ip == ip && e->keys == keys && e->attr == attr) {
+            mp_obj_t *value = mp_obj_instance_split_value(self, e->data);
+            if (value == NULL || *value == MP_OBJ_NULL) {
+                return NULL;
+            }
+            return value;
+        }
+    }
+    mp_obj_t *value = mp_obj_instance_lookup_cached(self, MP_OBJ_NEW_QSTR(attr), (byte*)ip);
+    if (value != NULL) {
+        e = attr_cache_new_entry(ip, attr, self->base.type);
+        e->keys = keys;
+        e->data = value - mp_obj_instance_split_value(self, 0);
+    }
+    return value;
+}
+
+// Load a method like mp_load_method, using the inline cache of the opcode at ip.
+// Only methods that are bound to the object itself are cached: then they were
+// found in the class (or in the locals of a native type), the same for any
+// object of that type that doesn't have a member shadowing them.
+STATIC void attr_cache_load_method(mp_obj_t obj, qstr attr, const byte *ip, mp_obj_t *dest) {
+    const mp_obj_type_t *type = mp_obj_get_type(obj);
+    const mp_map_t *keys = NULL;
+    if (type->attr == mp_obj_instance_attr) {
+        mp_obj_instance_t *self = MP_OBJ_TO_PTR(obj);
+        if (!self->members.is_split) {
+            mp_load_method(obj, attr, dest);
+            return;
+        }
+        keys = ((mp_obj_class_t*)type)->instance_keys;
+    } else if (type->attr != NULL) {
+        mp_load_method(obj, attr, dest);
+        return;
+    }
+    mp_uint_t version = MP_STATE_VM(class_lookup_version);
+    mp_attr_cache_entry_t *e = ATTR_CACHE_ENTRIES(ip);
+    for (size_t i = 0; i < ATTR_CACHE_WAYS; i++, e++) {
+        if (e->ip == ip && e->type == type && e->attr == attr && e->keys == keys && e->data == version) {
+            dest[0] = e->value;
+            dest[1] = obj;
+            return;
+        }
+    }
+    mp_load_method(obj, attr, dest);
+    if (dest[1] == obj && (keys == NULL || mp_map_lookup((mp_map_t*)keys, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP) == NULL)) {
+        e = attr_cache_new_entry(ip, attr, type);
+        e->keys = keys;
+        e->data = version;
+        e->value = dest[0];
+    }
+}
+#endif
+
+#if MICROPY_OPT_LOAD_GLOBAL_CACHE
+// The LOAD_GLOBAL and LOAD_NAME opcodes each get an entry of a table per thread,
+// found from their address, holding the element where they last found their
+// name.  The elements of versioned maps (see map.c) only move when keys are
+// added or removed, so an entry for the current globals with the current map
+// keys version is always right, and storing to existing globals and builtins
+// doesn't invalidate it.
+#define GLOBAL_CACHE_ENTRY(ip) \
+    (&MP_STATE_THREAD(lookup_caches)->global[(uintptr_t)(ip) & (MICROPY_OPT_LOAD_GLOBAL_CACHE_SIZE - 1)])
+
+// Load a global like mp_load_global, using the cache of the opcode at ip and
+// then the position of the key that's cached in the bytecode there.
+STATIC mp_obj_t global_cache_load(mp_obj_dict_t *globals, qstr qst, const byte *ip) {
+    mp_obj_t key = MP_OBJ_NEW_QSTR(qst);
+    mp_uint_t version = MP_STATE_VM(map_keys_version);
+    mp_global_cache_entry_t *e = GLOBAL_CACHE_ENTRY(ip);
+    if (e->dict == globals && e->version == version && e->elem->key == key) {
+        return e->elem->value;
+    }
+    mp_map_elem_t *elem;
+    mp_uint_t x = *ip;
+    if (x < globals->map.alloc && globals->map.table[x].key == key) {
+        elem = &globals->map.table[x];
+    } else {
+        elem = mp_map_lookup(&globals->map, key, MP_MAP_LOOKUP);
+        if (elem != NULL) {
+            *(byte*)ip = (elem - &globals->map.table[0]) & 0xff;
+        } else {
+            #if MICROPY_CAN_OVERRIDE_BUILTINS
+            if (MP_STATE_VM(mp_module_builtins_override_dict) != NULL) {
+                elem = mp_map_lookup(&MP_STATE_VM(mp_module_builtins_override_dict)->map, key, MP_MAP_LOOKUP);
+            }
+            if (elem == NULL)
+            #endif
+            {
+                elem = mp_map_lookup((mp_map_t*)&mp_module_builtins_globals.map, key, MP_MAP_LOOKUP);
+                if (elem == NULL) {
+                    // raise the NameError
+                    return mp_load_global(qst);
+                }
+            }
+        }
+    }
+    if (globals->map.is_versioned) {
+        e->dict = globals;
+        e->version = version;
+        e->elem = elem;
+    }
+    return elem->value;
+}
+#endif
+
+#if MICROPY_OPT_TIERED_NATIVE && MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+// Promoted native code does its lookups with these, so that they use the same
+// caches as the opcodes.  Each lookup in the native code has a byte of its own
+// that stands in for the byte after the qstr of the opcode.
+
+mp_obj_t mp_native_load_global_cached(qstr qst, byte *hint) {
+    #if MICROPY_OPT_LOAD_GLOBAL_CACHE
+    return global_cache_load(mp_globals_get(), qst, hint);
+    #else
+    (void)hint;
+    return mp_load_global(qst);
+    #endif
+}
+
+STATIC mp_obj_t *native_lookup_member(mp_obj_t base, qstr attr, byte *hint) {
+    if (mp_obj_get_type(base)->attr != mp_obj_instance_attr) {
+        return NULL;
+    }
+    mp_obj_instance_t *self = MP_OBJ_TO_PTR(base);
+    #if MICROPY_OPT_INLINE_ATTR_CACHE
+    return attr_cache_lookup_member(self, attr, hint);
+    #else
+    return mp_obj_instance_lookup_cached(self, MP_OBJ_NEW_QSTR(attr), hint);
+    #endif
+}
+
+mp_obj_t mp_native_load_attr_cached(mp_obj_t base, qstr attr, byte *hint) {
+    mp_obj_t *value = native_lookup_member(base, attr, hint);
+    if (value != NULL) {
+        return *value;
+    }
+    return mp_load_attr(base, attr);
+}
+
+void mp_native_store_attr_cached(mp_obj_t base, qstr attr, mp_obj_t value, byte *hint) {
+    mp_obj_t *dest = native_lookup_member(base, attr, hint);
+    if (dest != NULL) {
+        *dest = value;
+        return;
+    }
+    mp_store_attr(base, attr, value);
+}
+
+void mp_native_load_method_cached(mp_obj_t base, qstr attr, mp_obj_t *dest, byte *hint) {
+    #if MICROPY_OPT_INLINE_ATTR_CACHE
+    attr_cache_load_method(base, attr, hint, dest);
+    #else
+    (void)hint;
+    mp_load_method(base, attr, dest);
+    #endif
+}
+#endif
+
+#if MICROPY_OPT_QUICKEN_BYTECODE
+// Generic opcodes are rewritten in place with specialised ones when they see
+// operands that they have a specialisation for.  The specialised opcodes check
+// their operands and, when they are something else, write the generic opcode
+// back and execute that, so a wrong guess only costs rewriting a byte.
+
+// the binary op of each MP_BC_BINARY_OP_xxx_SMALL_INT and _FLOAT opcode
+STATIC const byte quick_binary_op_op[] = {
+    MP_BINARY_OP_ADD,
+    MP_BINARY_OP_INPLACE_ADD,
+    MP_BINARY_OP_SUBTRACT,
+    MP_BINARY_OP_INPLACE_SUBTRACT,
+    MP_BINARY_OP_LESS,
+    MP_BINARY_OP_MORE,
+    MP_BINARY_OP_EQUAL,
+    MP_BINARY_OP_LESS_EQUAL,
+    MP_BINARY_OP_MORE_EQUAL,
+    MP_BINARY_OP_NOT_EQUAL,
+    MP_BINARY_OP_ADD,
+    MP_BINARY_OP_INPLACE_ADD,
+    MP_BINARY_OP_SUBTRACT,
+    MP_BINARY_OP_MULTIPLY,
+    MP_BINARY_OP_INPLACE_MULTIPLY,
+};
+
+// the specialised opcodes of each binary op, for two small ints and for floats
+STATIC const byte quick_binary_op_bc[MP_BINARY_OP_NOT_EQUAL + 1][2] = {
+    [MP_BINARY_OP_ADD] = {MP_BC_BINARY_OP_ADD_SMALL_INT, MP_BC_BINARY_OP_ADD_FLOAT},
+    [MP_BINARY_OP_INPLACE_ADD] = {MP_BC_BINARY_OP_INPLACE_ADD_SMALL_INT, MP_BC_BINARY_OP_INPLACE_ADD_FLOAT},
+    [MP_BINARY_OP_SUBTRACT] = {MP_BC_BINARY_OP_SUBTRACT_SMALL_INT, MP_BC_BINARY_OP_SUBTRACT_FLOAT},
+    [MP_BINARY_OP_INPLACE_SUBTRACT] = {MP_BC_BINARY_OP_INPLACE_SUBTRACT_SMALL_INT, 0},
+    [MP_BINARY_OP_MULTIPLY] = {0, MP_BC_BINARY_OP_MULTIPLY_FLOAT},
+    [MP_BINARY_OP_INPLACE_MULTIPLY] = {0, MP_BC_BINARY_OP_INPLACE_MULTIPLY_FLOAT},
+    [MP_BINARY_OP_LESS] = {MP_BC_BINARY_OP_LESS_SMALL_INT, 0},
+    [MP_BINARY_OP_MORE] = {MP_BC_BINARY_OP_MORE_SMALL_INT, 0},
+    [MP_BINARY_OP_EQUAL] = {MP_BC_BINARY_OP_EQUAL_SMALL_INT, 0},
+    [MP_BINARY_OP_LESS_EQUAL] = {MP_BC_BINARY_OP_LESS_EQUAL_SMALL_INT, 0},
+    [MP_BINARY_OP_MORE_EQUAL] = {MP_BC_BINARY_OP_MORE_EQUAL_SMALL_INT, 0},
+    [MP_BINARY_OP_NOT_EQUAL] = {MP_BC_BINARY_OP_NOT_EQUAL_SMALL_INT, 0},
+};
+
+// Return the specialised opcode for a binary op with these operands, or 0.
+STATIC byte quicken_binary_op(mp_uint_t op, mp_obj_t lhs, mp_obj_t rhs) {
+    if (op > MP_BINARY_OP_NOT_EQUAL) {
+        return 0;
+    }
+    if (MP_OBJ_IS_SMALL_INT(lhs) && MP_OBJ_IS_SMALL_INT(rhs)) {
+        return quick_binary_op_bc[op][0];
+    }
+    #if MICROPY_PY_BUILTINS_FLOAT
+    if ((mp_obj_is_float(lhs) || MP_OBJ_IS_SMALL_INT(lhs)) && (mp_obj_is_float(rhs) || MP_OBJ_IS_SMALL_INT(rhs))) {
+        return quick_binary_op_bc[op][1];
+    }
+    #endif
+    return 0;
+}
+
+#if MICROPY_PY_BUILTINS_FLOAT
+// Get the operands of a specialised float op, which can be floats or small
+// ints but not both small ints, because then the result must be an int.
+STATIC bool quick_float_operands(mp_obj_t lhs, mp_obj_t rhs, mp_float_t *lhs_val, mp_float_t *rhs_val) {
+    if (mp_obj_is_float(lhs)) {
+        *lhs_val = mp_obj_float_get(lhs);
+    } else if (MP_OBJ_IS_SMALL_INT(lhs) && mp_obj_is_float(rhs)) {
+        *lhs_val = (mp_float_t)MP_OBJ_SMALL_INT_VALUE(lhs);
+    } else {
+        return false;
+    }
+    if (mp_obj_is_float(rhs)) {
+        *rhs_val = mp_obj_float_get(rhs);
+    } else if (MP_OBJ_IS_SMALL_INT(rhs)) {
+        *rhs_val = (mp_float_t)MP_OBJ_SMALL_INT_VALUE(rhs);
+    } else {
+        return false;
+    }
+    return true;
+}
+#endif
+#endif
+
 // fastn has items in reverse order (fastn[0] is local[0], fastn[-1] is local[1], etc)
 // sp points to bottom of stack which grows up
 // returns:
@@ -158,6 +446,14 @@ mp_vm_return_kind_t mp_execute_bytecode(mp_code_state_t *code_state, volatile mp
     // loop and the exception handler, leading to very obscure bugs.
     #define RAISE(o) do { nlr_pop(); nlr.ret_val = MP_OBJ_TO_PTR(o); goto exception_handler; } while (0)
 
+    #if MICROPY_PY_MICROPYTHON_ALLOC_PROFILE
+    // the allocation profiler attributes allocations to the running code state
+    mp_code_state_t *prev_code_state = MP_STATE_THREAD(current_code_state);
+    #define RESTORE_CODE_STATE() (MP_STATE_THREAD(current_code_state) = prev_code_state)
+    #else
+    #define RESTORE_CODE_STATE()
+    #endif
+
 #if MICROPY_STACKLESS
 run_code_state: ;
 #endif
@@ -169,6 +465,10 @@ run_code_state: ;
     volatile bool currently_in_except_block = MP_TAGPTR_TAG0(code_state->exc_sp); // 0 or 1, to detect nested exceptions
     mp_exc_stack_t *volatile exc_sp = MP_TAGPTR_PTR(code_state->exc_sp); // stack grows up, exc_sp points to top of stack
 
+    #if MICROPY_PY_MICROPYTHON_ALLOC_PROFILE
+    MP_STATE_THREAD(current_code_state) = code_state;
+    #endif
+
     // outer exception handling loop
     for (;;) {
         nlr_buf_t nlr;
@@ -276,6 +576,13 @@ dispatch_loop:
                 ENTRY(MP_BC_LOAD_NAME): {
                     MARK_EXC_IP_SELECTIVE();
                     DECODE_QSTR;
+                    #if MICROPY_OPT_LOAD_GLOBAL_CACHE
+                    if (MP_STATE_CTX(dict_locals) == MP_STATE_CTX(dict_globals)) {
+                        PUSH(global_cache_load(MP_STATE_CTX(dict_globals), qst, ip));
+                        ip++;
+                        DISPATCH();
+                    }
+                    #endif
                     mp_obj_t key = MP_OBJ_NEW_QSTR(qst);
                     mp_uint_t x = *ip;
                     if (x < MP_STATE_CTX(dict_locals)->map.alloc && MP_STATE_CTX(dict_locals)->map.table[x].key == key) {
@@ -305,6 +612,11 @@ dispatch_loop:
                 ENTRY(MP_BC_LOAD_GLOBAL): {
                     MARK_EXC_IP_SELECTIVE();
                     DECODE_QSTR;
+                    #if MICROPY_OPT_LOAD_GLOBAL_CACHE
+                    PUSH(global_cache_load(MP_STATE_CTX(dict_globals), qst, ip));
+                    ip++;
+                    DISPATCH();
+                    #else
                     mp_obj_t key = MP_OBJ_NEW_QSTR(qst);
                     mp_uint_t x = *ip;
                     if (x < MP_STATE_CTX(dict_globals)->map.alloc && MP_STATE_CTX(dict_globals)->map.table[x].key == key) {
@@ -320,6 +632,7 @@ dispatch_loop:
                     }
                     ip++;
                     DISPATCH();
+                    #endif
                 }
                 #endif
 
@@ -337,20 +650,15 @@ dispatch_loop:
                     mp_obj_t top = TOP();
                     if (mp_obj_get_type(top)->attr == mp_obj_instance_attr) {
                         mp_obj_instance_t *self = MP_OBJ_TO_PTR(top);
-                        mp_uint_t x = *ip;
-                        mp_obj_t key = MP_OBJ_NEW_QSTR(qst);
-                        mp_map_elem_t *elem;
-                        if (x < self->members.alloc && self->members.table[x].key == key) {
-                            elem = &self->members.table[x];
-                        } else {
-                            elem = mp_map_lookup(&self->members, key, MP_MAP_LOOKUP);
-                            if (elem != NULL) {
-                                *(byte*)ip = elem - &self->members.table[0];
-                            } else {
-                                goto load_attr_cache_fail;
-                            }
+                        #if MICROPY_OPT_INLINE_ATTR_CACHE
+                        mp_obj_t *value = attr_cache_lookup_member(self, qst, ip);
+                        #else
+                        mp_obj_t *value = mp_obj_instance_lookup_cached(self, MP_OBJ_NEW_QSTR(qst), (byte*)ip);
+                        #endif
+                        if (value == NULL) {
+                            goto load_attr_cache_fail;
                         }
-                        SET_TOP(elem->value);
+                        SET_TOP(*value);
                         ip++;
                         DISPATCH();
                     }
@@ -364,7 +672,11 @@ dispatch_loop:
                 ENTRY(MP_BC_LOAD_METHOD): {
                     MARK_EXC_IP_SELECTIVE();
                     DECODE_QSTR;
+                    #if MICROPY_OPT_INLINE_ATTR_CACHE
+                    attr_cache_load_method(*sp, qst, ip, sp);
+                    #else
                     mp_load_method(*sp, qst, sp);
+                    #endif
                     sp += 1;
                     DISPATCH();
                 }
@@ -377,6 +689,11 @@ dispatch_loop:
                 ENTRY(MP_BC_LOAD_SUBSCR): {
                     MARK_EXC_IP_SELECTIVE();
                     mp_obj_t index = POP();
+                    #if MICROPY_OPT_QUICKEN_BYTECODE
+                    if (MP_OBJ_IS_TYPE(TOP(), &mp_type_list) && MP_OBJ_IS_SMALL_INT(index)) {
+                        *(byte*)(ip - 1) = MP_BC_LOAD_SUBSCR_LIST_INT;
+                    }
+                    #endif
                     SET_TOP(mp_obj_subscr(TOP(), index, MP_OBJ_SENTINEL));
                     DISPATCH();
                 }
@@ -427,20 +744,15 @@ dispatch_loop:
                     mp_obj_t top = TOP();
                     if (mp_obj_get_type(top)->attr == mp_obj_instance_attr && sp[-1] != MP_OBJ_NULL) {
                         mp_obj_instance_t *self = MP_OBJ_TO_PTR(top);
-                        mp_uint_t x = *ip;
-                        mp_obj_t key = MP_OBJ_NEW_QSTR(qst);
-                        mp_map_elem_t *elem;
-                        if (x < self->members.alloc && self->members.table[x].key == key) {
-                            elem = &self->members.table[x];
-                        } else {
-                            elem = mp_map_lookup(&self->members, key, MP_MAP_LOOKUP);
-                            if (elem != NULL) {
-                                *(byte*)ip = elem - &self->members.table[0];
-                            } else {
-                                goto store_attr_cache_fail;
-                            }
+                        #if MICROPY_OPT_INLINE_ATTR_CACHE
+                        mp_obj_t *value = attr_cache_lookup_member(self, qst, ip);
+                        #else
+                        mp_obj_t *value = mp_obj_instance_lookup_cached(self, MP_OBJ_NEW_QSTR(qst), (byte*)ip);
+                        #endif
+                        if (value == NULL) {
+                            goto store_attr_cache_fail;
                         }
-                        elem->value = sp[-1];
+                        *value = sp[-1];
                         sp -= 2;
                         ip++;
                         DISPATCH();
@@ -455,6 +767,12 @@ dispatch_loop:
 
                 ENTRY(MP_BC_STORE_SUBSCR):
                     MARK_EXC_IP_SELECTIVE();
+                    #if MICROPY_OPT_QUICKEN_BYTECODE
+                    // a NULL value is a delete, which is left to the generic opcode
+                    if (sp[-2] != MP_OBJ_NULL && MP_OBJ_IS_TYPE(sp[-1], &mp_type_list) && MP_OBJ_IS_SMALL_INT(sp[0])) {
+                        *(byte*)(ip - 1) = MP_BC_STORE_SUBSCR_LIST_INT;
+                    }
+                    #endif
                     mp_obj_subscr(sp[-1], sp[0], sp[-2]);
                     sp -= 3;
                     DISPATCH();
@@ -527,6 +845,7 @@ dispatch_loop:
                 ENTRY(MP_BC_JUMP): {
                     DECODE_SLABEL;
                     ip += slab;
+                    COUNT_BACK_EDGE();
                     DISPATCH_WITH_PEND_EXC_CHECK();
                 }
 
@@ -534,6 +853,7 @@ dispatch_loop:
                     DECODE_SLABEL;
                     if (mp_obj_is_true(POP())) {
                         ip += slab;
+                        COUNT_BACK_EDGE();
                     }
                     DISPATCH_WITH_PEND_EXC_CHECK();
                 }
@@ -542,6 +862,7 @@ dispatch_loop:
                     DECODE_SLABEL;
                     if (!mp_obj_is_true(POP())) {
                         ip += slab;
+                        COUNT_BACK_EDGE();
                     }
                     DISPATCH_WITH_PEND_EXC_CHECK();
                 }
@@ -725,6 +1046,11 @@ unwind_jump:;
                     DECODE_ULABEL; // the jump offset if iteration finishes; for labels are always forward
                     code_state->sp = sp;
                     assert(TOP());
+                    #if MICROPY_OPT_QUICKEN_BYTECODE
+                    if (MP_OBJ_IS_TYPE(TOP(), &mp_type_range_it)) {
+                        *(byte*)(ip - 3) = MP_BC_FOR_ITER_RANGE;
+                    }
+                    #endif
                     mp_obj_t value = mp_iternext_allow_raise(TOP());
                     if (value == MP_OBJ_STOP_ITERATION) {
                         --sp; // pop the exhausted iterator
@@ -1060,6 +1386,7 @@ unwind_return:
                         goto run_code_state;
                     }
                     #endif
+                    RESTORE_CODE_STATE();
                     return MP_VM_RETURN_NORMAL;
 
                 ENTRY(MP_BC_RAISE_VARARGS): {
@@ -1097,6 +1424,7 @@ yield:
                     code_state->ip = ip;
                     code_state->sp = sp;
                     code_state->exc_sp = MP_TAGPTR_MAKE(exc_sp, currently_in_except_block);
+                    RESTORE_CODE_STATE();
                     return MP_VM_RETURN_YIELD;
 
                 ENTRY(MP_BC_YIELD_FROM): {
@@ -1174,6 +1502,188 @@ yield:
                     mp_import_all(POP());
                     DISPATCH();
 
+#if MICROPY_OPT_QUICKEN_BYTECODE
+                ENTRY(MP_BC_BINARY_OP_ADD_SMALL_INT):
+                ENTRY(MP_BC_BINARY_OP_INPLACE_ADD_SMALL_INT):
+                    if (MP_OBJ_IS_SMALL_INT(sp[-1]) && MP_OBJ_IS_SMALL_INT(sp[0])) {
+                        mp_int_t res = MP_OBJ_SMALL_INT_VALUE(sp[-1]) + MP_OBJ_SMALL_INT_VALUE(sp[0]);
+                        if (MP_SMALL_INT_FITS(res)) {
+                            sp--;
+                            SET_TOP(MP_OBJ_NEW_SMALL_INT(res));
+                            DISPATCH();
+                        }
+                    }
+                    goto binary_op_deoptimise;
+
+                ENTRY(MP_BC_BINARY_OP_SUBTRACT_SMALL_INT):
+                ENTRY(MP_BC_BINARY_OP_INPLACE_SUBTRACT_SMALL_INT):
+                    if (MP_OBJ_IS_SMALL_INT(sp[-1]) && MP_OBJ_IS_SMALL_INT(sp[0])) {
+                        mp_int_t res = MP_OBJ_SMALL_INT_VALUE(sp[-1]) - MP_OBJ_SMALL_INT_VALUE(sp[0]);
+                        if (MP_SMALL_INT_FITS(res)) {
+                            sp--;
+                            SET_TOP(MP_OBJ_NEW_SMALL_INT(res));
+                            DISPATCH();
+                        }
+                    }
+                    goto binary_op_deoptimise;
+
+                ENTRY(MP_BC_BINARY_OP_LESS_SMALL_INT):
+                    if (MP_OBJ_IS_SMALL_INT(sp[-1]) && MP_OBJ_IS_SMALL_INT(sp[0])) {
+                        mp_int_t lhs = MP_OBJ_SMALL_INT_VALUE(sp[-1]);
+                        mp_int_t rhs = MP_OBJ_SMALL_INT_VALUE(sp[0]);
+                        sp--;
+                        SET_TOP(mp_obj_new_bool(lhs < rhs));
+                        DISPATCH();
+                    }
+                    goto binary_op_deoptimise;
+
+                ENTRY(MP_BC_BINARY_OP_MORE_SMALL_INT):
+                    if (MP_OBJ_IS_SMALL_INT(sp[-1]) && MP_OBJ_IS_SMALL_INT(sp[0])) {
+                        mp_int_t lhs = MP_OBJ_SMALL_INT_VALUE(sp[-1]);
+                        mp_int_t rhs = MP_OBJ_SMALL_INT_VALUE(sp[0]);
+                        sp--;
+                        SET_TOP(mp_obj_new_bool(lhs > rhs));
+                        DISPATCH();
+                    }
+                    goto binary_op_deoptimise;
+
+                ENTRY(MP_BC_BINARY_OP_EQUAL_SMALL_INT):
+                    if (MP_OBJ_IS_SMALL_INT(sp[-1]) && MP_OBJ_IS_SMALL_INT(sp[0])) {
+                        mp_int_t lhs = MP_OBJ_SMALL_INT_VALUE(sp[-1]);
+                        mp_int_t rhs = MP_OBJ_SMALL_INT_VALUE(sp[0]);
+                        sp--;
+                        SET_TOP(mp_obj_new_bool(lhs == rhs));
+                        DISPATCH();
+                    }
+                    goto binary_op_deoptimise;
+
+                ENTRY(MP_BC_BINARY_OP_LESS_EQUAL_SMALL_INT):
+                    if (MP_OBJ_IS_SMALL_INT(sp[-1]) && MP_OBJ_IS_SMALL_INT(sp[0])) {
+                        mp_int_t lhs = MP_OBJ_SMALL_INT_VALUE(sp[-1]);
+                        mp_int_t rhs = MP_OBJ_SMALL_INT_VALUE(sp[0]);
+                        sp--;
+                        SET_TOP(mp_obj_new_bool(lhs <= rhs));
+                        DISPATCH();
+                    }
+                    goto binary_op_deoptimise;
+
+                ENTRY(MP_BC_BINARY_OP_MORE_EQUAL_SMALL_INT):
+                    if (MP_OBJ_IS_SMALL_INT(sp[-1]) && MP_OBJ_IS_SMALL_INT(sp[0])) {
+                        mp_int_t lhs = MP_OBJ_SMALL_INT_VALUE(sp[-1]);
+                        mp_int_t rhs = MP_OBJ_SMALL_INT_VALUE(sp[0]);
+                        sp--;
+                        SET_TOP(mp_obj_new_bool(lhs >= rhs));
+                        DISPATCH();
+                    }
+                    goto binary_op_deoptimise;
+
+                ENTRY(MP_BC_BINARY_OP_NOT_EQUAL_SMALL_INT):
+                    if (MP_OBJ_IS_SMALL_INT(sp[-1]) && MP_OBJ_IS_SMALL_INT(sp[0])) {
+                        mp_int_t lhs = MP_OBJ_SMALL_INT_VALUE(sp[-1]);
+                        mp_int_t rhs = MP_OBJ_SMALL_INT_VALUE(sp[0]);
+                        sp--;
+                        SET_TOP(mp_obj_new_bool(lhs != rhs));
+                        DISPATCH();
+                    }
+                    goto binary_op_deoptimise;
+
+                #if MICROPY_PY_BUILTINS_FLOAT
+                ENTRY(MP_BC_BINARY_OP_ADD_FLOAT):
+                ENTRY(MP_BC_BINARY_OP_INPLACE_ADD_FLOAT): {
+                    mp_float_t lhs_val, rhs_val;
+                    if (quick_float_operands(sp[-1], sp[0], &lhs_val, &rhs_val)) {
+                        MARK_EXC_IP_SELECTIVE();
+                        sp--;
+                        SET_TOP(mp_obj_new_float(lhs_val + rhs_val));
+                        DISPATCH();
+                    }
+                    goto binary_op_deoptimise;
+                }
+
+                ENTRY(MP_BC_BINARY_OP_SUBTRACT_FLOAT): {
+                    mp_float_t lhs_val, rhs_val;
+                    if (quick_float_operands(sp[-1], sp[0], &lhs_val, &rhs_val)) {
+                        MARK_EXC_IP_SELECTIVE();
+                        sp--;
+                        SET_TOP(mp_obj_new_float(lhs_val - rhs_val));
+                        DISPATCH();
+                    }
+                    goto binary_op_deoptimise;
+                }
+
+                ENTRY(MP_BC_BINARY_OP_MULTIPLY_FLOAT):
+                ENTRY(MP_BC_BINARY_OP_INPLACE_MULTIPLY_FLOAT): {
+                    mp_float_t lhs_val, rhs_val;
+                    if (quick_float_operands(sp[-1], sp[0], &lhs_val, &rhs_val)) {
+                        MARK_EXC_IP_SELECTIVE();
+                        sp--;
+                        SET_TOP(mp_obj_new_float(lhs_val * rhs_val));
+                        DISPATCH();
+                    }
+                    goto binary_op_deoptimise;
+                }
+                #endif
+
+                binary_op_deoptimise:
+                    // the operands aren't what the specialised opcode is for,
+                    // so put the generic opcode back and execute that instead
+                    *(byte*)(ip - 1) = MP_BC_BINARY_OP_MULTI + quick_binary_op_op[ip[-1] - MP_BC_BINARY_OP_QUICK];
+                    ip--;
+                    DISPATCH();
+
+                ENTRY(MP_BC_LOAD_SUBSCR_LIST_INT):
+                    if (MP_OBJ_IS_TYPE(sp[-1], &mp_type_list) && MP_OBJ_IS_SMALL_INT(sp[0])) {
+                        mp_obj_list_t *list = MP_OBJ_TO_PTR(sp[-1]);
+                        mp_int_t index = MP_OBJ_SMALL_INT_VALUE(sp[0]);
+                        if (index < 0) {
+                            index += list->len;
+                        }
+                        if (index >= 0 && (mp_uint_t)index < list->len) {
+                            sp--;
+                            SET_TOP(list->items[index]);
+                            DISPATCH();
+                        }
+                    }
+                    *(byte*)(ip - 1) = MP_BC_LOAD_SUBSCR;
+                    ip--;
+                    DISPATCH();
+
+                ENTRY(MP_BC_STORE_SUBSCR_LIST_INT):
+                    if (sp[-2] != MP_OBJ_NULL && MP_OBJ_IS_TYPE(sp[-1], &mp_type_list) && MP_OBJ_IS_SMALL_INT(sp[0])) {
+                        mp_obj_list_t *list = MP_OBJ_TO_PTR(sp[-1]);
+                        mp_int_t index = MP_OBJ_SMALL_INT_VALUE(sp[0]);
+                        if (index < 0) {
+                            index += list->len;
+                        }
+                        if (index >= 0 && (mp_uint_t)index < list->len) {
+                            list->items[index] = sp[-2];
+                            sp -= 3;
+                            DISPATCH();
+                        }
+                    }
+                    *(byte*)(ip - 1) = MP_BC_STORE_SUBSCR;
+                    ip--;
+                    DISPATCH();
+
+                ENTRY(MP_BC_FOR_ITER_RANGE):
+                    if (MP_OBJ_IS_TYPE(TOP(), &mp_type_range_it)) {
+                        mp_obj_range_it_t *range_it = MP_OBJ_TO_PTR(TOP());
+                        DECODE_ULABEL; // the jump offset if iteration finishes; for labels are always forward
+                        if ((range_it->step > 0 && range_it->cur < range_it->stop)
+                            || (range_it->step < 0 && range_it->cur > range_it->stop)) {
+                            PUSH(MP_OBJ_NEW_SMALL_INT(range_it->cur));
+                            range_it->cur += range_it->step;
+                        } else {
+                            --sp; // pop the exhausted iterator
+                            ip += ulab; // jump to after for-block
+                        }
+                        DISPATCH();
+                    }
+                    *(byte*)(ip - 1) = MP_BC_FOR_ITER;
+                    ip--;
+                    DISPATCH();
+#endif
+
 #if MICROPY_OPT_COMPUTED_GOTO
                 ENTRY(MP_BC_LOAD_CONST_SMALL_INT_MULTI):
                     PUSH(MP_OBJ_NEW_SMALL_INT((mp_int_t)ip[-1] - MP_BC_LOAD_CONST_SMALL_INT_MULTI - 16));
@@ -1197,6 +1707,12 @@ yield:
                     mp_obj_t rhs = POP();
                     mp_obj_t lhs = TOP();
                     SET_TOP(mp_binary_op(ip[-1] - MP_BC_BINARY_OP_MULTI, lhs, rhs));
+                    #if MICROPY_OPT_QUICKEN_BYTECODE
+                    byte quick = quicken_binary_op(ip[-1] - MP_BC_BINARY_OP_MULTI, lhs, rhs);
+                    if (quick != 0) {
+                        *(byte*)(ip - 1) = quick;
+                    }
+                    #endif
                     DISPATCH();
                 }
 
@@ -1220,6 +1736,12 @@ yield:
                         mp_obj_t rhs = POP();
                         mp_obj_t lhs = TOP();
                         SET_TOP(mp_binary_op(ip[-1] - MP_BC_BINARY_OP_MULTI, lhs, rhs));
+                        #if MICROPY_OPT_QUICKEN_BYTECODE
+                        byte quick = quicken_binary_op(ip[-1] - MP_BC_BINARY_OP_MULTI, lhs, rhs);
+                        if (quick != 0) {
+                            *(byte*)(ip - 1) = quick;
+                        }
+                        #endif
                         DISPATCH();
                     } else
 #endif
@@ -1227,6 +1749,7 @@ yield:
                     mp_obj_t obj = mp_obj_new_exception_msg(&mp_type_NotImplementedError, "byte code not implemented");
                     nlr_pop();
                     fastn[0] = obj;
+                    RESTORE_CODE_STATE();
                     return MP_VM_RETURN_EXCEPTION;
                 }
 
@@ -1243,6 +1766,12 @@ pending_exception_check:
                     RAISE(obj);
                 }
 
+                #if MICROPY_GC_STATS
+                if (MP_STATE_MEM(gc_callback_pending)) {
+                    gc_stats_run_callback();
+                }
+                #endif
+
                 // TODO make GIL release more efficient
                 MP_THREAD_GIL_EXIT();
                 MP_THREAD_GIL_ENTER();
@@ -1289,40 +1818,8 @@ unwind_loop:
             // But consider how to handle nested exceptions.
             // TODO need a better way of not adding traceback to constant objects (right now, just GeneratorExit_obj and MemoryError_obj)
             if (nlr.ret_val != &mp_const_GeneratorExit_obj && nlr.ret_val != &mp_const_MemoryError_obj) {
-                const byte *ip = code_state->code_info;
-                mp_uint_t code_info_size = mp_decode_uint(&ip);
-                #if MICROPY_PERSISTENT_CODE
-                qstr block_name = ip[0] | (ip[1] << 8);
-                qstr source_file = ip[2] | (ip[3] << 8);
-                ip += 4;
-                #else
-                qstr block_name = mp_decode_uint(&ip);
-                qstr source_file = mp_decode_uint(&ip);
-                #endif
-                size_t bc = code_state->ip - code_state->code_info - code_info_size;
-                size_t source_line = 1;
-                size_t c;
-                while ((c = *ip)) {
-                    mp_uint_t b, l;
-                    if ((c & 0x80) == 0) {
-                        // 0b0LLBBBBB encoding
-                        b = c & 0x1f;
-                        l = c >> 5;
-                        ip += 1;
-                    } else {
-                        // 0b1LLLBBBB 0bLLLLLLLL encoding (l's LSB in second byte)
-                        b = c & 0xf;
-                        l = ((c << 4) & 0x700) | ip[1];
-                        ip += 2;
-                    }
-                    if (bc >= b) {
-                        bc -= b;
-                        source_line += l;
-                    } else {
-                        // found source line corresponding to bytecode offset
-                        break;
-                    }
-                }
+                qstr block_name, source_file;
+                size_t source_line = mp_bytecode_get_source_info(code_state->code_info, code_state->ip, &block_name, &source_file);
                 mp_obj_exception_add_traceback(MP_OBJ_FROM_PTR(nlr.ret_val), source_file, source_line, block_name);
             }
 
@@ -1367,6 +1864,7 @@ unwind_loop:
                 // propagate exception to higher level
                 // TODO what to do about ip and sp? they don't really make sense at this point
                 fastn[0] = MP_OBJ_FROM_PTR(nlr.ret_val); // must put exception here because sp is invalid
+                RESTORE_CODE_STATE();
                 return MP_VM_RETURN_EXCEPTION;
             }
         }
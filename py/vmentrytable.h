@@ -109,6 +109,28 @@ static const void *const entry_table[256] = {
     [MP_BC_STORE_FAST_MULTI ... MP_BC_STORE_FAST_MULTI + 15] = &&entry_MP_BC_STORE_FAST_MULTI,
     [MP_BC_UNARY_OP_MULTI ... MP_BC_UNARY_OP_MULTI + 6] = &&entry_MP_BC_UNARY_OP_MULTI,
     [MP_BC_BINARY_OP_MULTI ... MP_BC_BINARY_OP_MULTI + 35] = &&entry_MP_BC_BINARY_OP_MULTI,
+    #if MICROPY_OPT_QUICKEN_BYTECODE
+    [MP_BC_BINARY_OP_ADD_SMALL_INT] = &&entry_MP_BC_BINARY_OP_ADD_SMALL_INT,
+    [MP_BC_BINARY_OP_INPLACE_ADD_SMALL_INT] = &&entry_MP_BC_BINARY_OP_INPLACE_ADD_SMALL_INT,
+    [MP_BC_BINARY_OP_SUBTRACT_SMALL_INT] = &&entry_MP_BC_BINARY_OP_SUBTRACT_SMALL_INT,
+    [MP_BC_BINARY_OP_INPLACE_SUBTRACT_SMALL_INT] = &&entry_MP_BC_BINARY_OP_INPLACE_SUBTRACT_SMALL_INT,
+    [MP_BC_BINARY_OP_LESS_SMALL_INT] = &&entry_MP_BC_BINARY_OP_LESS_SMALL_INT,
+    [MP_BC_BINARY_OP_MORE_SMALL_INT] = &&entry_MP_BC_BINARY_OP_MORE_SMALL_INT,
+    [MP_BC_BINARY_OP_EQUAL_SMALL_INT] = &&entry_MP_BC_BINARY_OP_EQUAL_SMALL_INT,
+    [MP_BC_BINARY_OP_LESS_EQUAL_SMALL_INT] = &&entry_MP_BC_BINARY_OP_LESS_EQUAL_SMALL_INT,
+    [MP_BC_BINARY_OP_MORE_EQUAL_SMALL_INT] = &&entry_MP_BC_BINARY_OP_MORE_EQUAL_SMALL_INT,
+    [MP_BC_BINARY_OP_NOT_EQUAL_SMALL_INT] = &&entry_MP_BC_BINARY_OP_NOT_EQUAL_SMALL_INT,
+    #if MICROPY_PY_BUILTINS_FLOAT
+    [MP_BC_BINARY_OP_ADD_FLOAT] = &&entry_MP_BC_BINARY_OP_ADD_FLOAT,
+    [MP_BC_BINARY_OP_INPLACE_ADD_FLOAT] = &&entry_MP_BC_BINARY_OP_INPLACE_ADD_FLOAT,
+    [MP_BC_BINARY_OP_SUBTRACT_FLOAT] = &&entry_MP_BC_BINARY_OP_SUBTRACT_FLOAT,
+    [MP_BC_BINARY_OP_MULTIPLY_FLOAT] = &&entry_MP_BC_BINARY_OP_MULTIPLY_FLOAT,
+    [MP_BC_BINARY_OP_INPLACE_MULTIPLY_FLOAT] = &&entry_MP_BC_BINARY_OP_INPLACE_MULTIPLY_FLOAT,
+    #endif
+    [MP_BC_LOAD_SUBSCR_LIST_INT] = &&entry_MP_BC_LOAD_SUBSCR_LIST_INT,
+    [MP_BC_STORE_SUBSCR_LIST_INT] = &&entry_MP_BC_STORE_SUBSCR_LIST_INT,
+    [MP_BC_FOR_ITER_RANGE] = &&entry_MP_BC_FOR_ITER_RANGE,
+    #endif
 };
 
 #if __clang__
@@ -0,0 +1,23 @@
+# test overriding builtins while their loads are cached
+
+try:
+    import builtins
+    builtins.abs = abs
+except (ImportError, AttributeError):
+    print("SKIP")
+    import sys
+    sys.exit()
+
+def f():
+    return abs(-1)
+
+orig_abs = abs
+print(f())
+builtins.abs = lambda x: 'override'
+print(f())
+abs = lambda x: 'global'
+print(f())
+del abs
+print(f())
+builtins.abs = orig_abs
+print(f())
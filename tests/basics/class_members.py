@@ -0,0 +1,47 @@
+# test storing, loading and deleting members of many instances of a class
+
+class A:
+    def __init__(self, i):
+        self.x = i
+        self.y = i * 2
+
+l = [A(i) for i in range(10)]
+print(sum([a.x + a.y for a in l]))
+
+# instances that have different members
+l[1].z = 1
+l[2].w = 2
+del l[3].x
+print(hasattr(l[1], 'z'), hasattr(l[2], 'z'), hasattr(l[3], 'x'), hasattr(l[4], 'x'))
+print(sorted([k for k in dir(l[1]) if not k.startswith('_')]))
+print(sorted([k for k in dir(l[3]) if not k.startswith('_')]))
+try:
+    l[3].x
+except AttributeError:
+    print('AttributeError')
+try:
+    del l[3].x
+except AttributeError:
+    print('AttributeError')
+l[3].x = 30
+print(l[3].x, l[3].y)
+
+# an instance with more members than can be shared
+a = l[5]
+for i in range(50):
+    setattr(a, 'm%d' % i, i)
+print(a.x, a.y, a.m0, a.m49, getattr(a, 'm25'))
+del a.m10
+print(hasattr(a, 'm10'), len([k for k in dir(a) if k.startswith('m')]))
+b = A(100)
+b.m5 = 5
+b.m60 = 60
+print(b.x, b.m5, b.m60, l[6].x)
+
+# subclasses have their own members
+class B(A):
+    def __init__(self, i):
+        self.b = i
+        A.__init__(self, i)
+b = B(7)
+print(b.b, b.x, b.y, hasattr(A(1), 'b'))
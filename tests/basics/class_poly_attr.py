@@ -0,0 +1,55 @@
+# test loading methods and members at the same place from objects of many types
+
+class A:
+    def __init__(self):
+        self.x = 'A.x'
+    def f(self):
+        return 'A.f'
+
+class B:
+    def __init__(self):
+        self.y = 0
+        self.x = 'B.x'
+    def f(self):
+        return 'B.f'
+
+class C(A):
+    def f(self):
+        return 'C.f'
+
+class D(A):
+    pass
+
+class E:
+    __slots__ = ('x',)
+    def __init__(self):
+        self.x = 'E.x'
+    def f(self):
+        return 'E.f'
+
+class L(list):
+    def f(self):
+        return 'L.f'
+
+def run(objs):
+    for o in objs:
+        print(o.f(), o.x)
+        o.x = o.x
+
+objs = [A(), B(), C(), D(), E(), L()]
+objs[-1].x = 'L.x'
+for i in range(2):
+    run(objs)
+
+# a member shadowing a method
+objs[0].f = lambda: 'member f'
+run(objs)
+
+# replacing a method in a base class
+A.f = lambda self: 'new A.f'
+run(objs)
+
+# methods of builtin types
+for o in ([], [1], bytearray(), [2]):
+    o.append(0)
+    print(o)
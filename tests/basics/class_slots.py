@@ -0,0 +1,76 @@
+# test classes with __slots__
+
+class A:
+    __slots__ = ('x', 'y')
+    def __init__(self, x):
+        self.x = x
+
+a = A(1)
+print(a.x)
+
+# a slot that's not set yet
+try:
+    a.y
+except AttributeError:
+    print('AttributeError')
+a.y = 2
+print(a.x, a.y)
+
+# storing something that's not a slot
+try:
+    a.z = 3
+except AttributeError:
+    print('AttributeError')
+
+# deleting a slot
+del a.y
+try:
+    a.y
+except AttributeError:
+    print('AttributeError')
+try:
+    del a.y
+except AttributeError:
+    print('AttributeError')
+a.y = 4
+print(a.x, a.y)
+
+# instances don't share their slots
+b = A(5)
+print(a.x, b.x)
+
+# a single name
+class B:
+    __slots__ = 'v'
+b = B()
+b.v = 6
+print(b.v)
+
+# subclasses add to the slots of their bases
+class C(A):
+    __slots__ = ['z']
+c = C(7)
+c.z = 8
+c.y = 9
+print(c.x, c.y, c.z)
+try:
+    c.w = 10
+except AttributeError:
+    print('AttributeError')
+
+# a subclass without __slots__ can have any member
+class D(A):
+    pass
+d = D(11)
+d.w = 12
+print(d.x, d.w)
+
+# class members are still found, and methods can set slots
+class E:
+    __slots__ = ('a',)
+    k = 13
+    def set(self, v):
+        self.a = v
+e = E()
+e.set(14)
+print(e.a, e.k)
@@ -0,0 +1,63 @@
+# test that changing the attributes of a class is seen by lookups that were done before
+
+class A:
+    def f(self):
+        return 'A.f'
+
+class B(A):
+    pass
+
+class C(B):
+    pass
+
+c = C()
+for i in range(2):
+    print(c.f(), C.f(c))
+
+# override in a base class
+def g(self):
+    return 'B.f'
+B.f = g
+for i in range(2):
+    print(c.f(), C.f(c))
+
+# delete the override
+del B.f
+for i in range(2):
+    print(c.f())
+
+# add a method to the root
+def h(self):
+    return 'A.h'
+try:
+    c.h()
+except AttributeError:
+    print('AttributeError')
+A.h = h
+print(c.h())
+
+# special methods
+class D:
+    def __len__(self):
+        return 1
+
+class E(D):
+    pass
+
+e = E()
+print(len(e), len(e))
+D.__len__ = lambda self: 2
+print(len(e), len(e))
+E.__len__ = lambda self: 3
+print(len(e), len(e))
+
+# class attributes
+class F:
+    x = 1
+
+class G(F):
+    pass
+
+print(G.x, G().x)
+F.x = 2
+print(G.x, G().x)
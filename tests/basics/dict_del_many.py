@@ -0,0 +1,31 @@
+# test dicts with many items deleted and added again
+
+d = {}
+for i in range(1000):
+    d[i] = i
+    d[str(i)] = i
+for i in range(0, 1000, 2):
+    del d[i]
+    del d[str(i + 1)]
+print(len(d), sum(d.values()), 0 in d, 1 in d, "0" in d, "1" in d)
+
+# keep the size the same, so deleted slots must be reused
+for i in range(5000):
+    d[-i - 1] = i
+    del d[-i - 1]
+print(len(d), sum(d.values()), -1 in d)
+
+# delete everything, then add it back
+for k in list(d.keys()):
+    del d[k]
+print(len(d), d)
+for i in range(100):
+    d[i] = -i
+print(len(d), d[0], d[99], sorted(d.keys()) == list(range(100)))
+
+# copy of a dict with deleted items
+for i in range(50):
+    del d[i]
+e = d.copy()
+e[0] = 0
+print(len(d), len(e), e[50], e[0], sorted(e.values())[:3])
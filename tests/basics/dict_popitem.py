@@ -14,3 +14,15 @@ else:
     print("Did not raise KeyError")
 print(sorted(els))
 
+
+# add items after popping some
+d = {1:2, 3:4, 'a':5, (1,2):3}
+d.popitem()
+d[5] = 6
+print(len(d), 5 in d)
+for i in range(30):
+    d[i] = i
+while len(d) > 10:
+    d.popitem()
+d[100] = 100
+print(len(d), d[100])
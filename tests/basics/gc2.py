@@ -0,0 +1,25 @@
+# test that the gc keeps alive objects that overflow its mark stack
+
+try:
+    import gc
+except ImportError:
+    print("SKIP")
+    import sys
+    sys.exit()
+
+# a wide structure, and a deep one
+wide = [[i, [i], (i, str(i))] for i in range(500)]
+deep = None
+for i in range(500):
+    deep = [i, deep]
+
+# allocate some garbage, which may reuse any memory that was wrongly freed
+gc.collect()
+junk = [[0, 0, 0] for i in range(1000)]
+
+print([x for i, x in enumerate(wide) if not (x[0] == i and x[1][0] == i and x[2][1] == str(i))])
+n = 0
+while deep is not None:
+    n += 1
+    deep = deep[1]
+print(n)
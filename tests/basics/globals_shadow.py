@@ -0,0 +1,62 @@
+# loading globals and builtins while globals are added, changed and removed
+
+def f():
+    return len([1, 2])
+
+print(f())
+
+# shadow a builtin with a global, then remove it again
+def len(x):
+    return -1
+print(f())
+del len
+print(f())
+
+# change the value of an existing global
+x = 1
+def g():
+    return x
+print(g())
+x = 2
+print(g())
+
+# remove a global and add it again
+del x
+try:
+    g()
+except NameError:
+    print('NameError')
+x = 3
+print(g())
+
+# add other globals, so that the globals dict grows
+for i in range(20):
+    globals()['y%d' % i] = i
+print(g(), f())
+print(y19)
+for i in range(20):
+    del globals()['y%d' % i]
+print(g(), f())
+
+# load in a loop while a global changes
+def h(n):
+    s = 0
+    for i in range(n):
+        s += x
+    return s
+x = 4
+print(h(5))
+x = 5
+print(h(5))
+
+# load a name at module level
+z = 10
+for i in range(3):
+    z = z + i
+print(z)
+
+# the globals of exec aren't versioned
+gl = {'x': 6}
+for i in range(2):
+    exec('print(x)', gl)
+    gl['x'] = 7
@@ -0,0 +1,86 @@
+# test opcodes that are specialised for the operands they see, and change back
+
+def arith(a, b):
+    return a + b, a - b, a * b, a < b, a > b, a == b, a <= b, a >= b, a != b
+
+def inplace(a, b):
+    a += b
+    a -= b
+    a *= b
+    return a
+
+for args in ((1, 2), (3, 3), (1.5, 2), (2, 0.5), (2.5, 0.5), ('a', 'b'), ([1], [2]), (1, 2), (1 << 80, 1), (2, 3.0)):
+    try:
+        print(arith(*args))
+    except TypeError:
+        print('TypeError')
+    try:
+        print(inplace(*args))
+    except TypeError:
+        print('TypeError')
+
+# overflow of small ints
+def add(a, b):
+    return a + b
+x = 1
+for i in range(80):
+    x = add(x, x)
+print(x)
+def sub(a, b):
+    return a - b
+x = -1
+for i in range(80):
+    x = sub(x, -x)
+print(x)
+
+# in-place ops on lists must stay in-place
+def iadd(a, b):
+    a += b
+    return a
+print(iadd(1, 2))
+l = [1]
+print(iadd(l, [2]), l)
+print(iadd(1.5, 2))
+
+# subscripts of lists, including negative and out of range indices
+def load(l, i):
+    return l[i]
+def store(l, i, v):
+    l[i] = v
+class List(list):
+    def __getitem__(self, i):
+        return 'List'
+    def __setitem__(self, i, v):
+        print('List set', i, v)
+l = [1, 2, 3]
+for i in (0, 2, -1, -3):
+    print(load(l, i))
+    store(l, i, i * 10)
+print(l)
+for i in (3, -4):
+    try:
+        load(l, i)
+    except IndexError:
+        print('IndexError')
+    try:
+        store(l, i, 0)
+    except IndexError:
+        print('IndexError')
+print(load((4, 5), 1), load({1: 'a'}, 1), load(List([1]), 0), load('abc', True))
+store(List([1]), 0, 1)
+print(load(l, 0))
+
+# deleting list items shares the store opcode, with a NULL value
+def delete(l, n):
+    for _ in range(n):
+        del l[0]
+    return l
+print(delete([1, 2, 3, 4, 5], 3), delete([1, 2], 2))
+
+# iterating over ranges and other iterables
+def total(it):
+    s = 0
+    for x in it:
+        s += x
+    return s
+print(total(range(10)), total(range(10, 0, -3)), total(range(0)), total([1, 2]), total(range(3)))
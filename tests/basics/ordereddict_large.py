@@ -0,0 +1,51 @@
+# test OrderedDict with enough items that lookups use a hash index
+
+try:
+    from collections import OrderedDict
+except ImportError:
+    try:
+        from ucollections import OrderedDict
+    except ImportError:
+        print("SKIP")
+        import sys
+        sys.exit()
+
+d = OrderedDict()
+for i in range(200):
+    d[i] = i * 2
+    d["s%d" % i] = i
+print(len(d), d[0], d[199], d["s0"], d["s199"])
+print(list(d.keys())[:6], list(d.keys())[-4:])
+
+# lookups of keys that aren't in the dict
+print(200 in d, "s200" in d, d.get("x"), d.get((1, 2), "missing"))
+
+# keys that are equal but not the same object
+print(d["s%d" % 150], d[10 ** 1 + 5])
+
+# delete and re-add, and replace existing items
+for i in range(0, 200, 3):
+    del d[i]
+for i in range(0, 200, 6):
+    d[i] = -i
+d["s5"] = "five"
+print(len(d), d.get(3), d[6], d[7], d["s5"])
+print(list(d.keys())[-3:], list(d.values())[-3:])
+
+# copy and pop
+e = d.copy()
+print(len(e), e[6], e["s100"], e == d)
+for i in range(1, 200, 3):
+    e.pop(i)
+print(len(e), 1 in e, 2 in e, len(d))
+
+# unhashable keys are rejected
+try:
+    d[[1]] = 1
+except TypeError:
+    print("TypeError")
+
+# many keyword arguments
+def f(**kw):
+    return len(kw), kw["a40"], kw.get("a80")
+print(f(**{"a%d" % i: i for i in range(50)}))
@@ -0,0 +1,18 @@
+# cmdline: -X heapsize=64k -X heapmax=1m
+# test gc.callback with a function that allocates, when collections are caused
+# by the list it appends to growing (so the collection happens in m_renew)
+import gc
+log = []
+def cb():
+    log.append(-1)
+gc.callback(cb)
+for i in range(20000):
+    log.append(i)
+gc.callback(None)
+n = 0
+ok = True
+for x in log:
+    if x >= 0:
+        ok = ok and x == n
+        n += 1
+print(len(log) > n, ok and n == 20000)
@@ -0,0 +1,12 @@
+# cmdline: -X heapsize=64k -X heapmax=1m
+# test that the heap grows until it's close to its maximum size, even when
+# growing by half its size at a time would go over the maximum
+l = []
+try:
+    while True:
+        l.append(bytearray(1000))
+except MemoryError:
+    pass
+n = len(l)
+l = None
+print(n > 850)
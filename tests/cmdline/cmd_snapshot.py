@@ -0,0 +1,38 @@
+# test saving the heap to a snapshot and starting again from it (the test is
+# run twice by run-tests, the first time with "save" as an argument)
+import sys
+import ustruct
+import array
+
+if sys.argv[1:] == ['save']:
+    class A:
+        def __init__(self, x):
+            self.x = x
+        def get(self):
+            return self.x * 2
+
+    def f(n):
+        return [i * i for i in range(n)]
+
+    a = A(21)
+    lst = [1, 'abc', (2, 3), {'k': b'v'}]
+    lst.append(lst)
+    name = 'snapshot_' + 'qstr'
+    setattr(a, name, 42)
+
+    # raw data that holds addresses of objects, which must not change
+    x = []
+    ref = ustruct.pack('P', id(x))
+    raw = list(ref)
+    buf = bytearray(ref * 2)
+    arr = array.array('P', [id(x), id(lst), id(a)])
+    arr_raw = list(bytes(arr))
+    flt = ustruct.unpack('d', ustruct.pack('Q', id(lst)))[0]
+    flt_raw = list(ustruct.pack('d', flt))
+    print('saved')
+else:
+    print(a.get(), f(5), lst[:4], lst[4] is lst, getattr(a, 'snapshot_qstr'))
+    print(list(ref) == raw, list(buf) == raw * 2)
+    print(list(bytes(arr)) == arr_raw, list(ustruct.pack('d', flt)) == flt_raw)
+    x.append(1)
+    print(x, len(sys.argv))
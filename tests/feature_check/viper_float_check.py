@@ -0,0 +1,4 @@
+# this test for native floats in the viper emitter
+@micropython.viper
+def f(x:float) -> float:
+    return x
@@ -0,0 +1,45 @@
+# test micropython.alloc_profile
+
+import micropython
+
+try:
+    micropython.alloc_profile
+except AttributeError:
+    print("SKIP")
+    import sys
+    sys.exit()
+
+class A:
+    pass
+
+def f():
+    l = []
+    for i in range(10):
+        l.append(A())
+    return l
+
+micropython.alloc_profile('start')
+f()
+micropython.alloc_profile('stop')
+sites, types = micropython.alloc_profile('snapshot')
+
+# the instances are attributed to the line creating them
+print(10 in [count for file, line, name, count, n_bytes in sites if name == 'f' and line == 18])
+
+# and to the type A
+for t, count, n_bytes in types:
+    if t is A:
+        print(count, n_bytes > 0)
+
+# sorted by number of bytes
+print([s[4] for s in sites] == sorted([s[4] for s in sites], reverse=True))
+print([t[2] for t in types] == sorted([t[2] for t in types], reverse=True))
+
+# nothing is recorded after stopping
+f()
+print(micropython.alloc_profile('snapshot') == (sites, types))
+
+try:
+    micropython.alloc_profile('foo')
+except ValueError:
+    print('ValueError')
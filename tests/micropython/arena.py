@@ -0,0 +1,58 @@
+# test micropython.arena
+
+import micropython, gc
+
+try:
+    micropython.arena
+except AttributeError:
+    print("SKIP")
+    import sys
+    sys.exit()
+
+# temporary objects are reclaimed when the arena exits
+def work(n):
+    total = 0
+    for i in range(n):
+        total += len(str(i) + "x")
+    return total
+
+with micropython.arena(4096) as a:
+    print(work(50))
+
+# objects that escape the arena survive as ordinary heap objects
+keep = []
+with micropython.arena(4096) as a:
+    for i in range(20):
+        keep.append([i, str(i)])
+print(a.escaped() > 0)
+gc.collect()
+print(keep[0], keep[19])
+
+# nested arenas
+with micropython.arena(4096) as a:
+    outer = [1, 2, 3]
+    with micropython.arena(2048) as b:
+        inner = (4, 5)
+        outer.append(inner)
+    print(outer)
+print(outer)
+
+# an allocation larger than the arena comes from the heap
+with micropython.arena(1024):
+    big = bytearray(4096)
+print(len(big))
+
+# arenas can't be entered twice
+a = micropython.arena(1024)
+with a:
+    try:
+        with a:
+            pass
+    except ValueError:
+        print("ValueError")
+
+# invalid size
+try:
+    micropython.arena(0)
+except ValueError:
+    print("ValueError")
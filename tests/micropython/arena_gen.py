@@ -0,0 +1,39 @@
+# test micropython.arena in generators
+
+import micropython, gc
+
+try:
+    micropython.arena
+except AttributeError:
+    print("SKIP")
+    import sys
+    sys.exit()
+
+# the caller of a generator suspended in an arena doesn't allocate from it
+a = micropython.arena(4096)
+def gen():
+    with a:
+        yield 1
+        yield 2
+g = gen()
+print(next(g))
+x = [1, 2, 3]
+print(list(g))
+print(a.escaped(), x)
+
+# generators suspended in an arena and then dropped
+def gen2():
+    with micropython.arena(4096):
+        l = [1]
+        yield l
+        yield 2
+def run():
+    g = gen2()
+    next(g)
+for i in range(20):
+    run()
+    gc.collect()
+    l = [str(j) for j in range(100)]
+print(l[-1])
+with micropython.arena(1024):
+    print([1, 2, 3])
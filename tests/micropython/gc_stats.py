@@ -0,0 +1,34 @@
+# test gc.stats() and gc.callback()
+
+import gc
+
+try:
+    gc.stats
+except AttributeError:
+    print("SKIP")
+    import sys
+    sys.exit()
+
+s0 = gc.stats()
+print(sorted(s0.keys()))
+print(len(s0['free_runs']))
+
+calls = []
+def cb():
+    calls.append(gc.stats()['collections'])
+
+gc.callback(cb)
+l = [[i] for i in range(100)]
+l = None
+gc.collect()
+gc.collect()
+gc.callback(None)
+gc.collect()
+
+s = gc.stats()
+print(calls == [s0['collections'] + 1, s0['collections'] + 2])
+print(s['collections'] == s0['collections'] + 3)
+print(s['mark_us'] >= s['mark_us_max'] >= 0, s['sweep_us'] >= s['sweep_us_max'] >= 0)
+print(s['reclaimed_total'] > s0['reclaimed_total'])
+print(s['reclaimed_bytes'] >= s['reclaimed_blocks'])
+print(sum(s['free_runs']) > 0)
@@ -0,0 +1,61 @@
+# test a mark followed by an incremental sweep, with gc.mark and gc.sweep_step
+
+import gc
+
+try:
+    gc.sweep_step
+except AttributeError:
+    print("SKIP")
+    import sys
+    sys.exit()
+
+gc.collect()
+
+# create some garbage, keeping some live objects
+live = []
+for i in range(200):
+    l = [i] * 100
+    if i % 10 == 0:
+        live.append(l)
+l = None
+
+# the mark alone reclaims nothing; the sweep is done in several steps, each of
+# a bounded amount of work, and then reclaims the garbage
+free = gc.mem_free()
+gc.mark()
+print(gc.mem_free() <= free)
+free = gc.mem_free()
+n = 1
+while not gc.sweep_step(0):
+    n += 1
+print(n > 1, gc.mem_free() - free >= 190 * 100 * 4)
+print(gc.sweep_step(0))
+
+# live objects are intact
+def check():
+    total = 0
+    for l in live:
+        if len(l) != 100 or l[99] != l[0]:
+            return False
+        total += l[0]
+    return total
+print(len(live), check())
+
+# allocate while a sweep is pending
+gc.mark()
+d = {}
+for i in range(100):
+    d[i] = str(i)
+print(len(d), d[42])
+print(len(live), check())
+
+# a full collection finishes any pending sweep
+gc.mark()
+gc.collect()
+print(gc.sweep_step(0))
+
+# the budget can't be negative, which would make it unlimited
+try:
+    gc.sweep_step(-1)
+except ValueError:
+    print('ValueError')
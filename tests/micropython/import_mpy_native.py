@@ -0,0 +1,74 @@
+# test importing a native module written in C, from a .mpy file made by
+# tools/mpy_ld.py from examples/natmod/checksum.c for unix on x86-64
+
+import sys
+try:
+    import uos as os
+except ImportError:
+    import os
+if not hasattr(os, 'unlink'):
+    print('SKIP')
+    sys.exit()
+
+mpy = (
+    b'\x4d\x01\x0b\x3f\xb0\x42\xe9\x07\x01\x00\x00\x55\x48\x89\xfd\xba'
+    b'\x01\x00\x00\x00\x53\x48\x89\xf3\x48\x83\xec\x28\x48\x8b\x3b\x48'
+    b'\x8d\x74\x24\x08\xe8\x9d\x05\x00\x00\xbf\x01\x00\x00\x00\x48\x83'
+    b'\xfd\x01\x76\x0b\x48\x8b\x7b\x08\xe8\x8f\x05\x00\x00\x89\xc7\x4c'
+    b'\x8b\x4c\x24\x08\x48\x8b\x74\x24\x10\x0f\xb7\xcf\x41\xb8\xf1\xff'
+    b'\x00\x00\xc1\xef\x10\x48\x85\xf6\x74\x3a\xb8\xb0\x15\x00\x00\x48'
+    b'\x39\xc6\x48\x0f\x46\xc6\x31\xd2\x48\x29\xc6\x45\x0f\xb6\x14\x11'
+    b'\x48\xff\xc2\x44\x01\xd1\x01\xcf\x48\x39\xd0\x75\xee\x49\x01\xc1'
+    b'\x31\xd2\x89\xc8\x41\xf7\xf0\x89\xf8\x89\xd1\x31\xd2\x41\xf7\xf0'
+    b'\x89\xd7\xeb\xc1\xc1\xe7\x10\x09\xcf\xe8\x34\x05\x00\x00\x48\x83'
+    b'\xc4\x28\x5b\x5d\xc3\x55\x48\x89\xfd\xba\x01\x00\x00\x00\x53\x48'
+    b'\x89\xf3\x48\x83\xec\x28\x48\x8b\x3b\x48\x8d\x74\x24\x08\xe8\x03'
+    b'\x05\x00\x00\x31\xff\x48\x83\xfd\x01\x76\x0b\x48\x8b\x7b\x08\xe8'
+    b'\xf8\x04\x00\x00\x89\xc7\x48\x8b\x74\x24\x08\x48\x8b\x4c\x24\x10'
+    b'\xf7\xd7\x31\xc0\x4c\x8d\x05\xdb\x00\x00\x00\x48\x39\xc1\x74\x14'
+    b'\x8a\x14\x06\x48\xff\xc0\x31\xfa\xc1\xef\x08\x0f\xb6\xd2\x41\x33'
+    b'\x3c\x90\xeb\xe7\xf7\xd7\xe8\xc7\x04\x00\x00\x48\x83\xc4\x28\x5b'
+    b'\x5d\xc3\x51\x31\xd2\x48\x8d\x35\xaa\x00\x00\x00\x89\xd0\xb9\x08'
+    b'\x00\x00\x00\x89\xc7\x83\xe0\x01\xf7\xd8\xd1\xef\x25\x20\x83\xb8'
+    b'\xed\x31\xf8\xff\xc9\x75\xec\x89\x04\x96\x48\xff\xc2\x48\x81\xfa'
+    b'\x00\x01\x00\x00\x75\xd6\x48\x8b\x3d\xa9\x04\x00\x00\x48\x8d\x35'
+    b'\x42\x00\x00\x00\xe8\x7f\x04\x00\x00\x48\x8b\x3d\xa6\x04\x00\x00'
+    b'\x48\x8d\x35\x0f\x00\x00\x00\xe8\x6c\x04\x00\x00\x48\x8b\x05\x9b'
+    b'\x04\x00\x00\x5a\xc3\x00\x00\x00\x00\x00\x00\x00\x00\x00\x02\x00'
+    b'\x02\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00'
+    b'\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x02\x00'
+    b'\x02'
+    + bytes(1061)
+    + b'\xff\x25\x12\x00\x00\x00\xff\x25\x14\x00\x00\x00\xff\x25\x16\x00'
+    b'\x00\x00\xff\x25\x20'
+    + bytes(64)
+    + b'\x0b\x97\x03\x2d\x98\x06\x05\x99\x03\x2d\x9a\x06\x81\x1f\xdd\x43'
+    b'\x36\xde\x03\x2f\xde\x43\x31\xdf\x00\x05\x63\x72\x63\x33\x32\xdf'
+    b'\x43\x07\xe0\x00\x07\x61\x64\x6c\x65\x72\x33\x32\xe0\x44\x00'
+)
+
+with open('checksum_natmod.mpy', 'wb') as f:
+    f.write(mpy)
+sys.path.insert(0, '')
+try:
+    import checksum_natmod as checksum
+except ValueError:
+    # not an x86-64 build, or the .mpy doesn't match its config
+    print('SKIP')
+    sys.exit()
+finally:
+    os.unlink('checksum_natmod.mpy')
+    sys.path.pop(0)
+
+print(checksum.crc32(b''), checksum.crc32(b'123456789'))
+print(checksum.crc32(b'world', checksum.crc32(b'hello ')))
+print(checksum.adler32(b''), checksum.adler32(b'abc'))
+print(checksum.adler32(b'x' * 10000), checksum.adler32(bytearray(b'x' * 10000), 1))
+try:
+    checksum.crc32(1)
+except TypeError:
+    print('TypeError')
+try:
+    checksum.adler32()
+except TypeError:
+    print('TypeError')
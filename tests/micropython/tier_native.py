@@ -0,0 +1,152 @@
+# test that functions behave the same once they're called often enough to be
+# promoted to native code
+
+N = 1200
+
+def run(f, *args):
+    r = None
+    for i in range(N):
+        r = f(*args)
+    return r
+
+# small int arithmetic that overflows into big ints
+def add(a, b):
+    return a + b
+def sub(a, b):
+    return a - b
+run(add, 1, 2)
+run(sub, 1, 2)
+print(add(1, 2), add(0x3fffffff, 0x3fffffff), add(0x3fffffffffffffff, 1))
+print(sub(1, 2), sub(-0x3fffffffffffffff, 2), sub(-0x4000000000000000, 1))
+print(add(1.5, 2), add('a', 'b'), sub(5, True))
+
+# comparisons of small ints and other objects
+class C:
+    def __lt__(self, other):
+        return 'lt'
+def lt(a, b):
+    return a < b
+def cmp(a, b):
+    return (a < b, a > b, a == b, a <= b, a >= b, a != b)
+run(lt, 1, 2)
+run(cmp, 1, 2)
+print(cmp(1, 2), cmp(2, 1), cmp(-3, -3))
+print(cmp(1.5, 1), cmp('a', 'b'), cmp(1 << 70, 1))
+print(lt(C(), 1))
+
+# truth of comparisons and of other objects in conditions
+def count(a, n):
+    c = 0
+    while n > 0:
+        if a:
+            c += 1
+        n -= 1
+    return c
+run(count, True, 3)
+print(count(True, 3), count(False, 3), count([1], 3), count('', 3), count(None, 3))
+
+# globals, including after they've been stored to and deleted
+g = 1
+def get_g():
+    return g + len('ab')
+run(get_g)
+print(get_g())
+g = 10
+print(get_g())
+del g
+try:
+    get_g()
+except NameError:
+    print('NameError')
+g = 100
+print(get_g())
+
+# attributes and methods, including after the class changes
+class A:
+    k = 5
+    def __init__(self, x):
+        self.x = x
+    def m(self):
+        return self.x + 1
+def attrs(a):
+    a.x += 1
+    return a.x + a.m() + a.k
+a = A(0)
+run(attrs, a)
+print(a.x, attrs(a))
+A.m = lambda self: -1
+A.k = 50
+print(attrs(a), attrs(A(0)))
+print(attrs(type('B', (), {'x': 1, 'm': lambda self: 2, 'k': 3})()))
+
+# unbound and deleted locals
+def unbound(c):
+    if c:
+        x = 1
+    return x
+def deleted():
+    x = 1
+    del x
+    return x
+run(unbound, 1)
+print(unbound(1))
+try:
+    unbound(0)
+except NameError:
+    print('NameError')
+for i in range(N):
+    try:
+        deleted()
+    except NameError:
+        pass
+try:
+    deleted()
+except NameError:
+    print('NameError')
+
+# locals that change in a try before an exception is caught
+def exc(n):
+    v = 1
+    try:
+        v = 2
+        n = n // 0
+    except ZeroDivisionError:
+        pass
+    return v
+run(exc, 1)
+print(exc(1))
+
+# exceptions get the same traceback as from the bytecode
+import sys
+try:
+    import uio as io
+except ImportError:
+    import io
+def raiser(n):
+    n += 1
+    if n > N:
+        raise ValueError(n)
+    return n
+def call_raiser(n):
+    return raiser(n) + 1
+for i in range(N + 1):
+    try:
+        call_raiser(i)
+    except ValueError as e:
+        buf = io.StringIO()
+        sys.print_exception(e, buf)
+        # the file name differs when the test is run from a .mpy
+        print([l.split(', ', 1)[-1] for l in buf.getvalue().split('\n')[2:4]])
+
+# default args, keyword args and closures
+def defaults(a, b=2, *, c=3):
+    return a + b + c
+run(defaults, 1)
+print(defaults(1), defaults(1, 5), defaults(1, c=7))
+def make_adder(n):
+    return lambda x: x + n
+run(make_adder(1), 1)
+print(run(make_adder(2), 1), make_adder(3)(1))
+
+# the function is still the same object
+print(add.__name__, type(add) == type(exc))
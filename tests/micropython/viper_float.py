@@ -0,0 +1,101 @@
+# test viper with native floats, and loads and stores on float arrays
+
+import array
+
+# arguments, return values and constants
+@micropython.viper
+def arith(x:float, y:float) -> float:
+    return (x + y) * 2.0 - y / 4.0
+print(arith(1.5, 2.0), arith(1, 2))
+
+# int operands are promoted, and casts convert the value
+@micropython.viper
+def mixed(x:float, n:int) -> float:
+    return x * n + n - float(n) / 8
+print(mixed(0.5, 4))
+
+@micropython.viper
+def to_int(x:float) -> int:
+    return int(x)
+print(to_int(3.7), to_int(-3.7), to_int(0.25))
+
+@micropython.viper
+def from_obj(x) -> float:
+    return float(x)
+print(from_obj(2), from_obj(2.5))
+
+# comparisons, including with nan
+@micropython.viper
+def cmp(a:float, b:float):
+    return (a < b, a > b, a == b, a <= b, a >= b, a != b)
+print(cmp(1.0, 2.0))
+print(cmp(2.0, 1.0))
+print(cmp(1.0, 1.0))
+print(cmp(float('nan'), 1.0))
+
+# unary ops
+@micropython.viper
+def neg(x:float) -> float:
+    return -x
+print(neg(2.5), neg(0.0), neg(-0.0), +neg(1.0))
+
+# floats are converted to objects when needed
+@micropython.viper
+def objs(x:float):
+    y = x * 2
+    print(y, 0.5)
+    return (y, [x])
+print(objs(1.25))
+
+# float constants are objects where they meet objects
+@micropython.viper
+def const_obj(o):
+    x = o
+    x = 1.5
+    return (o * 0.5, o < 0.5, 0.5 + o, x)
+print(const_obj(3), const_obj(0.25))
+@micropython.viper
+def const_ret():
+    return 2.5
+print(const_ret())
+
+# a filter over float arrays, without allocating
+@micropython.viper
+def fir(src, dest, n:int, k:float) -> float:
+    s = ptrf32(src)
+    d = ptrf64(dest)
+    prev = 0.0
+    total = 0.0
+    for i in range(n):
+        x = s[i]
+        y = k * x + (1.0 - k) * prev
+        d[i] = y
+        total += y
+        prev = x
+    return total
+src = array.array('f', [1, 2, 4, 8])
+dest = array.array('d', [0, 0, 0, 0])
+print(fir(src, dest, 4, 0.5), dest)
+
+# int values are converted when stored, and float32 stores round
+@micropython.viper
+def store(buf, x:float):
+    p = ptrf32(buf)
+    p[0] = 3
+    p[1] = x
+buf = array.array('f', [0, 0])
+store(buf, 1 / 3)
+print(buf[0], buf[1] == array.array('f', [1 / 3])[0])
+
+# type errors
+def test(code):
+    try:
+        exec(code)
+    except ViperTypeError as e:
+        print(repr(e))
+test("@micropython.viper\ndef f(x:float):\n    if x: pass")
+test("@micropython.viper\ndef f(x:float, p:ptr8):\n    x + p")
+test("@micropython.viper\ndef f(x:float):\n    x // 2")
+test("@micropython.viper\ndef f(x:float):\n    ptr8(x)")
+test("@micropython.viper\ndef f():\n    x = 1\n    x = 1.5")
+test("@micropython.viper\ndef f(p:ptrf32, x:float):\n    p[x] = 1.0")
@@ -0,0 +1,71 @@
+# test viper and native functions with more locals than registers
+
+@micropython.viper
+def many(a:int, b:int, c:int, d:int) -> int:
+    e = a + b
+    f = c + d
+    g = e * f
+    h = g - a
+    i = h + b
+    j = i * 2
+    return a + b + c + d + e + f + g + h + i + j
+
+print(many(1, 2, 3, 4))
+
+# locals that are only used in turn may share a register
+@micropython.viper
+def shared(n:int) -> int:
+    x = n + 1
+    y = x * 2
+    z = y + 3
+    w = z * 4
+    v = w + 5
+    return v
+
+print(shared(10))
+
+# values that live around the loop, including one set on some iterations only
+@micropython.viper
+def loop(buf:ptr8, n:int) -> int:
+    total = 0
+    prev = 0
+    last = 0
+    for i in range(n):
+        x = buf[i]
+        if x & 1:
+            last = x
+        total += x * prev + last
+        prev = x
+    return total + i
+
+print(loop(bytearray([1, 2, 3, 4, 5]), 5))
+
+@micropython.viper
+def copy(dest:ptr32, src:ptr32, n:int):
+    i = 0
+    while i < n:
+        a = src[i]
+        b = a + 1
+        c = b * 2
+        dest[i] = c - a
+        i += 1
+
+src = bytearray(16)
+dest = bytearray(16)
+for k in range(4):
+    src[4 * k] = k
+copy(dest, src, 4)
+print([dest[4 * k] for k in range(4)])
+
+# locals stay in registers across calls
+@micropython.native
+def calls(l):
+    a = len(l)
+    b = a + 1
+    c = b + 1
+    d = str(c)
+    e = int(d) + a
+    f = [a, b, c, d, e]
+    return f
+
+print(calls([1, 2]))
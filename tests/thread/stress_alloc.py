@@ -0,0 +1,39 @@
+# stress test for small allocations within threads, keeping the objects alive
+# across garbage collections and checking they are still intact
+#
+# MIT license; Copyright (c) 2016 Damien P. George on behalf of Pycom Ltd
+
+import _thread
+
+def thread_entry(n, k):
+    ok = True
+    for r in range(n):
+        # build a linked list of small objects
+        l = None
+        for i in range(100):
+            l = (i, [i * k], l, 0.5 * i)
+
+        # walk it and check each element
+        i = 99
+        while l is not None:
+            ok = ok and l[0] == i and l[1][0] == i * k and l[3] == 0.5 * i
+            l = l[2]
+            i -= 1
+
+    # print the result and indicate we are finished
+    with lock:
+        print(ok)
+        global n_finished
+        n_finished += 1
+
+lock = _thread.allocate_lock()
+n_thread = 4
+n_finished = 0
+
+# spawn threads
+for i in range(n_thread):
+    _thread.start_new_thread(thread_entry, (100, i))
+
+# busy wait for threads to finish
+while n_finished < n_thread:
+    pass
@@ -0,0 +1,42 @@
+# test looking up strings while other threads intern new ones, which makes the
+# qstr hash index grow
+
+import _thread
+
+class A:
+    pass
+
+# intern new names, as attributes of an object
+def intern(base, n):
+    for i in range(n):
+        if i % 100 == 0:
+            o = A()
+        setattr(o, 'n%d_%d' % (base, i), i)
+    assert getattr(o, 'n%d_%d' % (base, n - 1)) == n - 1
+    with lock:
+        global n_finished
+        n_finished += 1
+
+# make strings, which looks for an existing qstr, until the names are interned
+def lookup():
+    global n_finished
+    i = 0
+    while n_finished < 2:
+        assert int(str(i)) == i
+        i += 1
+    with lock:
+        n_finished += 1
+
+lock = _thread.allocate_lock()
+n_finished = 0
+n = 4000
+
+for i in range(2):
+    _thread.start_new_thread(intern, (i, n))
+    _thread.start_new_thread(lookup, ())
+
+# busy wait for threads to finish
+while n_finished < 4:
+    pass
+
+print('pass')
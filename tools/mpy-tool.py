@@ -420,7 +420,10 @@ def read_bytecode_qstrs(file, bytecode, ip):
         ip += sz
 
 def read_raw_code(f):
-    bc_len = read_uint(f)
+    kind_len = read_uint(f)
+    if kind_len & 3 != 0:
+        raise Exception('native code is not supported')
+    bc_len = kind_len >> 2
     bytecode = bytearray(f.read(bc_len))
     ip, ip2, prelude = extract_prelude(bytecode)
     read_qstr_and_pack(f, bytecode, ip2) # simple_name
@@ -438,7 +441,7 @@ def read_mpy(filename):
         header = bytes_cons(f.read(4))
         if header[0] != ord('M'):
             raise Exception('not a valid .mpy file')
-        if header[1] != 0:
+        if header[1] != 1:
             raise Exception('incompatible version')
         feature_flags = header[2]
         config.MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE = (feature_flags & 1) != 0
@@ -0,0 +1,438 @@
+#!/usr/bin/env python3
+#
+# This file is part of the MicroPython project, http://micropython.org/
+#
+# The MIT License (MIT)
+#
+# Copyright (c) 2016 Damien P. George
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+
+# Links native modules written in C into .mpy files.
+#
+# The C code is compiled to position-independent x86-64 object files (see
+# py/natmod.h and examples/natmod), and this tool puts their sections one
+# after the other in the machine code of a viper function that takes no
+# arguments and jumps to mpy_init.  References between the sections are
+# resolved here.  References to the runtime go through a table of words after
+# the code, like the GOT of a shared library, and the loader fills in these
+# words using the same relocations as native code saved by mpy-cross.
+#
+# It can also generate the header that defines MP_QSTR_xxx for the qstrs that
+# the C code uses:
+#
+#     mpy_ld.py --qstrs build/genhdr/natmod_qstrs.h module.c
+#     mpy_ld.py -o module.mpy build/module.o
+
+import sys
+import re
+import struct
+
+# these must match the values in py/persistentcode.c and py/emitglue.h
+MPY_VERSION = 1
+MP_NATIVE_ARCH_X64 = 2
+MP_CODE_NATIVE_VIPER = 2 # relative to MP_CODE_BYTECODE
+RELOC_QSTR = 0
+RELOC_QSTR_OBJ = 1
+RELOC_FUN_TABLE = 2
+RELOC_FUN = 3
+RELOC_CONST_OBJ = 4
+RELOC_CONST_TABLE = 5
+RELOC_CODE = 6
+
+# the entries of mp_fun_table that native modules can use, in order; this
+# must match the enum in py/runtime0.h, up to MP_F_RAISE_TYPE_ERROR
+FUN_TABLE = [
+    'mp_convert_obj_to_native',
+    'mp_convert_native_to_obj',
+    'mp_load_name',
+    'mp_load_global',
+    'mp_load_build_class',
+    'mp_load_attr',
+    'mp_load_method',
+    'mp_store_name',
+    'mp_store_global',
+    'mp_store_attr',
+    'mp_obj_subscr',
+    'mp_obj_is_true',
+    'mp_unary_op',
+    'mp_binary_op',
+    'mp_obj_new_tuple',
+    'mp_obj_new_list',
+    'mp_obj_list_append',
+    'mp_obj_new_dict',
+    'mp_obj_dict_store',
+    'mp_obj_new_set',
+    'mp_obj_set_store',
+    'mp_make_function_from_raw_code',
+    'mp_native_call_function_n_kw',
+    'mp_call_method_n_kw',
+    'mp_call_method_n_kw_var',
+    'mp_getiter',
+    'mp_iternext',
+    'nlr_push',
+    'nlr_pop',
+    'mp_native_raise',
+    'mp_import_name',
+    'mp_import_from',
+    'mp_import_all',
+    'mp_obj_new_slice',
+    'mp_unpack_sequence',
+    'mp_unpack_ex',
+    'mp_delete_name',
+    'mp_delete_global',
+    'mp_obj_new_cell',
+    'mp_make_closure_from_raw_code',
+    'mp_setup_code_state',
+    'mp_type_fun_builtin_0',
+    'mp_type_fun_builtin_1',
+    'mp_type_fun_builtin_2',
+    'mp_type_fun_builtin_3',
+    'mp_type_fun_builtin_var',
+    'mp_arg_check_num',
+    'mp_obj_get_int',
+    'mp_obj_new_int',
+    'mp_obj_new_int_from_uint',
+    'mp_obj_len',
+    'mp_obj_str_get_data',
+    'mp_obj_new_str',
+    'mp_obj_new_bytes',
+    'mp_get_buffer_raise',
+    'm_malloc',
+    'mp_raise_ValueError',
+    'mp_raise_TypeError',
+]
+
+# the objects that the loader knows, as mp_native_const_obj_t
+CONST_OBJS = {
+    'mp_const_none_obj': 0,
+    'mp_const_false_obj': 1,
+    'mp_const_true_obj': 2,
+    'mp_const_ellipsis_obj': 3,
+}
+
+QSTR_PREFIX = 'mp_natmod_qstr_'
+
+# ELF constants
+SHT_PROGBITS = 1
+SHT_RELA = 4
+SHT_NOBITS = 8
+SHF_WRITE = 1
+SHF_ALLOC = 2
+SHF_EXECINSTR = 4
+SHN_UNDEF = 0
+SHN_LORESERVE = 0xff00
+SHN_COMMON = 0xfff2
+STB_LOCAL = 0
+EM_X86_64 = 62
+R_X86_64_64 = 1
+R_X86_64_PC32 = 2
+R_X86_64_PLT32 = 4
+R_X86_64_GOTPCREL = 9
+R_X86_64_32 = 10
+R_X86_64_32S = 11
+R_X86_64_GOTPCRELX = 41
+R_X86_64_REX_GOTPCRELX = 42
+
+class LinkError(Exception):
+    pass
+
+class Section:
+    def __init__(self, obj, index, name, type, flags, data, size, align):
+        self.obj = obj
+        self.index = index
+        self.name = name
+        self.type = type
+        self.flags = flags
+        self.data = data
+        self.size = size
+        self.align = max(align, 1)
+        self.addr = None # where it goes in the code
+
+class Symbol:
+    def __init__(self, name, bind, shndx, value):
+        self.name = name
+        self.bind = bind
+        self.shndx = shndx
+        self.value = value
+
+class ObjectFile:
+    def __init__(self, filename):
+        self.filename = filename
+        with open(filename, 'rb') as f:
+            data = f.read()
+        if data[:4] != b'\x7fELF' or data[4] != 2 or data[5] != 1:
+            raise LinkError('%s: not a 64-bit little-endian ELF file' % filename)
+        (e_type, e_machine, _, _, _, e_shoff, _, _, _, _, e_shentsize, e_shnum,
+            e_shstrndx) = struct.unpack_from('<HHIQQQIHHHHHH', data, 16)
+        if e_type != 1 or e_machine != EM_X86_64:
+            raise LinkError('%s: not an x86-64 relocatable object file' % filename)
+
+        # read the section headers, then the names of the sections
+        headers = []
+        for i in range(e_shnum):
+            headers.append(struct.unpack_from('<IIQQQQIIQQ', data, e_shoff + i * e_shentsize))
+        strtab = headers[e_shstrndx]
+        def get_str(table, off):
+            start = table[4] + off
+            return data[start:data.index(b'\0', start)].decode()
+
+        self.sections = {}
+        self.relas = []
+        symtab = None
+        for i, (name, type, flags, _, offset, size, link, info, align, _) in enumerate(headers):
+            name = get_str(strtab, name)
+            if type == SHT_RELA:
+                self.relas.append((info, data[offset:offset + size]))
+            elif type == 2: # SHT_SYMTAB
+                symtab = (offset, size, headers[link])
+            elif flags & SHF_ALLOC and type in (SHT_PROGBITS, SHT_NOBITS) and name != '.eh_frame':
+                if type == SHT_NOBITS:
+                    sec_data = bytes(size)
+                else:
+                    sec_data = data[offset:offset + size]
+                self.sections[i] = Section(self, i, name, type, flags, sec_data, size, align)
+
+        self.symbols = []
+        if symtab is not None:
+            offset, size, sym_strtab = symtab
+            for off in range(offset, offset + size, 24):
+                name, info, _, shndx, value, _ = struct.unpack_from('<IBBHQQ', data, off)
+                self.symbols.append(Symbol(get_str(sym_strtab, name), info >> 4, shndx, value))
+
+class Linker:
+    def __init__(self, objs):
+        self.objs = objs
+        self.code = bytearray()
+        self.relocs = [] # (offset, kind, arg)
+        self.got = {} # target -> offset of its word
+        self.got_order = []
+        self.plt = {} # target -> offset of its stub
+        self.plt_order = []
+
+        # find the global symbols defined by each object file
+        self.globals = {}
+        for obj in objs:
+            for sym in obj.symbols:
+                if sym.bind != STB_LOCAL and sym.shndx != SHN_UNDEF:
+                    if sym.shndx == SHN_COMMON:
+                        raise LinkError('%s: common symbol %s, compile with -fno-common' % (obj.filename, sym.name))
+                    if sym.name in self.globals:
+                        raise LinkError('symbol %s is defined more than once' % sym.name)
+                    self.globals[sym.name] = (obj, sym)
+        if 'mpy_init' not in self.globals:
+            raise LinkError('mpy_init is not defined')
+
+    # Works out what a symbol refers to, as either ('addr', offset in the
+    # code) or the kind of relocation that the loader uses for it and its arg.
+    def resolve(self, obj, sym):
+        if sym.shndx == SHN_UNDEF:
+            if sym.name in self.globals:
+                obj, sym = self.globals[sym.name]
+            elif sym.name == 'mp_fun_table':
+                return (RELOC_FUN_TABLE, None)
+            elif sym.name.startswith(QSTR_PREFIX):
+                return (RELOC_QSTR, sym.name[len(QSTR_PREFIX):])
+            elif sym.name in CONST_OBJS:
+                return (RELOC_CONST_OBJ, CONST_OBJS[sym.name])
+            elif sym.name in FUN_TABLE:
+                return (RELOC_FUN, FUN_TABLE.index(sym.name))
+            else:
+                raise LinkError('%s: %s is not available to native modules' % (obj.filename, sym.name))
+        if sym.shndx >= SHN_LORESERVE or sym.shndx not in obj.sections:
+            raise LinkError('%s: unsupported reference to %s' % (obj.filename, sym.name))
+        return ('addr', obj.sections[sym.shndx].addr + sym.value)
+
+    def align(self, n):
+        while len(self.code) % n:
+            self.code.append(0)
+
+    def got_entry(self, target):
+        if target not in self.got:
+            self.got[target] = None
+            self.got_order.append(target)
+
+    def plt_entry(self, target):
+        if target not in self.plt:
+            self.plt[target] = None
+            self.plt_order.append(target)
+            self.got_entry(target)
+
+    def link(self):
+        # the code starts with a jump to mpy_init, which is filled in below
+        self.code.extend(b'\xe9\0\0\0\0')
+
+        # lay out the sections: code, then read-only data, then the rest
+        def order(sec):
+            if sec.flags & SHF_EXECINSTR:
+                return 0
+            elif not sec.flags & SHF_WRITE:
+                return 1
+            elif sec.type != SHT_NOBITS:
+                return 2
+            else:
+                return 3
+        sections = [sec for obj in self.objs for sec in obj.sections.values()]
+        sections.sort(key=order)
+        for sec in sections:
+            self.align(sec.align)
+            sec.addr = len(self.code)
+            self.code.extend(sec.data)
+
+        # go through the relocations, noting the GOT and PLT entries needed
+        refs = []
+        for obj in self.objs:
+            for info, rela_data in obj.relas:
+                if info not in obj.sections:
+                    continue
+                sec = obj.sections[info]
+                for off in range(0, len(rela_data), 24):
+                    r_offset, r_info, r_addend = struct.unpack_from('<QQq', rela_data, off)
+                    sym = obj.symbols[r_info >> 32]
+                    r_type = r_info & 0xffffffff
+                    target = self.resolve(obj, sym)
+                    where = sec.addr + r_offset
+                    if r_type in (R_X86_64_GOTPCREL, R_X86_64_GOTPCRELX, R_X86_64_REX_GOTPCRELX):
+                        self.got_entry(target)
+                    elif r_type in (R_X86_64_PC32, R_X86_64_PLT32) and target[0] != 'addr':
+                        if r_type == R_X86_64_PC32:
+                            raise LinkError('%s: direct reference to %s, compile with -fpic' % (obj.filename, sym.name))
+                        self.plt_entry(target)
+                    elif r_type in (R_X86_64_32, R_X86_64_32S):
+                        raise LinkError('%s: absolute reference to %s, compile with -fpic' % (obj.filename, sym.name))
+                    elif r_type not in (R_X86_64_64, R_X86_64_PC32, R_X86_64_PLT32):
+                        raise LinkError('%s: unsupported relocation type %d' % (obj.filename, r_type))
+                    refs.append((where, r_type, target, r_addend, sym.name))
+
+        # each PLT stub is "jmp *GOT(%rip)"
+        for target in self.plt_order:
+            self.plt[target] = len(self.code)
+            self.code.extend(b'\xff\x25\0\0\0\0')
+
+        # the GOT words are filled in by the loader, or hold an address in the code
+        self.align(8)
+        for target in self.got_order:
+            self.got[target] = len(self.code)
+            self.code.extend(bytes(8))
+            if target[0] == 'addr':
+                self.relocs.append((self.got[target], RELOC_CODE, target[1]))
+            else:
+                self.relocs.append((self.got[target], target[0], target[1]))
+        for target in self.plt_order:
+            self.put_pc32(self.plt[target] + 2, self.got[target] - 4)
+
+        # now everything has a place, apply the relocations
+        for where, r_type, target, addend, name in refs:
+            if r_type == R_X86_64_64:
+                if target[0] == 'addr':
+                    self.relocs.append((where, RELOC_CODE, target[1] + addend))
+                elif addend != 0:
+                    raise LinkError('unsupported reference to %s+%d' % (name, addend))
+                else:
+                    self.relocs.append((where, target[0], target[1]))
+            elif r_type in (R_X86_64_PC32, R_X86_64_PLT32):
+                if target[0] == 'addr':
+                    self.put_pc32(where, target[1] + addend)
+                else:
+                    self.put_pc32(where, self.plt[target] + addend)
+            else:
+                self.put_pc32(where, self.got[target] + addend)
+
+        # finally the jump to mpy_init
+        obj, sym = self.globals['mpy_init']
+        self.put_pc32(1, self.resolve(obj, sym)[1] - 4)
+
+        self.relocs.sort()
+
+    # stores the 32-bit PC-relative value S + A - P
+    def put_pc32(self, where, value):
+        struct.pack_into('<i', self.code, where, value - where)
+
+    def write_mpy(self, f, feature_flags, small_int_bits):
+        out = bytearray()
+        def write_uint(n):
+            buf = [n & 0x7f]
+            n >>= 7
+            while n:
+                buf.insert(0, 0x80 | (n & 0x7f))
+                n >>= 7
+            out.extend(buf)
+        def write_qstr(s):
+            s = s.encode()
+            write_uint(len(s))
+            out.extend(s)
+
+        out.extend(b'M')
+        out.append(MPY_VERSION)
+        out.append(feature_flags | MP_NATIVE_ARCH_X64 << 2)
+        out.append(small_int_bits)
+        write_uint(len(self.code) << 2 | MP_CODE_NATIVE_VIPER)
+        out.extend(self.code)
+        write_uint(0) # scope flags
+        write_uint(0) # number of positional args
+        write_uint(0) # type signature, returns an object
+        write_uint(0) # number of constant objects
+        write_uint(0) # number of nested raw codes
+        write_uint(len(self.relocs))
+        for offset, kind, arg in self.relocs:
+            write_uint(offset << 3 | kind)
+            if kind == RELOC_QSTR:
+                write_qstr(arg)
+            elif kind != RELOC_FUN_TABLE:
+                write_uint(arg)
+        f.write(out)
+
+def write_qstr_header(out_file, sources):
+    qstrs = set()
+    for src in sources:
+        with open(src) as f:
+            qstrs.update(re.findall(r'\bMP_QSTR_(\w+)', f.read()))
+    with open(out_file, 'w') as f:
+        f.write('// This file was generated by tools/mpy_ld.py\n')
+        for q in sorted(qstrs):
+            f.write('extern const char %s%s;\n' % (QSTR_PREFIX, q))
+            f.write('#define MP_QSTR_%s ((qstr)(uintptr_t)&%s%s)\n' % (q, QSTR_PREFIX, q))
+
+def main():
+    import argparse
+    cmd_parser = argparse.ArgumentParser(description='Link native modules into .mpy files.')
+    cmd_parser.add_argument('-o', '--output', required=True, help='output file')
+    cmd_parser.add_argument('--qstrs', action='store_true', help='generate the header of qstrs used by the C files')
+    cmd_parser.add_argument('-mcache-lookup-bc', action='store_true', help='the firmware caches map lookups in the bytecode')
+    cmd_parser.add_argument('-mno-unicode', action='store_true', help='the firmware doesn\'t support unicode')
+    cmd_parser.add_argument('-msmall-int-bits', type=int, default=63, help='the maximum bits used to encode a small-int')
+    cmd_parser.add_argument('files', nargs='+', help='input files')
+    args = cmd_parser.parse_args()
+
+    if args.qstrs:
+        write_qstr_header(args.output, args.files)
+        return
+
+    try:
+        linker = Linker([ObjectFile(f) for f in args.files])
+        linker.link()
+    except LinkError as er:
+        print('mpy_ld: ' + str(er), file=sys.stderr)
+        sys.exit(1)
+    feature_flags = args.mcache_lookup_bc | (not args.mno_unicode) << 1
+    with open(args.output, 'wb') as f:
+        linker.write_mpy(f, feature_flags, args.msmall_int_bits)
+
+if __name__ == '__main__':
+    main()
@@ -105,3 +105,72 @@ void ffi_closure_free(void *ptr) {
 #endif
 
 #endif // MICROPY_EMIT_NATIVE || (MICROPY_PY_FFI && MICROPY_FORCE_PLAT_ALLOC_EXEC)
+
+#if MICROPY_GC_SPLIT_HEAP_AUTO
+
+// set by the -X heapsize and -X heapmax options
+extern long heap_size;
+extern long heap_max;
+
+// total size of the regions added to the GC heap
+STATIC mp_uint_t heap_added = 0;
+
+#ifndef MAP_FIXED_NOREPLACE
+// older kernels take the address as a hint, which is checked below
+#define MAP_FIXED_NOREPLACE (0)
+#endif
+
+void *mp_unix_alloc_heap(mp_uint_t size) {
+    return mp_unix_alloc_heap_at(NULL, size);
+}
+
+// If addr isn't NULL then the region must be at that address (used to load a
+// snapshot of the heap).
+void *mp_unix_alloc_heap_at(void *addr, mp_uint_t size) {
+    // size needs to be a multiple of the page size
+    size = (size + 0xfff) & (~0xfff);
+    if (heap_size + heap_added + size > (mp_uint_t)heap_max) {
+        return NULL;
+    }
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (addr != NULL) {
+        flags |= MAP_FIXED_NOREPLACE;
+    }
+    void *ptr = mmap(addr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return NULL;
+    }
+    if (addr != NULL && ptr != addr) {
+        munmap(ptr, size);
+        return NULL;
+    }
+    heap_added += size;
+    return ptr;
+}
+
+void mp_unix_free_heap(void *ptr, mp_uint_t size) {
+    size = (size + 0xfff) & (~0xfff);
+    munmap(ptr, size);
+    heap_added -= size;
+}
+
+#endif // MICROPY_GC_SPLIT_HEAP_AUTO
+
+#if MICROPY_GC_AUX_STACK
+
+// The auxiliary mark stack may be grown while another thread is stopped in a
+// signal handler to scan its stack, so get it with mmap rather than malloc.
+
+void *mp_unix_alloc_gc_stack(mp_uint_t size) {
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return NULL;
+    }
+    return ptr;
+}
+
+void mp_unix_free_gc_stack(void *ptr, mp_uint_t size) {
+    munmap(ptr, size);
+}
+
+#endif // MICROPY_GC_AUX_STACK
@@ -0,0 +1,13 @@
+#include <stdint.h>
+const char mp_frozen_str_names[] = {
+"upip.py\0"
+"upip_utarfile.py\0"
+"\0"};
+const uint32_t mp_frozen_str_sizes[] = {
+7513,
+2434,
+};
+const char mp_frozen_str_content[] = {
+"import sys\nimport gc\nimport uos as os\nimport uerrno as errno\nimport ujson as json\nimport uzlib\nimport upip_utarfile as tarfile\ngc.collect()\n\n\ndebug = False\ninstall_path = None\ncleanup_files = []\ngzdict_sz = 16 + 15\n\nfile_buf = bytearray(512)\n\nclass NotFoundError(Exception):\n    pass\n\ndef op_split(path):\n    if path == \"\":\n        return (\"\", \"\")\n    r = path.rsplit(\"/\", 1)\n    if len(r) == 1:\n        return (\"\", path)\n    head = r[0]\n    if not head:\n        head = \"/\"\n    return (head, r[1])\n\ndef op_basename(path):\n    return op_split(path)[1]\n\n# Expects *file* name\ndef _makedirs(name, mode=0o777):\n    ret = False\n    s = \"\"\n    comps = name.rstrip(\"/\").split(\"/\")[:-1]\n    if comps[0] == \"\":\n        s = \"/\"\n    for c in comps:\n        if s and s[-1] != \"/\":\n            s += \"/\"\n        s += c\n        try:\n            os.mkdir(s)\n            ret = True\n        except OSError as e:\n            if e.args[0] != errno.EEXIST and e.args[0] != errno.EISDIR:\n                raise\n            ret = False\n    return ret\n\n\ndef save_file(fname, subf):\n    global file_buf\n    with open(fname, \"wb\") as outf:\n        while True:\n            sz = subf.readinto(file_buf)\n            if not sz:\n                break\n            outf.write(file_buf, sz)\n\ndef install_tar(f, prefix):\n    meta = {}\n    for info in f:\n        #print(info)\n        fname = info.name\n        try:\n            fname = fname[fname.index(\"/\") + 1:]\n        except ValueError:\n            fname = \"\"\n\n        save = True\n        for p in (\"setup.\", \"PKG-INFO\", \"README\"):\n                #print(fname, p)\n                if fname.startswith(p) or \".egg-info\" in fname:\n                    if fname.endswith(\"/requires.txt\"):\n                        meta[\"deps\"] = f.extractfile(info).read()\n                    save = False\n                    if debug:\n                        print(\"Skipping\", fname)\n                    break\n\n        if save:\n            outfname = prefix + fname\n            if info.type != tarfile.DIRTYPE:\n                if debug:\n                    print(\"Extracting \" + outfname)\n                _makedirs(outfname)\n                subf = f.extractfile(info)\n                save_file(outfname, subf)\n    return meta\n\ndef expandhome(s):\n    if \"~/\" in s:\n        h = os.getenv(\"HOME\")\n        s = s.replace(\"~/\", h + \"/\")\n    return s\n\nimport ussl\nimport usocket\nwarn_ussl = True\ndef url_open(url):\n    global warn_ussl\n    proto, _, host, urlpath = url.split('/', 3)\n    ai = usocket.getaddrinfo(host, 443)\n    #print(\"Address infos:\", ai)\n    addr = ai[0][4]\n\n    s = usocket.socket(ai[0][0])\n    #print(\"Connect address:\", addr)\n    s.connect(addr)\n\n    if proto == \"https:\":\n        s = ussl.wrap_socket(s)\n        if warn_ussl:\n            print(\"Warning: %s SSL certificate is not validated\" % host)\n            warn_ussl = False\n\n    # MicroPython rawsocket module supports file interface directly\n    s.write(\"GET /%s HTTP/1.0\\r\\nHost: %s\\r\\n\\r\\n\" % (urlpath, host))\n    l = s.readline()\n    protover, status, msg = l.split(None, 2)\n    if status != b\"200\":\n        if status == b\"404\":\n            print(\"Package not found\")\n        raise ValueError(status)\n    while 1:\n        l = s.readline()\n        if not l:\n            raise ValueError(\"Unexpected EOF\")\n        if l == b'\\r\\n':\n            break\n\n    return s\n\n\ndef get_pkg_metadata(name):\n    f = url_open(\"https://pypi.python.org/pypi/%s/json\" % name)\n    s = f.read()\n    f.close()\n    return json.loads(s)\n\n\ndef fatal(msg):\n    print(msg)\n    sys.exit(1)\n\ndef install_pkg(pkg_spec, install_path):\n    data = get_pkg_metadata(pkg_spec)\n\n    latest_ver = data[\"info\"][\"version\"]\n    packages = data[\"releases\"][latest_ver]\n    del data\n    gc.collect()\n    assert len(packages) == 1\n    package_url = packages[0][\"url\"]\n    print(\"Installing %s %s from %s\" % (pkg_spec, latest_ver, package_url))\n    package_fname = op_basename(package_url)\n    f1 = url_open(package_url)\n    f2 = uzlib.DecompIO(f1, gzdict_sz)\n    f3 = tarfile.TarFile(fileobj=f2)\n    meta = install_tar(f3, install_path)\n    f1.close()\n    del f3\n    del f2\n    gc.collect()\n    return meta\n\ndef install(to_install, install_path=None):\n    # Calculate gzip dictionary size to use\n    global gzdict_sz\n    sz = gc.mem_free() + gc.mem_alloc()\n    if sz <= 65536:\n        gzdict_sz = 16 + 12\n\n    if install_path is None:\n        install_path = get_install_path()\n    if install_path[-1] != \"/\":\n        install_path += \"/\"\n    if not isinstance(to_install, list):\n        to_install = [to_install]\n    print(\"Installing to: \" + install_path)\n    # sets would be perfect here, but don't depend on them\n    installed = []\n    try:\n        while to_install:\n            if debug:\n                print(\"Queue:\", to_install)\n            pkg_spec = to_install.pop(0)\n            if pkg_spec in installed:\n                continue\n            meta = install_pkg(pkg_spec, install_path)\n            installed.append(pkg_spec)\n            if debug:\n                print(meta)\n            deps = meta.get(\"deps\", \"\").rstrip()\n            if deps:\n                deps = deps.decode(\"utf-8\").split(\"\\n\")\n                to_install.extend(deps)\n    except NotFoundError:\n        print(\"Error: cannot find '%s' package (or server error), packages may be partially installed\" \\\n            % pkg_spec, file=sys.stderr)\n\ndef get_install_path():\n    global install_path\n    if install_path is None:\n        # sys.path[0] is current module's path\n        install_path = sys.path[1]\n    install_path = expandhome(install_path)\n    return install_path\n\ndef cleanup():\n    for fname in cleanup_files:\n        try:\n            os.unlink(fname)\n        except OSError:\n            print(\"Warning: Cannot delete \" + fname)\n\ndef help():\n    print(\"\"\"\\\nupip - Simple PyPI package manager for MicroPython\nUsage: micropython -m upip install [-p <path>] <package>... | -r <requirements.txt>\nimport upip; upip.install(package_or_list, [<path>])\n\nIf <path> is not given, packages will be installed into sys.path[1]\n(can be set from MICROPYPATH environment variable, if current system\nsupports that).\"\"\")\n    print(\"Current value of sys.path[1]:\", sys.path[1])\n    print(\"\"\"\\\n\nNote: only MicroPython packages (usually, named micropython-*) are supported\nfor installation, upip does not support arbitrary code in setup.py.\n\"\"\")\n\ndef main():\n    global debug\n    global install_path\n    install_path = None\n\n    if len(sys.argv) < 2 or sys.argv[1] == \"-h\" or sys.argv[1] == \"--help\":\n        help()\n        return\n\n    if sys.argv[1] != \"install\":\n        fatal(\"Only 'install' command supported\")\n\n    to_install = []\n\n    i = 2\n    while i < len(sys.argv) and sys.argv[i][0] == \"-\":\n        opt = sys.argv[i]\n        i += 1\n        if opt == \"-h\" or opt == \"--help\":\n            help()\n            return\n        elif opt == \"-p\":\n            install_path = sys.argv[i]\n            i += 1\n        elif opt == \"-r\":\n            list_file = sys.argv[i]\n            i += 1\n            with open(list_file) as f:\n                while True:\n                    l = f.readline()\n                    if not l:\n                        break\n                    to_install.append(l.rstrip())\n        elif opt == \"--debug\":\n            debug = True\n        else:\n            fatal(\"Unknown/unsupported option: \" + opt)\n\n    to_install.extend(sys.argv[i:])\n    if not to_install:\n        help()\n        return\n\n    install(to_install)\n\n    if not debug:\n        cleanup()\n\n\nif __name__ == \"__main__\":\n    main()\n\0"
+"import uctypes\n\n# http://www.gnu.org/software/tar/manual/html_node/Standard.html\nTAR_HEADER = {\n    \"name\": (uctypes.ARRAY | 0, uctypes.UINT8 | 100),\n    \"size\": (uctypes.ARRAY | 124, uctypes.UINT8 | 12),\n}\n\nDIRTYPE = \"dir\"\nREGTYPE = \"file\"\n\ndef roundup(val, align):\n    return (val + align - 1) & ~(align - 1)\n\nclass FileSection:\n\n    def __init__(self, f, content_len, aligned_len):\n        self.f = f\n        self.content_len = content_len\n        self.align = aligned_len - content_len\n\n    def read(self, sz=65536):\n        if self.content_len == 0:\n            return b\"\"\n        if sz > self.content_len:\n            sz = self.content_len\n        data = self.f.read(sz)\n        sz = len(data)\n        self.content_len -= sz\n        return data\n\n    def readinto(self, buf):\n        if self.content_len == 0:\n            return 0\n        if len(buf) > self.content_len:\n            buf = memoryview(buf)[:self.content_len]\n        sz = self.f.readinto(buf)\n        self.content_len -= sz\n        return sz\n\n    def skip(self):\n        sz = self.content_len + self.align\n        if sz:\n            buf = bytearray(16)\n            while sz:\n                s = min(sz, 16)\n                self.f.readinto(buf, s)\n                sz -= s\n\nclass TarInfo:\n\n    def __str__(self):\n        return \"TarInfo(%r, %s, %d)\" % (self.name, self.type, self.size)\n\nclass TarFile:\n\n    def __init__(self, name=None, fileobj=None):\n        if fileobj:\n            self.f = fileobj\n        else:\n            self.f = open(name, \"rb\")\n        self.subf = None\n\n    def next(self):\n            if self.subf:\n                self.subf.skip()\n            buf = self.f.read(512)\n            if not buf:\n                return None\n\n            h = uctypes.struct(uctypes.addressof(buf), TAR_HEADER, uctypes.LITTLE_ENDIAN)\n\n            # Empty block means end of archive\n            if h.name[0] == 0:\n                return None\n\n            d = TarInfo()\n            d.name = str(h.name, \"utf-8\").rstrip()\n            d.size = int(bytes(h.size).rstrip(), 8)\n            d.type = [REGTYPE, DIRTYPE][d.name[-1] == \"/\"]\n            self.subf = d.subf = FileSection(self.f, d.size, roundup(d.size, 512))\n            return d\n\n    def __iter__(self):\n        return self\n\n    def __next__(self):\n        v = self.next()\n        if v is None:\n            raise StopIteration\n        return v\n\n    def extractfile(self, tarinfo):\n        return tarinfo.subf\n\0"
+};
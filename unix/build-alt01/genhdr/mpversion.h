@@ -0,0 +1,8 @@
+// This file was generated by py/makeversionhdr.py
+#define MICROPY_GIT_TAG "ca8a8eb-dirty"
+#define MICROPY_GIT_HASH "ca8a8eb-dirty"
+#define MICROPY_BUILD_DATE "2026-10-17"
+#define MICROPY_VERSION_MAJOR (0)
+#define MICROPY_VERSION_MINOR (0)
+#define MICROPY_VERSION_MICRO (1)
+#define MICROPY_VERSION_STRING "0.0.1"